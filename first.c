@@ -5,23 +5,144 @@
   - Customer: browse, search, add/remove cart, checkout
   - Billing: VAT included, configurable TAX_RATE
   - Persistence: medicines.dat (binary), sales_history.txt (text append)
+  - Data file format: medicines.dat starts with a header (magic, format
+    version, record size) followed by fixed-width 256-byte records with
+    explicit padding, shared with the catalog program (second.c); a load is
+    one mmap of the file. --migrate-data converts a headerless file in
+    either program's old layout
+  - Inventory: medicines.dat is loaded once into memory with a hash index
+    by medicine ID; the file is only written when a record changes
+  - Deletes: a deleted record becomes a tombstone in place (one record
+    written), later adds reuse its slot; once COMPACT_DEAD_PERCENT of the
+    slots are tombstones the delete also compacts the file in the same
+    commit, or an admin compacts on demand
+  - Cart: no size limit; lines come from a pool, are found by medicine ID
+    through a small open-addressed table, keep the order they were added
+    in and carry a running subtotal
+  - Commits: a checkout or an admin change writes only the pages of
+    medicines.dat it dirtied, as shadow copies in medicines.shadow, and
+    publishes them together with the new end of sales_history.txt by
+    rewriting one of two checksummed headers; the pages are then written
+    back in place. A crash before the header leaves neither the stock
+    change nor the sale, a crash after it is finished on the next start.
+    The catalog program (second.c) commits through the same shadow file,
+    so either program finishes the other's last commit
+  - Shared terminals: several processes can run against one medicines.dat.
+    fcntl record locks over each Medicine slot let checkouts on different
+    medicines run in parallel; add/update/delete lock the whole layout and
+    reload first, so no terminal overwrites another's stock
+  - Group commit: concurrent checkouts share one commit and its fsyncs
+    (GROUP_COMMIT_WINDOW_US / GROUP_COMMIT_BATCH)
+  - Name search: trigram inverted index over lowercased names, maintained on
+    add/update/delete; only candidates from the posting lists are verified
+    with a SIMD (SSE2, or AVX2 when the CPU has it) case-folding matcher
+  - Quick find: name-sorted index returning the top matches for a typed
+    prefix, ranked by stock on hand
+  - Expiry: dates are validated on entry and indexed by day number; admins
+    list expired / soon-expiring stock, and checkout refuses expired lines
+  - Low stock: per-medicine reorder levels (reorder_levels.dat, shared
+    with the catalog program; default REORDER_LEVEL) and a heap of the
+    medicines below them, updated on every quantity change, so the report
+    never scans the catalog
+  - Sales rollups: revenue and units per hour, per day, per medicine and
+    per medicine per day, caught up from the tail of sales_history.txt
+    (every terminal's sales) before each report and save, and saved every
+    ROLLUP_SAVE_SALES checkouts (sales_rollup.dat; the catalog program
+    keeps its own for its transaction log); at startup only the
+    tail of sales_history.txt written since the last save is replayed, and
+    the tables can be rebuilt from the whole history
+  - Sales history: sales_history.txt is mapped with mmap and parsed in
+    place into structured records (pointers into the mapping, no per-line
+    allocation); the admin history view pages through it with date,
+    customer and medicine filters
+  - History scans: sales_history.txt is cut into chunks at record
+    boundaries and scanned by a work-stealing thread pool (one thread per
+    core); per-thread totals are merged, with optional date limits
+  - Server mode: one process owns the inventory and serves lookup, search,
+    cart and checkout requests to thin customer clients over a Unix domain
+    socket, from a non-blocking epoll loop plus checkout worker threads
+  - Stock counters: one cache-line-padded atomic counter per medicine ID
+    of the units checkouts may still claim; a checkout reserves its whole
+    cart with compare-and-swap (all lines or none) before taking any lock
   - Customer name at checkout is optional (press Enter to skip)
-  - Compile: gcc -o medstore medstore.c
+  - Compile: gcc -pthread -o medstore medstore.c
   - Run: ./medstore
+  - Benchmark: ./medstore --bench-group-commit [threads] [checkouts] [window_us]
+               ./medstore --bench-stock [max_threads] [checkouts] [medicines]
+               ./medstore --bench-checkout [medicines] [checkouts]
+               ./medstore --bench-substring [names]
+               ./medstore --bench-scan [sales] [max_threads]
+               ./medstore --bench-history [MB]
+  - Stress test: ./medstore --stress-locks [terminals] [checkouts] [medicines]
+  - Crash test: ./medstore --crash-test   (kills a commit at every write point)
+  - Server: ./medstore --serve [socket]      (default medstore.sock)
+            ./medstore --client [socket]     (customer menu as a thin client)
+            ./medstore --bench-server [clients] [requests] [medicines]
+  - Recovery: ./medstore --rebuild-rollups
+  - Compaction: ./medstore --compact
+  - Migration: ./medstore --migrate-data [store|catalog]   (store closed)
 */
 
+#define _GNU_SOURCE   /* open file description locks (F_OFD_SETLKW) */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
 #define DATAFILE "medicines.dat"
 #define SALESFILE "sales_history.txt"
-#define NAME_LEN 64
+#define NAME_LEN 100
+#define CATEGORY_LEN 50
 #define ADMIN_PASS "admin123"
 #define TAX_RATE 0.05   /* 5% VAT (adjust if needed) */
-#define MAX_CART 100
+#define SHADOWFILE "medicines.shadow"
+#define SHADOW_MAGIC 0x32444853u   /* "SHD2" */
+#define SHADOW_PAGE 4096           /* unit of DATAFILE a commit copies */
+#define SHADOW_SLOT 512            /* room for each of the two headers */
+#define SHADOW_APPLIED (2 * SHADOW_SLOT)   /* seq of the last commit written back */
+#define SHADOW_IMAGES SHADOW_PAGE  /* page images start here */
+#define ROLLUP_SAVE_SALES 1024     /* checkouts between saves of the rollups */
+#define GROUP_COMMIT_WINDOW_US 0   /* extra time a batch leader waits for followers */
+#define GROUP_COMMIT_BATCH 64      /* close a batch early at this many checkouts */
+#define QUICKFIND_TOP 10           /* prefix matches shown by quick find */
+#define REORDERFILE "reorder_levels.dat"   /* shared with the catalog program */
+#define REORDER_LEVEL 10           /* low-stock threshold for medicines without their own */
+#define COMPACT_DEAD_PERCENT 25    /* tombstoned share of DATAFILE that triggers compaction */
+#define REFRESH_MAX 1024           /* changed records past which a reload beats catching up */
+#define ROLLUPFILE "sales_rollup.dat"
+#define ROLLUP_MAGIC 0x31555253u   /* "SRU1"; the catalog program's rollups are "TRU1" */
+#define TOP_SELLERS 10
+#define SCAN_CHUNK_BYTES (4 << 20)  /* history scan work unit, cut at a record end */
+#define SCAN_MAX_THREADS 64
+#define SALE_SEPARATOR "----------------------------------------\n"
+#define HISTORY_PAGE 10            /* sales per page in the history view */
+#define SERVER_SOCKET "medstore.sock"
+#define SERVER_CHECKOUT_THREADS 8  /* server threads running checkouts (group commit) */
+#define SERVER_MAX_EVENTS 64
+#define SERVER_LINE_MAX 4096       /* longest request or reply line */
+#define SERVER_OUT_HIGH (1 << 20)  /* stop reading a client with this much unsent */
 
 /* Medicine record */
 typedef struct {
@@ -32,16 +153,447 @@ typedef struct {
     int expiry_day;
     int expiry_month;
     int expiry_year;
+    char category[CATEGORY_LEN];   /* not used here, kept for the other store program */
 } Medicine;
 
+/* DATAFILE on disk: a DataHeader, then one MedicineRecord per slot. Both
+   have fixed-width fields at fixed offsets and explicit padding, the same
+   in second.c, so the file depends on neither program's Medicine nor on
+   the compiler, and can be mapped and read in place. Records are
+   DATA_RECORD bytes and start DATA_RECORD bytes in, so none straddles a
+   page. Native byte order. Every commit bumps the header's generation and
+   stamps the records it writes with it, so a terminal can tell which
+   records changed since it last read the file. */
+#define DATA_MAGIC 0x3144454Du     /* "MED1" */
+#define DATA_VERSION 1
+#define DATA_RECORD 256
+#define DATA_HEADER DATA_RECORD
+#define DATA_NAME 128
+#define DATA_CATEGORY 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;      /* offset of the first record */
+    uint32_t record_size;
+    uint32_t generation;       /* commits so far */
+    unsigned char reserved[DATA_HEADER - 20];
+} DataHeader;
+
+typedef struct {
+    int32_t id;                /* 0 = free slot */
+    int32_t quantity;
+    double price;
+    int32_t expiry_day;        /* 0/0/0 = no date */
+    int32_t expiry_month;
+    int32_t expiry_year;
+    uint32_t generation;       /* header generation of the commit that last wrote this */
+    char name[DATA_NAME];      /* NUL-padded */
+    char category[DATA_CATEGORY];
+    unsigned char padding[DATA_RECORD - 32 - DATA_NAME - DATA_CATEGORY];
+} MedicineRecord;
+
+_Static_assert(sizeof(DataHeader) == DATA_HEADER && sizeof(MedicineRecord) == DATA_RECORD &&
+               offsetof(MedicineRecord, name) == 32, "DATAFILE layout");
+
+/* Layouts DATAFILE had before the header, read by --migrate-data: this
+   program's old Medicine and the other store program's */
+typedef struct {
+    int id;
+    char name[64];
+    double price;
+    int quantity;
+    int expiry_day;
+    int expiry_month;
+    int expiry_year;
+} LegacyStoreMedicine;
+
+typedef struct {
+    int id;
+    char name[100];
+    float price;
+    int quantity;
+    char category[50];
+    char expiry_date[20];      /* DD/MM/YYYY */
+} LegacyCatalogMedicine;
+
+/* Reorder level stored in REORDERFILE for a medicine that has its own */
+typedef struct {
+    int med_id;
+    int level;
+} ReorderLevel;
+
 /* Cart item */
 typedef struct {
     int med_id;
     char name[NAME_LEN];
     double price;
     int qty;
+    unsigned int version;   /* version of the record the line was taken from */
+    int prev, next;         /* neighbours in the order lines were added, -1 at the ends */
 } CartItem;
 
+/* A customer's cart, with no limit on its size. Lines come from a pool that
+   doubles when it runs out and are chained in the order they were added,
+   so receipts keep that order; removed lines go on a free list. index
+   finds a medicine's line by ID (linear probing, twice the pool size,
+   -1 = empty) and removal shifts the rest of a cluster back rather than
+   leaving tombstones, so add, merge and remove are O(1). The subtotal is
+   kept up to date as lines change. */
+typedef struct {
+    CartItem *line;
+    int cap, count;
+    int head, tail;         /* first and last line added, -1 when empty */
+    int free_line;          /* first unused line, -1 when the pool is full */
+    int *index;
+    int index_cap;
+    long long subtotal_cents;
+} Cart;
+
+/* A cart line joined to the inventory */
+typedef struct {
+    int med_id;
+    int slot;   /* -1 = not in the inventory */
+    int qty;
+} CartJoin;
+
+/* A changed record handed to a commit, as it should end up in its slot */
+typedef struct {
+    int slot;
+    Medicine rec;
+} RecordImage;
+
+/* SHADOWFILE keeps two headers (seq parity picks the slot); the valid one
+   with the higher seq is the last commit. A commit writes its page images
+   where the previous commit's are not, syncs them, then writes the header:
+   a torn header fails its checksum and the older one stands.
+   The catalog program (second.c) commits through the same SHADOWFILE,
+   header and commit lock, and logs its sales to the last three of
+   shadowFiles. Every commit publishes the length of all of them, so a
+   start of either program finishes the last commit whichever wrote it. */
+#define SHADOW_DATA 0              /* DATAFILE */
+#define SHADOW_SALES 1             /* SALESFILE */
+#define SHADOW_FILES 5
+
+typedef struct {
+    unsigned int magic;
+    unsigned int checksum;     /* FNV-1a of the header with this field 0 */
+    long long seq;
+    long long size[SHADOW_FILES];  /* length of each of shadowFiles after the commit, -1 = unknown */
+    long long images;          /* offset of the page images in SHADOWFILE */
+    int pages;
+    int reserved;
+} ShadowHeader;
+
+const char *shadowFiles[SHADOW_FILES] = {
+    DATAFILE, SALESFILE, "transactions.dat", "transactions.txt", "transactions.idx"
+};
+
+/* One shadowed page: its number in DATAFILE and its new contents */
+typedef struct {
+    long long page;
+    unsigned char data[SHADOW_PAGE];
+} ShadowImage;
+
+/* Commits of this process. The commit lock (fcntl on SHADOWFILE) keeps
+   terminals apart, the mutex keeps this process's threads apart. */
+typedef struct {
+    int fd;
+    pthread_mutex_t lock;
+} Shadow;
+
+Shadow shadow = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* --crash-test: the process dies at this write point of a commit (0 = off),
+   halfway through the write where there is one */
+#define FAULT_SALES 1       /* appending the sale */
+#define FAULT_IMAGES 2      /* writing the page images */
+#define FAULT_SYNCED 3      /* images and sale synced, header not written */
+#define FAULT_HEADER 4      /* writing the header */
+#define FAULT_COMMITTED 5   /* header synced, nothing written back */
+#define FAULT_APPLY 6       /* writing the pages back */
+#define FAULT_APPLIED 7     /* pages written back and synced */
+#define FAULT_POINTS 7
+#define FAULT_EXIT 86
+
+int faultPoint = 0;
+
+/* Resident inventory: all records of DATAFILE in file order (slot i lives at
+   byte offset dataOffset(i)) plus an open-addressed index id -> slot.
+   A deleted record stays behind as a tombstone (all zero, ID 0) until an add
+   reuses its slot or inventoryCompact closes the gaps. */
+typedef struct {
+    Medicine *recs;
+    int count;
+    int cap;
+    int *index;      /* slot per bucket, -1 = empty */
+    int index_cap;   /* power of two, kept at most half full */
+    int max_id;
+    int *free_slots; /* tombstoned slots, reused by inventoryAppend */
+    int free_count, free_cap;
+    FILE *fp;        /* DATAFILE, read at load; commits write pages back through it */
+    int *dirty;      /* slots changed since inventoryBeginChange (repeats allowed) */
+    int dirty_count, dirty_cap;
+    int sales_since_save;
+    int commits_in_flight;   /* checkouts between submitting their commit and hearing back */
+    int *reorder;    /* reorder level per slot */
+    struct stat reorder_file;    /* REORDERFILE as last read or written here */
+    int *low_heap;   /* slots below their reorder level, min-heap on quantity */
+    int *heap_pos;   /* position of each slot in low_heap, -1 = not low */
+    int low_count;
+    unsigned int *version;       /* per slot, restamped on every change to the record */
+    unsigned int version_clock;  /* last stamp handed out; stamps never repeat */
+    uint32_t generation;         /* DATAFILE generation memory was last brought up to */
+    pthread_mutex_t lock;    /* serializes concurrent checkouts */
+} Inventory;
+
+Inventory inventory = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Terminals sharing DATAFILE coordinate with fcntl locks: slot i is locked
+   over its own bytes, and one byte far past the records stands for the
+   layout. Checkouts hold the layout lock shared and their slots exclusively;
+   add/update/delete and rollup saves hold it exclusively. Open file
+   description locks also keep checkouts of one terminal apart. */
+#define LAYOUT_LOCK ((off_t)1 << 40)
+#ifdef F_OFD_SETLKW
+#define LOCK_WAIT F_OFD_SETLKW
+#define LOCK_TRY F_OFD_SETLK
+#else
+#define LOCK_WAIT F_SETLKW
+#define LOCK_TRY F_SETLK
+#endif
+
+int recordLocking = 1;   /* 0 only for the unlocked run of --stress-locks */
+
+/* Stock a checkout can still claim, one cache-line-padded atomic counter
+   per medicine ID so checkouts of different medicines never share a line.
+   A checkout reserves its whole cart with compare-and-swap before it takes
+   any lock; the counters trail the records by the units reserved by
+   checkouts still in flight. Counters live in pages of STOCK_PAGE IDs that
+   are allocated once and never move, so they are read without a lock. */
+#define STOCK_PAGE 1024
+#define STOCK_PAGES 4096   /* IDs up to 4M have counters; higher IDs skip them */
+
+typedef struct {
+    _Alignas(64) atomic_int available;
+    int synced;       /* record quantity folded in so far (inventory.lock) */
+    int generation;   /* last inventory reload that saw the ID */
+} StockCounter;
+
+typedef struct {
+    StockCounter *_Atomic pages[STOCK_PAGES];
+    int generation;
+} StockCounters;
+
+StockCounters stockCounters;
+
+/* Trigram posting list: sorted IDs of medicines whose lowercased name
+   contains the trigram */
+typedef struct {
+    unsigned int key;   /* three lowercased bytes, 0 = empty bucket */
+    int *ids;
+    int count;
+    int cap;
+} Posting;
+
+/* Open-addressed trigram -> posting list table */
+typedef struct {
+    Posting *buckets;
+    int cap;     /* power of two, kept at most half full */
+    int used;
+} TrigramIndex;
+
+TrigramIndex trigrams;
+
+/* Medicine IDs sorted by case-folded name (ties by ID), for prefix lookups */
+typedef struct {
+    int *ids;
+    int count;
+    int cap;
+} NameIndex;
+
+NameIndex names;
+
+/* Medicines ordered by expiry day number (ties by ID); records without a
+   valid expiry date are left out */
+typedef struct {
+    int day;   /* days since 1970-01-01 */
+    int id;
+} ExpiryEntry;
+
+typedef struct {
+    ExpiryEntry *entries;
+    int count;
+    int cap;
+} ExpiryIndex;
+
+ExpiryIndex expiries;
+
+/* Sales totals for one bucket: an hour (day * 24 + hour), a day (day
+   number), a medicine (ID) or a medicine on a day (day << 32 | ID).
+   Revenue is kept in cents before VAT so the tables add up exactly. */
+typedef struct {
+    long long key;
+    long long units;
+    long long cents;
+    int sales;
+} RollupBucket;
+
+/* Buckets sorted by key; sales arrive in time order, so new hours and
+   days are appended at the end */
+typedef struct {
+    RollupBucket *buckets;
+    int count;
+    int cap;
+} RollupTable;
+
+#define ROLLUP_HOURLY 0
+#define ROLLUP_DAILY 1
+#define ROLLUP_MEDICINE 2
+#define ROLLUP_MEDICINE_DAILY 3
+#define ROLLUP_TABLES 4
+
+typedef struct {
+    RollupTable table[ROLLUP_TABLES];
+    long covered;    /* bytes of SALESFILE the tables include */
+} Rollups;
+
+Rollups rollups;
+
+/* ROLLUPFILE header, followed by each table's buckets in order */
+typedef struct {
+    unsigned int magic;
+    int count[ROLLUP_TABLES];
+    long long covered;
+} RollupHeader;
+
+/* History scan: byte ranges of SALESFILE holding whole records. Each
+   worker owns a run of chunks, takes from its front and steals from the
+   back of another run when its own is empty. */
+typedef struct {
+    long offset;
+    long length;
+} ScanChunk;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int head, tail;   /* chunks [head, tail) not yet taken */
+} ScanDeque;
+
+typedef struct {
+    long long sales, units, cents;   /* cents before VAT, exact in any split */
+    long long bytes, steals;
+    int errors;
+} ScanTotals;
+
+typedef struct {
+    int fd;
+    ScanChunk *chunks;
+    ScanDeque *deques;
+    int threads;
+    int first_day, last_day;   /* inclusive, 0 = open */
+} ScanJob;
+
+typedef struct {
+    ScanJob *job;
+    int self;
+    ScanTotals totals;
+} ScanWorker;
+
+/* SALESFILE mapped read-only for in-place parsing */
+typedef struct {
+    const char *data;
+    size_t size;
+} SalesMap;
+
+/* One SALESFILE record parsed in place: the text fields point into the
+   mapping and are not NUL-terminated. Item lines are walked on demand
+   with saleNextLine. */
+typedef struct {
+    const char *start;       /* "Purchase Time:" line */
+    const char *end;         /* just past the separator line */
+    const char *when;        /* "YYYY-MM-DD HH:MM:SS" */
+    int when_len;
+    int day;                 /* days since 1970-01-01 */
+    const char *customer;    /* customer_len 0 = not provided */
+    int customer_len;
+    const char *items;       /* first item line */
+    const char *items_end;
+    int line_count;
+    long long subtotal_cents, tax_cents, total_cents;
+} SaleRecord;
+
+typedef struct {
+    const char *name;
+    int name_len;
+    int med_id;
+    int qty;
+    long long unit_cents, line_cents;
+} SaleLine;
+
+/* History view filters; 0 / empty means no limit */
+typedef struct {
+    int first_day, last_day;
+    char customer[NAME_LEN];   /* lowercased substring */
+    int med_id;
+} SaleFilter;
+
+/* One sale as read back from a SALESFILE record */
+typedef struct {
+    int day;     /* days since 1970-01-01 */
+    int hour;
+    int lines, cap;
+    struct { int med_id; int qty; long long cents; } *line;   /* grown as needed; caller frees */
+} SaleSummary;
+
+/* Group commit streams: each batch is one shadow commit of its checkouts'
+   records (RecordImage) and sale records */
+#define GC_RECORDS 0
+#define GC_SALES 1
+#define GC_STREAMS 2
+
+/* A batch of checkouts that become durable together */
+typedef struct CommitBatch {
+    char *buf[GC_STREAMS];
+    size_t len[GC_STREAMS], cap[GC_STREAMS];
+    int count;       /* checkouts in the batch */
+    int waiting;     /* checkouts not yet told the outcome */
+    int closed;      /* leader has started writing, no more joiners */
+    int done;        /* 1 = durable, -1 = write failed */
+    struct CommitBatch *next;
+} CommitBatch;
+
+/* Checkouts queue their bytes into the open batch. The first waiter of the
+   oldest batch leads: it writes and syncs the whole batch, then wakes the
+   rest. Checkouts arriving meanwhile pile into the next batch. */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int enabled;     /* 0 = every checkout is its own batch */
+    long window_us;
+    int batch_size;
+    int sales_fd;    /* SALESFILE, opened for appends */
+    CommitBatch *head, *tail;  /* batches in commit order, head is written next */
+    int writing;
+    int failed;      /* a batch could not be written; refuse further commits */
+    long batches, commits;
+} GroupCommit;
+
+GroupCommit groupCommit = {
+    .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER,
+    .enabled = 1, .window_us = GROUP_COMMIT_WINDOW_US, .batch_size = GROUP_COMMIT_BATCH,
+    .sales_fd = -1
+};
+
+void rollupCheckpoint(int wait);
+int shadowLock(int wait);
+void shadowUnlock();
+int shadowRecover(ShadowHeader *h);
+void inventoryCatchUp();
+int inventoryBeginChange();
+int inventoryEndChange();
+double nowSeconds();
+
 /* Utility to pause */
 void pressEnterToContinue() {
     printf("\nPress Enter to continue...");
@@ -65,412 +617,4534 @@ int ci_substr(const char *haystack, const char *needle) {
     return strstr(h, n) != NULL;
 }
 
-/* Get next medicine ID (max ID + 1) */
-int getNextMedicineID() {
-    FILE *fp = fopen(DATAFILE, "rb");
-    if (!fp) return 1;
-    Medicine m;
-    int max_id = 0;
-    while (fread(&m, sizeof(Medicine), 1, fp) == 1) {
-        if (m.id > max_id) max_id = m.id;
+/* ASCII lowercase of one byte, same folding as tolower() in the C locale */
+#define ASCII_LOWER(c) ((unsigned char)((c) - 'A') < 26 ? (char)((c) | 0x20) : (char)(c))
+
+/* Compare n bytes of a name against an already lowercased needle */
+int ci_match(const char *h, const char *needle, size_t n) {
+    for (size_t k = 0; k < n; ++k)
+        if (ASCII_LOWER(h[k]) != needle[k]) return 0;
+    return 1;
+}
+
+/* Case-insensitive substring search inside a fixed-size name field, without
+   copying. The needle must already be lowercased; the kernels may read the
+   whole field, including bytes after the terminating NUL. */
+int ci_find_scalar(const char *field, size_t field_size, const char *needle, size_t nlen) {
+    size_t hlen = strnlen(field, field_size);
+    if (nlen > hlen) return 0;
+    for (size_t i = 0; i + nlen <= hlen; ++i)
+        if (ASCII_LOWER(field[i]) == needle[0] && ci_match(field + i + 1, needle + 1, nlen - 1)) return 1;
+    return 0;
+}
+
+#ifdef HAVE_X86_SIMD
+/* Lowercase the ASCII letters of 16 bytes */
+__m128i fold_sse2(__m128i v) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+/* SSE2 kernel: test 16 start positions at once by matching the needle's
+   first and last byte, then verify the middle of each hit */
+int ci_find_sse2(const char *field, size_t field_size, const char *needle, size_t nlen) {
+    size_t hlen = strnlen(field, field_size);
+    if (nlen == 0) return 1;
+    if (nlen > hlen) return 0;
+    if (nlen - 1 + 16 > field_size) return ci_find_scalar(field, field_size, needle, nlen);
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[nlen - 1]);
+    size_t last_start = hlen - nlen;
+    for (size_t i = 0; i <= last_start; i += 16) {
+        /* keep both loads inside the field; the final window may overlap */
+        size_t at = i + nlen - 1 + 16 > field_size ? field_size - 16 - (nlen - 1) : i;
+        __m128i a = fold_sse2(_mm_loadu_si128((const __m128i *)(field + at)));
+        __m128i b = fold_sse2(_mm_loadu_si128((const __m128i *)(field + at + nlen - 1)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        if (last_start - at < 15) mask &= (1u << (last_start - at + 1)) - 1;
+        while (mask) {
+            size_t pos = at + (size_t)__builtin_ctz(mask);
+            if (nlen <= 2 || ci_match(field + pos + 1, needle + 1, nlen - 2)) return 1;
+            mask &= mask - 1;
+        }
     }
-    fclose(fp);
-    return max_id + 1;
+    return 0;
 }
 
-/* Add a new medicine */
-void addMedicine() {
-    Medicine m;
-    m.id = getNextMedicineID();
+__attribute__((target("avx2")))
+__m256i fold_avx2(__m256i v) {
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
 
-    printf("\n--- Add New Medicine ---\n");
-    printf("Name: ");
-    getchar(); /* clear newline */
-    fgets(m.name, NAME_LEN, stdin);
-    m.name[strcspn(m.name, "\n")] = '\0';
+/* AVX2 kernel: same scheme as SSE2 over 32 start positions */
+__attribute__((target("avx2")))
+int ci_find_avx2(const char *field, size_t field_size, const char *needle, size_t nlen) {
+    size_t hlen = strnlen(field, field_size);
+    if (nlen == 0) return 1;
+    if (nlen > hlen) return 0;
+    if (nlen - 1 + 32 > field_size) return ci_find_sse2(field, field_size, needle, nlen);
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[nlen - 1]);
+    size_t last_start = hlen - nlen;
+    for (size_t i = 0; i <= last_start; i += 32) {
+        size_t at = i + nlen - 1 + 32 > field_size ? field_size - 32 - (nlen - 1) : i;
+        __m256i a = fold_avx2(_mm256_loadu_si256((const __m256i *)(field + at)));
+        __m256i b = fold_avx2(_mm256_loadu_si256((const __m256i *)(field + at + nlen - 1)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        if (last_start - at < 31) mask &= (1u << (last_start - at + 1)) - 1;
+        while (mask) {
+            size_t pos = at + (size_t)__builtin_ctz(mask);
+            if (nlen <= 2 || ci_match(field + pos + 1, needle + 1, nlen - 2)) return 1;
+            mask &= mask - 1;
+        }
+    }
+    return 0;
+}
+#endif
 
-    printf("Price: ");
-    if (scanf("%lf", &m.price) != 1) { printf("Invalid input.\n"); while(getchar()!='\n'); return; }
-    printf("Quantity: ");
-    if (scanf("%d", &m.quantity) != 1) { printf("Invalid input.\n"); while(getchar()!='\n'); return; }
-    printf("Expiry Day (1-31): "); scanf("%d", &m.expiry_day);
-    printf("Expiry Month (1-12): "); scanf("%d", &m.expiry_month);
-    printf("Expiry Year (e.g., 2026): "); scanf("%d", &m.expiry_year);
+/* Kernel picked for this CPU on first use */
+int (*ci_find_impl)(const char *, size_t, const char *, size_t);
 
-    FILE *fp = fopen(DATAFILE, "ab");
-    if (!fp) { perror("Unable to open data file"); return; }
-    fwrite(&m, sizeof(Medicine), 1, fp);
-    fclose(fp);
+int ci_find_field(const char *field, size_t field_size, const char *needle, size_t nlen) {
+    if (!ci_find_impl) {
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        ci_find_impl = __builtin_cpu_supports("avx2") ? ci_find_avx2 : ci_find_sse2;
+#else
+        ci_find_impl = ci_find_scalar;
+#endif
+    }
+    return ci_find_impl(field, field_size, needle, nlen);
+}
 
-    printf("\nMedicine added with ID: %d\n", m.id);
+/* Case-insensitive match of a Medicine name against a lowercased needle */
+#define NAME_MATCHES(m, needle, nlen) ci_find_field((m)->name, NAME_LEN, (needle), (nlen))
+
+/* Hash a medicine ID into the index (Fibonacci hashing) */
+unsigned int hashMedicineID(int id) {
+    return (unsigned int)id * 2654435769u;
 }
 
-/* Print a medicine (single) */
-void printMedicine(const Medicine *m) {
-    printf("ID: %d | %s | Price: %.2f | Qty: %d | Exp: %02d-%02d-%04d\n",
-           m->id, m->name, m->price, m->quantity,
-           m->expiry_day, m->expiry_month, m->expiry_year);
+/* Insert id -> slot into the index (caller guarantees free buckets) */
+void indexInsert(int id, int slot) {
+    unsigned int mask = (unsigned int)inventory.index_cap - 1;
+    unsigned int b = hashMedicineID(id) & mask;
+    while (inventory.index[b] != -1 && inventory.recs[inventory.index[b]].id != id)
+        b = (b + 1) & mask;
+    inventory.index[b] = slot;
 }
 
-/* View all medicines */
-void viewMedicines() {
-    FILE *fp = fopen(DATAFILE, "rb");
-    if (!fp) { printf("\nNo medicines available.\n"); return; }
-    Medicine m;
-    printf("\n--- Medicine List ---\n");
-    int found = 0;
-    while (fread(&m, sizeof(Medicine), 1, fp) == 1) {
-        printMedicine(&m);
-        found = 1;
-    }
-    if (!found) printf("No medicines in inventory.\n");
-    fclose(fp);
+/* Rebuild the index with room for at least `need` records */
+void indexRebuild(int need) {
+    int cap = 16;
+    while (cap < need * 2) cap <<= 1;
+    int *idx = malloc(sizeof(int) * cap);
+    if (!idx) { perror("Unable to allocate inventory index"); exit(1); }
+    free(inventory.index);
+    inventory.index = idx;
+    inventory.index_cap = cap;
+    for (int b = 0; b < cap; ++b) idx[b] = -1;
+    for (int i = 0; i < inventory.count; ++i)
+        if (inventory.recs[i].id) indexInsert(inventory.recs[i].id, i);
 }
 
-/* Search medicine by exact id, returns 1 and fills out if found */
-int searchMedicineByID(int id, Medicine *out) {
-    FILE *fp = fopen(DATAFILE, "rb");
-    if (!fp) return 0;
-    Medicine m;
-    while (fread(&m, sizeof(Medicine), 1, fp) == 1) {
-        if (m.id == id) {
-            if (out) *out = m;
-            fclose(fp);
-            return 1;
-        }
-    }
-    fclose(fp);
-    return 0;
+/* Grow the index to room for `need` records, moving the entries it holds
+   rather than indexing every slot again */
+void indexReserve(int need) {
+    if (need * 2 <= inventory.index_cap) return;
+    int cap = 16, *old = inventory.index, old_cap = inventory.index_cap;
+    while (cap < need * 2) cap <<= 1;
+    int *idx = malloc(sizeof(int) * cap);
+    if (!idx) { perror("Unable to allocate inventory index"); exit(1); }
+    inventory.index = idx;
+    inventory.index_cap = cap;
+    for (int b = 0; b < cap; ++b) idx[b] = -1;
+    for (int b = 0; b < old_cap; ++b)
+        if (old[b] != -1) indexInsert(inventory.recs[old[b]].id, old[b]);
+    free(old);
 }
 
-/* Search medicine by name (partial, case-insensitive) - prints matches */
-int searchMedicineByName(const char *name) {
-    FILE *fp = fopen(DATAFILE, "rb");
-    if (!fp) { printf("\nNo medicines available.\n"); return 0; }
-    Medicine m;
-    int found = 0;
-    printf("\nSearch results for \"%s\":\n", name);
-    while (fread(&m, sizeof(Medicine), 1, fp) == 1) {
-        if (ci_substr(m.name, name)) {
-            printMedicine(&m);
-            found = 1;
+/* Take a slot out of the index (backward-shift delete, no tombstones) */
+void indexRemove(int slot) {
+    unsigned int mask = (unsigned int)inventory.index_cap - 1;
+    unsigned int b = hashMedicineID(inventory.recs[slot].id) & mask;
+    while (inventory.index[b] != slot) b = (b + 1) & mask;
+    for (unsigned int next = (b + 1) & mask; inventory.index[next] != -1; next = (next + 1) & mask) {
+        unsigned int home = hashMedicineID(inventory.recs[inventory.index[next]].id) & mask;
+        /* the entry at next may fill the hole unless its home lies in (b, next] */
+        if (((next - home) & mask) >= ((next - b) & mask)) {
+            inventory.index[b] = inventory.index[next];
+            b = next;
         }
     }
-    if (!found) printf("No matches found.\n");
-    fclose(fp);
-    return found;
+    inventory.index[b] = -1;
 }
 
-/* Update medicine (by id) */
-void updateMedicine() {
-    printf("\n--- Update Medicine ---\n");
-    printf("Enter medicine ID: ");
-    int id; if (scanf("%d", &id) != 1) { printf("Invalid input.\n"); while(getchar()!='\n'); return; }
+/* Find the slot of a medicine ID, -1 if absent */
+int inventoryFind(int id) {
+    if (inventory.index_cap == 0) return -1;
+    unsigned int mask = (unsigned int)inventory.index_cap - 1;
+    unsigned int b = hashMedicineID(id) & mask;
+    while (inventory.index[b] != -1) {
+        if (inventory.recs[inventory.index[b]].id == id) return inventory.index[b];
+        b = (b + 1) & mask;
+    }
+    return -1;
+}
 
-    FILE *fp = fopen(DATAFILE, "rb+");
-    if (!fp) { printf("No data file.\n"); return; }
-
-    Medicine m;
-    int found = 0;
-    while (fread(&m, sizeof(Medicine), 1, fp) == 1) {
-        if (m.id == id) {
-            found = 1;
-            printf("Existing record:\n"); printMedicine(&m);
-            getchar(); /* consume newline */
-            printf("New Name (leave blank to keep): ");
-            char newname[NAME_LEN]; fgets(newname, NAME_LEN, stdin);
-            if (newname[0] != '\n') {
-                newname[strcspn(newname, "\n")] = '\0';
-                strncpy(m.name, newname, NAME_LEN);
-            }
-            printf("New Price (-1 to keep %.2f): ", m.price);
-            double newprice; if (scanf("%lf", &newprice) == 1 && newprice >= 0) m.price = newprice;
-            printf("New Quantity (-1 to keep %d): ", m.quantity);
-            int newqty; if (scanf("%d", &newqty) == 1 && newqty >= 0) m.quantity = newqty;
-            printf("New Expiry Day (0 to keep %d): ", m.expiry_day); int nd; if (scanf("%d", &nd) == 1 && nd>0) m.expiry_day = nd;
-            printf("New Expiry Month (0 to keep %d): ", m.expiry_month); int nm; if (scanf("%d", &nm) == 1 && nm>0) m.expiry_month = nm;
-            printf("New Expiry Year (0 to keep %d): ", m.expiry_year); int ny; if (scanf("%d", &ny) == 1 && ny>0) m.expiry_year = ny;
-
-            /* move file pointer back to overwrite */
-            fseek(fp, - (long)sizeof(Medicine), SEEK_CUR);
-            fwrite(&m, sizeof(Medicine), 1, fp);
-            printf("Record updated.\n");
-            break;
-        }
+/* Make room for `need` records in memory */
+void inventoryReserve(int need) {
+    if (need <= inventory.cap) return;
+    int cap = inventory.cap ? inventory.cap : 64;
+    while (cap < need) cap *= 2;
+    Medicine *recs = realloc(inventory.recs, sizeof(Medicine) * cap);
+    int *reorder = realloc(inventory.reorder, sizeof(int) * cap);
+    int *low_heap = realloc(inventory.low_heap, sizeof(int) * cap);
+    int *heap_pos = realloc(inventory.heap_pos, sizeof(int) * cap);
+    unsigned int *version = realloc(inventory.version, sizeof(unsigned int) * cap);
+    if (!recs || !reorder || !low_heap || !heap_pos || !version) {
+        perror("Unable to allocate inventory"); exit(1);
     }
-    if (!found) printf("Medicine with ID %d not found.\n", id);
-    fclose(fp);
+    inventory.recs = recs;
+    inventory.reorder = reorder;
+    inventory.low_heap = low_heap;
+    inventory.heap_pos = heap_pos;
+    inventory.version = version;
+    inventory.cap = cap;
 }
 
-/* Delete medicine by id */
-void deleteMedicine() {
-    printf("\n--- Delete Medicine ---\n");
-    printf("Enter medicine ID: ");
-    int id; if (scanf("%d", &id) != 1) { printf("Invalid input.\n"); while(getchar()!='\n'); return; }
+/* Byte offset of a slot's record in DATAFILE; dataOffset(count) is the
+   file's length */
+long long dataOffset(int slot) {
+    return DATA_HEADER + (long long)slot * DATA_RECORD;
+}
+
+/* Pack a medicine into its DATAFILE record, every unused byte zero */
+void medicineToRecord(MedicineRecord *r, const Medicine *m) {
+    memset(r, 0, sizeof(*r));
+    r->id = m->id;
+    r->quantity = m->quantity;
+    r->price = m->price;
+    r->expiry_day = m->expiry_day;
+    r->expiry_month = m->expiry_month;
+    r->expiry_year = m->expiry_year;
+    memcpy(r->name, m->name, strnlen(m->name, NAME_LEN));
+    memcpy(r->category, m->category, strnlen(m->category, CATEGORY_LEN));
+}
 
-    FILE *fp = fopen(DATAFILE, "rb");
-    if (!fp) { printf("No data file.\n"); return; }
-    FILE *tmp = fopen("tmp.dat", "wb");
-    if (!tmp) { perror("Unable to create temp file"); fclose(fp); return; }
+void medicineFromRecord(Medicine *m, const MedicineRecord *r) {
+    memset(m, 0, sizeof(*m));
+    m->id = r->id;
+    m->quantity = r->quantity;
+    m->price = r->price;
+    m->expiry_day = r->expiry_day;
+    m->expiry_month = r->expiry_month;
+    m->expiry_year = r->expiry_year;
+    memcpy(m->name, r->name, strnlen(r->name, NAME_LEN - 1));
+    memcpy(m->category, r->category, strnlen(r->category, CATEGORY_LEN - 1));
+}
+
+/* Give a slot a new version after its record changed, so carts holding
+   the old one know to look again */
+void versionBump(int slot) {
+    inventory.version[slot] = ++inventory.version_clock;
+}
 
-    Medicine m;
-    int found = 0;
-    while (fread(&m, sizeof(Medicine), 1, fp) == 1) {
-        if (m.id == id) { found = 1; continue; } /* skip writing the deleted record */
-        fwrite(&m, sizeof(Medicine), 1, tmp);
+/* Counter of a medicine ID, NULL when the ID is out of range or its page
+   was never needed. With create set (inventory.lock held) the page is
+   allocated and published. */
+StockCounter *stockCounter(int id, int create) {
+    if (id < 0 || id >= STOCK_PAGE * STOCK_PAGES) return NULL;
+    StockCounter *page = atomic_load_explicit(&stockCounters.pages[id / STOCK_PAGE], memory_order_acquire);
+    if (!page && create) {
+        page = aligned_alloc(64, sizeof(StockCounter) * STOCK_PAGE);
+        if (!page) { perror("Unable to allocate stock counters"); exit(1); }
+        memset(page, 0, sizeof(StockCounter) * STOCK_PAGE);
+        atomic_store_explicit(&stockCounters.pages[id / STOCK_PAGE], page, memory_order_release);
     }
-    fclose(fp); fclose(tmp);
+    return page ? &page[id % STOCK_PAGE] : NULL;
+}
 
-    if (found) {
-        remove(DATAFILE);
-        rename("tmp.dat", DATAFILE);
-        printf("Medicine with ID %d deleted.\n", id);
-    } else {
-        remove("tmp.dat");
-        printf("Medicine with ID %d not found.\n", id);
+/* Fold a change of a slot's quantity into its counter. Callers hold
+   inventory.lock (or are the only thread). */
+void stockSync(int slot) {
+    const Medicine *m = &inventory.recs[slot];
+    StockCounter *c = stockCounter(m->id, 1);
+    if (!c) return;
+    c->generation = stockCounters.generation;
+    if (m->quantity == c->synced) return;
+    atomic_fetch_add(&c->available, m->quantity - c->synced);
+    c->synced = m->quantity;
+}
+
+/* Bring every counter up to date after the slots were rebuilt or shifted;
+   IDs no longer on file drop to nothing */
+void stockSyncAll() {
+    int gen = ++stockCounters.generation;
+    for (int i = 0; i < inventory.count; ++i) stockSync(i);
+    for (int p = 0; p < STOCK_PAGES; ++p) {
+        StockCounter *page = atomic_load_explicit(&stockCounters.pages[p], memory_order_acquire);
+        for (int i = 0; page && i < STOCK_PAGE; ++i) {
+            if (page[i].generation == gen || page[i].synced == 0) continue;
+            atomic_fetch_sub(&page[i].available, page[i].synced);
+            page[i].synced = 0;
+        }
     }
 }
 
-/* Append sale record to SALESFILE */
-void appendSaleRecord(const char *customer_name, CartItem cart[], int cartCount, double subtotal, double tax, double total) {
-    FILE *fp = fopen(SALESFILE, "a");
-    if (!fp) { perror("Unable to open sales history file"); return; }
+/* Reserve qty units if that many are available: 1 on success, 0 if not.
+   IDs without a counter are left to the check under the lock (1), unless
+   their page exists and the ID simply is not stocked. */
+int stockReserve(int id, int qty) {
+    StockCounter *c = stockCounter(id, 0);
+    if (!c) return id < 0 || id >= STOCK_PAGE * STOCK_PAGES;
+    int have = atomic_load_explicit(&c->available, memory_order_relaxed);
+    do {
+        if (have < qty) return 0;
+    } while (!atomic_compare_exchange_weak(&c->available, &have, have - qty));
+    return 1;
+}
 
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    char timestr[64];
-    strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", t);
+void stockRelease(int id, int qty) {
+    StockCounter *c = stockCounter(id, 0);
+    if (c) atomic_fetch_add(&c->available, qty);
+}
 
-    fprintf(fp, "Purchase Time: %s\n", timestr);
-    if (customer_name && customer_name[0] != '\0')
-        fprintf(fp, "Customer: %s\n", customer_name);
-    else
-        fprintf(fp, "Customer: (not provided)\n");
-    fprintf(fp, "Items:\n");
-    for (int i = 0; i < cartCount; ++i) {
-        double line = cart[i].price * cart[i].qty;
-        fprintf(fp, " - %s | ID:%d | Qty:%d | Unit:%.2f | Line:%.2f\n",
-                cart[i].name, cart[i].med_id, cart[i].qty, cart[i].price, line);
+/* Reserve every line of a cart or none of them */
+int stockReserveCart(const Cart *cart) {
+    for (int i = cart->head; i >= 0; i = cart->line[i].next) {
+        if (stockReserve(cart->line[i].med_id, cart->line[i].qty)) continue;
+        while ((i = cart->line[i].prev) >= 0) stockRelease(cart->line[i].med_id, cart->line[i].qty);
+        return 0;
     }
-    fprintf(fp, "Subtotal: %.2f\n", subtotal);
-    fprintf(fp, "VAT %.2f%%: %.2f\n", TAX_RATE * 100.0, tax);
-    fprintf(fp, "Total: %.2f\n", total);
-    fprintf(fp, "----------------------------------------\n");
-    fclose(fp);
+    return 1;
 }
 
-/* Admin view sales history */
-void viewSalesHistory() {
-    FILE *fp = fopen(SALESFILE, "r");
-    if (!fp) { printf("\nNo sales history available.\n"); return; }
-    printf("\n--- Sales History ---\n\n");
-    int ch;
-    while ((ch = fgetc(fp)) != EOF) putchar(ch);
-    fclose(fp);
+void stockReleaseCart(const Cart *cart) {
+    for (int i = cart->head; i >= 0; i = cart->line[i].next) stockRelease(cart->line[i].med_id, cart->line[i].qty);
 }
 
-/* Admin menu */
-void adminMenu() {
-    char pass[64];
-    printf("\nEnter admin password: ");
-    getchar(); /* consume newline */
-    fgets(pass, sizeof(pass), stdin);
-    pass[strcspn(pass, "\n")] = '\0';
-    if (strcmp(pass, ADMIN_PASS) != 0) {
-        printf("Incorrect password.\n");
-        return;
-    }
+/* A checkout took its reserved units off the record: the counter already
+   reflects them, so only its view of the record moves */
+void stockConsume(int slot, int qty) {
+    StockCounter *c = stockCounter(inventory.recs[slot].id, 1);
+    if (c) c->synced -= qty;
+}
 
-    int choice;
-    do {
-        printf("\n--- Admin Panel ---\n");
-        printf("1. Add Medicine\n");
-        printf("2. View All Medicines\n");
-        printf("3. Search Medicine by Name\n");
-        printf("4. Update Medicine\n");
-        printf("5. Delete Medicine\n");
-        printf("6. View Sales History\n");
-        printf("0. Back to Main Menu\n");
-        printf("Choice: "); if (scanf("%d", &choice) != 1) { while(getchar()!='\n'); choice = -1; }
+/* Trigram key of three name bytes, lowercased */
+unsigned int trigramKey(const char *p) {
+    return ((unsigned int)tolower((unsigned char)p[0]) << 16) |
+           ((unsigned int)tolower((unsigned char)p[1]) << 8) |
+            (unsigned int)tolower((unsigned char)p[2]);
+}
 
-        switch (choice) {
-            case 1: addMedicine(); break;
-            case 2: viewMedicines(); break;
-            case 3: {
-                char keyword[NAME_LEN];
-                printf("Enter name keyword: ");
-                getchar(); fgets(keyword, NAME_LEN, stdin);
-                keyword[strcspn(keyword, "\n")] = '\0';
-                searchMedicineByName(keyword);
-                break;
-            }
-            case 4: updateMedicine(); break;
-            case 5: deleteMedicine(); break;
-            case 6: viewSalesHistory(); break;
-            case 0: break;
-            default: printf("Invalid choice.\n");
-        }
-        pressEnterToContinue();
-    } while (choice != 0);
+/* Bucket for a trigram key: its posting list, or the empty bucket it would use */
+Posting *trigramBucket(unsigned int key) {
+    unsigned int mask = (unsigned int)trigrams.cap - 1;
+    unsigned int b = (key * 2654435769u) & mask;
+    while (trigrams.buckets[b].key != 0 && trigrams.buckets[b].key != key) b = (b + 1) & mask;
+    return &trigrams.buckets[b];
 }
 
-/* Customer purchase flow with add/remove cart and checkout */
-void customerMenu() {
-    CartItem cart[MAX_CART];
-    int cartCount = 0;
-    int choice;
+/* Posting list of a trigram, NULL if no name contains it */
+Posting *trigramFind(unsigned int key) {
+    if (trigrams.cap == 0) return NULL;
+    Posting *p = trigramBucket(key);
+    return p->key ? p : NULL;
+}
+
+/* Grow the trigram table so it stays at most half full */
+void trigramGrow() {
+    TrigramIndex old = trigrams;
+    trigrams.cap = old.cap ? old.cap * 2 : 1024;
+    trigrams.buckets = calloc(trigrams.cap, sizeof(Posting));
+    if (!trigrams.buckets) { perror("Unable to allocate trigram index"); exit(1); }
+    for (int b = 0; b < old.cap; ++b)
+        if (old.buckets[b].key) *trigramBucket(old.buckets[b].key) = old.buckets[b];
+    free(old.buckets);
+}
+
+/* First position in a sorted posting list whose ID is >= id */
+int postingLowerBound(const Posting *p, int id) {
+    int lo = 0, hi = p->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (p->ids[mid] < id) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Index every trigram of a name under the medicine ID */
+void trigramAdd(const char *name, int id) {
+    size_t len = strnlen(name, NAME_LEN);
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        unsigned int key = trigramKey(name + i);
+        if ((trigrams.used + 1) * 2 > trigrams.cap) trigramGrow();
+        Posting *p = trigramBucket(key);
+        if (!p->key) { p->key = key; trigrams.used++; }
+        int pos = postingLowerBound(p, id);
+        if (pos < p->count && p->ids[pos] == id) continue; /* trigram repeats in the name */
+        if (p->count == p->cap) {
+            int cap = p->cap ? p->cap * 2 : 4;
+            int *ids = realloc(p->ids, sizeof(int) * cap);
+            if (!ids) { perror("Unable to allocate trigram index"); exit(1); }
+            p->ids = ids;
+            p->cap = cap;
+        }
+        memmove(&p->ids[pos + 1], &p->ids[pos], sizeof(int) * (p->count - pos));
+        p->ids[pos] = id;
+        p->count++;
+    }
+}
+
+/* Drop a medicine ID from the posting lists of its name's trigrams */
+void trigramRemove(const char *name, int id) {
+    size_t len = strnlen(name, NAME_LEN);
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        Posting *p = trigramFind(trigramKey(name + i));
+        if (!p) continue;
+        int pos = postingLowerBound(p, id);
+        if (pos == p->count || p->ids[pos] != id) continue;
+        memmove(&p->ids[pos], &p->ids[pos + 1], sizeof(int) * (p->count - pos - 1));
+        p->count--;
+    }
+}
+
+/* Candidate IDs for a substring query: the intersection of the posting lists
+   of all its trigrams, in ID order. Returns the count (candidates still need
+   verifying), or -1 if the query is shorter than a trigram. */
+int trigramCandidates(const char *query, int **out) {
+    size_t len = strlen(query);
+    *out = NULL;
+    if (len < 3) return -1;
+
+    /* start from the shortest list so the intersection never grows */
+    Posting *shortest = NULL;
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        Posting *p = trigramFind(trigramKey(query + i));
+        if (!p || p->count == 0) return 0;
+        if (!shortest || p->count < shortest->count) shortest = p;
+    }
+    int *ids = malloc(sizeof(int) * shortest->count);
+    if (!ids) return 0;
+    memcpy(ids, shortest->ids, sizeof(int) * shortest->count);
+    int n = shortest->count;
+
+    for (size_t i = 0; i + 3 <= len && n > 0; ++i) {
+        Posting *p = trigramFind(trigramKey(query + i));
+        if (p == shortest) continue;
+        int kept = 0, from = 0;
+        for (int k = 0; k < n; ++k) {
+            /* gallop forward to the first ID >= ids[k] */
+            int step = 1, hi = from;
+            while (hi < p->count && p->ids[hi] < ids[k]) { from = hi + 1; hi += step; step *= 2; }
+            if (hi > p->count) hi = p->count;
+            while (from < hi) {
+                int mid = (from + hi) / 2;
+                if (p->ids[mid] < ids[k]) from = mid + 1; else hi = mid;
+            }
+            if (from < p->count && p->ids[from] == ids[k]) ids[kept++] = ids[k];
+        }
+        n = kept;
+    }
+    *out = ids;
+    return n;
+}
+
+/* Build the trigram index over every loaded record */
+void trigramBuild() {
+    for (int b = 0; b < trigrams.cap; ++b) trigrams.buckets[b].count = 0;
+    for (int i = 0; i < inventory.count; ++i)
+        if (inventory.recs[i].id) trigramAdd(inventory.recs[i].name, inventory.recs[i].id);
+}
+
+/* Order two medicines by case-folded name, then ID */
+int nameOrder(const Medicine *a, const Medicine *b) {
+    int c = strncasecmp(a->name, b->name, NAME_LEN);
+    return c ? c : (a->id > b->id) - (a->id < b->id);
+}
+
+/* Position of the first name-index entry not ordered before m */
+int nameLowerBound(const Medicine *m) {
+    int lo = 0, hi = names.count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (nameOrder(&inventory.recs[inventoryFind(names.ids[mid])], m) < 0) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Insert a medicine into the name index (its record must be in inventory) */
+void nameIndexInsert(const Medicine *m) {
+    if (names.count == names.cap) {
+        int cap = names.cap ? names.cap * 2 : 64;
+        int *ids = realloc(names.ids, sizeof(int) * cap);
+        if (!ids) { perror("Unable to allocate name index"); exit(1); }
+        names.ids = ids;
+        names.cap = cap;
+    }
+    int pos = nameLowerBound(m);
+    memmove(&names.ids[pos + 1], &names.ids[pos], sizeof(int) * (names.count - pos));
+    names.ids[pos] = m->id;
+    names.count++;
+}
+
+/* Remove a medicine from the name index; m must still hold the indexed name */
+void nameIndexRemove(const Medicine *m) {
+    int pos = nameLowerBound(m);
+    if (pos == names.count || names.ids[pos] != m->id) return;
+    memmove(&names.ids[pos], &names.ids[pos + 1], sizeof(int) * (names.count - pos - 1));
+    names.count--;
+}
+
+int compareByName(const void *a, const void *b) {
+    return nameOrder(&inventory.recs[inventoryFind(*(const int *)a)],
+                     &inventory.recs[inventoryFind(*(const int *)b)]);
+}
+
+/* Build the name index over every loaded record */
+void nameIndexBuild() {
+    names.cap = inventory.count > 64 ? inventory.count : 64;
+    free(names.ids);
+    names.ids = malloc(sizeof(int) * names.cap);
+    if (!names.ids) { perror("Unable to allocate name index"); exit(1); }
+    names.count = 0;
+    for (int i = 0; i < inventory.count; ++i)
+        if (inventory.recs[i].id) names.ids[names.count++] = inventory.recs[i].id;
+    qsort(names.ids, names.count, sizeof(int), compareByName);
+}
+
+/* Top `k` medicines whose name starts with `prefix` (case-insensitive),
+   most stock first. Fills out[] with slots and returns how many. */
+int prefixTopMatches(const char *prefix, int k, int out[]) {
+    size_t plen = strlen(prefix);
+    int lo = 0, hi = names.count, n = 0;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strncasecmp(inventory.recs[inventoryFind(names.ids[mid])].name, prefix, plen) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    for (int i = lo; i < names.count; ++i) {
+        int slot = inventoryFind(names.ids[i]);
+        if (strncasecmp(inventory.recs[slot].name, prefix, plen) != 0) break;
+        /* insertion into the short ranked list */
+        int qty = inventory.recs[slot].quantity, pos = n < k ? n++ : k;
+        while (pos > 0 && inventory.recs[out[pos - 1]].quantity < qty) {
+            if (pos < k) out[pos] = out[pos - 1];
+            pos--;
+        }
+        if (pos < k) out[pos] = slot;
+    }
+    return n;
+}
+
+/* Days since 1970-01-01 for a calendar date, 0 if the date does not exist */
+int dayNumber(int d, int m, int y) {
+    static const int mdays[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (y < 1970 || y > 9999 || m < 1 || m > 12 || d < 1) return 0;
+    int leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    if (d > mdays[m - 1] + (m == 2 && leap)) return 0;
+    y -= m <= 2;   /* count from March so the leap day ends the year */
+    int era = y / 400, yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+int expiryDayNumber(const Medicine *m) {
+    return dayNumber(m->expiry_day, m->expiry_month, m->expiry_year);
+}
+
+int todayDayNumber() {
+    time_t now = time(NULL);
+    struct tm *t = localtime(&now);
+    return dayNumber(t->tm_mday, t->tm_mon + 1, t->tm_year + 1900);
+}
+
+/* Past its expiry day; a record without a valid date never counts as expired */
+int isExpired(const Medicine *m, int today) {
+    int day = expiryDayNumber(m);
+    return day != 0 && day < today;
+}
+
+/* Position of the first expiry-index entry not ordered before (day, id) */
+int expiryLowerBound(int day, int id) {
+    int lo = 0, hi = expiries.count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const ExpiryEntry *e = &expiries.entries[mid];
+        if (e->day < day || (e->day == day && e->id < id)) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+void expiryIndexInsert(const Medicine *m) {
+    int day = expiryDayNumber(m);
+    if (!day) return;
+    if (expiries.count == expiries.cap) {
+        int cap = expiries.cap ? expiries.cap * 2 : 64;
+        ExpiryEntry *e = realloc(expiries.entries, sizeof(ExpiryEntry) * cap);
+        if (!e) { perror("Unable to allocate expiry index"); exit(1); }
+        expiries.entries = e;
+        expiries.cap = cap;
+    }
+    int pos = expiryLowerBound(day, m->id);
+    memmove(&expiries.entries[pos + 1], &expiries.entries[pos], sizeof(ExpiryEntry) * (expiries.count - pos));
+    expiries.entries[pos].day = day;
+    expiries.entries[pos].id = m->id;
+    expiries.count++;
+}
+
+/* Remove a medicine from the expiry index; m must still hold the indexed date */
+void expiryIndexRemove(const Medicine *m) {
+    int day = expiryDayNumber(m), pos = expiryLowerBound(day, m->id);
+    if (!day || pos == expiries.count || expiries.entries[pos].id != m->id) return;
+    memmove(&expiries.entries[pos], &expiries.entries[pos + 1], sizeof(ExpiryEntry) * (expiries.count - pos - 1));
+    expiries.count--;
+}
+
+int compareByExpiry(const void *a, const void *b) {
+    const ExpiryEntry *x = a, *y = b;
+    if (x->day != y->day) return (x->day > y->day) - (x->day < y->day);
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/* Build the expiry index over every loaded record */
+void expiryIndexBuild() {
+    expiries.cap = inventory.count > 64 ? inventory.count : 64;
+    free(expiries.entries);
+    expiries.entries = malloc(sizeof(ExpiryEntry) * expiries.cap);
+    if (!expiries.entries) { perror("Unable to allocate expiry index"); exit(1); }
+    expiries.count = 0;
+    for (int i = 0; i < inventory.count; ++i) {
+        int day = expiryDayNumber(&inventory.recs[i]);
+        if (!day) continue;
+        expiries.entries[expiries.count].day = day;
+        expiries.entries[expiries.count].id = inventory.recs[i].id;
+        expiries.count++;
+    }
+    qsort(expiries.entries, expiries.count, sizeof(ExpiryEntry), compareByExpiry);
+}
+
+/* Low-stock queue: lowest quantity first, ties by ID */
+int lowStockBefore(int a, int b) {
+    const Medicine *x = &inventory.recs[a], *y = &inventory.recs[b];
+    return x->quantity != y->quantity ? x->quantity < y->quantity : x->id < y->id;
+}
+
+void lowStockPlace(int pos, int slot) {
+    inventory.low_heap[pos] = slot;
+    inventory.heap_pos[slot] = pos;
+}
+
+void lowStockSiftUp(int pos) {
+    int slot = inventory.low_heap[pos];
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!lowStockBefore(slot, inventory.low_heap[parent])) break;
+        lowStockPlace(pos, inventory.low_heap[parent]);
+        pos = parent;
+    }
+    lowStockPlace(pos, slot);
+}
+
+void lowStockSiftDown(int pos) {
+    int slot = inventory.low_heap[pos];
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= inventory.low_count) break;
+        if (child + 1 < inventory.low_count && lowStockBefore(inventory.low_heap[child + 1], inventory.low_heap[child])) child++;
+        if (!lowStockBefore(inventory.low_heap[child], slot)) break;
+        lowStockPlace(pos, inventory.low_heap[child]);
+        pos = child;
+    }
+    lowStockPlace(pos, slot);
+}
+
+/* Take a slot out of the queue, if it is in it */
+void lowStockRemove(int slot) {
+    int pos = inventory.heap_pos[slot];
+    if (pos < 0) return;
+    inventory.heap_pos[slot] = -1;
+    int last = inventory.low_heap[--inventory.low_count];
+    if (pos < inventory.low_count) {
+        lowStockPlace(pos, last);
+        lowStockSiftUp(pos);
+        lowStockSiftDown(inventory.heap_pos[last]);
+    }
+}
+
+/* Re-file a slot after its quantity or reorder level changed: O(log n) */
+void lowStockUpdate(int slot) {
+    int low = inventory.recs[slot].id != 0 && inventory.recs[slot].quantity < inventory.reorder[slot];
+    int pos = inventory.heap_pos[slot];
+    if (low && pos < 0) {
+        pos = inventory.low_count++;
+        lowStockPlace(pos, slot);
+        lowStockSiftUp(pos);
+    } else if (!low && pos >= 0) {
+        lowStockRemove(slot);
+    } else if (low) {
+        lowStockSiftUp(pos);
+        lowStockSiftDown(inventory.heap_pos[slot]);
+    }
+}
+
+/* Rebuild the queue over every slot (after load, or when slots shift) */
+void lowStockBuild() {
+    inventory.low_count = 0;
+    for (int i = 0; i < inventory.count; ++i) inventory.heap_pos[i] = -1;
+    for (int i = 0; i < inventory.count; ++i) lowStockUpdate(i);
+}
+
+/* Has REORDERFILE been swapped or rewritten since it was last read or
+   written here? With note set it is remembered as it is now, which readers
+   do before reading so a save in between is not missed. */
+int reorderFileChanged(int note) {
+    struct stat st;
+    if (stat(REORDERFILE, &st) != 0) memset(&st, 0, sizeof(st));
+    const struct stat *seen = &inventory.reorder_file;
+    int changed = st.st_ino != seen->st_ino || st.st_size != seen->st_size ||
+                  st.st_mtim.tv_sec != seen->st_mtim.tv_sec || st.st_mtim.tv_nsec != seen->st_mtim.tv_nsec;
+    if (note) inventory.reorder_file = st;
+    return changed;
+}
+
+/* Read REORDERFILE; medicines not listed get REORDER_LEVEL */
+void reorderLoad() {
+    for (int i = 0; i < inventory.count; ++i) inventory.reorder[i] = REORDER_LEVEL;
+    reorderFileChanged(1);
+    FILE *fp = fopen(REORDERFILE, "rb");
+    if (!fp) return;
+    ReorderLevel r;
+    while (fread(&r, sizeof(r), 1, fp) == 1) {
+        int slot = inventoryFind(r.med_id);
+        if (slot >= 0) inventory.reorder[slot] = r.level;
+    }
+    fclose(fp);
+}
+
+/* Rewrite REORDERFILE with every level that differs from the default and
+   swap it in. The catalog program keeps its levels there too, so callers
+   hold the layout lock exclusively and have just caught up with the file. */
+int reorderSave() {
+    FILE *fp = fopen(REORDERFILE ".tmp", "wb");
+    if (!fp) { perror("Unable to write reorder levels"); return 0; }
+    for (int i = 0; i < inventory.count; ++i) {
+        if (inventory.reorder[i] == REORDER_LEVEL) continue;
+        ReorderLevel r = { inventory.recs[i].id, inventory.reorder[i] };
+        fwrite(&r, sizeof(r), 1, fp);
+    }
+    if (fclose(fp) != 0 || rename(REORDERFILE ".tmp", REORDERFILE) != 0) {
+        perror("Unable to write reorder levels");
+        unlink(REORDERFILE ".tmp");
+        return 0;
+    }
+    reorderFileChanged(1);
+    return 1;
+}
+
+/* Bring the reorder levels up to REORDERFILE: slots filled since it was
+   read take their levels from it, and if another terminal rewrote it,
+   every slot does, levels it no longer lists going back to the default.
+   Only slots whose level changed move in the low-stock queue. */
+void reorderRefresh() {
+    int *levels = NULL;
+    if (reorderFileChanged(1)) {
+        if (!(levels = malloc(sizeof(int) * (inventory.count + 1)))) { perror("Unable to allocate inventory"); exit(1); }
+        for (int i = 0; i < inventory.count; ++i) levels[i] = REORDER_LEVEL;
+    }
+    FILE *fp = fopen(REORDERFILE, "rb");
+    ReorderLevel r;
+    while (fp && fread(&r, sizeof(r), 1, fp) == 1) {
+        int slot = inventoryFind(r.med_id);
+        if (slot < 0) continue;
+        if (levels) levels[slot] = r.level;
+        else if (inventory.reorder[slot] != r.level) {
+            inventory.reorder[slot] = r.level;
+            lowStockUpdate(slot);
+        }
+    }
+    if (fp) fclose(fp);
+    for (int i = 0; levels && i < inventory.count; ++i) {
+        if (levels[i] == inventory.reorder[i]) continue;
+        inventory.reorder[i] = levels[i];
+        lowStockUpdate(i);
+    }
+    free(levels);
+}
+
+/* Bucket for key, inserted empty if missing; NULL when out of memory */
+RollupBucket *rollupBucket(RollupTable *t, long long key) {
+    int lo = 0, hi = t->count;
+    if (hi > 0 && t->buckets[hi - 1].key < key) lo = hi;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (t->buckets[mid].key < key) lo = mid + 1; else hi = mid;
+    }
+    if (lo < t->count && t->buckets[lo].key == key) return &t->buckets[lo];
+    if (t->count == t->cap) {
+        int cap = t->cap ? t->cap * 2 : 64;
+        RollupBucket *b = realloc(t->buckets, sizeof(RollupBucket) * cap);
+        if (!b) return NULL;
+        t->buckets = b;
+        t->cap = cap;
+    }
+    memmove(&t->buckets[lo + 1], &t->buckets[lo], sizeof(RollupBucket) * (t->count - lo));
+    t->count++;
+    memset(&t->buckets[lo], 0, sizeof(RollupBucket));
+    t->buckets[lo].key = key;
+    return &t->buckets[lo];
+}
+
+/* First bucket with a key not below `key` */
+int rollupLowerBound(const RollupTable *t, long long key) {
+    int lo = 0, hi = t->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (t->buckets[mid].key < key) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+void rollupAdd(RollupTable *t, long long key, long long units, long long cents, int sign) {
+    RollupBucket *b = rollupBucket(t, key);
+    if (!b) { perror("Unable to update sales rollups"); return; }
+    b->units += sign * units;
+    b->cents += sign * cents;
+    b->sales += sign;
+}
+
+/* Add (sign 1) or take back (sign -1) one sale in every table */
+void rollupApply(const SaleSummary *s, int sign) {
+    long long units = 0, cents = 0;
+    for (int i = 0; i < s->lines; ++i) {
+        units += s->line[i].qty;
+        cents += s->line[i].cents;
+        rollupAdd(&rollups.table[ROLLUP_MEDICINE], s->line[i].med_id, s->line[i].qty, s->line[i].cents, sign);
+        rollupAdd(&rollups.table[ROLLUP_MEDICINE_DAILY], (long long)s->day << 32 | (unsigned int)s->line[i].med_id,
+                  s->line[i].qty, s->line[i].cents, sign);
+    }
+    rollupAdd(&rollups.table[ROLLUP_HOURLY], (long long)s->day * 24 + s->hour, units, cents, sign);
+    rollupAdd(&rollups.table[ROLLUP_DAILY], s->day, units, cents, sign);
+}
+
+/* Read the next complete SALESFILE record; returns 0 at the end of the
+   stream or of the last record that has its closing line */
+int rollupReadSale(FILE *fp, SaleSummary *s) {
+    char line[256];
+    int in_sale = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        int y, mo, d, h, mi, sec;
+        if (sscanf(line, "Purchase Time: %d-%d-%d %d:%d:%d", &y, &mo, &d, &h, &mi, &sec) == 6) {
+            s->day = dayNumber(d, mo, y);
+            s->hour = h;
+            s->lines = 0;
+            in_sale = 1;
+        } else if (in_sale && strncmp(line, " - ", 3) == 0) {
+            /* the name may hold anything, so read from the last " | ID:" */
+            char *p = NULL, *q = line;
+            while ((q = strstr(q, " | ID:")) != NULL) p = q++;
+            int id, qty; double unit, total;
+            if (p && sscanf(p, " | ID:%d | Qty:%d | Unit:%lf | Line:%lf", &id, &qty, &unit, &total) == 4) {
+                if (s->lines == s->cap) {
+                    int cap = s->cap ? s->cap * 2 : 16;
+                    void *grown = realloc(s->line, sizeof(*s->line) * cap);
+                    if (!grown) { perror("Unable to read sale"); exit(1); }
+                    s->line = grown;
+                    s->cap = cap;
+                }
+                s->line[s->lines].med_id = id;
+                s->line[s->lines].qty = qty;
+                s->line[s->lines].cents = (long long)(total * 100.0 + 0.5);
+                s->lines++;
+            }
+        } else if (in_sale && strncmp(line, "----", 4) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Apply every complete record from the current position on and advance
+   rollups.covered past the last one */
+void rollupReplay(FILE *fp) {
+    SaleSummary s = { 0 };
+    while (rollupReadSale(fp, &s)) {
+        rollupApply(&s, 1);
+        rollups.covered = ftell(fp);
+    }
+    free(s.line);
+}
+
+void rollupReset() {
+    for (int t = 0; t < ROLLUP_TABLES; ++t) rollups.table[t].count = 0;
+    rollups.covered = 0;
+}
+
+/* Bring the tables up to the end of SALESFILE the last commit published,
+   so covered stands for that end. Checkouts do not add their own sales;
+   every terminal's get in through here, in file order. Holds the commit
+   lock (when the inventory is open) so no sale is half written meanwhile. */
+void rollupCatchUp() {
+    ShadowHeader h;
+    int locked = inventory.fp && shadowLock(1);
+    if (locked) shadowRecover(&h);
+    FILE *fp = fopen(SALESFILE, "r");
+    if (fp) {
+        fseek(fp, rollups.covered, SEEK_SET);
+        rollupReplay(fp);
+        fclose(fp);
+    }
+    if (locked) shadowUnlock();
+}
+
+/* Rebuild every table from the whole SALESFILE */
+void rollupRebuild() {
+    rollupReset();
+    rollupCatchUp();
+}
+
+/* Catch the tables up, then write ROLLUPFILE next to the data and swap it
+   in, so a save never drops sales other terminals made meanwhile. Callers
+   hold the layout lock exclusively, which keeps saves apart. */
+int rollupSave() {
+    rollupCatchUp();
+    FILE *fp = fopen(ROLLUPFILE ".tmp", "wb");
+    if (!fp) { perror("Unable to write sales rollups"); return 0; }
+    RollupHeader h = { ROLLUP_MAGIC, { 0 }, rollups.covered };
+    for (int t = 0; t < ROLLUP_TABLES; ++t) h.count[t] = rollups.table[t].count;
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    for (int t = 0; ok && t < ROLLUP_TABLES; ++t)
+        ok = fwrite(rollups.table[t].buckets, sizeof(RollupBucket), h.count[t], fp) == (size_t)h.count[t];
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || rename(ROLLUPFILE ".tmp", ROLLUPFILE) != 0) {
+        perror("Unable to write sales rollups");
+        unlink(ROLLUPFILE ".tmp");
+        return 0;
+    }
+    return 1;
+}
+
+/* Load ROLLUPFILE and replay only the sales written after it was saved.
+   A missing or damaged file, or a SALESFILE shorter than it covers,
+   means a full rebuild. */
+void rollupLoad() {
+    FILE *fp = fopen(ROLLUPFILE, "rb");
+    RollupHeader h;
+    int ok = fp && fread(&h, sizeof(h), 1, fp) == 1 && h.magic == ROLLUP_MAGIC;
+    rollupReset();
+    for (int t = 0; ok && t < ROLLUP_TABLES; ++t) {
+        RollupTable *tab = &rollups.table[t];
+        if (h.count[t] < 0) { ok = 0; break; }
+        if (h.count[t] > tab->cap) {
+            RollupBucket *b = realloc(tab->buckets, sizeof(RollupBucket) * h.count[t]);
+            if (!b) { ok = 0; break; }
+            tab->buckets = b;
+            tab->cap = h.count[t];
+        }
+        tab->count = (int)fread(tab->buckets, sizeof(RollupBucket), h.count[t], fp);
+        if (tab->count != h.count[t]) ok = 0;
+    }
+    if (fp) fclose(fp);
+
+    struct stat st;
+    long size = stat(SALESFILE, &st) == 0 ? (long)st.st_size : 0;
+    if (!ok || h.covered > size) {
+        rollupReset();
+    } else {
+        rollups.covered = (long)h.covered;
+    }
+    rollupCatchUp();
+}
+
+/* fcntl lock on a byte range of fd (F_RDLCK, F_WRLCK or F_UNLCK); with
+   wait 0 gives up instead of blocking. Always succeeds when locking is off. */
+int fileLock(int fd, int type, off_t start, off_t len, int wait) {
+    if (!recordLocking) return 1;
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = (short)type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len;
+    while (fcntl(fd, wait ? LOCK_WAIT : LOCK_TRY, &fl) != 0)
+        if (errno != EINTR) return 0;
+    return 1;
+}
+
+int layoutLock(int fd, int type, int wait) {
+    return fileLock(fd, type, LAYOUT_LOCK, 1, wait);
+}
+
+/* Write a whole buffer, retrying short writes */
+int writeAll(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) { if (errno == EINTR) continue; return 0; }
+        p += n; len -= (size_t)n;
+    }
+    return 1;
+}
+
+/* Write a whole buffer at an offset */
+int pwriteAll(int fd, const char *p, size_t len, off_t at) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, at);
+        if (n < 0) { if (errno == EINTR) continue; return 0; }
+        p += n; len -= (size_t)n; at += n;
+    }
+    return 1;
+}
+
+/* One write of a commit (at -1 = append). Under --crash-test the process
+   dies at its fault point with half the bytes written, as a kill can
+   leave them. */
+int faultWrite(int point, int fd, const void *p, size_t len, off_t at) {
+    if (faultPoint == point) {
+        if (at < 0) writeAll(fd, p, len / 2); else pwriteAll(fd, p, len / 2, at);
+        _exit(FAULT_EXIT);
+    }
+    return at < 0 ? writeAll(fd, p, len) : pwriteAll(fd, p, len, at);
+}
+
+void faultCheck(int point) {
+    if (faultPoint == point) _exit(FAULT_EXIT);
+}
+
+unsigned int fnv1a(unsigned int h, const void *p, size_t len) {
+    const unsigned char *c = p;
+    while (len--) h = (h ^ *c++) * 16777619u;
+    return h;
+}
+
+unsigned int shadowChecksum(const ShadowHeader *h) {
+    ShadowHeader c = *h;
+    c.checksum = 0;
+    return fnv1a(2166136261u, &c, sizeof(c));
+}
+
+/* The last commit published in SHADOWFILE (seq 0 if there is none) and
+   the seq of the last one written back to DATAFILE */
+void shadowNewest(ShadowHeader *h, long long *applied) {
+    char buf[SHADOW_APPLIED + sizeof(long long)];
+    ssize_t n = shadow.fd >= 0 ? pread(shadow.fd, buf, sizeof(buf), 0) : -1;
+    memset(h, 0, sizeof(*h));
+    for (int i = 0; i < SHADOW_FILES; ++i) h->size[i] = -1;
+    *applied = 0;
+    for (int i = 0; i < 2 && n >= (ssize_t)(i * SHADOW_SLOT + sizeof(ShadowHeader)); ++i) {
+        ShadowHeader c;
+        memcpy(&c, buf + i * SHADOW_SLOT, sizeof(c));
+        if (c.magic == SHADOW_MAGIC && c.checksum == shadowChecksum(&c) && c.seq > h->seq) *h = c;
+    }
+    if (n == (ssize_t)sizeof(buf)) memcpy(applied, buf + SHADOW_APPLIED, sizeof(*applied));
+}
+
+/* Take the commit lock: this process's threads first, then other
+   terminals; with wait 0 give up if anyone holds it. Taken even when
+   record locking is off, since interleaved commits would leave SHADOWFILE
+   unreadable. */
+int shadowLock(int wait) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    if (!wait) {
+        if (pthread_mutex_trylock(&shadow.lock) != 0) return 0;
+    } else {
+        pthread_mutex_lock(&shadow.lock);
+    }
+    if (shadow.fd >= 0) {
+        int r;
+        while ((r = fcntl(shadow.fd, wait ? LOCK_WAIT : LOCK_TRY, &fl)) != 0 && errno == EINTR);
+        if (r == 0) return 1;
+    }
+    pthread_mutex_unlock(&shadow.lock);
+    return 0;
+}
+
+void shadowUnlock() {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fcntl(shadow.fd, LOCK_WAIT, &fl);
+    pthread_mutex_unlock(&shadow.lock);
+}
+
+/* Write a commit's pages back to DATAFILE, sync it and note the commit as
+   written back. Doing this twice is harmless, so a commit whose terminal
+   died on the way is simply done again. */
+int shadowApply(const ShadowHeader *h, const ShadowImage *img) {
+    int fd = fileno(inventory.fp);
+    for (int i = 0; i < h->pages; ++i)
+        if (!faultWrite(FAULT_APPLY, fd, img[i].data, SHADOW_PAGE, (off_t)img[i].page * SHADOW_PAGE)) return 0;
+    if (ftruncate(fd, (off_t)h->size[SHADOW_DATA]) != 0 || fdatasync(fd) != 0) return 0;
+    faultCheck(FAULT_APPLIED);
+    return pwriteAll(shadow.fd, (const char *)&h->seq, sizeof(h->seq), SHADOW_APPLIED);
+}
+
+/* Finish the last commit if its terminal died before writing it back, and
+   cut SALESFILE and the catalog program's logs back to the ends that
+   commit published, which drops a sale torn by a crash before its header.
+   Callers hold the commit lock. */
+int shadowRecover(ShadowHeader *h) {
+    long long applied;
+    struct stat st;
+    shadowNewest(h, &applied);
+    if (h->seq > 0 && applied != h->seq) {
+        size_t len = sizeof(ShadowImage) * h->pages;
+        ShadowImage *img = malloc(len ? len : 1);
+        int ok = img && pread(shadow.fd, img, len, (off_t)h->images) == (ssize_t)len && shadowApply(h, img);
+        free(img);
+        if (!ok) { perror("Unable to finish the last commit"); return 0; }
+    }
+    for (int i = SHADOW_SALES; i < SHADOW_FILES; ++i)
+        if (h->size[i] >= 0 && stat(shadowFiles[i], &st) == 0 && st.st_size > (off_t)h->size[i] &&
+            truncate(shadowFiles[i], (off_t)h->size[i]) != 0) {
+            perror("Unable to drop an unfinished sale");
+            return 0;
+        }
+    return 1;
+}
+
+/* Finish a commit a dead terminal published but never wrote back, before
+   records are read from DATAFILE. Costs one read when there is none; a
+   commit under way holds the lock and finishes it anyway. */
+void shadowCatchUp() {
+    ShadowHeader h;
+    long long applied;
+    shadowNewest(&h, &applied);
+    if (h.seq == applied || !shadowLock(0)) return;
+    shadowRecover(&h);
+    shadowUnlock();
+}
+
+int compareRecordImages(const void *a, const void *b) {
+    int x = ((const RecordImage *)a)->slot, y = ((const RecordImage *)b)->slot;
+    return (x > y) - (x < y);
+}
+
+/* Commit changed records and a sale (sale_len may be 0) together. The
+   DATAFILE pages the records fall on, and the header's with the
+   generation bumped, are read, patched and written to
+   SHADOWFILE clear of the last commit's, the sale is appended to
+   SALESFILE, and once both are synced one header write publishes them;
+   then the pages are written back in place. size is DATAFILE's new
+   length, -1 to keep it. Sorts recs. Returns 1 once the header is on
+   disk. A failure before that cuts SALESFILE back and leaves DATAFILE
+   as it was. */
+int shadowCommit(RecordImage *recs, int n, long long size, const char *sale, size_t sale_len) {
+    if (!inventory.fp || !shadowLock(1)) { perror("Unable to lock shadow file"); return 0; }
+    int fd = fileno(inventory.fp), sales_fd = groupCommit.sales_fd, pages = 0;
+    ShadowHeader last, h;
+    ShadowImage *img = NULL;
+    off_t sales_start = -1;
+    struct stat st;
+    uint32_t gen = 0;
+    int ok = shadowRecover(&last) && fstat(fd, &st) == 0;
+    if (ok && size < 0) size = st.st_size;
+
+    /* the header's page, then the pages the records fall on, in file
+       order, each read once */
+    qsort(recs, n, sizeof(RecordImage), compareRecordImages);
+    long long cap = (size + SHADOW_PAGE - 1) / SHADOW_PAGE;
+    if (cap > 2LL * n + 1) cap = 2LL * n + 1;
+    if (ok) ok = (img = malloc(sizeof(ShadowImage) * (size_t)(cap ? cap : 1))) != NULL;
+    if (ok) {
+        ssize_t got = pread(fd, img[0].data, SHADOW_PAGE, 0);
+        ok = got >= (ssize_t)sizeof(DataHeader);
+        if (ok) {
+            memset(img[0].data + got, 0, SHADOW_PAGE - (size_t)got);
+            img[pages++].page = 0;
+            memcpy(&gen, img[0].data + offsetof(DataHeader, generation), sizeof(gen));
+            gen++;
+            memcpy(img[0].data + offsetof(DataHeader, generation), &gen, sizeof(gen));
+        }
+    }
+    for (int i = 0; ok && i < n; ++i) {
+        long long from = dataOffset(recs[i].slot), to = from + DATA_RECORD;
+        if (to > size) continue;
+        for (long long pg = from / SHADOW_PAGE; ok && pg <= (to - 1) / SHADOW_PAGE; ++pg) {
+            if (pages > 0 && img[pages - 1].page == pg) continue;
+            ssize_t got = pread(fd, img[pages].data, SHADOW_PAGE, (off_t)pg * SHADOW_PAGE);
+            if (got < 0) { ok = 0; break; }
+            memset(img[pages].data + got, 0, SHADOW_PAGE - (size_t)got);
+            img[pages++].page = pg;
+        }
+        MedicineRecord disk;
+        medicineToRecord(&disk, &recs[i].rec);
+        disk.generation = gen;
+        const unsigned char *src = (const unsigned char *)&disk;
+        for (int k = pages - 1; k >= 0 && img[k].page >= from / SHADOW_PAGE; --k) {
+            long long base = img[k].page * SHADOW_PAGE;
+            long long a = from > base ? from : base, b = to < base + SHADOW_PAGE ? to : base + SHADOW_PAGE;
+            memcpy(img[k].data + (a - base), src + (a - from), (size_t)(b - a));
+        }
+    }
+
+    /* every log keeps its length but SALESFILE, when there is a sale; a
+       missing file counts as empty */
+    h = (ShadowHeader){ SHADOW_MAGIC, 0, last.seq + 1, { size }, SHADOW_IMAGES, pages, 0 };
+    for (int i = SHADOW_SALES; i < SHADOW_FILES; ++i)
+        h.size[i] = stat(shadowFiles[i], &st) == 0 ? (long long)st.st_size : 0;
+    if (ok && sale_len) {
+        sales_start = lseek(sales_fd, 0, SEEK_END);
+        ok = sales_start >= 0 && faultWrite(FAULT_SALES, sales_fd, sale, sale_len, -1);
+        h.size[SHADOW_SALES] = (long long)sales_start + (long long)sale_len;
+    }
+
+    /* images go where the last commit's are not: a torn header falls back
+       to that commit, which must still be there to finish */
+    long long len = (long long)sizeof(ShadowImage) * pages;
+    if (last.seq > 0 && last.images - SHADOW_IMAGES < len)
+        h.images = last.images + (long long)sizeof(ShadowImage) * last.pages;
+    ok = ok && faultWrite(FAULT_IMAGES, shadow.fd, img, (size_t)len, (off_t)h.images) &&
+         (!sale_len || fdatasync(sales_fd) == 0) && fdatasync(shadow.fd) == 0;
+    if (ok) faultCheck(FAULT_SYNCED);
+
+    h.checksum = shadowChecksum(&h);
+    ok = ok && faultWrite(FAULT_HEADER, shadow.fd, &h, sizeof(h), (off_t)(h.seq & 1) * SHADOW_SLOT) &&
+         fdatasync(shadow.fd) == 0;
+
+    if (ok) {
+        /* memory already holds what this wrote; it is only up to date if no
+           other terminal committed since it last looked */
+        if (inventory.generation == gen - 1) inventory.generation = gen;
+        faultCheck(FAULT_COMMITTED);
+        if (!shadowApply(&h, img)) perror("Unable to write data file (the commit stands and is finished by the next one)");
+    } else {
+        perror("Unable to commit");
+        if (sales_start >= 0 && ftruncate(sales_fd, sales_start) != 0) perror("Unable to roll back sale");
+    }
+    shadowUnlock();
+    free(img);
+    return ok;
+}
+
+/* Put a tombstoned slot on the free list */
+void inventoryFreeSlot(int slot) {
+    if (inventory.free_count == inventory.free_cap) {
+        int cap = inventory.free_cap ? inventory.free_cap * 2 : 64;
+        int *slots = realloc(inventory.free_slots, sizeof(int) * cap);
+        if (!slots) { perror("Unable to allocate inventory"); exit(1); }
+        inventory.free_slots = slots;
+        inventory.free_cap = cap;
+    }
+    inventory.free_slots[inventory.free_count++] = slot;
+}
+
+/* Medicines on file, not counting tombstones */
+int inventoryLive() {
+    return inventory.count - inventory.free_count;
+}
+
+/* Read every record of DATAFILE into memory and rebuild the indexes.
+   Changes not committed yet are dropped. The file's generation is taken
+   first, so a commit racing the read is read again by the next catch-up. */
+void inventoryRead() {
+    struct stat st;
+    DataHeader dh;
+    if (inventory.fp && pread(fileno(inventory.fp), &dh, sizeof(dh), 0) == (ssize_t)sizeof(dh))
+        inventory.generation = dh.generation;
+    inventory.count = 0;
+    inventory.max_id = 0;
+    inventory.free_count = 0;
+    inventory.dirty_count = 0;
+    if (inventory.fp && fstat(fileno(inventory.fp), &st) == 0 && st.st_size > DATA_HEADER) {
+        /* one mapping of the whole file; records are unpacked from it in
+           place, straight into their slots */
+        const unsigned char *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fileno(inventory.fp), 0);
+        if (map == MAP_FAILED) {
+            perror("Unable to map data file");
+        } else {
+            int n = (int)((st.st_size - DATA_HEADER) / DATA_RECORD);
+            const MedicineRecord *recs = (const MedicineRecord *)(map + DATA_HEADER);
+            inventoryReserve(n);
+            for (int i = 0; i < n; ++i) medicineFromRecord(&inventory.recs[i], &recs[i]);
+            inventory.count = n;
+            munmap((void *)map, (size_t)st.st_size);
+        }
+    }
+    for (int i = 0; i < inventory.count; ++i) {
+        if (inventory.recs[i].id > inventory.max_id) inventory.max_id = inventory.recs[i].id;
+        if (inventory.recs[i].id == 0) inventoryFreeSlot(i);
+    }
+    indexRebuild(inventory.count);
+    trigramBuild();
+    nameIndexBuild();
+    expiryIndexBuild();
+    reorderLoad();
+    lowStockBuild();
+    stockSyncAll();
+    for (int i = 0; i < inventory.count; ++i) versionBump(i);
+}
+
+/* Check DATAFILE's header, writing one into a new file (or over one a
+   crash tore while it was written). Returns 0 for a file in a legacy
+   layout or of another format version, which must be left alone. */
+int dataFileCheck(int fd) {
+    DataHeader fresh, h;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.magic = DATA_MAGIC;
+    fresh.version = DATA_VERSION;
+    fresh.header_size = DATA_HEADER;
+    fresh.record_size = DATA_RECORD;
+    if (!layoutLock(fd, F_WRLCK, 1)) { perror("Unable to lock data file"); return 0; }
+    struct stat st;
+    ssize_t got = fstat(fd, &st) == 0 ? pread(fd, &h, sizeof(h), 0) : -1;
+    int ok = 1;
+    if (got < 0) {
+        perror("Unable to read data file");
+        ok = 0;
+    } else if (got < (ssize_t)sizeof(h) && got == st.st_size && memcmp(&h, &fresh, (size_t)got) == 0) {
+        ok = pwriteAll(fd, (const char *)&fresh, sizeof(fresh), 0) && fdatasync(fd) == 0;
+        if (!ok) perror("Unable to write data file header");
+    } else if (got < (ssize_t)sizeof(h) || h.magic != DATA_MAGIC) {
+        printf("%s is in an older layout; convert it with --migrate-data\n", DATAFILE);
+        ok = 0;
+    } else if (h.version != DATA_VERSION || h.header_size != DATA_HEADER || h.record_size != DATA_RECORD) {
+        printf("%s is format version %u; this program reads version %d\n", DATAFILE, h.version, DATA_VERSION);
+        ok = 0;
+    }
+    layoutLock(fd, F_UNLCK, 1);
+    return ok;
+}
+
+/* Open DATAFILE (created up front: other terminals lock bytes of it) and
+   SHADOWFILE, finish a commit a terminal died in the middle of and load.
+   A DATAFILE this program cannot read ends the program. */
+void inventoryLoad() {
+    int fd = open(DATAFILE, O_RDWR | O_CREAT, 0644);
+    inventory.fp = fd >= 0 ? fdopen(fd, "rb+") : NULL;
+    if (!inventory.fp) perror("Unable to open data file");
+    else if (!dataFileCheck(fd)) exit(1);
+    shadow.fd = open(SHADOWFILE, O_RDWR | O_CREAT, 0644);
+    if (shadow.fd < 0) perror("Unable to open shadow file");
+    if (inventoryBeginChange()) inventoryEndChange();
+    else inventoryRead();
+}
+
+/* Close DATAFILE and SHADOWFILE; a forked terminal must not share them,
+   as their locks would be its locks too */
+void inventoryClose() {
+    if (inventory.fp) fclose(inventory.fp);
+    if (shadow.fd >= 0) close(shadow.fd);
+    inventory.fp = NULL;
+    shadow.fd = -1;
+}
+
+/* Take the layout lock exclusively and catch up with the file, so a change
+   made now is made to what is on file. Returns 0 if the lock could not be
+   taken. */
+int inventoryBeginChange() {
+    if (!inventory.fp || !layoutLock(fileno(inventory.fp), F_WRLCK, 1)) {
+        perror("Unable to lock data file");
+        return 0;
+    }
+    inventoryCatchUp();
+    return 1;
+}
+
+/* Commit every record changed since inventoryBeginChange, and the new
+   length of DATAFILE, as one shadow commit and let go of the layout. When
+   the commit fails the change is dropped by reading the file back.
+   Returns 1 on success. */
+int inventoryEndChange() {
+    long long size = dataOffset(inventory.count);
+    struct stat st;
+    int ok = 1;
+    if (inventory.dirty_count > 0 || (fstat(fileno(inventory.fp), &st) == 0 && st.st_size != (off_t)size)) {
+        RecordImage *recs = malloc(sizeof(RecordImage) * (inventory.dirty_count + 1));
+        int n = 0;
+        for (int i = 0; recs && i < inventory.dirty_count; ++i) {
+            int slot = inventory.dirty[i];
+            if (slot >= inventory.count) continue;
+            recs[n].slot = slot;
+            recs[n++].rec = inventory.recs[slot];
+        }
+        ok = recs && shadowCommit(recs, n, size, NULL, 0);
+        free(recs);
+        if (!ok) inventoryRead();
+    }
+    inventory.dirty_count = 0;
+    layoutLock(fileno(inventory.fp), F_UNLCK, 1);
+    return ok;
+}
+
+/* Note a changed slot for inventoryEndChange to commit */
+void inventoryMarkDirty(int slot) {
+    if (inventory.dirty_count == inventory.dirty_cap) {
+        int cap = inventory.dirty_cap ? inventory.dirty_cap * 2 : 64;
+        int *dirty = realloc(inventory.dirty, sizeof(int) * cap);
+        if (!dirty) { perror("Unable to allocate inventory"); exit(1); }
+        inventory.dirty = dirty;
+        inventory.dirty_cap = cap;
+    }
+    inventory.dirty[inventory.dirty_count++] = slot;
+}
+
+/* Put the record just stored in a slot into the indexes (the ID index
+   must have room for it) */
+void inventoryIndexSlot(int slot) {
+    const Medicine *m = &inventory.recs[slot];
+    indexInsert(m->id, slot);
+    if (m->id > inventory.max_id) inventory.max_id = m->id;
+    trigramAdd(m->name, m->id);
+    nameIndexInsert(m);
+    expiryIndexInsert(m);
+    inventory.reorder[slot] = REORDER_LEVEL;
+    inventory.heap_pos[slot] = -1;
+    lowStockUpdate(slot);
+    stockSync(slot);
+    versionBump(slot);
+}
+
+/* Take a slot's record out of every index; the record stays in the slot */
+void inventoryUnindex(int slot) {
+    const Medicine *m = &inventory.recs[slot];
+    trigramRemove(m->name, m->id);
+    nameIndexRemove(m);
+    expiryIndexRemove(m);
+    indexRemove(slot);
+    lowStockRemove(slot);
+    StockCounter *c = stockCounter(m->id, 0);
+    if (c && c->synced) {
+        atomic_fetch_sub(&c->available, c->synced);
+        c->synced = 0;
+    }
+}
+
+/* Add a new record to memory and the index, in a tombstoned slot if there
+   is one and otherwise at the end; inventoryEndChange writes it to DATAFILE */
+void inventoryAppend(const Medicine *m) {
+    int slot;
+    if (inventory.free_count > 0) {
+        slot = inventory.free_slots[--inventory.free_count];
+    } else {
+        inventoryReserve(inventory.count + 1);
+        slot = inventory.count++;
+    }
+    inventory.recs[slot] = *m;
+    indexReserve(inventory.count);
+    inventoryIndexSlot(slot);
+    inventoryMarkDirty(slot);
+}
+
+/* Overwrite a record in memory only, keeping the name and expiry indexes
+   and the low-stock heap current */
+void inventoryAdopt(int slot, const Medicine *m) {
+    Medicine *old = &inventory.recs[slot];
+    int renamed = strncmp(old->name, m->name, NAME_LEN) != 0;
+    if (renamed) {
+        trigramRemove(old->name, old->id);
+        trigramAdd(m->name, m->id);
+        nameIndexRemove(old);
+    }
+    int redated = expiryDayNumber(old) != expiryDayNumber(m);
+    if (redated) expiryIndexRemove(old);
+    *old = *m;
+    if (renamed) nameIndexInsert(old);
+    if (redated) expiryIndexInsert(old);
+    lowStockUpdate(slot);
+    stockSync(slot);
+    versionBump(slot);
+}
+
+/* Overwrite a record in memory, to be committed by inventoryEndChange */
+void inventoryReplace(int slot, const Medicine *m) {
+    inventoryAdopt(slot, m);
+    inventoryMarkDirty(slot);
+}
+
+/* Remove a record by leaving a tombstone in its slot: only that one record
+   is committed by inventoryEndChange (layout lock held exclusively) */
+int inventoryRemove(int id) {
+    int slot = inventoryFind(id);
+    if (slot < 0) return 0;
+    inventoryUnindex(slot);
+    int had_level = inventory.reorder[slot] != REORDER_LEVEL;
+    memset(&inventory.recs[slot], 0, sizeof(Medicine));
+    inventory.reorder[slot] = REORDER_LEVEL;
+    versionBump(slot);
+    inventoryFreeSlot(slot);
+    inventoryMarkDirty(slot);
+    /* IDs can be reused, so a deleted medicine's level must not linger */
+    if (had_level) reorderSave();
+    return 1;
+}
+
+/* Catch memory up with DATAFILE after other terminals committed to it,
+   under the commit lock so none commits meanwhile. Nothing is read when the
+   header's generation is the one memory was brought up to; otherwise only
+   the records committed since and the slots past either end are, each
+   going into the indexes on its own. With many changes one full read is
+   cheaper. Changes not committed yet are dropped. */
+void inventoryCatchUp() {
+    int fd = fileno(inventory.fp), locked = shadowLock(1), n = 0, nstale = 0;
+    int stale[REFRESH_MAX];
+    ShadowHeader h;
+    DataHeader dh;
+    struct stat st;
+    const unsigned char *map = MAP_FAILED;
+    if (locked) shadowRecover(&h);
+    int ok = pread(fd, &dh, sizeof(dh), 0) == (ssize_t)sizeof(dh) && fstat(fd, &st) == 0;
+    if (ok && st.st_size > DATA_HEADER) n = (int)((st.st_size - DATA_HEADER) / DATA_RECORD);
+    if (ok && dh.generation == inventory.generation && n == inventory.count && inventory.dirty_count == 0) {
+        if (reorderFileChanged(0)) reorderRefresh();
+        if (locked) shadowUnlock();
+        return;
+    }
+
+    /* the slots committed since, stopping once a full read is cheaper */
+    if (ok && n > 0) ok = (map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED;
+    const MedicineRecord *disk = map != MAP_FAILED ? (const MedicineRecord *)(map + DATA_HEADER) : NULL;
+    int kept = n < inventory.count ? n : inventory.count;
+    int changed = n < inventory.count ? inventory.count - n : n - inventory.count;
+    for (int i = 0; ok && i < kept && changed + nstale <= REFRESH_MAX; ++i) {
+        if ((int32_t)(disk[i].generation - inventory.generation) <= 0) continue;
+        if (nstale < REFRESH_MAX) stale[nstale] = i;
+        nstale++;
+    }
+    if (!ok || inventory.dirty_count > 0 || changed + nstale > REFRESH_MAX) {
+        if (map != MAP_FAILED) munmap((void *)map, (size_t)st.st_size);
+        inventoryRead();
+        if (locked) shadowUnlock();
+        return;
+    }
+
+    /* out of the indexes first: slots that now hold another medicine and
+       those past the end, so an ID that moved is never in them twice */
+    for (int k = 0; k < nstale; ++k) {
+        int i = stale[k];
+        if (inventory.recs[i].id && disk[i].id != inventory.recs[i].id) inventoryUnindex(i);
+    }
+    for (int i = kept; i < inventory.count; ++i)
+        if (inventory.recs[i].id) inventoryUnindex(i);
+    int prune = inventory.count > kept, old_free = inventory.free_count;
+    inventory.count = kept;
+    inventoryReserve(n);
+    indexReserve(n);
+
+    for (int k = 0; k < nstale; ++k) {
+        int i = stale[k];
+        Medicine m;
+        medicineFromRecord(&m, &disk[i]);
+        if (m.id == inventory.recs[i].id) {
+            if (m.id) inventoryAdopt(i, &m);
+            continue;
+        }
+        prune |= inventory.recs[i].id == 0;
+        if (!m.id) inventoryFreeSlot(i);
+        inventory.recs[i] = m;
+        if (m.id) inventoryIndexSlot(i);
+        else {
+            inventory.reorder[i] = REORDER_LEVEL;
+            versionBump(i);
+        }
+    }
+    for (int i = kept; i < n; ++i) {
+        medicineFromRecord(&inventory.recs[i], &disk[i]);
+        inventory.count = i + 1;
+        if (inventory.recs[i].id) {
+            inventoryIndexSlot(i);
+            continue;
+        }
+        inventory.reorder[i] = REORDER_LEVEL;
+        inventory.heap_pos[i] = -1;
+        versionBump(i);
+        inventoryFreeSlot(i);
+    }
+    if (map != MAP_FAILED) munmap((void *)map, (size_t)st.st_size);
+
+    /* tombstones that were filled or cut off leave the free list */
+    int kept_free = 0;
+    for (int k = 0; prune && k < inventory.free_count; ++k) {
+        int slot = inventory.free_slots[k];
+        if (k >= old_free || (slot < inventory.count && inventory.recs[slot].id == 0))
+            inventory.free_slots[kept_free++] = slot;
+    }
+    if (prune) inventory.free_count = kept_free;
+    inventory.generation = dh.generation;
+    reorderRefresh();
+    if (locked) shadowUnlock();
+}
+
+int compareSlots(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Close the tombstone gaps: the last live records move down into the
+   lowest free slots and DATAFILE is cut short after the last one, all in
+   the one commit of inventoryEndChange. Returns the slots reclaimed. */
+int inventoryCompact() {
+    int before = inventory.count, lo = 0;
+    qsort(inventory.free_slots, inventory.free_count, sizeof(int), compareSlots);
+    int hi = inventory.count;
+    while (hi > 0 && inventory.recs[hi - 1].id == 0) hi--;
+    while (lo < inventory.free_count && inventory.free_slots[lo] < hi) {
+        int from = hi - 1, to = inventory.free_slots[lo++];
+        inventory.recs[to] = inventory.recs[from];
+        inventory.reorder[to] = inventory.reorder[from];
+        memset(&inventory.recs[from], 0, sizeof(Medicine));
+        versionBump(to);
+        inventoryMarkDirty(to);
+        while (hi > 0 && inventory.recs[hi - 1].id == 0) hi--;
+    }
+    inventory.count = hi;
+    inventory.free_count = 0;
+    indexRebuild(inventory.count);
+    lowStockBuild();
+    return before - inventory.count;
+}
+
+/* Compact once tombstones make up COMPACT_DEAD_PERCENT of the slots
+   (inside a change) */
+int inventoryCompactDue() {
+    return inventory.free_count > 0 &&
+           inventory.free_count * 100 >= inventory.count * COMPACT_DEAD_PERCENT;
+}
+
+/* Save the rollups while no checkout of this terminal is in flight, since
+   those hold the layout lock this takes exclusively. The layout lock keeps
+   other terminals' saves apart; with wait 0 this gives up rather than
+   block. */
+void rollupCheckpoint(int wait) {
+    if (!inventory.fp || inventory.commits_in_flight > 0 ||
+        !layoutLock(fileno(inventory.fp), F_WRLCK, wait)) return;
+    if (rollupSave()) inventory.sales_since_save = 0;
+    layoutLock(fileno(inventory.fp), F_UNLCK, 1);
+}
+
+/* Open SALESFILE for the appends of group commit */
+int groupCommitOpen() {
+    groupCommit.sales_fd = open(SALESFILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (groupCommit.sales_fd < 0) {
+        perror("Unable to open sales history");
+        return 0;
+    }
+    return 1;
+}
+
+/* Append bytes to one stream of a batch (group commit lock held) */
+int batchAppend(CommitBatch *b, int stream, const void *data, size_t len) {
+    if (b->len[stream] + len > b->cap[stream]) {
+        size_t cap = b->cap[stream] ? b->cap[stream] * 2 : 4096;
+        while (cap < b->len[stream] + len) cap *= 2;
+        char *buf = realloc(b->buf[stream], cap);
+        if (!buf) return 0;
+        b->buf[stream] = buf;
+        b->cap[stream] = cap;
+    }
+    memcpy(b->buf[stream] + b->len[stream], data, len);
+    b->len[stream] += len;
+    return 1;
+}
+
+/* Write a batch: all its checkouts go in one shadow commit */
+int batchWrite(CommitBatch *b) {
+    return shadowCommit((RecordImage *)b->buf[GC_RECORDS], (int)(b->len[GC_RECORDS] / sizeof(RecordImage)), -1,
+                        b->buf[GC_SALES], b->len[GC_SALES]);
+}
+
+/* Queue one checkout's changed records and sale bytes into the open batch.
+   Called with the inventory lock held so sales are written in the order
+   stock changed. */
+CommitBatch *groupCommitSubmit(const void *recs, size_t recs_len, const void *sale, size_t sale_len) {
+    pthread_mutex_lock(&groupCommit.lock);
+    CommitBatch *b = groupCommit.tail;
+    int limit = groupCommit.enabled ? groupCommit.batch_size : 1;
+    if (groupCommit.failed) { pthread_mutex_unlock(&groupCommit.lock); return NULL; }
+    if (!b || b->closed || b->count >= limit) {
+        b = calloc(1, sizeof(CommitBatch));
+        if (!b) { pthread_mutex_unlock(&groupCommit.lock); return NULL; }
+        if (groupCommit.tail) groupCommit.tail->next = b; else groupCommit.head = b;
+        groupCommit.tail = b;
+    }
+    if (!batchAppend(b, GC_RECORDS, recs, recs_len) || !batchAppend(b, GC_SALES, sale, sale_len)) {
+        pthread_mutex_unlock(&groupCommit.lock);
+        return NULL;
+    }
+    b->count++;
+    b->waiting++;
+    groupCommit.commits++;
+    if (b->count >= limit) pthread_cond_broadcast(&groupCommit.cond);
+    pthread_mutex_unlock(&groupCommit.lock);
+    return b;
+}
+
+/* Block until a batch is durable; returns 1 on success. The first waiter
+   of the oldest batch writes it, optionally waiting up to window_us for
+   more checkouts to join. */
+int groupCommitWait(CommitBatch *b) {
+    pthread_mutex_lock(&groupCommit.lock);
+    while (!b->done) {
+        if (b != groupCommit.head || groupCommit.writing) {
+            pthread_cond_wait(&groupCommit.cond, &groupCommit.lock);
+            continue;
+        }
+        groupCommit.writing = 1;
+        if (groupCommit.enabled && groupCommit.window_us > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += groupCommit.window_us * 1000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            while (b->count < groupCommit.batch_size &&
+                   pthread_cond_timedwait(&groupCommit.cond, &groupCommit.lock, &deadline) != ETIMEDOUT);
+        }
+        b->closed = 1;
+        pthread_mutex_unlock(&groupCommit.lock);
+        int ok = batchWrite(b);
+        pthread_mutex_lock(&groupCommit.lock);
+        b->done = ok ? 1 : -1;
+        if (!ok) groupCommit.failed = 1;
+        groupCommit.head = b->next;
+        if (!groupCommit.head) groupCommit.tail = NULL;
+        groupCommit.writing = 0;
+        groupCommit.batches++;
+        pthread_cond_broadcast(&groupCommit.cond);
+    }
+    int ok = b->done > 0;
+    if (--b->waiting == 0) {
+        for (int s = 0; s < GC_STREAMS; ++s) free(b->buf[s]);
+        free(b);
+    }
+    pthread_mutex_unlock(&groupCommit.lock);
+    return ok;
+}
+
+/* Get next medicine ID (max ID + 1) */
+int getNextMedicineID() {
+    return inventory.max_id + 1;
+}
+
+/* Add a new medicine */
+void addMedicine() {
+    Medicine m = {0};   /* added without a category */
+
+    printf("\n--- Add New Medicine ---\n");
+    printf("Name: ");
+    getchar(); /* clear newline */
+    fgets(m.name, NAME_LEN, stdin);
+    m.name[strcspn(m.name, "\n")] = '\0';
+
+    printf("Price: ");
+    if (scanf("%lf", &m.price) != 1) { printf("Invalid input.\n"); while(getchar()!='\n'); return; }
+    printf("Quantity: ");
+    if (scanf("%d", &m.quantity) != 1) { printf("Invalid input.\n"); while(getchar()!='\n'); return; }
+    printf("Expiry Day (1-31): "); scanf("%d", &m.expiry_day);
+    printf("Expiry Month (1-12): "); scanf("%d", &m.expiry_month);
+    printf("Expiry Year (e.g., 2026): "); scanf("%d", &m.expiry_year);
+    if (!expiryDayNumber(&m)) { printf("Invalid expiry date.\n"); return; }
+
+    /* the ID is picked after reloading, so it is new to every terminal */
+    if (!inventoryBeginChange()) return;
+    m.id = getNextMedicineID();
+    inventoryAppend(&m);
+    if (!inventoryEndChange()) return;
+
+    printf("\nMedicine added with ID: %d\n", m.id);
+}
+
+/* Format a medicine as one display line (with the newline) */
+int formatMedicine(char *buf, size_t len, const Medicine *m) {
+    return snprintf(buf, len, "ID: %d | %.*s | Price: %.2f | Qty: %d | Exp: %02d-%02d-%04d\n",
+                    m->id, NAME_LEN, m->name, m->price, m->quantity,
+                    m->expiry_day, m->expiry_month, m->expiry_year);
+}
+
+/* Print a medicine (single) */
+void printMedicine(const Medicine *m) {
+    char line[NAME_LEN + 96];
+    formatMedicine(line, sizeof(line), m);
+    fputs(line, stdout);
+}
+
+/* View all medicines */
+void viewMedicines() {
+    printf("\n--- Medicine List ---\n");
+    for (int i = 0; i < inventory.count; ++i)
+        if (inventory.recs[i].id) printMedicine(&inventory.recs[i]);
+    if (inventoryLive() == 0) printf("No medicines in inventory.\n");
+}
+
+/* Search medicine by exact id, returns 1 and fills out if found */
+int searchMedicineByID(int id, Medicine *out) {
+    int slot = inventoryFind(id);
+    if (slot < 0) return 0;
+    if (out) *out = inventory.recs[slot];
+    return 1;
+}
+
+/* Slots of the medicines whose name contains `name` (case-insensitive), in
+   a malloc'd array; *count gets how many (-1 if out of memory) */
+int *nameMatches(const char *name, int *count) {
+    char needle[NAME_LEN];
+    strtolower_copy(name, needle, sizeof(needle));
+    size_t nlen = strlen(needle);
+    int *slots = malloc(sizeof(int) * (inventory.count + 1));
+    *count = slots ? 0 : -1;
+    if (!slots) return NULL;
+    int *ids;
+    int n = trigramCandidates(needle, &ids);
+    if (n >= 0) {
+        /* verify only the candidates: trigrams may match out of order */
+        for (int k = 0; k < n; ++k) {
+            int slot = inventoryFind(ids[k]);
+            if (NAME_MATCHES(&inventory.recs[slot], needle, nlen)) slots[(*count)++] = slot;
+        }
+        free(ids);
+    } else {
+        /* one or two characters: too short for trigrams, scan instead */
+        for (int i = 0; i < inventory.count; ++i)
+            if (inventory.recs[i].id && NAME_MATCHES(&inventory.recs[i], needle, nlen)) slots[(*count)++] = i;
+    }
+    return slots;
+}
+
+/* Search medicine by name (partial, case-insensitive) - prints matches */
+int searchMedicineByName(const char *name) {
+    if (inventoryLive() == 0) { printf("\nNo medicines available.\n"); return 0; }
+    printf("\nSearch results for \"%s\":\n", name);
+    int found;
+    int *slots = nameMatches(name, &found);
+    for (int i = 0; i < found; ++i) printMedicine(&inventory.recs[slots[i]]);
+    free(slots);
+    if (found <= 0) printf("No matches found.\n");
+    return found > 0;
+}
+
+/* Quick find: top matches for a typed name prefix, most stock first */
+void quickFindByPrefix(const char *prefix) {
+    int top[QUICKFIND_TOP];
+    int n = prefixTopMatches(prefix, QUICKFIND_TOP, top);
+    printf("\nTop matches for \"%s\":\n", prefix);
+    for (int i = 0; i < n; ++i) printMedicine(&inventory.recs[top[i]]);
+    if (n == 0) printf("No matches found.\n");
+}
+
+/* Update medicine (by id). Edits are applied to a freshly reloaded copy at
+   the end, so fields left alone keep what other terminals wrote meanwhile. */
+void updateMedicine() {
+    printf("\n--- Update Medicine ---\n");
+    printf("Enter medicine ID: ");
+    int id; if (scanf("%d", &id) != 1) { printf("Invalid input.\n"); while(getchar()!='\n'); return; }
+
+    int slot = inventoryFind(id);
+    if (slot < 0) { printf("Medicine with ID %d not found.\n", id); return; }
+
+    Medicine m = inventory.recs[slot];
+    printf("Existing record:\n"); printMedicine(&m);
+    getchar(); /* consume newline */
+    printf("New Name (leave blank to keep): ");
+    char newname[NAME_LEN]; fgets(newname, NAME_LEN, stdin);
+    if (newname[0] != '\n') newname[strcspn(newname, "\n")] = '\0';
+    else newname[0] = '\0';
+    printf("New Price (-1 to keep %.2f): ", m.price);
+    double newprice; if (scanf("%lf", &newprice) != 1) newprice = -1;
+    printf("New Quantity (-1 to keep %d): ", m.quantity);
+    int newqty; if (scanf("%d", &newqty) != 1) newqty = -1;
+    printf("New Expiry Day (0 to keep %d): ", m.expiry_day); int nd; if (scanf("%d", &nd) != 1) nd = 0;
+    printf("New Expiry Month (0 to keep %d): ", m.expiry_month); int nm; if (scanf("%d", &nm) != 1) nm = 0;
+    printf("New Expiry Year (0 to keep %d): ", m.expiry_year); int ny; if (scanf("%d", &ny) != 1) ny = 0;
+    printf("New Reorder Level (-1 to keep %d): ", inventory.reorder[slot]);
+    int nl; if (scanf("%d", &nl) != 1) nl = -1;
+
+    if (!inventoryBeginChange()) return;
+    slot = inventoryFind(id);
+    if (slot < 0) { inventoryEndChange(); printf("Medicine with ID %d was deleted meanwhile.\n", id); return; }
+    m = inventory.recs[slot];
+    if (newname[0]) strncpy(m.name, newname, NAME_LEN);
+    if (newprice >= 0) m.price = newprice;
+    if (newqty >= 0) m.quantity = newqty;
+    if (nd > 0) m.expiry_day = nd;
+    if (nm > 0) m.expiry_month = nm;
+    if (ny > 0) m.expiry_year = ny;
+    if (!expiryDayNumber(&m)) { inventoryEndChange(); printf("Invalid expiry date. Record not changed.\n"); return; }
+
+    inventoryReplace(slot, &m);
+    int ok = 1;
+    if (nl >= 0 && nl != inventory.reorder[slot]) {
+        inventory.reorder[slot] = nl;
+        lowStockUpdate(slot);
+        ok = reorderSave();
+    }
+    ok = inventoryEndChange() && ok;
+    if (ok) printf("Record updated.\n");
+}
+
+/* List medicines already expired, or expiring within `days` days, soonest
+   first: a binary search for the cut-off plus the entries listed */
+void viewExpiring(int days) {
+    int today = todayDayNumber();
+    int end = expiryLowerBound(days > 0 ? today + days + 1 : today, 0);
+    if (days > 0) printf("\n--- Expired or expiring within %d days ---\n", days);
+    else printf("\n--- Expired medicines ---\n");
+    for (int i = 0; i < end; ++i) {
+        const ExpiryEntry *e = &expiries.entries[i];
+        if (e->day < today) printf("[EXPIRED]  ");
+        else printf("[%3d days] ", e->day - today);
+        printMedicine(&inventory.recs[inventoryFind(e->id)]);
+    }
+    if (end == 0) printf("None.\n");
+}
+
+int compareLowStock(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return lowStockBefore(x, y) ? -1 : lowStockBefore(y, x);
+}
+
+/* Low-stock report: sorts a copy of the k queued slots, never the catalog */
+void viewLowStock() {
+    printf("\n--- Low Stock (below reorder level) ---\n");
+    int n = inventory.low_count;
+    if (n == 0) { printf("No medicines below their reorder level.\n"); return; }
+    int *order = malloc(sizeof(int) * n);
+    if (!order) { perror("Unable to allocate report"); return; }
+    memcpy(order, inventory.low_heap, sizeof(int) * n);
+    qsort(order, n, sizeof(int), compareLowStock);
+    for (int i = 0; i < n; ++i) {
+        printf("[reorder at %3d] ", inventory.reorder[order[i]]);
+        printMedicine(&inventory.recs[order[i]]);
+    }
+    free(order);
+}
+
+/* End-of-day report for one day: the day's bucket plus its 24 hourly
+   buckets, whatever the length of the history */
+void viewDailySales(int days_ago) {
+    time_t when = time(NULL) - (time_t)days_ago * 86400;
+    struct tm *t = localtime(&when);
+    char datestr[32];
+    strftime(datestr, sizeof(datestr), "%Y-%m-%d", t);
+    int day = dayNumber(t->tm_mday, t->tm_mon + 1, t->tm_year + 1900);
+
+    printf("\n--- Sales for %s ---\n", datestr);
+    rollupCatchUp();
+    const RollupTable *daily = &rollups.table[ROLLUP_DAILY];
+    int i = rollupLowerBound(daily, day);
+    if (i == daily->count || daily->buckets[i].key != day || daily->buckets[i].sales == 0) {
+        printf("No sales.\n");
+        return;
+    }
+    const RollupBucket *d = &daily->buckets[i];
+    double revenue = d->cents / 100.0;
+    printf("Sales: %d | Units: %lld\n", d->sales, d->units);
+    printf("Revenue: %.2f | VAT (%.0f%%): %.2f | Total: %.2f\n",
+           revenue, TAX_RATE * 100, revenue * TAX_RATE, revenue * (1 + TAX_RATE));
+
+    printf("\nHour  | Sales | Units | Revenue\n");
+    const RollupTable *hourly = &rollups.table[ROLLUP_HOURLY];
+    for (int h = rollupLowerBound(hourly, (long long)day * 24);
+         h < hourly->count && hourly->buckets[h].key < (long long)(day + 1) * 24; ++h) {
+        const RollupBucket *b = &hourly->buckets[h];
+        if (b->sales == 0) continue;
+        printf("%02lld:00 | %5d | %5lld | %.2f\n", b->key % 24, b->sales, b->units, b->cents / 100.0);
+    }
+}
+
+int compareBucketKey(const void *a, const void *b) {
+    const RollupBucket *x = a, *y = b;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+int compareBucketUnits(const void *a, const void *b) {
+    const RollupBucket *x = a, *y = b;
+    if (x->units != y->units) return x->units > y->units ? -1 : 1;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+const char *rollupMedicineName(int id) {
+    int slot = inventoryFind(id);
+    return slot >= 0 ? inventory.recs[slot].name : "(deleted)";
+}
+
+/* All-time best sellers from the per-medicine table */
+void viewTopSellers() {
+    printf("\n--- Top Sellers (all time) ---\n");
+    rollupCatchUp();
+    const RollupTable *t = &rollups.table[ROLLUP_MEDICINE];
+    if (t->count == 0) { printf("No sales.\n"); return; }
+    RollupBucket *order = malloc(sizeof(RollupBucket) * t->count);
+    if (!order) { perror("Unable to allocate report"); return; }
+    memcpy(order, t->buckets, sizeof(RollupBucket) * t->count);
+    qsort(order, t->count, sizeof(RollupBucket), compareBucketUnits);
+    for (int i = 0; i < t->count && i < TOP_SELLERS && order[i].units > 0; ++i)
+        printf("%2d) ID:%-5lld %-30s Units: %-6lld Sales: %-5d Revenue: %.2f\n", i + 1, order[i].key,
+               rollupMedicineName((int)order[i].key), order[i].units, order[i].sales, order[i].cents / 100.0);
+    free(order);
+}
+
+/* Units per day for every medicine sold in the last `days` days, with the
+   days of cover its current stock gives at that rate. Reads only the
+   per-medicine-per-day buckets inside the window. */
+void viewSalesVelocity(int days) {
+    printf("\n--- Sales velocity, last %d days ---\n", days);
+    rollupCatchUp();
+    const RollupTable *t = &rollups.table[ROLLUP_MEDICINE_DAILY];
+    int first = rollupLowerBound(t, (long long)(todayDayNumber() - days + 1) << 32);
+    int n = t->count - first;
+    RollupBucket *sold = malloc(sizeof(RollupBucket) * (n + 1));
+    if (!sold) { perror("Unable to allocate report"); return; }
+    /* re-key the window by medicine ID, then fold each medicine's days */
+    for (int i = 0; i < n; ++i) {
+        sold[i] = t->buckets[first + i];
+        sold[i].key = (unsigned int)sold[i].key;
+    }
+    qsort(sold, n, sizeof(RollupBucket), compareBucketKey);
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        if (m > 0 && sold[m - 1].key == sold[i].key) {
+            sold[m - 1].units += sold[i].units;
+            sold[m - 1].cents += sold[i].cents;
+            sold[m - 1].sales += sold[i].sales;
+        } else {
+            sold[m++] = sold[i];
+        }
+    }
+    n = m;
+    qsort(sold, n, sizeof(RollupBucket), compareBucketUnits);
+    int shown = 0;
+    for (int i = 0; i < n; ++i) {
+        if (sold[i].units <= 0) continue;
+        double per_day = (double)sold[i].units / days;
+        int slot = inventoryFind((int)sold[i].key);
+        printf("ID:%-5lld %-30s Units: %-6lld %7.2f/day", sold[i].key, rollupMedicineName((int)sold[i].key),
+               sold[i].units, per_day);
+        if (slot >= 0) printf(" | Stock: %-5d Cover: %.1f days", inventory.recs[slot].quantity,
+                              inventory.recs[slot].quantity / per_day);
+        printf("\n");
+        shown++;
+    }
+    if (shown == 0) printf("No sales.\n");
+    free(sold);
+}
+
+/* Delete medicine by id */
+void deleteMedicine() {
+    printf("\n--- Delete Medicine ---\n");
+    printf("Enter medicine ID: ");
+    int id; if (scanf("%d", &id) != 1) { printf("Invalid input.\n"); while(getchar()!='\n'); return; }
+
+    if (!inventoryBeginChange()) return;
+    int removed = inventoryRemove(id);
+    if (removed && inventoryCompactDue()) inventoryCompact();
+    if (!inventoryEndChange()) return;
+    if (removed) printf("Medicine with ID %d deleted.\n", id);
+    else printf("Medicine with ID %d not found.\n", id);
+}
+
+/* Compact DATAFILE on demand, whatever the share of tombstones.
+   Returns 1 on success. */
+int compactDataFile() {
+    if (!inventoryBeginChange()) return 0;
+    int reclaimed = inventoryCompact();
+    if (!inventoryEndChange()) return 0;
+    printf("Compacted %s: %d free slots reclaimed, %d medicines.\n", DATAFILE, reclaimed, inventory.count);
+    return 1;
+}
+
+/* Could this be a record of a legacy layout? All-zero records are
+   tombstones. Used to tell the two layouts apart. */
+int legacyStorePlausible(const LegacyStoreMedicine *m) {
+    static const LegacyStoreMedicine zero;
+    if (m->id == 0) return memcmp(m, &zero, sizeof(zero)) == 0;
+    return m->id > 0 && m->quantity >= 0 && m->price >= 0 && m->price < 1e9 &&
+           m->expiry_month >= 0 && m->expiry_month <= 12 && memchr(m->name, '\0', sizeof(m->name)) != NULL;
+}
+
+int legacyCatalogPlausible(const LegacyCatalogMedicine *m) {
+    return m->id > 0 && m->quantity >= 0 && m->price >= 0 && m->price < 1e9f &&
+           memchr(m->name, '\0', sizeof(m->name)) && memchr(m->category, '\0', sizeof(m->category)) &&
+           memchr(m->expiry_date, '\0', sizeof(m->expiry_date));
+}
+
+/* The legacy layout `size` bytes of DATAFILE are in: 1 this program's,
+   2 the catalog program's, 0 when neither or both fit */
+int legacyLayout(const unsigned char *data, size_t size) {
+    int store = size % sizeof(LegacyStoreMedicine) == 0, catalog = size % sizeof(LegacyCatalogMedicine) == 0;
+    for (size_t i = 0; store && i < size / sizeof(LegacyStoreMedicine); ++i)
+        store = legacyStorePlausible((const LegacyStoreMedicine *)data + i);
+    for (size_t i = 0; catalog && i < size / sizeof(LegacyCatalogMedicine); ++i)
+        catalog = legacyCatalogPlausible((const LegacyCatalogMedicine *)data + i);
+    return store == catalog ? 0 : store ? 1 : 2;
+}
+
+void legacyStoreToRecord(MedicineRecord *r, const LegacyStoreMedicine *m) {
+    memset(r, 0, sizeof(*r));
+    r->id = m->id;
+    r->quantity = m->quantity;
+    r->price = m->price;
+    r->expiry_day = m->expiry_day;
+    r->expiry_month = m->expiry_month;
+    r->expiry_year = m->expiry_year;
+    memcpy(r->name, m->name, strnlen(m->name, sizeof(m->name)));
+}
+
+/* The catalog program kept the expiry as DD/MM/YYYY text; anything else
+   becomes no date */
+void legacyCatalogToRecord(MedicineRecord *r, const LegacyCatalogMedicine *m) {
+    char date[sizeof(m->expiry_date) + 1];
+    int d, mo, y;
+    memset(r, 0, sizeof(*r));
+    r->id = m->id;
+    r->quantity = m->quantity;
+    r->price = m->price;
+    memcpy(r->name, m->name, strnlen(m->name, sizeof(m->name)));
+    memcpy(r->category, m->category, strnlen(m->category, sizeof(m->category)));
+    snprintf(date, sizeof(date), "%.*s", (int)sizeof(m->expiry_date), m->expiry_date);
+    if (sscanf(date, "%d/%d/%d", &d, &mo, &y) == 3 || sscanf(date, "%d-%d-%d", &d, &mo, &y) == 3) {
+        r->expiry_day = d;
+        r->expiry_month = mo;
+        r->expiry_year = y;
+    }
+}
+
+/* --migrate-data [store|catalog]: convert DATAFILE from a layout it had
+   before the header, this program's or the catalog program's, to the
+   current format. The layout is worked out from the records unless
+   given. A commit left unfinished is finished first; the converted file
+   replaces the old one in a single rename. Run it with the store closed. */
+int migrateDataFile(int argc, char **argv) {
+    int layout = 0;
+    if (argc > 0) layout = strcmp(argv[0], "store") == 0 ? 1 : strcmp(argv[0], "catalog") == 0 ? 2 : -1;
+    if (layout < 0) { printf("Usage: --migrate-data [store|catalog]\n"); return 1; }
+    int fd = open(DATAFILE, O_RDWR);
+    inventory.fp = fd >= 0 ? fdopen(fd, "rb+") : NULL;
+    if (!inventory.fp) { perror("Unable to open data file"); return 1; }
+    shadow.fd = open(SHADOWFILE, O_RDWR | O_CREAT, 0644);
+    ShadowHeader h;
+    if (!layoutLock(fd, F_WRLCK, 1) || !shadowLock(1)) { perror("Unable to lock data file"); inventoryClose(); return 1; }
+    int ok = shadowRecover(&h);
+
+    struct stat st;
+    unsigned char *data = NULL;
+    size_t size = 0;
+    ok = ok && fstat(fd, &st) == 0;
+    if (ok && (size = (size_t)st.st_size) > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) { perror("Unable to map data file"); data = NULL; ok = 0; }
+    }
+    int done = 0;
+    if (ok && size == 0) {
+        printf("%s is empty; it gets a header when the store is opened.\n", DATAFILE);
+        done = 1;
+    } else if (ok && size >= sizeof(uint32_t) && *(const uint32_t *)data == DATA_MAGIC) {
+        printf("%s is already in format version %u.\n", DATAFILE, ((const DataHeader *)data)->version);
+        done = 1;
+    } else if (ok && !layout && !(layout = legacyLayout(data, size))) {
+        printf("Cannot tell the layout of %s; name it: --migrate-data store|catalog\n", DATAFILE);
+        ok = 0;
+    }
+
+    int count = 0;
+    if (ok && !done) {
+        size_t rec_size = layout == 1 ? sizeof(LegacyStoreMedicine) : sizeof(LegacyCatalogMedicine);
+        count = (int)(size / rec_size);
+        MedicineRecord *out = calloc((size_t)count + 1, DATA_RECORD);
+        if (!out) { perror("Unable to allocate records"); exit(1); }
+        DataHeader *hdr = (DataHeader *)out;
+        hdr->magic = DATA_MAGIC;
+        hdr->version = DATA_VERSION;
+        hdr->header_size = DATA_HEADER;
+        hdr->record_size = DATA_RECORD;
+        for (int i = 0; i < count; ++i) {
+            if (layout == 1) legacyStoreToRecord(&out[i + 1], (const LegacyStoreMedicine *)data + i);
+            else legacyCatalogToRecord(&out[i + 1], (const LegacyCatalogMedicine *)(data + (size_t)i * rec_size));
+        }
+        int tmp = open(DATAFILE ".migrating", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok = tmp >= 0 && writeAll(tmp, (const char *)out, (size_t)dataOffset(count)) && fsync(tmp) == 0;
+        if (tmp >= 0 && close(tmp) != 0) ok = 0;
+        ok = ok && rename(DATAFILE ".migrating", DATAFILE) == 0;
+        if (!ok) { perror("Unable to write converted data file"); unlink(DATAFILE ".migrating"); }
+        free(out);
+    }
+    if (data) munmap(data, size);
+    shadowUnlock();
+    inventoryClose();
+    if (ok && !done)
+        printf("Converted %d records of %s from the %s layout to format version %d.\n",
+               count, DATAFILE, layout == 1 ? "store" : "catalog", DATA_VERSION);
+    return ok ? 0 : 1;
+}
+
+/* Append sale record (SALESFILE format) to a stream */
+void appendSaleRecord(FILE *fp, time_t when, const char *customer_name, const Cart *cart, double subtotal, double tax, double total) {
+    struct tm *t = localtime(&when);
+    char timestr[64];
+    strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", t);
+
+    fprintf(fp, "Purchase Time: %s\n", timestr);
+    if (customer_name && customer_name[0] != '\0')
+        fprintf(fp, "Customer: %s\n", customer_name);
+    else
+        fprintf(fp, "Customer: (not provided)\n");
+    fprintf(fp, "Items:\n");
+    for (int i = cart->head; i >= 0; i = cart->line[i].next) {
+        const CartItem *l = &cart->line[i];
+        fprintf(fp, " - %s | ID:%d | Qty:%d | Unit:%.2f | Line:%.2f\n",
+                l->name, l->med_id, l->qty, l->price, l->price * l->qty);
+    }
+    fprintf(fp, "Subtotal: %.2f\n", subtotal);
+    fprintf(fp, "VAT %.2f%%: %.2f\n", TAX_RATE * 100.0, tax);
+    fprintf(fp, "Total: %.2f\n", total);
+    fprintf(fp, SALE_SEPARATOR);
+}
+
+/* Re-read the locked records of joined cart lines from DATAFILE. Returns 0
+   when the file no longer lines up with memory (records added, removed or
+   moved by another terminal), which calls for a reload. */
+int inventoryRefresh(int fd, const CartJoin join[], int count) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != (off_t)dataOffset(inventory.count)) return 0;
+    for (int i = 0; i < count; ++i) {
+        int slot = join[i].slot;
+        MedicineRecord fresh, held;
+        if (pread(fd, &fresh, sizeof(fresh), (off_t)dataOffset(slot)) != (ssize_t)sizeof(fresh) ||
+            fresh.id != inventory.recs[slot].id) return 0;
+        medicineToRecord(&held, &inventory.recs[slot]);
+        held.generation = fresh.generation;
+        if (memcmp(&fresh, &held, sizeof(fresh)) != 0) {
+            Medicine m;
+            medicineFromRecord(&m, &fresh);
+            inventoryAdopt(slot, &m);
+        }
+    }
+    return 1;
+}
+
+/* Join a cart to the inventory: a cart holds each medicine once, so that
+   is one ID index probe per line. Fills out (room for cart->count entries)
+   and returns how many it wrote. Callers hold inventory.lock. */
+int cartJoin(const Cart *cart, CartJoin out[]) {
+    int n = 0;
+    for (int i = cart->head; i >= 0; i = cart->line[i].next) {
+        out[n].med_id = cart->line[i].med_id;
+        out[n].slot = inventoryFind(cart->line[i].med_id);
+        out[n++].qty = cart->line[i].qty;
+    }
+    return n;
+}
+
+int compareJoinSlots(const void *a, const void *b) {
+    return compareSlots(&((const CartJoin *)a)->slot, &((const CartJoin *)b)->slot);
+}
+
+/* Join a cart to the inventory and lock the DATAFILE slots it touches, in
+   file order so two checkouts never wait on each other, and bring them up
+   to date. join comes back sorted by slot, lines missing from the
+   inventory first. Returns the number of joined lines with the inventory
+   lock held, or -1. The slots stay put while the layout lock is held.
+   Closing fd drops every lock this took. */
+int lockSaleRecords(int fd, const Cart *cart, CartJoin join[]) {
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        if (!layoutLock(fd, F_RDLCK, 1)) return -1;
+        pthread_mutex_lock(&inventory.lock);
+        int n = cartJoin(cart, join), first = 0;
+        pthread_mutex_unlock(&inventory.lock);
+        qsort(join, n, sizeof(CartJoin), compareJoinSlots);
+        while (first < n && join[first].slot < 0) ++first;
+
+        int locked = 1;
+        for (int i = first; locked && i < n; ++i)
+            locked = fileLock(fd, F_WRLCK, (off_t)dataOffset(join[i].slot), DATA_RECORD, 1);
+        if (locked) shadowCatchUp();
+        pthread_mutex_lock(&inventory.lock);
+        if (locked && inventoryRefresh(fd, join + first, n - first)) return n;
+
+        /* another terminal changed the layout: catch up with the file */
+        inventoryCatchUp();
+        pthread_mutex_unlock(&inventory.lock);
+        fileLock(fd, F_UNLCK, 0, 0, 1);
+    }
+    return -1;
+}
+
+/* Commit a sale: reserve the cart's stock on the counters, join the cart to
+   the inventory and lock its records and re-read them from DATAFILE, reduce
+   stock in memory, then commit the changed records and the sale record
+   together through group commit; the locks go once they are written back.
+   Returns 1 on success, 0 if stock ran short or a line has expired
+   (nothing changed), -1 if the sale could not be written. */
+int commitSale(const char *customer_name, Cart *cart, double subtotal, double tax, double total) {
+    RecordImage *recs = malloc(sizeof(RecordImage) * (cart->count + 1));
+    CartJoin *join = malloc(sizeof(CartJoin) * (cart->count + 1));
+    char *sale = NULL;
+    size_t sale_len = 0;
+    FILE *out = open_memstream(&sale, &sale_len);
+    if (!recs || !join || !out) { free(recs); free(join); if (out) fclose(out); free(sale); return -1; }
+    appendSaleRecord(out, time(NULL), customer_name, cart, subtotal, tax, total);
+    fclose(out);
+
+    /* a descriptor of its own per checkout, so its locks are its own */
+    int today = todayDayNumber();
+    int fd = open(DATAFILE, O_RDWR);
+    if (fd < 0) { free(recs); free(join); free(sale); return -1; }
+
+    /* claim the stock without a lock; when it looks short another terminal
+       may have restocked, so re-read the cart's records once and retry */
+    int reserved = stockReserveCart(cart);
+    if (!reserved && lockSaleRecords(fd, cart, join) >= 0) {
+        pthread_mutex_unlock(&inventory.lock);
+        fileLock(fd, F_UNLCK, 0, 0, 1);
+        reserved = stockReserveCart(cart);
+    }
+    if (!reserved) {
+        close(fd);
+        free(recs); free(join); free(sale);
+        return 0;
+    }
+    int n = lockSaleRecords(fd, cart, join);
+    if (n < 0) {
+        stockReleaseCart(cart);
+        close(fd);
+        free(recs); free(join); free(sale);
+        return -1;
+    }
+    /* records can still be short of a reservation when another terminal
+       sold them since this one last looked */
+    for (int i = 0; i < n; ++i) {
+        int slot = join[i].slot;
+        if (slot < 0 || join[i].qty > inventory.recs[slot].quantity || isExpired(&inventory.recs[slot], today)) {
+            pthread_mutex_unlock(&inventory.lock);
+            stockReleaseCart(cart);
+            close(fd);
+            free(recs); free(join); free(sale);
+            return 0;
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        int slot = join[i].slot;
+        inventory.recs[slot].quantity -= join[i].qty;
+        stockConsume(slot, join[i].qty);
+        lowStockUpdate(slot);
+        versionBump(slot);
+        recs[i].slot = slot;
+        recs[i].rec = inventory.recs[slot];
+    }
+    inventory.commits_in_flight++;
+    CommitBatch *b = groupCommitSubmit(recs, sizeof(RecordImage) * n, sale, sale_len);
+    pthread_mutex_unlock(&inventory.lock);
+    free(sale);
+    free(recs);
+
+    /* once this returns the records are back in DATAFILE for other terminals */
+    int ok = b && groupCommitWait(b);
+
+    pthread_mutex_lock(&inventory.lock);
+    inventory.commits_in_flight--;
+    if (!ok) {
+        /* give the stock back; SALESFILE was cut back to before the batch */
+        for (int i = 0; i < n; ++i) {
+            inventory.recs[join[i].slot].quantity += join[i].qty;
+            lowStockUpdate(join[i].slot);
+            stockSync(join[i].slot);
+            versionBump(join[i].slot);
+        }
+    }
+    pthread_mutex_unlock(&inventory.lock);
+    close(fd);
+    free(join);
+    if (!ok) return -1;
+
+    /* save the rollups now and then, when no batch is in flight */
+    pthread_mutex_lock(&inventory.lock);
+    if (++inventory.sales_since_save >= ROLLUP_SAVE_SALES) {
+        pthread_mutex_lock(&groupCommit.lock);
+        if (!groupCommit.head) rollupCheckpoint(0);
+        pthread_mutex_unlock(&groupCommit.lock);
+    }
+    pthread_mutex_unlock(&inventory.lock);
+    return 1;
+}
+
+/* Read a YYYY-MM-DD date; an empty line leaves the limit open (day 0) */
+int readOptionalDate(const char *prompt, int *day) {
+    char buf[32];
+    int y, m, d;
+    printf("%s", prompt);
+    if (!fgets(buf, sizeof(buf), stdin)) return 0;
+    if (buf[0] == '\n') { *day = 0; return 1; }
+    if (sscanf(buf, "%d-%d-%d", &y, &m, &d) != 3) return 0;
+    *day = dayNumber(d, m, y);
+    return *day != 0;
+}
+
+/* Map SALESFILE; an empty or missing file gives an empty map */
+int salesMapOpen(SalesMap *m) {
+    m->data = NULL;
+    m->size = 0;
+    int fd = open(SALESFILE, O_RDONLY);
+    if (fd < 0) return errno == ENOENT;
+    struct stat st;
+    int ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) ok = 0;
+        else {
+            m->data = p;
+            m->size = (size_t)st.st_size;
+            madvise(p, m->size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    if (!ok) perror("Unable to map sales history");
+    return ok;
+}
+
+void salesMapClose(SalesMap *m) {
+    if (m->data) munmap((void *)m->data, m->size);
+    m->data = NULL;
+    m->size = 0;
+}
+
+/* Bounded helpers: the mapping has no terminating NUL */
+const char *lineEnd(const char *p, const char *end) {
+    const char *nl = memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+int spanStarts(const char *p, const char *end, const char *lit) {
+    size_t n = strlen(lit);
+    return (size_t)(end - p) >= n && memcmp(p, lit, n) == 0;
+}
+
+/* Unsigned decimal at *p; advances *p, returns -1 if there are no digits */
+long long parseDigits(const char **p, const char *end) {
+    const char *q = *p;
+    long long v = 0;
+    while (q < end && (unsigned char)(*q - '0') < 10) v = v * 10 + (*q++ - '0');
+    if (q == *p) return -1;
+    *p = q;
+    return v;
+}
+
+/* "123.45" as cents (two decimals, as appendSaleRecord prints them) */
+int parseCents(const char **p, const char *end, long long *cents) {
+    int neg = *p < end && **p == '-';
+    if (neg) ++*p;
+    long long whole = parseDigits(p, end), frac = 0;
+    if (whole < 0) return 0;
+    if (*p < end && **p == '.') {
+        ++*p;
+        for (int k = 0; k < 2; ++k) frac = frac * 10 + (*p < end && (unsigned char)(**p - '0') < 10 ? *(*p)++ - '0' : 0);
+        while (*p < end && (unsigned char)(**p - '0') < 10) ++*p;
+    }
+    *cents = neg ? -(whole * 100 + frac) : whole * 100 + frac;
+    return 1;
+}
+
+/* Value after the last ':' of a line, e.g. "VAT 5.00%: 0.13" */
+long long lineCents(const char *p, const char *eol) {
+    const char *colon = eol;
+    while (colon > p && colon[-1] != ':') --colon;
+    while (colon < eol && *colon == ' ') ++colon;
+    long long v = 0;
+    return parseCents(&colon, eol, &v) ? v : 0;
+}
+
+/* Parse the item line at *cursor and move past it; 0 at the end of the
+   record's items */
+int saleNextLine(const char **cursor, const char *items_end, SaleLine *l) {
+    while (*cursor < items_end) {
+        const char *p = *cursor, *eol = lineEnd(p, items_end);
+        *cursor = eol < items_end ? eol + 1 : items_end;
+        if (!spanStarts(p, eol, " - ")) continue;
+        /* the name may hold anything, so read from the last " | ID:" */
+        const char *id = eol;
+        while (id > p && !spanStarts(id, eol, " | ID:")) --id;
+        if (id == p) continue;
+        l->name = p + 3;
+        l->name_len = (int)(id - l->name);
+        const char *q = id + 6;
+        l->med_id = (int)parseDigits(&q, eol);
+        if (!spanStarts(q, eol, " | Qty:")) continue;
+        q += 7;
+        l->qty = (int)parseDigits(&q, eol);
+        if (!spanStarts(q, eol, " | Unit:")) continue;
+        q += 8;
+        if (!parseCents(&q, eol, &l->unit_cents) || !spanStarts(q, eol, " | Line:")) continue;
+        q += 8;
+        if (!parseCents(&q, eol, &l->line_cents)) continue;
+        return 1;
+    }
+    return 0;
+}
+
+/* Parse the next complete record from *cursor; 0 when none is left (a
+   torn last record without its separator line is not returned) */
+int saleParseNext(const char **cursor, const char *end, SaleRecord *r) {
+    const char *p = *cursor;
+    while (p < end) {
+        const char *eol = lineEnd(p, end);
+        if (!spanStarts(p, eol, "Purchase Time: ")) { p = eol < end ? eol + 1 : end; continue; }
+        const char *q = p + 15;
+        long long y = parseDigits(&q, eol), mo = -1, d = -1;
+        if (q < eol && *q == '-') { ++q; mo = parseDigits(&q, eol); }
+        if (q < eol && *q == '-') { ++q; d = parseDigits(&q, eol); }
+        memset(r, 0, sizeof(*r));
+        r->start = p;
+        r->when = p + 15;
+        r->when_len = (int)(eol - r->when);
+        r->day = dayNumber((int)d, (int)mo, (int)y);
+        int in_items = 0;
+        for (p = eol + 1; p < end; p = eol + 1) {
+            eol = lineEnd(p, end);
+            if (in_items && !spanStarts(p, eol, " - ")) { r->items_end = p; in_items = 0; }
+            if (spanStarts(p, eol, " - ")) {
+                if (!r->items) { r->items = p; in_items = 1; }
+                r->line_count++;
+            } else if (spanStarts(p, eol, "Customer: ")) {
+                r->customer = p + 10;
+                r->customer_len = (int)(eol - r->customer);
+                if (spanStarts(r->customer, eol, "(not provided)") && r->customer_len == 14) r->customer_len = 0;
+            } else if (spanStarts(p, eol, "Subtotal: ")) {
+                r->subtotal_cents = lineCents(p, eol);
+            } else if (spanStarts(p, eol, "VAT ")) {
+                r->tax_cents = lineCents(p, eol);
+            } else if (spanStarts(p, eol, "Total: ")) {
+                r->total_cents = lineCents(p, eol);
+            } else if (eol < end && (size_t)(eol + 1 - p) == strlen(SALE_SEPARATOR) &&
+                       memcmp(p, SALE_SEPARATOR, eol + 1 - p) == 0) {
+                if (!r->items) r->items = r->items_end = p;
+                if (in_items) r->items_end = p;
+                r->end = eol + 1;
+                *cursor = r->end;
+                return 1;
+            } else if (spanStarts(p, eol, "Purchase Time: ")) {
+                break;   /* record cut short; start over at this one */
+            }
+        }
+        if (p >= end) break;
+    }
+    *cursor = end;
+    return 0;
+}
+
+int saleMatches(const SaleRecord *r, const SaleFilter *f) {
+    if (f->first_day && r->day < f->first_day) return 0;
+    if (f->last_day && r->day > f->last_day) return 0;
+    if (f->customer[0] && (!r->customer_len || !ci_find_scalar(r->customer, r->customer_len, f->customer, strlen(f->customer))))
+        return 0;
+    if (f->med_id) {
+        const char *c = r->items;
+        SaleLine l;
+        while (saleNextLine(&c, r->items_end, &l))
+            if (l.med_id == f->med_id) return 1;
+        return 0;
+    }
+    return 1;
+}
+
+void printSaleRecord(const SaleRecord *r) {
+    printf("%.*s | ", r->when_len, r->when);
+    if (r->customer_len) printf("%.*s\n", r->customer_len, r->customer);
+    else printf("(no customer name)\n");
+    const char *c = r->items;
+    SaleLine l;
+    while (saleNextLine(&c, r->items_end, &l))
+        printf("   %-30.*s ID:%-5d Qty:%-4d Unit:%8.2f Line:%9.2f\n", l.name_len, l.name, l.med_id, l.qty,
+               l.unit_cents / 100.0, l.line_cents / 100.0);
+    printf("   Subtotal: %.2f  VAT: %.2f  Total: %.2f\n", r->subtotal_cents / 100.0, r->tax_cents / 100.0,
+           r->total_cents / 100.0);
+}
+
+/* Admin view sales history: filtered, HISTORY_PAGE sales per page, parsed
+   straight out of the mapped file */
+void viewSalesHistory() {
+    SaleFilter f;
+    memset(&f, 0, sizeof(f));
+    char buf[NAME_LEN];
+    getchar(); /* consume newline */
+    if (!readOptionalDate("From date (YYYY-MM-DD, Enter for the beginning): ", &f.first_day) ||
+        !readOptionalDate("To date (YYYY-MM-DD, Enter for no limit): ", &f.last_day)) {
+        printf("Invalid date.\n");
+        return;
+    }
+    printf("Customer name contains (Enter for any): ");
+    if (!fgets(buf, sizeof(buf), stdin)) return;
+    buf[strcspn(buf, "\n")] = '\0';
+    strtolower_copy(buf, f.customer, sizeof(f.customer));
+    printf("Medicine ID (Enter for any): ");
+    if (!fgets(buf, sizeof(buf), stdin)) return;
+    f.med_id = atoi(buf);
+
+    SalesMap map;
+    if (!salesMapOpen(&map)) return;
+    if (map.size == 0) { printf("\nNo sales history available.\n"); return; }
+    const char *end = map.data + map.size;
+    /* where each page shown so far starts, for paging back */
+    const char **pages = malloc(sizeof(const char *) * 16);
+    int page = 0, page_cap = 16;
+    if (!pages) { perror("Unable to allocate history view"); salesMapClose(&map); return; }
+    pages[0] = map.data;
+    for (;;) {
+        const char *cursor = pages[page];
+        SaleRecord r;
+        int shown = 0;
+        printf("\n--- Sales History (page %d) ---\n", page + 1);
+        while (shown < HISTORY_PAGE && saleParseNext(&cursor, end, &r)) {
+            if (!saleMatches(&r, &f)) continue;
+            printSaleRecord(&r);
+            shown++;
+        }
+        const char *next = cursor;
+        int more = 0;
+        while (saleParseNext(&cursor, end, &r))
+            if (saleMatches(&r, &f)) { more = 1; next = r.start; break; }
+        if (shown == 0) printf("No matching sales.\n");
+        if (!more) printf("(end of history)\n");
+
+        printf("[n]ext, [p]revious, [q]uit: ");
+        if (!fgets(buf, sizeof(buf), stdin) || buf[0] == 'q' || buf[0] == 'Q') break;
+        if ((buf[0] == 'p' || buf[0] == 'P') && page > 0) {
+            page--;
+        } else if ((buf[0] == 'n' || buf[0] == 'N' || buf[0] == '\n') && more) {
+            if (page + 1 == page_cap) {
+                const char **grown = realloc(pages, sizeof(const char *) * page_cap * 2);
+                if (!grown) break;
+                pages = grown;
+                page_cap *= 2;
+            }
+            pages[++page] = next;
+        } else if (buf[0] == '\n') {
+            break;
+        }
+    }
+    free(pages);
+    salesMapClose(&map);
+}
+
+/* Next chunk for a worker: the front of its own run, else the back of
+   another's; -1 once every run is empty */
+int scanTakeChunk(ScanWorker *w) {
+    ScanJob *job = w->job;
+    for (int k = 0; k < job->threads; ++k) {
+        ScanDeque *d = &job->deques[(w->self + k) % job->threads];
+        int chunk = -1;
+        pthread_mutex_lock(&d->lock);
+        if (d->head < d->tail) chunk = k == 0 ? d->head++ : --d->tail;
+        pthread_mutex_unlock(&d->lock);
+        if (chunk >= 0) { if (k > 0) w->totals.steals++; return chunk; }
+    }
+    return -1;
+}
+
+/* Read each chunk whole and parse the records in place */
+void *scanWorkerRun(void *arg) {
+    ScanWorker *w = arg;
+    ScanJob *job = w->job;
+    char *buf = NULL;
+    long cap = 0;
+    int chunk;
+    while ((chunk = scanTakeChunk(w)) >= 0) {
+        const ScanChunk *c = &job->chunks[chunk];
+        if (c->length > cap) {
+            char *grown = realloc(buf, c->length);
+            if (!grown) { w->totals.errors++; continue; }
+            buf = grown;
+            cap = c->length;
+        }
+        long done = 0;
+        while (done < c->length) {
+            ssize_t n = pread(job->fd, buf + done, c->length - done, c->offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        if (done != c->length) { w->totals.errors++; continue; }
+        w->totals.bytes += done;
+        const char *cursor = buf, *end = buf + done;
+        SaleRecord r;
+        SaleLine l;
+        while (saleParseNext(&cursor, end, &r)) {
+            if ((job->first_day && r.day < job->first_day) || (job->last_day && r.day > job->last_day)) continue;
+            w->totals.sales++;
+            for (const char *item = r.items; saleNextLine(&item, r.items_end, &l); ) {
+                w->totals.units += l.qty;
+                w->totals.cents += l.line_cents;
+            }
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+/* Offset just past the first record separator at or after `from` */
+long scanNextBoundary(FILE *fp, long from, long size) {
+    char line[256];
+    if (from <= 0) return 0;
+    if (fseek(fp, from - 1, SEEK_SET) != 0) return size;
+    /* a boundary that lands mid-line first skips the rest of that line */
+    if (fgetc(fp) != '\n' && !fgets(line, sizeof(line), fp)) return size;
+    while (fgets(line, sizeof(line), fp))
+        if (strcmp(line, SALE_SEPARATOR) == 0) return ftell(fp);
+    return size;
+}
+
+/* Totals of every sale between two days (inclusive, 0 = open) using
+   `threads` workers over SCAN_CHUNK_BYTES chunks of SALESFILE */
+int scanSales(int first_day, int last_day, int threads, ScanTotals *totals) {
+    memset(totals, 0, sizeof(*totals));
+    if (threads < 1) threads = 1;
+    if (threads > SCAN_MAX_THREADS) threads = SCAN_MAX_THREADS;
+    FILE *fp = fopen(SALESFILE, "r");
+    if (!fp) return 1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+
+    ScanJob job = { .threads = threads, .first_day = first_day, .last_day = last_day };
+    int n = 0, cap = (int)(size / SCAN_CHUNK_BYTES) + 2;
+    job.chunks = malloc(sizeof(ScanChunk) * cap);
+    job.deques = malloc(sizeof(ScanDeque) * threads);
+    ScanWorker *w = calloc(threads, sizeof(ScanWorker));
+    pthread_t *tid = malloc(sizeof(pthread_t) * threads);
+    if (!job.chunks || !job.deques || !w || !tid) { perror("Unable to start scan"); exit(1); }
+    for (long start = 0; start < size && n < cap; ) {
+        long end = scanNextBoundary(fp, start + SCAN_CHUNK_BYTES, size);
+        job.chunks[n].offset = start;
+        job.chunks[n].length = end - start;
+        n++;
+        start = end;
+    }
+    fclose(fp);
+
+    job.fd = open(SALESFILE, O_RDONLY);
+    if (job.fd < 0) { perror("Unable to open sales history"); free(job.chunks); free(job.deques); free(w); free(tid); return 0; }
+    /* neighbouring chunks start in the same run so each worker reads ahead */
+    for (int t = 0; t < threads; ++t) {
+        pthread_mutex_init(&job.deques[t].lock, NULL);
+        job.deques[t].head = (int)((long long)n * t / threads);
+        job.deques[t].tail = (int)((long long)n * (t + 1) / threads);
+        w[t].job = &job;
+        w[t].self = t;
+    }
+    int started = 1;
+    for (int t = 1; t < threads && pthread_create(&tid[t], NULL, scanWorkerRun, &w[t]) == 0; ++t) started++;
+    scanWorkerRun(&w[0]);
+    for (int t = 0; t < threads; ++t) {
+        if (t > 0 && t < started) pthread_join(tid[t], NULL);
+        totals->sales += w[t].totals.sales;
+        totals->units += w[t].totals.units;
+        totals->cents += w[t].totals.cents;
+        totals->bytes += w[t].totals.bytes;
+        totals->steals += w[t].totals.steals;
+        totals->errors += w[t].totals.errors;
+        pthread_mutex_destroy(&job.deques[t].lock);
+    }
+    close(job.fd);
+    free(job.chunks); free(job.deques); free(w); free(tid);
+    return totals->errors == 0;
+}
+
+int scanThreadCount() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) return 1;
+    return cores > SCAN_MAX_THREADS ? SCAN_MAX_THREADS : (int)cores;
+}
+
+/* Sales totals for a date range from a parallel scan of SALESFILE */
+void viewSalesTotals() {
+    int first_day, last_day;
+    getchar(); /* consume newline */
+    if (!readOptionalDate("From date (YYYY-MM-DD, Enter for the beginning): ", &first_day) ||
+        !readOptionalDate("To date (YYYY-MM-DD, Enter for no limit): ", &last_day)) {
+        printf("Invalid date.\n");
+        return;
+    }
+    ScanTotals t;
+    int threads = scanThreadCount();
+    double t0 = nowSeconds();
+    if (!scanSales(first_day, last_day, threads, &t)) printf("Warning: parts of the sales history could not be read.\n");
+    double revenue = t.cents / 100.0;
+    printf("\n--- Sales Totals ---\n");
+    printf("Sales: %lld | Units: %lld\n", t.sales, t.units);
+    printf("Revenue: %.2f | VAT (%.0f%%): %.2f | Total: %.2f\n",
+           revenue, TAX_RATE * 100, revenue * TAX_RATE, revenue * (1 + TAX_RATE));
+    printf("Scanned %.1f MB with %d threads in %.3f s\n", t.bytes / 1048576.0, threads, nowSeconds() - t0);
+}
+
+/* Admin menu */
+void adminMenu() {
+    char pass[64];
+    printf("\nEnter admin password: ");
+    getchar(); /* consume newline */
+    fgets(pass, sizeof(pass), stdin);
+    pass[strcspn(pass, "\n")] = '\0';
+    if (strcmp(pass, ADMIN_PASS) != 0) {
+        printf("Incorrect password.\n");
+        return;
+    }
+
+    int choice;
+    do {
+        printf("\n--- Admin Panel ---\n");
+        printf("1. Add Medicine\n");
+        printf("2. View All Medicines\n");
+        printf("3. Search Medicine by Name\n");
+        printf("4. Update Medicine\n");
+        printf("5. Delete Medicine\n");
+        printf("6. View Sales History\n");
+        printf("7. Expired / Expiring Medicines\n");
+        printf("8. Low Stock Report\n");
+        printf("9. End-of-Day Sales Report\n");
+        printf("10. Top Sellers\n");
+        printf("11. Sales Velocity\n");
+        printf("12. Rebuild Sales Rollups from History\n");
+        printf("13. Sales Totals by Date Range\n");
+        printf("14. Compact Data File\n");
+        printf("0. Back to Main Menu\n");
+        printf("Choice: "); if (scanf("%d", &choice) != 1) { while(getchar()!='\n'); choice = -1; }
+
+        switch (choice) {
+            case 1: addMedicine(); break;
+            case 2: viewMedicines(); break;
+            case 3: {
+                char keyword[NAME_LEN];
+                printf("Enter name keyword: ");
+                getchar(); fgets(keyword, NAME_LEN, stdin);
+                keyword[strcspn(keyword, "\n")] = '\0';
+                searchMedicineByName(keyword);
+                break;
+            }
+            case 4: updateMedicine(); break;
+            case 5: deleteMedicine(); break;
+            case 6: viewSalesHistory(); break;
+            case 7: {
+                printf("Expiring within how many days (0 = already expired): ");
+                int days; if (scanf("%d", &days) != 1 || days < 0) { printf("Invalid input.\n"); while(getchar()!='\n'); break; }
+                viewExpiring(days);
+                break;
+            }
+            case 8: viewLowStock(); break;
+            case 9: {
+                printf("Days ago (0 = today): ");
+                int days; if (scanf("%d", &days) != 1 || days < 0) { printf("Invalid input.\n"); while(getchar()!='\n'); break; }
+                viewDailySales(days);
+                break;
+            }
+            case 10: viewTopSellers(); break;
+            case 11: {
+                printf("Window in days (e.g., 30): ");
+                int days; if (scanf("%d", &days) != 1 || days <= 0) { printf("Invalid input.\n"); while(getchar()!='\n'); break; }
+                viewSalesVelocity(days);
+                break;
+            }
+            case 12:
+                rollupRebuild();
+                if (rollupSave()) printf("Rollups rebuilt: %d days, %d medicines.\n",
+                                         rollups.table[ROLLUP_DAILY].count, rollups.table[ROLLUP_MEDICINE].count);
+                break;
+            case 13: viewSalesTotals(); break;
+            case 14: compactDataFile(); break;
+            case 0: break;
+            default: printf("Invalid choice.\n");
+        }
+        pressEnterToContinue();
+    } while (choice != 0);
+}
+
+void cartInit(Cart *c) {
+    memset(c, 0, sizeof(*c));
+    c->head = c->tail = c->free_line = -1;
+}
+
+void cartFree(Cart *c) {
+    free(c->line);
+    free(c->index);
+    cartInit(c);
+}
+
+/* Empty a cart, keeping its pool for the next customer */
+void cartClear(Cart *c) {
+    if (c->head >= 0) {
+        c->line[c->tail].next = c->free_line;
+        c->free_line = c->head;
+    }
+    if (c->index) memset(c->index, -1, sizeof(int) * c->index_cap);
+    c->head = c->tail = -1;
+    c->count = 0;
+    c->subtotal_cents = 0;
+}
+
+long long cartLineCents(const CartItem *l) {
+    return (long long)(l->price * 100.0 + 0.5) * l->qty;
+}
+
+void cartIndexInsert(Cart *c, int i) {
+    unsigned int mask = (unsigned int)c->index_cap - 1, b = hashMedicineID(c->line[i].med_id) & mask;
+    while (c->index[b] != -1) b = (b + 1) & mask;
+    c->index[b] = i;
+}
+
+/* Line holding a medicine, or -1 */
+int cartFind(const Cart *c, int med_id) {
+    if (c->count == 0) return -1;
+    unsigned int mask = (unsigned int)c->index_cap - 1;
+    for (unsigned int b = hashMedicineID(med_id) & mask; c->index[b] != -1; b = (b + 1) & mask)
+        if (c->line[c->index[b]].med_id == med_id) return c->index[b];
+    return -1;
+}
+
+/* Double the line pool, chaining the new lines onto the free list, and
+   index the lines again at twice the new size */
+void cartGrow(Cart *c) {
+    int cap = c->cap ? c->cap * 2 : 16;
+    CartItem *line = realloc(c->line, sizeof(CartItem) * cap);
+    if (!line) { perror("Unable to allocate cart"); exit(1); }
+    c->line = line;
+    free(c->index);
+    c->index = malloc(sizeof(int) * cap * 2);
+    if (!c->index) { perror("Unable to allocate cart"); exit(1); }
+    c->index_cap = cap * 2;
+    memset(c->index, -1, sizeof(int) * c->index_cap);
+    for (int i = c->cap; i < cap; ++i) line[i].next = i + 1 < cap ? i + 1 : c->free_line;
+    c->free_line = c->cap;
+    c->cap = cap;
+    for (int i = c->head; i >= 0; i = line[i].next) cartIndexInsert(c, i);
+}
+
+/* Line holding a medicine, added empty at the end of the cart if the
+   medicine is not in it yet */
+int cartLine(Cart *c, int med_id) {
+    int i = cartFind(c, med_id);
+    if (i >= 0) return i;
+    if (c->free_line < 0) cartGrow(c);
+    i = c->free_line;
+    c->free_line = c->line[i].next;
+    memset(&c->line[i], 0, sizeof(CartItem));
+    c->line[i].med_id = med_id;
+    c->line[i].prev = c->tail;
+    c->line[i].next = -1;
+    if (c->tail >= 0) c->line[c->tail].next = i; else c->head = i;
+    c->tail = i;
+    c->count++;
+    cartIndexInsert(c, i);
+    return i;
+}
+
+/* Take a line out of the cart. Entries further along its probe cluster
+   move back into the gap unless their home bucket lies past it. */
+void cartRemove(Cart *c, int i) {
+    unsigned int mask = (unsigned int)c->index_cap - 1, gap = hashMedicineID(c->line[i].med_id) & mask;
+    while (c->index[gap] != i) gap = (gap + 1) & mask;
+    for (unsigned int b = (gap + 1) & mask; c->index[b] != -1; b = (b + 1) & mask) {
+        unsigned int home = hashMedicineID(c->line[c->index[b]].med_id) & mask;
+        if (((b - home) & mask) >= ((b - gap) & mask)) { c->index[gap] = c->index[b]; gap = b; }
+    }
+    c->index[gap] = -1;
+
+    CartItem *l = &c->line[i];
+    c->subtotal_cents -= cartLineCents(l);
+    if (l->prev >= 0) c->line[l->prev].next = l->next; else c->head = l->next;
+    if (l->next >= 0) c->line[l->next].prev = l->prev; else c->tail = l->prev;
+    l->next = c->free_line;
+    c->free_line = i;
+    c->count--;
+}
+
+/* Line shown as item number num (from 1) in the cart, or -1 */
+int cartAt(const Cart *c, int num) {
+    int i = c->head;
+    while (i >= 0 && --num > 0) i = c->line[i].next;
+    return num == 0 ? i : -1;
+}
+
+void cartSetQty(Cart *c, int i, int qty) {
+    c->subtotal_cents -= cartLineCents(&c->line[i]);
+    c->line[i].qty = qty;
+    c->subtotal_cents += cartLineCents(&c->line[i]);
+}
+
+/* Price a cart line from the record in a slot */
+void cartTake(Cart *c, int i, int slot) {
+    const Medicine *m = &inventory.recs[slot];
+    CartItem *line = &c->line[i];
+    c->subtotal_cents -= cartLineCents(line);
+    line->med_id = m->id;
+    strncpy(line->name, m->name, NAME_LEN);
+    line->price = m->price;
+    line->version = inventory.version[slot];
+    c->subtotal_cents += cartLineCents(line);
+}
+
+/* Print the cart's lines in the order they were added */
+void cartPrint(const Cart *c) {
+    int num = 0;
+    for (int i = c->head; i >= 0; i = c->line[i].next) {
+        const CartItem *l = &c->line[i];
+        printf("%d) %s | Unit: %.2f | Qty: %d | Line: %.2f\n", ++num, l->name, l->price, l->qty, l->price * l->qty);
+    }
+}
+
+/* Check a cart before checkout in one pass. A line whose record still has
+   the version it was taken at was in stock then and is now, so only the
+   expiry date (which passes without a change) is checked. A changed record
+   is looked at again: the line gets its current name and price and stock
+   is checked. Returns 0 if the cart can go through, 1 with msg set if it
+   cannot, 2 with msg set if a price changed (the cart has the new prices,
+   so its totals must be shown again). Callers hold inventory.lock or are
+   the only thread. */
+int cartValidate(Cart *cart, char *msg, size_t len) {
+    int today = todayDayNumber(), repriced = 0;
+    for (int i = cart->head; i >= 0; i = cart->line[i].next) {
+        const CartItem *l = &cart->line[i];
+        int slot = inventoryFind(l->med_id);
+        if (slot < 0) { snprintf(msg, len, "%s is no longer available.", l->name); return 1; }
+        const Medicine *m = &inventory.recs[slot];
+        if (isExpired(m, today)) { snprintf(msg, len, "%.*s has expired.", NAME_LEN, m->name); return 1; }
+        if (l->version == inventory.version[slot]) continue;
+        if (l->qty > m->quantity) { snprintf(msg, len, "insufficient stock for %.*s during checkout.", NAME_LEN, m->name); return 1; }
+        if (l->price != m->price && !repriced++)
+            snprintf(msg, len, "the price of %.*s is now %.2f; please review the cart.", NAME_LEN, m->name, m->price);
+        cartTake(cart, i, slot);
+    }
+    return repriced ? 2 : 0;
+}
+
+/* Customer purchase flow with add/remove cart and checkout */
+void customerMenu() {
+    Cart cart;
+    cartInit(&cart);
+    int choice;
+
+    do {
+        printf("\n--- Customer Menu ---\n");
+        printf("1. Browse all medicines\n");
+        printf("2. Search medicine by name\n");
+        printf("3. Add medicine to cart (by ID)\n");
+        printf("4. Remove item from cart\n");
+        printf("5. View cart\n");
+        printf("6. Checkout\n");
+        printf("7. Quick find by name prefix\n");
+        printf("0. Back to Main Menu\n");
+        printf("Choice: "); if (scanf("%d", &choice) != 1) { while(getchar()!='\n'); choice = -1; }
+
+        if (choice == 1) {
+            viewMedicines();
+        } else if (choice == 2) {
+            char keyword[NAME_LEN];
+            printf("Enter name keyword: ");
+            getchar(); fgets(keyword, NAME_LEN, stdin);
+            keyword[strcspn(keyword, "\n")] = '\0';
+            searchMedicineByName(keyword);
+        } else if (choice == 3) {
+            printf("Enter medicine ID to add: ");
+            int id; if (scanf("%d", &id) != 1) { printf("Invalid.\n"); while(getchar()!='\n'); continue; }
+            int slot = inventoryFind(id);
+            if (slot < 0) { printf("Medicine not found.\n"); continue; }
+            Medicine m = inventory.recs[slot];
+            if (m.quantity <= 0) { printf("Out of stock.\n"); continue; }
+            if (isExpired(&m, todayDayNumber())) { printf("%s has expired and cannot be sold.\n", m.name); continue; }
+            printf("Available quantity: %d\nEnter desired quantity: ", m.quantity);
+            int q; if (scanf("%d", &q) != 1 || q <= 0) { printf("Invalid qty.\n"); while(getchar()!='\n'); continue; }
+            if (q > m.quantity) { printf("Only %d units available.\n", m.quantity); continue; }
+
+            /* If already in cart, increase qty; the line is re-taken from the
+               record so its version vouches for the new total */
+            int line = cartFind(&cart, id);
+            if (line >= 0 && cart.line[line].qty + q > m.quantity) { printf("Only %d units available, some already in your cart.\n", m.quantity); continue; }
+            line = cartLine(&cart, id);
+            cartTake(&cart, line, slot);
+            cartSetQty(&cart, line, cart.line[line].qty + q);
+            printf("%d x %s added to cart.\n", q, m.name);
+        } else if (choice == 4) {
+            if (cart.count == 0) { printf("Cart is empty.\n"); continue; }
+            printf("\n--- Remove from Cart ---\n");
+            int num = 0;
+            for (int i = cart.head; i >= 0; i = cart.line[i].next)
+                printf("%d) %s | Qty: %d\n", ++num, cart.line[i].name, cart.line[i].qty);
+            printf("Enter item number to remove (0 to cancel): ");
+            if (scanf("%d", &num) != 1) { printf("Invalid.\n"); while(getchar()!='\n'); continue; }
+            if (num <= 0) { printf("Cancelled.\n"); continue; }
+            if (num > cart.count) { printf("Invalid item number.\n"); continue; }
+            cartRemove(&cart, cartAt(&cart, num));
+            printf("Item removed from cart.\n");
+        } else if (choice == 5) {
+            if (cart.count == 0) { printf("Cart is empty.\n"); }
+            else {
+                printf("\n--- Your Cart ---\n");
+                cartPrint(&cart);
+                printf("Subtotal: %.2f\n", cart.subtotal_cents / 100.0);
+            }
+        } else if (choice == 6) {
+            if (cart.count == 0) { printf("Cart empty — add items first.\n"); continue; }
+            /* Bring changed lines up to date so the invoice has current prices */
+            char problem[NAME_LEN + 64];
+            int check = cartValidate(&cart, problem, sizeof(problem));
+            if (check == 1) { printf("Error: %s\n", problem); continue; }
+            if (check == 2) printf("Note: %s\n", problem);
+            /* Show invoice */
+            printf("\n--- Invoice ---\n");
+            cartPrint(&cart);
+            double subtotal = cart.subtotal_cents / 100.0;
+            double tax = subtotal * TAX_RATE;
+            double total = subtotal + tax;
+            printf("Subtotal: %.2f\nVAT (%.0f%%): %.2f\nTotal: %.2f\n", subtotal, TAX_RATE*100, tax, total);
+
+            printf("Proceed to payment? (1 = Yes, 0 = No): ");
+            int pay; if (scanf("%d", &pay) != 1) { printf("Invalid.\n"); while(getchar()!='\n'); continue; }
+            if (pay == 1) {
+                /* Optionally ask customer name (can be blank) */
+                char customer_name[NAME_LEN];
+                printf("Enter your name (press Enter to skip): ");
+                getchar(); /* consume newline */
+                fgets(customer_name, NAME_LEN, stdin);
+                customer_name[strcspn(customer_name, "\n")] = '\0';
+
+                /* Check the cart again before touching anything */
+                check = cartValidate(&cart, problem, sizeof(problem));
+                int ok = check ? 0 : commitSale(customer_name, &cart, subtotal, tax, total);
+                if (check) {
+                    printf("Error: %s\n", problem);
+                } else if (ok == 0) {
+                    printf("Checkout failed due to stock issue. Please adjust cart.\n");
+                } else if (ok < 0) {
+                    printf("Error: unable to record the sale. Checkout aborted.\n");
+                } else {
+                    printf("Payment successful. Thank you for your purchase!\n");
+                    /* clear cart */
+                    cartClear(&cart);
+                }
+            } else {
+                printf("Checkout cancelled.\n");
+            }
+        } else if (choice == 7) {
+            char prefix[NAME_LEN];
+            printf("Enter the start of the name: ");
+            getchar(); fgets(prefix, NAME_LEN, stdin);
+            prefix[strcspn(prefix, "\n")] = '\0';
+            quickFindByPrefix(prefix);
+        } else if (choice == 0) {
+            break;
+        } else {
+            printf("Invalid choice.\n");
+        }
+        pressEnterToContinue();
+    } while (1);
+    cartFree(&cart);
+}
+
+/* Server mode: one process owns the inventory and serves customer
+   terminals over a Unix domain socket. Requests are single lines; every
+   reply starts with "OK <lines> [message]" or "ERR <message>", followed by
+   <lines> display lines the client prints as they are.
+     PING | LIST | GET id | SEARCH text | PREFIX text
+     ADD id qty | REMOVE item | CART | INVOICE | CHECKOUT [customer]
+   Carts live in the server, one per connection. A non-blocking epoll loop
+   answers everything but checkouts, which go to a few worker threads so
+   their fsyncs share group commit batches instead of stalling the loop. */
+typedef struct Connection {
+    int fd;
+    char *in;
+    size_t in_len, in_cap;
+    char *out;
+    size_t out_len, out_sent, out_cap;
+    Cart cart;
+    int busy;        /* a checkout worker has it; input waits */
+    int closing;     /* peer hung up or broke the protocol */
+    char customer[NAME_LEN];
+    int result;      /* commitSale result, or 0 with problem set */
+    char problem[NAME_LEN + 64];
+    struct Connection *next;   /* checkout queue link */
+} Connection;
+
+typedef struct {
+    int listen_fd, epoll_fd, wake_fd;
+    pthread_mutex_t lock;      /* guards the queues below */
+    pthread_cond_t cond;
+    Connection *queue_head, *queue_tail;  /* checkouts waiting for a worker */
+    Connection *done;          /* finished checkouts, back to the loop */
+    int stopping;
+} Server;
+
+Server server = { .listen_fd = -1, .epoll_fd = -1, .wake_fd = -1,
+                  .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+volatile sig_atomic_t serverStop = 0;
+
+void serverSignal(int sig) { (void)sig; serverStop = 1; }
+
+/* Append formatted text to a connection's output */
+void connPrintf(Connection *c, const char *fmt, ...) {
+    va_list ap;
+    for (;;) {
+        va_start(ap, fmt);
+        int n = vsnprintf(c->out + c->out_len, c->out_cap - c->out_len, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < c->out_cap - c->out_len) { c->out_len += (size_t)n; return; }
+        size_t cap = c->out_cap ? c->out_cap * 2 : 4096;
+        while (cap < c->out_len + (size_t)n + 1) cap *= 2;
+        char *out = realloc(c->out, cap);
+        if (!out) { c->closing = 1; return; }
+        c->out = out;
+        c->out_cap = cap;
+    }
+}
+
+/* Reply with medicine lines for a list of slots (inventory lock held) */
+void connMedicines(Connection *c, const int slots[], int n, const char *none) {
+    if (n <= 0) { connPrintf(c, "OK 0 %s\n", none); return; }
+    connPrintf(c, "OK %d\n", n);
+    char line[NAME_LEN + 96];
+    for (int i = 0; i < n; ++i) {
+        formatMedicine(line, sizeof(line), &inventory.recs[slots[i]]);
+        connPrintf(c, "%s", line);
+    }
+}
+
+/* Reply with the cart lines and subtotal, plus VAT and total for an invoice */
+void connCart(Connection *c, int invoice) {
+    if (c->cart.count == 0) { connPrintf(c, invoice ? "ERR Cart empty — add items first.\n" : "ERR Cart is empty.\n"); return; }
+    /* the invoice brings changed lines up to date first, as the menu does */
+    char note[NAME_LEN + 64] = "";
+    int check = invoice ? cartValidate(&c->cart, note, sizeof(note)) : 0;
+    if (check == 1) { connPrintf(c, "ERR Error: %s\n", note); return; }
+    if (check == 2) connPrintf(c, "OK %d Note: %s\n", c->cart.count + 3, note);
+    else connPrintf(c, "OK %d\n", c->cart.count + (invoice ? 3 : 1));
+    int num = 0;
+    for (int i = c->cart.head; i >= 0; i = c->cart.line[i].next) {
+        const CartItem *l = &c->cart.line[i];
+        connPrintf(c, "%d) %.*s | Unit: %.2f | Qty: %d | Line: %.2f\n",
+                   ++num, NAME_LEN, l->name, l->price, l->qty, l->price * l->qty);
+    }
+    double subtotal = c->cart.subtotal_cents / 100.0;
+    connPrintf(c, "Subtotal: %.2f\n", subtotal);
+    if (invoice)
+        connPrintf(c, "VAT (%.0f%%): %.2f\nTotal: %.2f\n", TAX_RATE * 100, subtotal * TAX_RATE, subtotal * (1.0 + TAX_RATE));
+}
+
+/* Add to a connection's cart with the same checks as the customer menu */
+void connAdd(Connection *c, int id, int q) {
+    int slot = inventoryFind(id);
+    if (slot < 0) { connPrintf(c, "ERR Medicine not found.\n"); return; }
+    const Medicine *m = &inventory.recs[slot];
+    if (m->quantity <= 0) { connPrintf(c, "ERR Out of stock.\n"); return; }
+    if (isExpired(m, todayDayNumber())) { connPrintf(c, "ERR %.*s has expired and cannot be sold.\n", NAME_LEN, m->name); return; }
+    if (q <= 0) { connPrintf(c, "ERR Invalid qty.\n"); return; }
+    if (q > m->quantity) { connPrintf(c, "ERR Only %d units available.\n", m->quantity); return; }
+    int i = cartFind(&c->cart, id);
+    if (i >= 0 && c->cart.line[i].qty + q > m->quantity) {
+        connPrintf(c, "ERR Only %d units available, some already in your cart.\n", m->quantity);
+        return;
+    }
+    i = cartLine(&c->cart, id);
+    cartTake(&c->cart, i, slot);
+    cartSetQty(&c->cart, i, c->cart.line[i].qty + q);
+    connPrintf(c, "OK 0 %d x %.*s added to cart.\n", q, NAME_LEN, m->name);
+}
+
+/* Hand a checkout to the workers; the loop stops reading from c until done */
+void connCheckout(Connection *c, const char *customer) {
+    if (c->cart.count == 0) { connPrintf(c, "ERR Cart empty — add items first.\n"); return; }
+    strncpy(c->customer, customer, NAME_LEN - 1);
+    c->customer[NAME_LEN - 1] = '\0';
+    c->busy = 1;
+    c->next = NULL;
+    pthread_mutex_lock(&server.lock);
+    if (server.queue_tail) server.queue_tail->next = c; else server.queue_head = c;
+    server.queue_tail = c;
+    pthread_cond_signal(&server.cond);
+    pthread_mutex_unlock(&server.lock);
+}
+
+/* Answer one request line */
+void connRequest(Connection *c, char *line) {
+    char *arg = line + strcspn(line, " ");
+    if (*arg) *arg++ = '\0';
+    if (strcmp(line, "CHECKOUT") == 0) { connCheckout(c, arg); return; }
+
+    pthread_mutex_lock(&inventory.lock);
+    if (strcmp(line, "PING") == 0) {
+        connPrintf(c, "OK 0\n");
+    } else if (strcmp(line, "LIST") == 0) {
+        int *slots = malloc(sizeof(int) * (inventory.count + 1)), n = 0;
+        if (slots) for (int i = 0; i < inventory.count; ++i) if (inventory.recs[i].id) slots[n++] = i;
+        if (slots) connMedicines(c, slots, n, "No medicines in inventory.");
+        else connPrintf(c, "ERR Out of memory.\n");
+        free(slots);
+    } else if (strcmp(line, "GET") == 0) {
+        int slot = inventoryFind(atoi(arg));
+        if (slot >= 0) connMedicines(c, &slot, 1, "");
+        else connPrintf(c, "ERR Medicine not found.\n");
+    } else if (strcmp(line, "SEARCH") == 0) {
+        int n;
+        int *slots = nameMatches(arg, &n);
+        connMedicines(c, slots, n, "No matches found.");
+        free(slots);
+    } else if (strcmp(line, "PREFIX") == 0) {
+        int top[QUICKFIND_TOP];
+        connMedicines(c, top, prefixTopMatches(arg, QUICKFIND_TOP, top), "No matches found.");
+    } else if (strcmp(line, "ADD") == 0) {
+        int id, q;
+        if (sscanf(arg, "%d %d", &id, &q) == 2) connAdd(c, id, q);
+        else connPrintf(c, "ERR Invalid.\n");
+    } else if (strcmp(line, "REMOVE") == 0) {
+        int num = atoi(arg);
+        if (num <= 0 || num > c->cart.count) connPrintf(c, "ERR Invalid item number.\n");
+        else {
+            cartRemove(&c->cart, cartAt(&c->cart, num));
+            connPrintf(c, "OK 0 Item removed from cart.\n");
+        }
+    } else if (strcmp(line, "CART") == 0 || strcmp(line, "INVOICE") == 0) {
+        connCart(c, line[0] == 'I');
+    } else {
+        connPrintf(c, "ERR Unknown request.\n");
+    }
+    pthread_mutex_unlock(&inventory.lock);
+}
+
+/* Answer every complete line buffered for c, stopping at a checkout */
+void connProcess(Connection *c) {
+    size_t start = 0;
+    while (!c->busy && !c->closing) {
+        char *nl = memchr(c->in + start, '\n', c->in_len - start);
+        if (!nl) break;
+        *nl = '\0';
+        if (nl > c->in + start && nl[-1] == '\r') nl[-1] = '\0';
+        connRequest(c, c->in + start);
+        start = (size_t)(nl - c->in) + 1;
+    }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
+    if (!c->busy && c->in_len >= SERVER_LINE_MAX) c->closing = 1; /* no newline in sight */
+}
+
+/* Read what the peer sent; marks c closing on EOF or error */
+void connRead(Connection *c) {
+    for (;;) {
+        if (c->in_cap - c->in_len < 1024) {
+            size_t cap = c->in_cap ? c->in_cap * 2 : 4096;
+            char *in = realloc(c->in, cap);
+            if (!in) { c->closing = 1; return; }
+            c->in = in;
+            c->in_cap = cap;
+        }
+        ssize_t n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+        if (n > 0) { c->in_len += (size_t)n; if (c->in_len >= SERVER_LINE_MAX) return; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) c->closing = 1;
+        return;
+    }
+}
+
+/* Send as much pending output as the socket takes */
+void connWrite(Connection *c) {
+    while (c->out_sent < c->out_len) {
+        ssize_t n = write(c->fd, c->out + c->out_sent, c->out_len - c->out_sent);
+        if (n > 0) { c->out_sent += (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        c->closing = 1;
+        c->out_sent = c->out_len;
+    }
+    c->out_len = c->out_sent = 0;
+}
+
+/* Set what the loop waits for on c, or free it once it is finished.
+   Reading pauses during a checkout and while output is backed up. */
+void connUpdate(Connection *c) {
+    if (c->closing) {
+        /* a hung-up socket keeps reporting; the worker's reply finishes it */
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+        if (c->busy) return;
+        close(c->fd);
+        cartFree(&c->cart);
+        free(c->in); free(c->out); free(c);
+        return;
+    }
+    struct epoll_event ev = { .data.ptr = c };
+    if (!c->busy && c->out_len - c->out_sent < SERVER_OUT_HIGH) ev.events |= EPOLLIN;
+    if (c->out_sent < c->out_len) ev.events |= EPOLLOUT;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/* Checkout worker: sell queued carts and hand them back to the loop */
+void *serverCheckoutWorker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&server.lock);
+    for (;;) {
+        while (!server.queue_head && !server.stopping) pthread_cond_wait(&server.cond, &server.lock);
+        Connection *c = server.queue_head;
+        if (!c) break;
+        server.queue_head = c->next;
+        if (!server.queue_head) server.queue_tail = NULL;
+        pthread_mutex_unlock(&server.lock);
+
+        pthread_mutex_lock(&inventory.lock);
+        int problem = cartValidate(&c->cart, c->problem, sizeof(c->problem));
+        pthread_mutex_unlock(&inventory.lock);
+        double subtotal = c->cart.subtotal_cents / 100.0;
+        c->result = problem ? 0 : commitSale(c->customer, &c->cart,
+                                             subtotal, subtotal * TAX_RATE, subtotal * (1.0 + TAX_RATE));
+        if (!problem) c->problem[0] = '\0';
+
+        pthread_mutex_lock(&server.lock);
+        c->next = server.done;
+        server.done = c;
+        uint64_t one = 1;
+        if (write(server.wake_fd, &one, sizeof(one)) < 0) perror("Unable to wake server");
+    }
+    pthread_mutex_unlock(&server.lock);
+    return NULL;
+}
+
+/* Reply to checkouts the workers finished and resume their connections */
+void serverFinishCheckouts() {
+    uint64_t count;
+    if (read(server.wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("Unable to read server wakeup");
+    pthread_mutex_lock(&server.lock);
+    Connection *c = server.done;
+    server.done = NULL;
+    pthread_mutex_unlock(&server.lock);
+    while (c) {
+        Connection *next = c->next;
+        c->busy = 0;
+        if (c->result > 0) {
+            cartClear(&c->cart);
+            connPrintf(c, "OK 0 Payment successful. Thank you for your purchase!\n");
+        } else if (c->result < 0) {
+            connPrintf(c, "ERR Error: unable to record the sale. Checkout aborted.\n");
+        } else if (c->problem[0]) {
+            connPrintf(c, "ERR Error: %s\n", c->problem);
+        } else {
+            connPrintf(c, "ERR Checkout failed due to stock issue. Please adjust cart.\n");
+        }
+        connProcess(c);
+        connWrite(c);
+        connUpdate(c);
+        c = next;
+    }
+}
+
+/* Take every waiting connection */
+void serverAccept() {
+    for (;;) {
+        int fd = accept4(server.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Unable to accept client");
+            return;
+        }
+        Connection *c = calloc(1, sizeof(Connection));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (!c || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            perror("Unable to register client");
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        cartInit(&c->cart);
+    }
+}
+
+/* Run the inventory server on a Unix domain socket until SIGINT/SIGTERM */
+int serveInventory(int argc, char **argv) {
+    const char *path = argc > 0 ? argv[0] : SERVER_SOCKET;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) { fprintf(stderr, "Socket path too long: %s\n", path); return 1; }
+    strcpy(addr.sun_path, path);
+
+    inventoryLoad();
+    rollupLoad();
+    if (!groupCommitOpen()) return 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serverSignal;   /* no SA_RESTART: epoll_wait must return */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    unlink(path);
+    struct epoll_event ev = { .events = EPOLLIN };
+    if (server.listen_fd < 0 || server.epoll_fd < 0 || server.wake_fd < 0 ||
+        bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server.listen_fd, SOMAXCONN) != 0 ||
+        (ev.data.ptr = &server.listen_fd, epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &ev)) != 0 ||
+        (ev.data.ptr = &server.wake_fd, epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.wake_fd, &ev)) != 0) {
+        perror("Unable to start server");
+        return 1;
+    }
+
+    pthread_t workers[SERVER_CHECKOUT_THREADS];
+    for (int i = 0; i < SERVER_CHECKOUT_THREADS; ++i) pthread_create(&workers[i], NULL, serverCheckoutWorker, NULL);
+    printf("Serving %d medicines on %s\n", inventoryLive(), path);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!serverStop) {
+        int n = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Unable to wait for clients");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == &server.listen_fd) { serverAccept(); continue; }
+            if (events[i].data.ptr == &server.wake_fd) { serverFinishCheckouts(); continue; }
+            Connection *c = events[i].data.ptr;
+            if (events[i].events & EPOLLOUT) connWrite(c);
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                connRead(c);
+                connProcess(c);
+                connWrite(c);
+            }
+            connUpdate(c);
+        }
+    }
+
+    /* let queued checkouts finish; their connections go with the process */
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.cond);
+    pthread_mutex_unlock(&server.lock);
+    for (int i = 0; i < SERVER_CHECKOUT_THREADS; ++i) pthread_join(workers[i], NULL);
+    close(server.listen_fd);
+    unlink(path);
+    rollupCheckpoint(1);
+    close(groupCommit.sales_fd);
+    inventoryClose();
+    return 0;
+}
+
+/* Thin client side: a connection to the server with a buffered reader */
+typedef struct {
+    int fd;
+    FILE *in;
+} ServerLink;
+
+int serverConnect(ServerLink *link, const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    link->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    link->in = NULL;
+    if (link->fd < 0) return 0;
+    if (connect(link->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        !(link->in = fdopen(dup(link->fd), "r"))) {
+        close(link->fd);
+        return 0;
+    }
+    return 1;
+}
+
+void serverDisconnect(ServerLink *link) {
+    fclose(link->in);
+    close(link->fd);
+}
+
+/* Send one request line and read the reply. Display lines are printed when
+   `show` is set and skipped otherwise; the status message goes to msg.
+   Returns 1 for OK, 0 for ERR, -1 if the connection failed. */
+int serverRequest(ServerLink *link, const char *request, int show, char *msg, size_t msglen) {
+    char line[SERVER_LINE_MAX];
+    size_t len = strlen(request);
+    if (len + 1 >= sizeof(line)) return -1;
+    memcpy(line, request, len);
+    line[len] = '\n';
+    if (!writeAll(link->fd, line, len + 1) || !fgets(line, sizeof(line), link->in)) return -1;
+    line[strcspn(line, "\n")] = '\0';
+    int lines = 0, skip = 0;
+    int ok = sscanf(line, "OK %d %n", &lines, &skip) >= 1;
+    if (!ok && strncmp(line, "ERR ", 4) != 0) return -1;
+    if (msg) snprintf(msg, msglen, "%s", ok ? (skip ? line + skip : "") : line + 4);
+    for (int i = 0; i < lines; ++i) {
+        if (!fgets(line, sizeof(line), link->in)) return -1;
+        if (show) fputs(line, stdout);
+    }
+    return ok;
+}
+
+/* Ask and print a reply; the status message is shown on its own line */
+int clientShow(ServerLink *link, const char *request) {
+    char msg[SERVER_LINE_MAX];
+    int ok = serverRequest(link, request, 1, msg, sizeof(msg));
+    if (ok < 0) printf("Lost connection to the server.\n");
+    else if (msg[0]) printf("%s\n", msg);
+    return ok;
+}
+
+/* The customer menu as a thin client of a running server */
+int clientMenu(int argc, char **argv) {
+    const char *path = argc > 0 ? argv[0] : SERVER_SOCKET;
+    ServerLink link;
+    if (!serverConnect(&link, path)) { perror("Unable to connect to server"); return 1; }
+    signal(SIGPIPE, SIG_IGN);
+    char request[SERVER_LINE_MAX];
+    int choice;
 
     do {
-        printf("\n--- Customer Menu ---\n");
+        printf("\n--- Customer Menu (server %s) ---\n", path);
         printf("1. Browse all medicines\n");
         printf("2. Search medicine by name\n");
         printf("3. Add medicine to cart (by ID)\n");
         printf("4. Remove item from cart\n");
         printf("5. View cart\n");
         printf("6. Checkout\n");
-        printf("0. Back to Main Menu\n");
-        printf("Choice: "); if (scanf("%d", &choice) != 1) { while(getchar()!='\n'); choice = -1; }
+        printf("7. Quick find by name prefix\n");
+        printf("0. Exit\n");
+        printf("Choice: "); if (scanf("%d", &choice) != 1) { if (feof(stdin)) break; while(getchar()!='\n'); choice = -1; }
 
+        int ok = 1;
         if (choice == 1) {
-            viewMedicines();
-        } else if (choice == 2) {
+            printf("\n--- Medicine List ---\n");
+            ok = clientShow(&link, "LIST");
+        } else if (choice == 2 || choice == 7) {
             char keyword[NAME_LEN];
-            printf("Enter name keyword: ");
-            getchar(); fgets(keyword, NAME_LEN, stdin);
+            printf(choice == 2 ? "Enter name keyword: " : "Enter the start of the name: ");
+            getchar(); if (!fgets(keyword, NAME_LEN, stdin)) keyword[0] = '\0';
             keyword[strcspn(keyword, "\n")] = '\0';
-            searchMedicineByName(keyword);
+            printf(choice == 2 ? "\nSearch results for \"%s\":\n" : "\nTop matches for \"%s\":\n", keyword);
+            snprintf(request, sizeof(request), "%s %s", choice == 2 ? "SEARCH" : "PREFIX", keyword);
+            ok = clientShow(&link, request);
         } else if (choice == 3) {
             printf("Enter medicine ID to add: ");
             int id; if (scanf("%d", &id) != 1) { printf("Invalid.\n"); while(getchar()!='\n'); continue; }
-            Medicine m;
-            if (!searchMedicineByID(id, &m)) { printf("Medicine not found.\n"); continue; }
-            if (m.quantity <= 0) { printf("Out of stock.\n"); continue; }
-            printf("Available quantity: %d\nEnter desired quantity: ", m.quantity);
+            snprintf(request, sizeof(request), "GET %d", id);
+            ok = clientShow(&link, request);
+            if (ok <= 0) continue;
+            printf("Enter desired quantity: ");
             int q; if (scanf("%d", &q) != 1 || q <= 0) { printf("Invalid qty.\n"); while(getchar()!='\n'); continue; }
-            if (q > m.quantity) { printf("Only %d units available.\n", m.quantity); continue; }
-
-            /* If already in cart, increase qty */
-            int found = 0;
-            for (int i=0;i<cartCount;i++){
-                if (cart[i].med_id == id) {
-                    cart[i].qty += q; found = 1; break;
-                }
-            }
-            if (!found) {
-                if (cartCount >= MAX_CART) { printf("Cart is full.\n"); continue; }
-                cart[cartCount].med_id = id;
-                strncpy(cart[cartCount].name, m.name, NAME_LEN);
-                cart[cartCount].price = m.price;
-                cart[cartCount].qty = q;
-                cartCount++;
-            }
-            printf("%d x %s added to cart.\n", q, m.name);
+            snprintf(request, sizeof(request), "ADD %d %d", id, q);
+            ok = clientShow(&link, request);
         } else if (choice == 4) {
-            if (cartCount == 0) { printf("Cart is empty.\n"); continue; }
             printf("\n--- Remove from Cart ---\n");
-            for (int i=0;i<cartCount;i++){
-                printf("%d) %s | Qty: %d\n", i+1, cart[i].name, cart[i].qty);
-            }
+            ok = clientShow(&link, "CART");
+            if (ok <= 0) continue;
             printf("Enter item number to remove (0 to cancel): ");
             int num; if (scanf("%d", &num) != 1) { printf("Invalid.\n"); while(getchar()!='\n'); continue; }
             if (num <= 0) { printf("Cancelled.\n"); continue; }
-            if (num > cartCount) { printf("Invalid item number.\n"); continue; }
-            /* Remove by shifting */
-            for (int i = num - 1; i < cartCount - 1; ++i) cart[i] = cart[i+1];
-            cartCount--;
-            printf("Item removed from cart.\n");
+            snprintf(request, sizeof(request), "REMOVE %d", num);
+            ok = clientShow(&link, request);
         } else if (choice == 5) {
-            if (cartCount == 0) { printf("Cart is empty.\n"); }
-            else {
-                printf("\n--- Your Cart ---\n");
-                double subtotal = 0.0;
-                for (int i=0;i<cartCount;i++){
-                    double line = cart[i].price * cart[i].qty;
-                    printf("%d) %s | Unit: %.2f | Qty: %d | Line: %.2f\n",
-                           i+1, cart[i].name, cart[i].price, cart[i].qty, line);
-                    subtotal += line;
-                }
-                printf("Subtotal: %.2f\n", subtotal);
-            }
+            printf("\n--- Your Cart ---\n");
+            ok = clientShow(&link, "CART");
         } else if (choice == 6) {
-            if (cartCount == 0) { printf("Cart empty — add items first.\n"); continue; }
-            /* Show invoice */
             printf("\n--- Invoice ---\n");
-            double subtotal = 0.0;
-            for (int i=0;i<cartCount;i++){
-                double line = cart[i].price * cart[i].qty;
-                printf("%d) %s | Unit: %.2f | Qty: %d | Line: %.2f\n",
-                       i+1, cart[i].name, cart[i].price, cart[i].qty, line);
-                subtotal += line;
-            }
-            double tax = subtotal * TAX_RATE;
-            double total = subtotal + tax;
-            printf("Subtotal: %.2f\nVAT (%.0f%%): %.2f\nTotal: %.2f\n", subtotal, TAX_RATE*100, tax, total);
-
+            ok = clientShow(&link, "INVOICE");
+            if (ok <= 0) continue;
             printf("Proceed to payment? (1 = Yes, 0 = No): ");
             int pay; if (scanf("%d", &pay) != 1) { printf("Invalid.\n"); while(getchar()!='\n'); continue; }
-            if (pay == 1) {
-                /* Optionally ask customer name (can be blank) */
-                char customer_name[NAME_LEN];
-                printf("Enter your name (press Enter to skip): ");
-                getchar(); /* consume newline */
-                fgets(customer_name, NAME_LEN, stdin);
-                customer_name[strcspn(customer_name, "\n")] = '\0';
+            if (pay != 1) { printf("Checkout cancelled.\n"); continue; }
+            char customer_name[NAME_LEN];
+            printf("Enter your name (press Enter to skip): ");
+            getchar(); if (!fgets(customer_name, NAME_LEN, stdin)) customer_name[0] = '\0';
+            customer_name[strcspn(customer_name, "\n")] = '\0';
+            snprintf(request, sizeof(request), "CHECKOUT %s", customer_name);
+            ok = clientShow(&link, request);
+        } else if (choice != 0) {
+            printf("Invalid choice.\n");
+        }
+        if (ok < 0) break;
+    } while (choice != 0);
 
-                /* Reduce stock and write updated file */
-                FILE *fp = fopen(DATAFILE, "rb");
-                if (!fp) { printf("Error: data file not found.\n"); continue; }
-                FILE *tmp = fopen("tmp.dat", "wb");
-                if (!tmp) { printf("Error: cannot open temp file.\n"); fclose(fp); continue; }
-
-                Medicine m;
-                int ok = 1;
-                while (fread(&m, sizeof(Medicine), 1, fp) == 1) {
-                    /* check if in cart */
-                    for (int i=0;i<cartCount;i++){
-                        if (m.id == cart[i].med_id) {
-                            if (cart[i].qty <= m.quantity) {
-                                m.quantity -= cart[i].qty;
-                            } else {
-                                /* Insufficient stock during checkout */
-                                printf("Error: insufficient stock for %s during checkout.\n", m.name);
-                                ok = 0;
-                                break;
-                            }
-                        }
-                    }
-                    if (!ok) break;
-                    fwrite(&m, sizeof(Medicine), 1, tmp);
-                }
-                if (!ok) {
-                    fclose(fp); fclose(tmp);
-                    remove("tmp.dat");
-                    printf("Checkout failed due to stock issue. Please adjust cart.\n");
-                } else {
-                    fclose(fp); fclose(tmp);
-                    remove(DATAFILE);
-                    rename("tmp.dat", DATAFILE);
-                    printf("Payment successful. Thank you for your purchase!\n");
-                    /* append sale record */
-                    appendSaleRecord(customer_name, cart, cartCount, subtotal, tax, total);
-                    /* clear cart */
-                    cartCount = 0;
-                }
-            } else {
-                printf("Checkout cancelled.\n");
-            }
-        } else if (choice == 0) {
+    serverDisconnect(&link);
+    return 0;
+}
+
+/* Seconds on a monotonic clock, for benchmarks */
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    int checkouts;
+    unsigned int seed;
+} BenchWorker;
+
+/* Benchmark worker: random 1-5 line carts against the whole catalog */
+void *benchCheckoutWorker(void *arg) {
+    BenchWorker *w = arg;
+    Cart cart;
+    cartInit(&cart);
+    for (int n = 0; n < w->checkouts; ++n) {
+        int lines = 1 + rand_r(&w->seed) % 5;
+        cartClear(&cart);
+        for (int i = 0; i < lines; ++i) {
+            int slot = rand_r(&w->seed) % inventory.count;
+            int line = cartLine(&cart, inventory.recs[slot].id);
+            cartTake(&cart, line, slot);
+            cartSetQty(&cart, line, cart.line[line].qty + 1);
+        }
+        if (commitSale("bench", &cart, 0.0, 0.0, 0.0) < 0) {
+            fprintf(stderr, "checkout failed\n");
             break;
+        }
+    }
+    cartFree(&cart);
+    return NULL;
+}
+
+/* Checkouts/sec from concurrent counters with group commit off and on.
+   Runs in a scratch directory so real data files are never touched. */
+int benchGroupCommit(int argc, char **argv) {
+    int threads = argc > 0 ? atoi(argv[0]) : 8;
+    int checkouts = argc > 1 ? atoi(argv[1]) : 200;
+    long window_us = argc > 2 ? atol(argv[2]) : GROUP_COMMIT_WINDOW_US;
+    if (threads < 1) threads = 1;
+    if (checkouts < 1) checkouts = 1;
+
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) { perror("Unable to create scratch directory"); return 1; }
+    inventoryLoad();
+    if (!groupCommitOpen()) return 1;
+    inventoryBeginChange();
+    for (int i = 0; i < 1000; ++i) {
+        Medicine m = { .id = i + 1, .price = 1.0, .quantity = 1 << 30 };
+        snprintf(m.name, NAME_LEN, "Medicine %d", i + 1);
+        inventoryAppend(&m);
+    }
+    inventoryEndChange();
+
+    printf("%d threads x %d checkouts, window %ld us, batch %d\n",
+           threads, checkouts, window_us, GROUP_COMMIT_BATCH);
+    pthread_t *tid = malloc(sizeof(pthread_t) * threads);
+    BenchWorker *w = malloc(sizeof(BenchWorker) * threads);
+    for (int mode = 0; mode < 2; ++mode) {
+        groupCommit.enabled = mode;
+        groupCommit.window_us = window_us;
+        groupCommit.batches = groupCommit.commits = 0;
+        double t0 = nowSeconds();
+        for (int i = 0; i < threads; ++i) {
+            w[i].checkouts = checkouts;
+            w[i].seed = 12345u + (unsigned)i;
+            pthread_create(&tid[i], NULL, benchCheckoutWorker, &w[i]);
+        }
+        for (int i = 0; i < threads; ++i) pthread_join(tid[i], NULL);
+        double secs = nowSeconds() - t0;
+        printf("group commit %-3s: %8.0f checkouts/sec, %ld fsync batches (%.1f checkouts/batch)\n",
+               mode ? "on" : "off", groupCommit.commits / secs, groupCommit.batches,
+               groupCommit.batches ? (double)groupCommit.commits / groupCommit.batches : 0.0);
+    }
+    free(tid); free(w);
+
+    close(groupCommit.sales_fd);
+    inventoryClose();
+    unlink(DATAFILE); unlink(SHADOWFILE); unlink(SALESFILE); unlink(ROLLUPFILE);
+    if (chdir("/") == 0) rmdir(dir);
+    return 0;
+}
+
+typedef struct {
+    int checkouts;
+    int hot;          /* medicines that take STOCK_BENCH_HOT_PCT of the lines */
+    int locked;       /* 1 = read-check-subtract under inventory.lock */
+    unsigned int seed;
+    long units;
+    long refused;
+} StockWorker;
+
+#define STOCK_BENCH_HOT_PCT 90
+
+/* Benchmark worker: 1-3 line carts skewed to a few hot medicines, claimed
+   either the old way under the inventory lock or on the stock counters */
+void *benchStockWorker(void *arg) {
+    StockWorker *w = arg;
+    Cart cart;
+    cartInit(&cart);
+    for (int n = 0; n < w->checkouts; ++n) {
+        int lines = 1 + rand_r(&w->seed) % 3;
+        cartClear(&cart);
+        for (int i = 0; i < lines; ++i) {
+            int r = rand_r(&w->seed);
+            int slot = r % 100 < STOCK_BENCH_HOT_PCT ? r / 100 % w->hot : r / 100 % inventory.count;
+            int line = cartLine(&cart, inventory.recs[slot].id);
+            cart.line[line].qty++;
+        }
+        int ok = 1;
+        if (w->locked) {
+            pthread_mutex_lock(&inventory.lock);
+            for (int i = cart.head; ok && i >= 0; i = cart.line[i].next) {
+                int slot = inventoryFind(cart.line[i].med_id);
+                ok = slot >= 0 && cart.line[i].qty <= inventory.recs[slot].quantity;
+            }
+            for (int i = cart.head; ok && i >= 0; i = cart.line[i].next)
+                inventory.recs[inventoryFind(cart.line[i].med_id)].quantity -= cart.line[i].qty;
+            pthread_mutex_unlock(&inventory.lock);
         } else {
-            printf("Invalid choice.\n");
+            ok = stockReserveCart(&cart);
         }
-        pressEnterToContinue();
-    } while (1);
+        if (!ok) { w->refused++; continue; }
+        w->units += lines;
+    }
+    cartFree(&cart);
+    return NULL;
+}
+
+/* Units left across the catalog, on the records or on the counters */
+long stockTotal(int locked) {
+    long total = 0;
+    for (int i = 0; i < inventory.count; ++i) {
+        StockCounter *c = stockCounter(inventory.recs[i].id, 0);
+        total += locked ? inventory.recs[i].quantity : (c ? atomic_load(&c->available) : 0);
+    }
+    return total;
+}
+
+/* Cart claims/sec by thread count on a hot-SKU workload: the inventory
+   lock against the CAS counters. Only the claim is timed; the durable part
+   of a checkout is what --bench-group-commit measures. Runs in a scratch
+   directory so real data files are never touched. */
+int benchStock(int argc, char **argv) {
+    int max_threads = argc > 0 ? atoi(argv[0]) : 16;
+    int checkouts = argc > 1 ? atoi(argv[1]) : 200000;
+    int medicines = argc > 2 ? atoi(argv[2]) : 10000;
+    int hot = 8;
+    if (max_threads < 1) max_threads = 1;
+    if (checkouts < 1) checkouts = 1;
+    if (medicines < hot) medicines = hot;
+
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) { perror("Unable to create scratch directory"); return 1; }
+    inventoryLoad();
+    inventoryBeginChange();
+    for (int i = 0; i < medicines; ++i) {
+        Medicine m = { .id = i + 1, .price = 1.0, .quantity = 1 << 30 };
+        snprintf(m.name, NAME_LEN, "Medicine %d", i + 1);
+        inventoryAppend(&m);
+    }
+    inventoryEndChange();
+
+    printf("%d checkouts per thread, %d medicines, %d%% of lines on %d of them\n",
+           checkouts, medicines, STOCK_BENCH_HOT_PCT, hot);
+    printf("%-8s %18s %18s\n", "threads", "lock checkouts/s", "CAS checkouts/s");
+    pthread_t *tid = malloc(sizeof(pthread_t) * max_threads);
+    StockWorker *w = malloc(sizeof(StockWorker) * max_threads);
+    int conserved = 1;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double rate[2];
+        for (int locked = 1; locked >= 0; --locked) {
+            long before = stockTotal(locked), units = 0;
+            double t0 = nowSeconds();
+            for (int i = 0; i < threads; ++i) {
+                w[i] = (StockWorker){ .checkouts = checkouts, .hot = hot, .locked = locked,
+                                      .seed = 777u + (unsigned)i };
+                pthread_create(&tid[i], NULL, benchStockWorker, &w[i]);
+            }
+            for (int i = 0; i < threads; ++i) pthread_join(tid[i], NULL);
+            rate[locked] = (double)threads * checkouts / (nowSeconds() - t0);
+            for (int i = 0; i < threads; ++i) units += w[i].units;
+            if (before - stockTotal(locked) != units) conserved = 0;
+        }
+        printf("%-8d %18.0f %18.0f\n", threads, rate[1], rate[0]);
+        if (threads < max_threads && threads * 2 > max_threads) threads = max_threads / 2;
+    }
+    printf("stock conserved: %s\n", conserved ? "yes" : "NO");
+    free(tid); free(w);
+
+    inventoryClose();
+    unlink(DATAFILE); unlink(SHADOWFILE);
+    if (chdir("/") == 0) rmdir(dir);
+    return conserved ? 0 : 1;
+}
+
+/* The in-memory part of a checkout, nested the way it once was: every cart
+   line walks the catalog to check its stock, then again to take it */
+int checkoutNested(const Cart *cart) {
+    for (int i = cart->head; i >= 0; i = cart->line[i].next) {
+        int found = 0;
+        for (int j = 0; j < inventory.count && !found; ++j)
+            found = inventory.recs[j].id == cart->line[i].med_id && inventory.recs[j].quantity >= cart->line[i].qty;
+        if (!found) return 0;
+    }
+    for (int i = cart->head; i >= 0; i = cart->line[i].next)
+        for (int j = 0; j < inventory.count; ++j)
+            if (inventory.recs[j].id == cart->line[i].med_id) { inventory.recs[j].quantity -= cart->line[i].qty; break; }
+    return 1;
+}
+
+/* The same through cartJoin: one index probe per line */
+int checkoutJoined(const Cart *cart, CartJoin join[]) {
+    int n = cartJoin(cart, join);
+    for (int i = 0; i < n; ++i)
+        if (join[i].slot < 0 || inventory.recs[join[i].slot].quantity < join[i].qty) return 0;
+    for (int i = 0; i < n; ++i) inventory.recs[join[i].slot].quantity -= join[i].qty;
+    return 1;
+}
+
+/* Checkout cost by cart size on a large catalog: nested cart x catalog
+   loops against the hash join. Only the check and the stock update under
+   the inventory lock are timed; the durable part of a checkout is what
+   --bench-group-commit measures. Runs in a scratch directory so real data
+   files are never touched. */
+int benchCheckout(int argc, char **argv) {
+    int skus = argc > 0 ? atoi(argv[0]) : 100000;
+    int rounds = argc > 1 ? atoi(argv[1]) : 100;
+    static const int sizes[] = { 1, 20, 100 };
+    if (skus < 100) skus = 100;
+    if (rounds < 1) rounds = 1;
+
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) { perror("Unable to create scratch directory"); return 1; }
+    inventoryLoad();
+    inventoryBeginChange();
+    for (int i = 0; i < skus; ++i) {
+        Medicine m = { .id = i + 1, .price = 1.0, .quantity = 1 << 30 };
+        snprintf(m.name, NAME_LEN, "Medicine %d", i + 1);
+        inventoryAppend(&m);
+    }
+    inventoryEndChange();
+
+    printf("%d medicines, %d checkouts per cart size\n", skus, rounds);
+    printf("%-8s %16s %16s %10s\n", "lines", "nested us/cart", "joined us/cart", "speedup");
+    Cart cart;
+    cartInit(&cart);
+    CartJoin join[100];
+    unsigned int seed = 4242u;
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s) {
+        double secs[2];
+        for (int mode = 0; mode < 2; ++mode) {
+            double total = 0.0;
+            for (int r = 0; r < rounds; ++r) {
+                cartClear(&cart);
+                for (int i = 0; i < sizes[s]; ++i) cartSetQty(&cart, cartLine(&cart, 1 + rand_r(&seed) % skus), 1);
+                pthread_mutex_lock(&inventory.lock);
+                double t0 = nowSeconds();
+                int ok = mode ? checkoutJoined(&cart, join) : checkoutNested(&cart);
+                total += nowSeconds() - t0;
+                pthread_mutex_unlock(&inventory.lock);
+                if (!ok) { fprintf(stderr, "checkout failed\n"); break; }
+            }
+            secs[mode] = total;
+        }
+        printf("%-8d %16.2f %16.2f %9.0fx\n", sizes[s], secs[0] * 1e6 / rounds, secs[1] * 1e6 / rounds,
+               secs[1] > 0.0 ? secs[0] / secs[1] : 0.0);
+    }
+    cartFree(&cart);
+
+    inventoryClose();
+    unlink(DATAFILE); unlink(SHADOWFILE);
+    if (chdir("/") == 0) rmdir(dir);
+    return 0;
+}
+
+/* One terminal of the lock stress test: random 1-3 line carts of 1-3 units
+   against the shared catalog. Returns how many checkouts failed. */
+int stressTerminal(int checkouts, unsigned int seed) {
+    inventoryLoad();
+    if (!groupCommitOpen() || inventory.count == 0) return checkouts;
+    int failures = 0;
+    Cart cart;
+    cartInit(&cart);
+    for (int n = 0; n < checkouts; ++n) {
+        int lines = 1 + rand_r(&seed) % 3;
+        cartClear(&cart);
+        for (int i = 0; i < lines; ++i) {
+            int slot = rand_r(&seed) % inventory.count;
+            int line = cartLine(&cart, inventory.recs[slot].id);
+            cartTake(&cart, line, slot);
+            cartSetQty(&cart, line, cart.line[line].qty + 1 + rand_r(&seed) % 3);
+        }
+        if (commitSale("stress", &cart, 0.0, 0.0, 0.0) != 1) failures++;
+    }
+    cartFree(&cart);
+    rollupCheckpoint(1);
+    close(groupCommit.sales_fd);
+    inventoryClose();
+    return failures;
+}
+
+/* Several terminals (processes) check out the same few medicines at once,
+   first without record locks and then with them. Afterwards every unit in
+   SALESFILE must be missing from stock; anything else is a lost update.
+   Runs in a scratch directory so real data files are never touched. */
+int stressLocks(int argc, char **argv) {
+    int terminals = argc > 0 ? atoi(argv[0]) : 4;
+    int checkouts = argc > 1 ? atoi(argv[1]) : 200;
+    int medicines = argc > 2 ? atoi(argv[2]) : 8;
+    if (terminals < 1) terminals = 1;
+    if (checkouts < 1) checkouts = 1;
+    if (medicines < 1) medicines = 1;
+
+    char dir[] = "/tmp/medstore-stress-XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) { perror("Unable to create scratch directory"); return 1; }
+    printf("%d terminals x %d checkouts on %d medicines\n", terminals, checkouts, medicines);
+    int passed = 0;
+    for (int mode = 0; mode < 2; ++mode) {
+        recordLocking = mode;
+        unlink(DATAFILE); unlink(SHADOWFILE); unlink(SALESFILE); unlink(ROLLUPFILE);
+        inventoryLoad();
+        inventoryBeginChange();
+        for (int i = 0; i < medicines; ++i) {
+            Medicine m = { .id = i + 1, .price = 1.0, .quantity = 1 << 24,
+                           .expiry_day = 31, .expiry_month = 12, .expiry_year = 2099 };
+            snprintf(m.name, NAME_LEN, "Medicine %d", i + 1);
+            inventoryAppend(&m);
+        }
+        inventoryEndChange();
+        inventoryClose();
+
+        fflush(stdout);
+        double t0 = nowSeconds();
+        int failed = 0, status;
+        for (int p = 0; p < terminals; ++p) {
+            pid_t pid = fork();
+            if (pid == 0) _exit(stressTerminal(checkouts, 777u + (unsigned)p) != 0);
+            if (pid < 0) { perror("Unable to start terminal"); failed++; }
+        }
+        while (wait(&status) > 0)
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+        double secs = nowSeconds() - t0;
+
+        /* read back as a new terminal would, and count sales from scratch */
+        recordLocking = 1;
+        inventoryLoad();
+        rollupRebuild();
+        long long lost = 0, sales = 0;
+        const RollupTable *sold = &rollups.table[ROLLUP_MEDICINE];
+        for (int i = 0; i < inventory.count; ++i) {
+            int pos = rollupLowerBound(sold, inventory.recs[i].id);
+            long long units = pos < sold->count && sold->buckets[pos].key == inventory.recs[i].id ? sold->buckets[pos].units : 0;
+            lost += llabs((1LL << 24) - units - inventory.recs[i].quantity);
+        }
+        for (int i = 0; i < rollups.table[ROLLUP_DAILY].count; ++i) sales += rollups.table[ROLLUP_DAILY].buckets[i].sales;
+        inventoryClose();
+
+        printf("record locks %-3s: %8.0f checkouts/sec, %lld of %lld sales on file, %lld units of stock lost%s\n",
+               mode ? "on" : "off", terminals * (double)checkouts / secs, sales,
+               (long long)terminals * checkouts, lost, failed ? " (some terminals failed)" : "");
+        if (mode == 1) passed = lost == 0 && !failed && sales == (long long)terminals * checkouts;
+    }
+
+    unlink(DATAFILE); unlink(SHADOWFILE); unlink(SALESFILE); unlink(ROLLUPFILE);
+    if (chdir("/") == 0) rmdir(dir);
+    return passed ? 0 : 1;
+}
+
+#define CRASH_MEDICINES 200   /* several SHADOW_PAGEs of records */
+#define CRASH_STOCK 50
+#define CRASH_SCENARIOS 3
+
+const char *faultNames[FAULT_POINTS + 1] = {
+    "none", "sales", "images", "synced", "header", "committed", "apply", "applied"
+};
+const char *crashScenarios[CRASH_SCENARIOS] = { "checkout", "add", "delete" };
+const int crashCart[] = { 1, 15, 16, 120, CRASH_MEDICINES };   /* 15 and 16 end and start a page */
+#define CRASH_CART_LINES 5
+#define CRASH_DELETED 7
+
+/* Run one scenario of the crash test; in the child, faultPoint kills it */
+void crashScenario(int scenario) {
+    inventoryLoad();
+    if (scenario == 0) {
+        Cart cart;
+        cartInit(&cart);
+        for (int i = 0; i < CRASH_CART_LINES; ++i) {
+            int line = cartLine(&cart, crashCart[i]);
+            cartTake(&cart, line, inventoryFind(crashCart[i]));
+            cartSetQty(&cart, line, 3);
+        }
+        if (groupCommitOpen()) commitSale("crash", &cart, 0.0, 0.0, 0.0);
+        cartFree(&cart);
+    } else if (!inventoryBeginChange()) {
+        return;
+    } else {
+        Medicine m = { .id = CRASH_MEDICINES + 1, .price = 1.0, .quantity = CRASH_STOCK,
+                       .expiry_day = 31, .expiry_month = 12, .expiry_year = 2099 };
+        snprintf(m.name, NAME_LEN, "Medicine %d", m.id);
+        if (scenario == 1) inventoryAppend(&m);
+        else inventoryRemove(CRASH_DELETED);
+        inventoryEndChange();
+    }
+}
+
+/* Does the store, after recovery, hold the scenario's change (1), not
+   hold it (0) or hold something else (-1)? Every record, its stock and
+   SALESFILE are checked. */
+int crashOutcome(int scenario) {
+    struct stat st;
+    inventoryLoad();
+    rollupRebuild();
+    long sales_size = stat(SALESFILE, &st) == 0 ? (long)st.st_size : 0;
+    long long sales = 0;
+    for (int i = 0; i < rollups.table[ROLLUP_DAILY].count; ++i) sales += rollups.table[ROLLUP_DAILY].buckets[i].sales;
+    int outcome = -1;
+    for (int changed = 0; outcome < 0 && changed <= 1; ++changed) {
+        int ok = inventory.count == CRASH_MEDICINES + (changed && scenario == 1);
+        for (int slot = 0; ok && slot < inventory.count; ++slot) {
+            int id = slot + 1, qty = CRASH_STOCK;
+            for (int i = 0; changed && scenario == 0 && i < CRASH_CART_LINES; ++i)
+                if (crashCart[i] == id) qty -= 3;
+            char name[NAME_LEN];
+            snprintf(name, NAME_LEN, "Medicine %d", id);
+            /* a delete leaves a tombstone in the medicine's slot */
+            if (changed && scenario == 2 && id == CRASH_DELETED) {
+                id = qty = 0;
+                name[0] = '\0';
+            }
+            ok = inventory.recs[slot].id == id && inventory.recs[slot].quantity == qty &&
+                 strcmp(inventory.recs[slot].name, name) == 0;
+        }
+        if (ok && sales == (changed && scenario == 0) && rollups.covered == sales_size) outcome = changed;
+    }
+    inventoryClose();
+    return outcome;
+}
+
+/* Kill a checkout, an add and a delete at each write point of a commit
+   (halfway through the write where there is one), then load the store as
+   the next terminal would. A kill before the header is written must leave
+   no trace of the change and after it the whole change. Runs in a scratch
+   directory so real data files are never touched. */
+int crashTest(int argc, char **argv) {
+    (void)argc; (void)argv;
+    char dir[] = "/tmp/medstore-crash-XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) { perror("Unable to create scratch directory"); return 1; }
+    printf("%d medicines; each change killed at every write point, then recovered\n", CRASH_MEDICINES);
+    printf("%-9s %-10s %-8s %s\n", "change", "killed at", "died", "after reload");
+    int failures = 0;
+    for (int scenario = 0; scenario < CRASH_SCENARIOS; ++scenario) {
+        for (int point = 1; point <= FAULT_POINTS; ++point) {
+            unlink(DATAFILE); unlink(SHADOWFILE); unlink(SALESFILE); unlink(ROLLUPFILE); unlink(REORDERFILE);
+            inventoryLoad();
+            inventoryBeginChange();
+            for (int i = 0; i < CRASH_MEDICINES; ++i) {
+                Medicine m = { .id = i + 1, .price = 1.0, .quantity = CRASH_STOCK,
+                               .expiry_day = 31, .expiry_month = 12, .expiry_year = 2099 };
+                snprintf(m.name, NAME_LEN, "Medicine %d", i + 1);
+                inventoryAppend(&m);
+            }
+            inventoryEndChange();
+            inventoryClose();
+
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                faultPoint = point;
+                crashScenario(scenario);
+                _exit(0);
+            }
+            int status = 0;
+            if (pid < 0 || waitpid(pid, &status, 0) != pid) { perror("Unable to run crash test"); return 1; }
+            int died = WIFEXITED(status) && WEXITSTATUS(status) == FAULT_EXIT;
+
+            /* a change that got as far as its header must be all there */
+            int expect = !died || point >= FAULT_COMMITTED, outcome = crashOutcome(scenario);
+            if (outcome != expect) failures++;
+            printf("%-9s %-10s %-8s %-12s %s\n", crashScenarios[scenario], faultNames[point],
+                   died ? "yes" : "no", outcome < 0 ? "damaged" : outcome ? "committed" : "rolled back",
+                   outcome == expect ? "ok" : "WRONG");
+        }
+    }
+    printf("%s\n", failures ? "crash test FAILED" : "crash test passed");
+
+    unlink(DATAFILE); unlink(SHADOWFILE); unlink(SALESFILE); unlink(ROLLUPFILE); unlink(REORDERFILE);
+    if (chdir("/") == 0) rmdir(dir);
+    return failures ? 1 : 0;
+}
+
+typedef struct {
+    const char *path;
+    int requests;
+    int medicines;
+    unsigned int seed;
+    double *latency;     /* seconds per request */
+    double *checkout;    /* seconds per checkout */
+    int checkouts;
+    int failed;
+} LoadClient;
+
+/* Load generator client: a mix of lookups, searches, prefix finds and
+   carts, one request at a time on its own connection */
+void *loadClientRun(void *arg) {
+    LoadClient *w = arg;
+    ServerLink link;
+    if (!serverConnect(&link, w->path)) { w->failed = w->requests; return NULL; }
+    char request[128];
+    for (int n = 0; n < w->requests; ++n) {
+        int id = 1 + rand_r(&w->seed) % w->medicines;
+        int kind = n % 10;
+        if (kind < 4) snprintf(request, sizeof(request), "GET %d", id);
+        else if (kind < 6) snprintf(request, sizeof(request), "SEARCH icine %d", id);
+        else if (kind < 8) snprintf(request, sizeof(request), "PREFIX medicine %d", id);
+        else if (kind == 8) snprintf(request, sizeof(request), "ADD %d 1", id);
+        else snprintf(request, sizeof(request), "CHECKOUT load");
+        double t0 = nowSeconds();
+        int ok = serverRequest(&link, request, 0, NULL, 0);
+        double secs = nowSeconds() - t0;
+        w->latency[n] = secs;
+        if (kind == 9) w->checkout[w->checkouts++] = secs;
+        if (ok != 1) w->failed++;
+        if (ok < 0) break;
+    }
+    serverDisconnect(&link);
+    return NULL;
+}
+
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Latency at a percentile of a sorted sample, in microseconds */
+double percentileUs(const double *sorted, long n, double pct) {
+    if (n == 0) return 0.0;
+    long i = (long)(pct / 100.0 * (double)(n - 1) + 0.5);
+    return sorted[i] * 1e6;
+}
+
+/* Start a server on a scratch catalog and drive it with concurrent clients;
+   reports requests/sec and p50 / p99 latency. Real data files are never
+   touched. */
+int benchServer(int argc, char **argv) {
+    int clients = argc > 0 ? atoi(argv[0]) : 16;
+    int requests = argc > 1 ? atoi(argv[1]) : 2000;
+    int medicines = argc > 2 ? atoi(argv[2]) : 10000;
+    if (clients < 1) clients = 1;
+    if (requests < 1) requests = 1;
+    if (medicines < 1) medicines = 1;
+
+    char dir[] = "/tmp/medstore-server-XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) { perror("Unable to create scratch directory"); return 1; }
+    inventoryLoad();
+    inventoryBeginChange();
+    for (int i = 0; i < medicines; ++i) {
+        Medicine m = { .id = i + 1, .price = 1.0, .quantity = 1 << 30,
+                       .expiry_day = 31, .expiry_month = 12, .expiry_year = 2099 };
+        snprintf(m.name, NAME_LEN, "Medicine %d", i + 1);
+        inventoryAppend(&m);
+    }
+    inventoryEndChange();
+    inventoryClose();
+
+    char path[sizeof(dir) + 16];
+    snprintf(path, sizeof(path), "%s/%s", dir, SERVER_SOCKET);
+    char *server_argv[] = { path };
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(1);
+        _exit(serveInventory(1, server_argv));
+    }
+    if (pid < 0) { perror("Unable to start server"); return 1; }
+    ServerLink probe;
+    int up = 0;
+    for (int i = 0; i < 500 && !up; ++i) {
+        up = serverConnect(&probe, path);
+        if (!up) usleep(10000);
+    }
+    if (up) serverDisconnect(&probe);
+
+    printf("%d clients x %d requests, %d medicines, %d checkout threads\n",
+           clients, requests, medicines, SERVER_CHECKOUT_THREADS);
+    pthread_t *tid = malloc(sizeof(pthread_t) * clients);
+    LoadClient *w = calloc(clients, sizeof(LoadClient));
+    double *latency = malloc(sizeof(double) * clients * (size_t)requests);
+    double *checkout = malloc(sizeof(double) * clients * (size_t)requests);
+    int ok = up && tid && w && latency && checkout;
+    double secs = 0.0;
+    long n = 0, nc = 0, failed = 0;
+    if (ok) {
+        double t0 = nowSeconds();
+        for (int i = 0; i < clients; ++i) {
+            w[i].path = path;
+            w[i].requests = requests;
+            w[i].medicines = medicines;
+            w[i].seed = 4242u + (unsigned)i;
+            w[i].latency = latency + (size_t)i * requests;
+            w[i].checkout = checkout + (size_t)i * requests;
+            pthread_create(&tid[i], NULL, loadClientRun, &w[i]);
+        }
+        for (int i = 0; i < clients; ++i) pthread_join(tid[i], NULL);
+        secs = nowSeconds() - t0;
+        for (int i = 0; i < clients; ++i) {
+            for (int k = 0; k < w[i].checkouts; ++k) checkout[nc++] = w[i].checkout[k];
+            failed += w[i].failed;
+        }
+        n = (long)clients * requests;
+        qsort(latency, n, sizeof(double), compareDoubles);
+        qsort(checkout, nc, sizeof(double), compareDoubles);
+        printf("%.0f requests/sec, p50 %.0f us, p99 %.0f us, max %.0f us\n",
+               n / secs, percentileUs(latency, n, 50), percentileUs(latency, n, 99), percentileUs(latency, n, 100));
+        printf("checkouts: %ld, p50 %.0f us, p99 %.0f us; %ld requests refused\n",
+               nc, percentileUs(checkout, nc, 50), percentileUs(checkout, nc, 99), failed);
+    } else {
+        fprintf(stderr, "Server did not come up\n");
+    }
+    free(tid); free(w); free(latency); free(checkout);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(DATAFILE); unlink(SHADOWFILE); unlink(SALESFILE); unlink(ROLLUPFILE); unlink(path);
+    if (chdir("/") == 0) rmdir(dir);
+    return ok ? 0 : 1;
+}
+
+/* Time full scans of a synthetic name column with ci_substr and each
+   ci_find kernel; match counts must agree */
+int benchSubstring(int argc, char **argv) {
+    int count = argc > 0 ? atoi(argv[0]) : 1000000;
+    if (count < 1) count = 1;
+    static const char *syllables[] = { "para", "ceta", "mol", "amoxi", "cillin", "ibu", "pro", "fen",
+                                       "ceti", "ri", "zine", "met", "for", "min", "lora", "ta", "dine",
+                                       "vita", "cal", "cium", "ome", "pra", "zole", "azi", "thro", "my" };
+    static const char *queries[] = { "para", "cillin", "ZOLE", "min 500", "xyzzy", "thromy" };
+    int nsyl = sizeof(syllables) / sizeof(syllables[0]);
+    int nq = sizeof(queries) / sizeof(queries[0]);
+
+    char (*names)[NAME_LEN] = malloc((size_t)count * NAME_LEN);
+    if (!names) { perror("Unable to allocate names"); return 1; }
+    unsigned int seed = 42;
+    for (int i = 0; i < count; ++i) {
+        int len = 0, parts = 2 + rand_r(&seed) % 4;
+        memset(names[i], 0, NAME_LEN);
+        for (int p = 0; p < parts; ++p)
+            len += snprintf(names[i] + len, NAME_LEN - len, "%s", syllables[rand_r(&seed) % nsyl]);
+        names[i][0] = (char)toupper((unsigned char)names[i][0]);
+        if (rand_r(&seed) % 3 == 0) snprintf(names[i] + len, NAME_LEN - len, " %d mg", 100 * (1 + rand_r(&seed) % 9));
+    }
+
+    const char *labels[] = { "ci_substr", "scalar", "sse2", "avx2" };
+    int (*kernels[4])(const char *, size_t, const char *, size_t) = { NULL, ci_find_scalar, NULL, NULL };
+    int nk = 2;
+#ifdef HAVE_X86_SIMD
+    kernels[nk++] = ci_find_sse2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) kernels[nk++] = ci_find_avx2;
+#endif
+
+    printf("%d names, ms per full scan\n%-10s", count, "query");
+    for (int k = 0; k < nk; ++k) printf(" %10s", labels[k]);
+    printf(" %8s\n", "matches");
+    for (int q = 0; q < nq; ++q) {
+        char needle[NAME_LEN];
+        strtolower_copy(queries[q], needle, sizeof(needle));
+        size_t nlen = strlen(needle);
+        int matches[4];
+        printf("%-10s", queries[q]);
+        for (int k = 0; k < nk; ++k) {
+            double t0 = nowSeconds();
+            matches[k] = 0;
+            for (int i = 0; i < count; ++i)
+                matches[k] += k == 0 ? ci_substr(names[i], queries[q])
+                                     : kernels[k](names[i], NAME_LEN, needle, nlen);
+            printf(" %10.2f", (nowSeconds() - t0) * 1000.0);
+        }
+        printf(" %8d", matches[0]);
+        for (int k = 1; k < nk; ++k)
+            if (matches[k] != matches[0]) printf("  MISMATCH(%s=%d)", labels[k], matches[k]);
+        printf("\n");
+    }
+    free(names);
+    return 0;
+}
+
+/* Scan a synthetic three-year sales history with 1, 2, 4 ... threads;
+   every run must produce the same totals */
+int benchScan(int argc, char **argv) {
+    int count = argc > 0 ? atoi(argv[0]) : 1000000;
+    int max_threads = argc > 1 ? atoi(argv[1]) : scanThreadCount();
+    if (count < 1) count = 1;
+    if (max_threads < 1) max_threads = 1;
+    if (max_threads > SCAN_MAX_THREADS) max_threads = SCAN_MAX_THREADS;
+
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) { perror("Unable to create scratch directory"); return 1; }
+    FILE *fp = fopen(SALESFILE, "w");
+    if (!fp) { perror("Unable to write sales history"); return 1; }
+    unsigned seed = 42;
+    int days = 3 * 365;
+    time_t start = time(NULL) - (time_t)days * 86400;
+    Cart cart;
+    cartInit(&cart);
+    for (int i = 0; i < count; ++i) {
+        time_t when = start + (time_t)((long long)i * days * 86400 / count);
+        int lines = 1 + rand_r(&seed) % 5;
+        cartClear(&cart);
+        for (int j = 0; j < lines; ++j) {
+            int line = cartLine(&cart, 1 + rand_r(&seed) % 1000);
+            double price = (1 + rand_r(&seed) % 5000) / 100.0;
+            if (cart.line[line].qty == 0) {
+                snprintf(cart.line[line].name, NAME_LEN, "Medicine %d", cart.line[line].med_id);
+                cart.line[line].price = price;
+            }
+            cartSetQty(&cart, line, cart.line[line].qty + 1 + rand_r(&seed) % 4);
+        }
+        double subtotal = cart.subtotal_cents / 100.0;
+        appendSaleRecord(fp, when, i % 3 ? "bench" : "", &cart, subtotal, subtotal * TAX_RATE, subtotal * (1 + TAX_RATE));
+    }
+    cartFree(&cart);
+    long size = ftell(fp);
+    fclose(fp);
+
+    ScanTotals base, t;
+    scanSales(0, 0, 1, &base);   /* warms the page cache */
+    printf("%d sales, %.1f MB, %d cores online\n", count, size / 1048576.0, scanThreadCount());
+    printf("%-8s %10s %10s %9s %8s %14s\n", "threads", "ms", "MB/s", "speedup", "steals", "revenue");
+    double single = 0;
+    for (int threads = 1; ; threads = threads * 2 > max_threads && threads < max_threads ? max_threads : threads * 2) {
+        double t0 = nowSeconds();
+        int ok = scanSales(0, 0, threads, &t);
+        double secs = nowSeconds() - t0;
+        if (threads == 1) single = secs;
+        printf("%-8d %10.2f %10.1f %8.2fx %8lld %14.2f\n", threads, secs * 1000.0, t.bytes / 1048576.0 / secs,
+               single / secs, t.steals, t.cents / 100.0);
+        if (!ok || t.sales != base.sales || t.units != base.units || t.cents != base.cents)
+            printf("Error: %d-thread scan disagrees with the single-thread totals\n", threads);
+        if (threads >= max_threads) break;
+    }
+    int today = todayDayNumber();
+    double t0 = nowSeconds();
+    scanSales(today - 89, today, max_threads, &t);
+    printf("last 90 days, %d threads: %lld sales, %.2f revenue, %.2f ms\n", max_threads, t.sales, t.cents / 100.0,
+           (nowSeconds() - t0) * 1000.0);
+
+    unlink(SALESFILE);
+    if (chdir("/") == 0) rmdir(dir);
+    return 0;
+}
+
+/* Parse a synthetic sales history of the given size three ways: the old
+   fgetc dump, the fgets/sscanf record reader and the mmap parser */
+int benchHistory(int argc, char **argv) {
+    long mb = argc > 0 ? atol(argv[0]) : 1024;
+    if (mb < 1) mb = 1;
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) { perror("Unable to create scratch directory"); return 1; }
+    FILE *fp = fopen(SALESFILE, "w");
+    if (!fp) { perror("Unable to write sales history"); return 1; }
+    unsigned seed = 7;
+    long target = mb << 20;
+    long span = 3 * 365 * 86400L;   /* three years up to today, spread by file position */
+    time_t start = time(NULL) - span;
+    Cart cart;
+    cartInit(&cart);
+    long count = 0;
+    while (ftell(fp) < target) {
+        int lines = 1 + rand_r(&seed) % 5;
+        cartClear(&cart);
+        for (int j = 0; j < lines; ++j) {
+            int line = cartLine(&cart, 1 + rand_r(&seed) % 1000);
+            double price = (1 + rand_r(&seed) % 5000) / 100.0;
+            if (cart.line[line].qty == 0) {
+                snprintf(cart.line[line].name, NAME_LEN, "Medicine %d", cart.line[line].med_id);
+                cart.line[line].price = price;
+            }
+            cartSetQty(&cart, line, cart.line[line].qty + 1 + rand_r(&seed) % 4);
+        }
+        double subtotal = cart.subtotal_cents / 100.0;
+        char customer[NAME_LEN];
+        snprintf(customer, sizeof(customer), count % 3 ? "Customer %d" : "", rand_r(&seed) % 5000);
+        time_t when = start + (time_t)((double)ftell(fp) / target * span);
+        appendSaleRecord(fp, when, customer, &cart, subtotal, subtotal * TAX_RATE, subtotal * (1 + TAX_RATE));
+        count++;
+    }
+    cartFree(&cart);
+    long size = ftell(fp);
+    fclose(fp);
+    printf("%ld sales, %.1f MB\n", count, size / 1048576.0);
+    printf("%-22s %10s %10s %12s %16s\n", "reader", "ms", "MB/s", "sales", "revenue");
+
+    /* old viewer: one fgetc per byte, output left out */
+    double t0 = nowSeconds();
+    long newlines = 0;
+    fp = fopen(SALESFILE, "r");
+    for (int ch; (ch = fgetc(fp)) != EOF; ) newlines += ch == '\n';
+    fclose(fp);
+    double secs = nowSeconds() - t0;
+    printf("%-22s %10.1f %10.1f %12s %16ld\n", "fgetc dump (lines)", secs * 1000.0, size / 1048576.0 / secs, "-", newlines);
+
+    SaleSummary s = { 0 };
+    long long sales = 0, cents = 0;
+    t0 = nowSeconds();
+    fp = fopen(SALESFILE, "r");
+    while (rollupReadSale(fp, &s)) {
+        sales++;
+        for (int i = 0; i < s.lines; ++i) cents += s.line[i].cents;
+    }
+    fclose(fp);
+    free(s.line);
+    secs = nowSeconds() - t0;
+    printf("%-22s %10.1f %10.1f %12lld %16.2f\n", "fgets + sscanf", secs * 1000.0, size / 1048576.0 / secs, sales, cents / 100.0);
+
+    long long mapped_sales = 0, mapped_cents = 0;
+    t0 = nowSeconds();
+    SalesMap map;
+    if (!salesMapOpen(&map)) return 1;
+    const char *cursor = map.data, *end = map.data + map.size;
+    SaleRecord r;
+    SaleLine l;
+    while (saleParseNext(&cursor, end, &r)) {
+        mapped_sales++;
+        for (const char *item = r.items; saleNextLine(&item, r.items_end, &l); ) mapped_cents += l.line_cents;
+    }
+    secs = nowSeconds() - t0;
+    printf("%-22s %10.1f %10.1f %12lld %16.2f\n", "mmap parser", secs * 1000.0, size / 1048576.0 / secs,
+           mapped_sales, mapped_cents / 100.0);
+    if (mapped_sales != sales || mapped_cents != cents) printf("Error: parsers disagree\n");
+
+    /* a history view query: one medicine, one customer, last 30 days */
+    SaleFilter f = { .first_day = todayDayNumber() - 29, .med_id = 500 };
+    strcpy(f.customer, "customer 1");
+    long long matches = 0;
+    t0 = nowSeconds();
+    cursor = map.data;
+    while (saleParseNext(&cursor, end, &r)) matches += saleMatches(&r, &f);
+    secs = nowSeconds() - t0;
+    printf("%-22s %10.1f %10.1f %12lld %16s\n", "mmap filtered query", secs * 1000.0, size / 1048576.0 / secs, matches, "-");
+    salesMapClose(&map);
+
+    unlink(SALESFILE);
+    if (chdir("/") == 0) rmdir(dir);
+    return 0;
 }
 
 /* Main menu */
-int main() {
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench-group-commit") == 0)
+        return benchGroupCommit(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--bench-stock") == 0)
+        return benchStock(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--bench-checkout") == 0)
+        return benchCheckout(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--bench-substring") == 0)
+        return benchSubstring(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--bench-scan") == 0)
+        return benchScan(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--bench-history") == 0)
+        return benchHistory(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--stress-locks") == 0)
+        return stressLocks(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--crash-test") == 0)
+        return crashTest(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--bench-server") == 0)
+        return benchServer(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0)
+        return serveInventory(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--client") == 0)
+        return clientMenu(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--rebuild-rollups") == 0) {
+        rollupRebuild();
+        if (!rollupSave()) return 1;
+        printf("Rebuilt from %ld bytes of %s: %d hours, %d days, %d medicines.\n", rollups.covered, SALESFILE,
+               rollups.table[ROLLUP_HOURLY].count, rollups.table[ROLLUP_DAILY].count, rollups.table[ROLLUP_MEDICINE].count);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--migrate-data") == 0)
+        return migrateDataFile(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--compact") == 0) {
+        inventoryLoad();
+        int ok = compactDataFile();
+        inventoryClose();
+        return ok ? 0 : 1;
+    }
+
     int choice;
+    inventoryLoad();
+    rollupLoad();
+    if (!groupCommitOpen()) return 1;
     do {
         printf("\n=== Medical Store Management System ===\n");
         printf("1. Admin Panel\n");
@@ -487,5 +5161,8 @@ int main() {
         }
     } while (choice != 0);
 
+    rollupCheckpoint(1);
+    close(groupCommit.sales_fd);
+    inventoryClose();
     return 0;
 }
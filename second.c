@@ -1,8 +1,30 @@
+#define _GNU_SOURCE             // open file description locks (F_OFD_SETLKW)
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
 // Structure for Medicine
 typedef struct {
@@ -14,19 +36,94 @@ typedef struct {
     char expiry_date[20];
 } Medicine;
 
+// The medicine file on disk: a DataHeader, then one MedicineRecord per
+// slot. Both have fixed-width fields at fixed offsets and explicit padding,
+// the same in first.c, so the file depends on neither program's Medicine
+// nor on the compiler, and can be mapped and read in place. Records are
+// DATA_RECORD bytes and start DATA_RECORD bytes in, so none straddles a
+// page. Native byte order. Every commit bumps the header's generation and
+// stamps the records it writes with it, so a terminal can tell which
+// records changed since it last read the file.
+#define DATA_MAGIC 0x3144454Du      // "MED1"
+#define DATA_VERSION 1
+#define DATA_RECORD 256
+#define DATA_HEADER DATA_RECORD
+#define DATA_NAME 128
+#define DATA_CATEGORY 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;           // offset of the first record
+    uint32_t record_size;
+    uint32_t generation;            // commits so far
+    unsigned char reserved[DATA_HEADER - 20];
+} DataHeader;
+
+typedef struct {
+    int32_t id;
+    int32_t quantity;
+    double price;
+    int32_t expiry_day;             // 0/0/0 = no date
+    int32_t expiry_month;
+    int32_t expiry_year;
+    uint32_t generation;            // header generation of the commit that last wrote this
+    char name[DATA_NAME];           // NUL-padded
+    char category[DATA_CATEGORY];
+    unsigned char padding[DATA_RECORD - 32 - DATA_NAME - DATA_CATEGORY];
+} MedicineRecord;
+
+_Static_assert(sizeof(DataHeader) == DATA_HEADER && sizeof(MedicineRecord) == DATA_RECORD &&
+               offsetof(MedicineRecord, name) == 32, "medicine file layout");
+
+// Layouts the medicine file had before the header, read by --migrate-data:
+// the other store program's old record and this program's old Medicine
+typedef struct {
+    int id;
+    char name[64];
+    double price;
+    int quantity;
+    int expiry_day;
+    int expiry_month;
+    int expiry_year;
+} LegacyStoreMedicine;
+
+typedef struct {
+    int id;
+    char name[100];
+    float price;
+    int quantity;
+    char category[50];
+    char expiry_date[20];
+} LegacyCatalogMedicine;
+
 // Structure for Cart Item
 typedef struct CartItem {
     int medicine_id;
     char medicine_name[100];
     float price;
     int quantity;
-    struct CartItem* next;
+    unsigned int version;       // version of the record the line was priced from
+    int prev;                   // lines in the order they were added, -1 at the ends
+    int next;
 } CartItem;
 
-// Structure for Cart
+// Structure for Cart. There is no limit on its size: lines come from a pool
+// that doubles when it runs out and are chained in the order they were
+// added, so receipts keep that order, and removed lines go on a free list.
+// The index finds a medicine's line by id (linear probing, twice the pool
+// size, -1 = empty); a removal shifts the rest of its cluster back instead
+// of leaving a tombstone. The subtotal is kept as lines change.
 typedef struct {
-    CartItem* items;
+    CartItem* items;            // line pool
+    int capacity;
     int item_count;
+    int head;                   // first and last line added, -1 when empty
+    int tail;
+    int free_item;              // first unused line, -1 when the pool is full
+    int* index;
+    int index_capacity;
+    long long subtotal_cents;
     float subtotal;
     float tax;
     float total;
@@ -40,21 +137,499 @@ typedef struct {
     int quantity;
 } TransactionItem;
 
-// Structure for Transaction
+// Structure for Transaction. It owns its items, allocated to the size of
+// the cart it is made from (transactionReserve), so it has no size limit
 typedef struct {
     int transaction_id;
     char date[20];
     char time[20];
     float amount;
     int items_count;
-    TransactionItem items[100]; // Store details of purchased items
+    TransactionItem* items;     // items_count lines
 } Transaction;
 
+// The fixed-size transaction record the transaction file held before
+// frames, read only by the converter
+#define LEGACY_TRANSACTION_ITEMS 100
+
+typedef struct {
+    int transaction_id;
+    char date[20];
+    char time[20];
+    float amount;
+    int items_count;
+    TransactionItem items[LEGACY_TRANSACTION_ITEMS];
+} LegacyTransaction;
+
+// Transactions are stored as frames: a header followed by exactly
+// items_count TransactionItems. The index file holds one entry per frame,
+// so listings read only headers and a single sale is found by seeking.
+#define TRANSACTION_MAGIC 0x314e5254u   // "TRN1", also tells frames from the old layout
+
+typedef struct {
+    unsigned int magic;
+    int transaction_id;
+    long long timestamp;        // seconds since the epoch
+    char date[20];
+    char time[20];
+    float amount;
+    int items_count;
+} TransactionHeader;
+
+typedef struct {
+    int transaction_id;
+    int items_count;
+    long long timestamp;
+    long long offset;           // where the frame starts in the transaction file
+} TransactionIndexEntry;
+
+// Sales totals for one bucket: an hour (day * 24 + hour), a day (day
+// number), a medicine (ID) or a medicine on a day (day << 32 | ID).
+// Revenue is kept in cents before tax so the tables add up exactly.
+typedef struct {
+    long long key;
+    long long units;
+    long long cents;
+    int sales;
+} RollupBucket;
+
+// Buckets sorted by key; sales arrive in time order, so new hours and
+// days are appended at the end
+typedef struct {
+    RollupBucket* buckets;
+    int count;
+    int capacity;
+} RollupTable;
+
+#define ROLLUP_HOURLY 0
+#define ROLLUP_DAILY 1
+#define ROLLUP_MEDICINE 2
+#define ROLLUP_MEDICINE_DAILY 3
+#define ROLLUP_TABLES 4
+#define ROLLUP_MAGIC 0x31555254u        // "TRU1"; the store program's rollups are "SRU1"
+
+typedef struct {
+    RollupTable tables[ROLLUP_TABLES];
+    long long covered;          // bytes of the transaction file the tables include
+} SalesRollups;
+
+// Rollup file header, followed by each table's buckets in order
+typedef struct {
+    unsigned int magic;
+    int count[ROLLUP_TABLES];
+    long long covered;
+} RollupHeader;
+
+// History scans cut the transaction file into chunks of whole frames (the
+// boundaries come from the index) and scan them on a small thread pool.
+// Each worker owns a run of chunks, takes from its front and steals from
+// the back of the others once its own run is empty; per-worker totals are
+// merged when all are done.
+#define SCAN_CHUNK_BYTES (4 << 20)
+#define SCAN_MAX_THREADS 64
+
+typedef struct {
+    long long offset;
+    long long length;
+} ScanChunk;
+
+// Sales between two dates, both inclusive; 0 leaves that end open
+typedef struct {
+    int first_day;
+    int last_day;
+} ScanFilter;
+
+typedef struct {
+    long long transactions;
+    long long items;
+    long long cents;            // amounts summed in cents so any split adds up the same
+    long long bytes;            // frame bytes read
+    long long steals;
+    int errors;
+} ScanTotals;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int head;                   // next chunk the owner takes
+    int tail;                   // one past the chunk a thief takes
+} ScanDeque;
+
+typedef struct {
+    int fd;
+    ScanChunk* chunks;
+    ScanDeque* deques;
+    int threads;
+    long long from;             // timestamp range, [from, to)
+    long long to;
+} ScanJob;
+
+typedef struct {
+    ScanJob* job;
+    int self;
+    ScanTotals totals;
+} ScanWorker;
+
+// A transaction joined to the catalog: one line per distinct medicine
+typedef struct {
+    int medicine_id;
+    int slot;       // -1 when the medicine is no longer in the catalog
+    int quantity;   // all lines of the medicine together
+} SaleLine;
+
+
+// A record a commit writes: its slot in the medicine file and new contents
+typedef struct {
+    int slot;
+    Medicine record;
+} RecordImage;
+
+// Reorder level stored in the reorder file for a medicine that has its own
+typedef struct {
+    int medicine_id;
+    int level;
+} ReorderLevel;
+
+// Category dictionary: every distinct category (compared ignoring case)
+// gets a small code in the order it was first seen. Names are kept in the
+// category file in code order, so codes stay the same between runs.
+typedef struct {
+    char name[50];
+    int* ids;                   // medicines in the category, sorted by ID
+    int count;
+    int capacity;
+} CategoryEntry;
+
+typedef struct {
+    CategoryEntry* entries;
+    int count;
+    int capacity;
+    int* index;                 // open-addressed folded name -> code, -1 = empty
+    int index_capacity;         // power of two, at most half full
+} CategoryDictionary;
+
+// Medicines are handed out from fixed-size pool blocks so a record never
+// moves once allocated, no matter how large the catalog grows
+#define MEDICINE_POOL_BLOCK 256
+
+typedef struct MedicineBlock {
+    Medicine records[MEDICINE_POOL_BLOCK];
+    struct MedicineBlock* next;
+} MedicineBlock;
+
+// In-memory catalog, loaded once and kept for the whole session.
+// Slot i mirrors record i of the medicine file; only dirty slots are
+// written back.
+typedef struct {
+    MedicineBlock* blocks;      // pool blocks, newest first
+    int block_used;             // records handed out from the newest block
+    Medicine* free_list;        // released records, chained through their own storage
+    Medicine** slots;
+    int count;
+    int capacity;
+    int* index;                 // open-addressed id -> slot, -1 = empty
+    int index_capacity;         // power of two, at most half full
+    unsigned char* dirty;       // per-slot dirty flag
+    int* dirty_slots;           // slots waiting to be written back
+    int dirty_count;
+    int file_count;             // records currently stored in the file
+    uint32_t generation;        // header generation the slots were last brought up to
+    int max_id;
+    // Columnar copy of the fields reports scan, slot-aligned with slots[]
+    // and refreshed whenever a slot is marked dirty
+    int* column_id;
+    float* column_price;
+    int* column_quantity;
+    int* column_expiry;         // days since 1970-01-01, 0 = unparsable
+    int* column_category;       // category code, see CategoryDictionary
+    int* reorder_level;         // per slot; below this the medicine is low stock
+    struct stat reorder_file;   // the reorder file as last read or written here
+    int* low_stock_heap;        // low-stock slots, min-heap on quantity then ID
+    int* low_stock_position;    // heap position per slot, -1 = not low
+    int low_stock_count;
+    unsigned int* version;      // per slot, restamped on every change to the record
+    unsigned int version_clock; // last stamp handed out; stamps never repeat
+    FILE* file;
+    int sales_since_save;       // checkouts since the sales rollups were last saved
+    int commits_in_flight;      // checkouts between taking their record locks and writing back
+    pthread_mutex_t lock;       // serializes concurrent checkouts
+} Catalog;
+
+// Several terminals can share one medicine file. They coordinate with
+// fcntl locks: record i is locked over its own bytes, and one byte far
+// past the records stands for the file layout. Checkouts hold the layout
+// lock shared and their records exclusively, so checkouts on different
+// medicines run in parallel. Adding, removing or editing medicines and
+// saving the sales rollups hold it exclusively and reload the catalog first.
+// Open file description locks (Linux) also keep the threads of one
+// terminal apart; elsewhere the per-process locks are used.
+#define CATALOG_LAYOUT_LOCK ((off_t)1 << 40)
+#ifdef F_OFD_SETLKW
+#define LOCK_WAIT F_OFD_SETLKW
+#define LOCK_TRY F_OFD_SETLK
+#else
+#define LOCK_WAIT F_SETLKW
+#define LOCK_TRY F_SETLK
+#endif
+
+// Stock a checkout can still claim: one cache-line-padded atomic counter
+// per medicine ID, so checkouts of different medicines never share a line.
+// A checkout reserves every line of its transaction with compare-and-swap
+// before it takes any lock. The counters trail the records by the units
+// reserved by checkouts still in flight. They live in pages of STOCK_PAGE
+// IDs that are allocated once and never move, so reads need no lock.
+#define STOCK_PAGE 1024
+#define STOCK_PAGES 4096            // IDs up to 4M have counters; higher IDs skip them
+#define STOCK_BENCH_HOT_PERCENT 90  // share of --bench-stock lines on the hot medicines
+
+typedef struct {
+    _Alignas(64) atomic_int available;
+    int synced;                     // record quantity folded in so far (catalog lock)
+    int generation;                 // last catalog build that saw the ID
+} StockCounter;
+
+typedef struct {
+    StockCounter* _Atomic pages[STOCK_PAGES];
+    int generation;
+} StockCounters;
+
+// Medicines sorted by case-folded name (ties by ID) for prefix lookups.
+// Pool records never move, so the index holds pointers to them.
+typedef struct {
+    Medicine** entries;
+    int count;
+    int capacity;
+} NameIndex;
+
+// Medicines ordered by expiry day number (ties by ID). Records whose
+// expiry date does not parse are left out.
+typedef struct {
+    int day;
+    Medicine* medicine;
+} ExpiryEntry;
+
+typedef struct {
+    ExpiryEntry* entries;
+    int count;
+    int capacity;
+} ExpiryIndex;
+
+// Group commit streams: a batch is one shadow commit of its checkouts'
+// records that also appends to the three transaction files
+#define GC_RECORDS 0
+#define GC_TRANSACTION_BIN 1
+#define GC_TRANSACTION_TEXT 2
+#define GC_TRANSACTION_INDEX 3
+#define GC_STREAMS 4
+
+// A batch of checkouts that become durable together. Transaction IDs are
+// handed out when the batch is written, so the text stream is only filled
+// in then, from the checkouts' transactions.
+typedef struct CommitBatch {
+    char* buffer[GC_STREAMS];
+    size_t length[GC_STREAMS];
+    size_t capacity[GC_STREAMS];
+    Transaction** sales;        // the checkouts' transactions, in log order
+    int count;                  // checkouts in the batch
+    int waiting;                // checkouts not yet told the outcome
+    int closed;                 // leader started writing, no more joiners
+    int done;                   // 1 = durable, -1 = write failed
+    struct CommitBatch* next;
+} CommitBatch;
+
+// Checkouts queue their bytes into the open batch. The first waiter of the
+// oldest batch leads: it writes and syncs the whole batch and wakes the
+// others, while checkouts arriving meanwhile pile into the next batch.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int enabled;                // 0 = every checkout is its own batch
+    long window_us;             // how long a leader waits for the batch to fill
+    int batch_size;             // close a batch early at this many checkouts
+    int fd[GC_STREAMS];         // transaction files; none for GC_RECORDS
+    CommitBatch* head;          // oldest batch, written next
+    CommitBatch* tail;          // batch accepting new checkouts
+    int writing;
+    int failed;                 // a batch could not be written; refuse more
+    long batches;
+    long commits;
+} GroupCommit;
+
+// Commits go through the shadow file. The medicine file pages a commit
+// changes are written there first, and one header write publishes them
+// together with the new length of the medicine file and of each
+// transaction file. Two header slots (picked by seq parity) mean a torn
+// header write falls back to the commit before it.
+// The store program (first.c) commits through the same shadow file, header
+// and commit lock, and logs its sales to SHADOW_SALES. Every commit
+// publishes the length of all of shadowFiles, so a start of either program
+// finishes the last commit whichever wrote it.
+#define SHADOW_MAGIC 0x32444853u    // "SHD2"
+#define SHADOW_PAGE 4096            // unit of the medicine file a commit copies
+#define SHADOW_SLOT 512             // room for each of the two headers
+#define SHADOW_APPLIED (2 * SHADOW_SLOT)  // seq of the last commit written back
+#define SHADOW_IMAGES SHADOW_PAGE   // page images start here
+
+#define SHADOW_DATA 0               // the medicine file
+#define SHADOW_SALES 1              // the store program's sales history
+#define SHADOW_FILES 5              // then one per transaction stream, in stream order
+
+typedef struct {
+    unsigned int magic;
+    unsigned int checksum;      // of the header with this field 0
+    long long seq;              // commit number, 0 = no commit yet
+    // Each of shadowFiles' length after the commit, -1 = unknown; a
+    // missing file counts as empty
+    long long size[SHADOW_FILES];
+    long long images;           // offset of the page images in the shadow file
+    int pages;
+    int reserved;
+} ShadowHeader;
+
+// One shadowed page: its number in the medicine file and its new contents
+typedef struct {
+    long long page;
+    unsigned char data[SHADOW_PAGE];
+} ShadowImage;
+
+// The commit lock: a mutex for this terminal's threads and an fcntl lock
+// on the shadow file for the other terminals
+typedef struct {
+    int fd;
+    pthread_mutex_t lock;
+} Shadow;
+
+// --crash-test: the process dies at this write point of a commit (0 = off)
+#define FAULT_SALES 1               // appending the transactions
+#define FAULT_IMAGES 2              // writing the page images
+#define FAULT_SYNCED 3              // images and transactions synced, header not written
+#define FAULT_HEADER 4              // writing the header
+#define FAULT_COMMITTED 5           // header synced, nothing written back
+#define FAULT_APPLY 6               // writing the pages back
+#define FAULT_APPLIED 7             // pages written back and synced
+#define FAULT_POINTS 7
+#define FAULT_EXIT 86
+
+// Columns of the CSV catalog format, in export order
+#define CSV_ID 0
+#define CSV_NAME 1
+#define CSV_PRICE 2
+#define CSV_QUANTITY 3
+#define CSV_CATEGORY 4
+#define CSV_EXPIRY 5
+#define CSV_REORDER 6
+#define CSV_COLUMNS 7
+#define CSV_MAX_FIELDS 32           // fields kept per row; later ones are ignored
+#define CSV_FIELD_SIZE 128          // longer fields are cut to this
+#define CSV_REPORTED_ERRORS 10      // rejected rows described before going quiet
+
+// One CSV record at a time, parsed into buffers reused for every row
+typedef struct {
+    FILE* file;
+    long lines;                 // line breaks consumed so far
+    long line;                  // line the current record starts on
+    int count;                  // fields in the current record
+    char field[CSV_MAX_FIELDS][CSV_FIELD_SIZE];
+} CsvReader;
+
+// Case-insensitive name to slot table that stands in for the name index
+// while an import defers it. Renames leave stale entries behind; lookups
+// skip them because the slot's current name no longer matches.
+typedef struct {
+    int* slots;
+    unsigned int capacity;
+    int used;
+} ImportNames;
+
+typedef struct {
+    long rows;
+    long inserted;
+    long updated;
+    long rejected;
+    int reorder_changed;
+} ImportStats;
+
+// Server mode: one process owns the catalog and answers customer terminals
+// over a Unix domain socket. Requests are single lines; a reply starts with
+// "OK <lines> [message]" or "ERR <message>" and is followed by <lines>
+// display lines that the client prints as they are.
+//   PING | CATEGORIES | BROWSE category | SEARCH term | PREFIX text
+//   ADD id quantity | REMOVE id quantity | CART | CHECKOUT amount_paid
+// Carts live in the server, one per connection. A non-blocking epoll loop
+// answers everything except checkouts. Checkouts go to worker threads, so
+// their fsyncs share group commit batches instead of stalling the loop.
+#define SERVER_SOCKET "medstore.sock"
+#define SERVER_CHECKOUT_THREADS 8   // threads committing checkouts (group commit)
+#define SERVER_MAX_EVENTS 64
+#define SERVER_LINE_MAX 4096        // longest request or reply line
+#define SERVER_OUTPUT_HIGH (1 << 20) // stop reading a client with this much unsent
+
+typedef struct Connection {
+    int fd;
+    char* input;
+    size_t input_length;
+    size_t input_capacity;
+    char* output;
+    size_t output_length;
+    size_t output_sent;
+    size_t output_capacity;
+    size_t reply_start;         // display lines of the reply being built start here
+    Cart cart;
+    int busy;                   // a checkout worker has it; input waits
+    int closing;                // peer hung up or broke the protocol
+    Transaction* trans;         // checkout being committed
+    float paid;
+    int result;                 // commitSale result
+    struct Connection* next;    // checkout queue link
+} Connection;
+
+typedef struct {
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;                // eventfd the workers signal when done
+    pthread_mutex_t lock;       // guards the queues below
+    pthread_cond_t cond;
+    Connection* queue_head;     // checkouts waiting for a worker
+    Connection* queue_tail;
+    Connection* done;           // finished checkouts, back to the loop
+    int stopping;
+} Server;
+
+// Thin client side: a connection to the server with a buffered reader
+typedef struct {
+    int fd;
+    FILE* in;
+} ServerLink;
+
+typedef struct {
+    const char* path;
+    int requests;
+    int medicines;
+    unsigned int seed;
+    double* latency;            // seconds per request
+    double* checkout;           // seconds per checkout
+    int checkouts;
+    int answered;               // requests with a latency recorded
+    int failed;
+    int misframed;              // replies not framed right; the connection is given up
+} LoadClient;
+
 // Global variables
-#define MAX_MEDICINES 1000
 #define MEDICINE_FILE "medicines.dat"
 #define TRANSACTION_BIN_FILE "transactions.dat"
 #define TRANSACTION_TEXT_FILE "transactions.txt"
+#define TRANSACTION_INDEX_FILE "transactions.idx"
+#define SHADOW_FILE "medicines.shadow"
+#define ROLLUP_SAVE_SALES 1024      // checkouts between saves of the sales rollups
+#define GROUP_COMMIT_WINDOW_US 0    // extra time a batch leader waits for followers
+#define GROUP_COMMIT_BATCH 64       // close a batch early at this many checkouts
+#define QUICK_FIND_TOP 10           // prefix matches shown by quick find
+#define REFRESH_MAX_RECORDS 256     // changed records past which a reload beats catching up
+#define REORDER_LEVEL_FILE "reorder_levels.dat"  // shared with the store program
+#define CATEGORY_FILE "categories.dat"
+#define SALES_ROLLUP_FILE "transaction_rollup.dat"  // the store program's are in sales_rollup.dat
+#define TOP_SELLERS 10              // medicines listed by the top sellers report
+#define LOW_STOCK_THRESHOLD 10      // reorder level of medicines without their own
+#define COLUMN_LANES 8              // independent accumulators in column reductions
 #define ADMIN_PASSWORD "admin123"
 
 // Function prototypes
@@ -68,25 +643,301 @@ void searchMedicine();
 void updateMedicine();
 void deleteMedicine();
 void viewLowStock();
+void inventorySummary();
+void viewExpiringMedicines();
 void browseMedicines();
+void quickFind();
 void addToCart(Cart* cart);
 void removeFromCart(Cart* cart);
 void viewCart(Cart* cart);
+void cartInit(Cart* cart);
+void cartFree(Cart* cart);
+void cartClear(Cart* cart);
+long long cartLineCents(const CartItem* item);
+void cartIndexInsert(Cart* cart, int line);
+int cartFind(const Cart* cart, int medicine_id);
+void cartGrow(Cart* cart);
+int cartLine(Cart* cart, int medicine_id);
+void cartRemove(Cart* cart, int line);
+void cartSetQuantity(Cart* cart, int line, int quantity);
+void cartTotals(Cart* cart);
+int transactionReserve(Transaction* trans, int count);
+void transactionFree(Transaction* trans);
+int cartToTransaction(const Cart* cart, Transaction* trans);
+void cartTake(Cart* cart, int line, int slot);
+int cartValidate(Cart* cart, char* message, size_t message_size);
 void checkout(Cart* cart);
 void processPayment(Cart* cart);
-void saveTransactionToBinary(Transaction* trans);
-void saveTransactionToText(Transaction* trans);
+void saveTransactionToBinary(FILE* file, Transaction* trans);
+void saveTransactionToText(FILE* file, Transaction* trans);
 void viewTransactions();
+void viewTransactionDetails();
+long long transactionTimestamp(const Transaction* trans);
+long long transactionFrameSize(int items_count);
+int readTransactionHeader(FILE* file, TransactionHeader* header);
+TransactionIndexEntry* loadTransactionIndex(int* count);
+int convertTransactionFile();
+void recoverTransactionFiles();
 void viewTransactionsFromText();
-void loadMedicines(Medicine medicines[], int* count);
-void saveMedicines(Medicine medicines[], int count);
+void fillTransactionHeader(TransactionHeader* header, const Transaction* trans);
+RollupBucket* rollupBucket(RollupTable* table, long long key);
+int rollupLowerBound(const RollupTable* table, long long key);
+void rollupApply(const TransactionHeader* header, const TransactionItem* items, int sign);
+int rollupReplay(FILE* file);
+int rollupCatchUp();
+void rebuildSalesRollups();
+int saveSalesRollups();
+void loadSalesRollups();
+void viewDailySales();
+void viewTopSellers();
+void viewSalesVelocity();
+int scanTransactions(const ScanFilter* filter, int threads, ScanTotals* totals);
+int scanThreadCount();
+void viewSalesTotals();
+int benchScan(int argc, char* argv[]);
+double nowSeconds();
+int csvReadRecord(CsvReader* reader);
+int importCatalogCsv(const char* path);
+int exportCatalogCsv(const char* path);
+void importMedicines();
+void exportMedicines();
+long long dataOffset(int slot);
+void medicineToRecord(MedicineRecord* record, const Medicine* med);
+void medicineFromRecord(Medicine* med, const MedicineRecord* record);
+int dataFileCheck(int fd);
+void loadMedicines();
+void catalogReadRecords();
+void catalogCloseFreeSlots(int fd);
+void catalogCompactFreeSlots();
+void catalogReload();
+int catalogSlotStale(int slot, const MedicineRecord* record);
+int catalogRefresh();
+int legacyStorePlausible(const LegacyStoreMedicine* med);
+int legacyCatalogPlausible(const LegacyCatalogMedicine* med);
+int legacyLayout(const unsigned char* data, size_t size);
+void legacyStoreToRecord(MedicineRecord* record, const LegacyStoreMedicine* med);
+void legacyCatalogToRecord(MedicineRecord* record, const LegacyCatalogMedicine* med);
+int migrateDataFile(int argc, char* argv[]);
+int fileLock(int fd, int type, off_t start, off_t length, int wait);
+int layoutLock(int fd, int type, int wait);
+int catalogBeginChange();
+void catalogEndChange();
+void catalogCheckpoint(int wait);
+void catalogAdopt(int slot, const Medicine* fresh);
+int catalogRefreshSlots(int fd, const int slots[], int count);
+int stressTerminal(int checkouts, unsigned int seed);
+int stressLocks(int argc, char* argv[]);
+void crashScenario(int scenario);
+int crashOutcome(int scenario);
+int crashTest(int argc, char* argv[]);
+void connPrintf(Connection* c, const char* format, ...);
+void connBegin(Connection* c);
+void connReply(Connection* c, int ok, const char* message);
+void connRequest(Connection* c, char* line);
+void connProcess(Connection* c);
+void connUpdate(Connection* c);
+void* serverCheckoutWorker(void* arg);
+void serverFinishCheckouts();
+int serveCatalog(int argc, char* argv[]);
+int serverConnect(ServerLink* link, const char* path);
+int serverSend(ServerLink* link, const char* request);
+int serverReadReply(ServerLink* link, int show, char* message, size_t message_size);
+int serverRequest(ServerLink* link, const char* request, int show, char* message, size_t message_size);
+int clientPanel(int argc, char* argv[]);
+int benchServer(int argc, char* argv[]);
+int writeAll(int fd, const char* data, size_t length);
+int pwriteAll(int fd, const char* data, size_t length, off_t at);
+int shadowOpen();
+int faultWrite(int point, int fd, const void* data, size_t length, off_t at);
+void faultCheck(int point);
+unsigned int shadowChecksum(const ShadowHeader* header);
+void shadowNewest(ShadowHeader* header, long long* applied);
+int shadowLock(int wait);
+void shadowUnlock();
+int shadowApply(const ShadowHeader* header, const ShadowImage images[], int fd);
+int shadowRecover(ShadowHeader* header);
+void shadowCatchUp();
+int compareRecordImages(const void* a, const void* b);
+int lastTransactionId();
+int batchNumber(CommitBatch* batch);
+int batchAppend(CommitBatch* batch, int stream, const void* data, size_t length);
+int shadowCommit(RecordImage records[], int count, long long size, CommitBatch* batch);
+void catalogBuildIndexes();
+int saveMedicines();
+void freeMedicines();
+Medicine* findMedicine(int id);
+unsigned int hashMedicineId(int id);
+void indexReserve(int needed);
+void indexRemove(int slot);
+void indexMove(int from, int to);
+int findMedicineSlot(int id);
+int catalogAppend(const Medicine* med);
+Medicine* catalogAdd(const Medicine* med);
+void catalogMarkDirty(int slot);
+void catalogIndexSlot(int slot);
+void catalogUnindex(int slot);
+void catalogCloseSlot(int slot);
+int catalogRemove(int id);
+void catalogSyncColumns(int slot);
+StockCounter* stockCounter(int id, int create);
+void stockSync(int slot);
+void stockSweep();
+void stockForget(int id);
+int stockReserveTransaction(const Transaction* trans);
+void stockReleaseTransaction(const Transaction* trans);
+void stockConsume(int slot, int quantity);
+int dayNumber(int day, int month, int year);
+int expiryDayNumber(const char* text);
+int todayDayNumber();
+int normalizeExpiryDate(const char* input, char* output, size_t output_size);
+int slotExpired(int slot, int today);
+void expiryIndexInsert(Medicine* med);
+void expiryIndexRemove(Medicine* med);
+int expiryLowerBound(int day, int id);
+double columnsInventoryValue(long long* units);
+int categoryIntern(const char* name);
+void categoryAssign(int slot);
+void categoryPostingAppend(int code, int id);
+void categoryPostingInsert(int code, int id);
+int compareIds(const void* a, const void* b);
+void categoryPostingRemove(int code, int id);
+void loadCategories();
+unsigned int categoryHash(const char* name);
+int lowStockBefore(int a, int b);
+void lowStockUpdate(int slot);
+void lowStockRemove(int slot);
+int reorderFileChanged(int note);
+void loadReorderLevels();
+void refreshReorderLevels();
+int saveReorderLevels();
+int columnsSelectBelow(int threshold, int out[]);
+int joinSaleLines(const Transaction* trans, SaleLine lines[]);
+int lockSaleRecords(int fd, const Transaction* trans, SaleLine lines[]);
+int commitSale(Transaction* trans);
+void nameIndexInsert(Medicine* med);
+void nameIndexRemove(Medicine* med);
+void nameIndexBuild();
+void expiryIndexBuild();
+int prefixTopMatches(const char* prefix, int k, Medicine* out[]);
+int groupCommitOpen();
+void groupCommitClose();
+CommitBatch* groupCommitSubmit(const void* data[], const size_t length[], Transaction* trans);
+int groupCommitWait(CommitBatch* batch);
+int benchGroupCommit(int argc, char* argv[]);
+int benchStock(int argc, char* argv[]);
+int checkoutNested(const Transaction* trans);
+int checkoutJoined(const Transaction* trans, SaleLine lines[]);
+int benchCheckout(int argc, char* argv[]);
+int ciFindField(const char* field, size_t field_size, const char* needle, size_t needle_length);
+void lowercaseCopy(const char* src, char* dst, size_t dst_size);
+int benchSubstring(int argc, char* argv[]);
+int benchReports(int argc, char* argv[]);
 int generateMedicineId();
-int generateTransactionId();
 void clearInputBuffer();
 void printHeader(const char* title);
 void printLine(char ch, int length);
 
-int main() {
+Catalog catalog;
+NameIndex nameIndex;
+ExpiryIndex expiryIndex;
+CategoryDictionary categories;
+int maxTransactionId = 0;          // highest transaction ID on file at startup
+SalesRollups salesRollups;
+StockCounters stockCounters;
+int recordLocking = 1;             // 0 only for the unlocked run of --stress-locks
+int faultPoint = 0;                // see FAULT_SALES
+Shadow shadow = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+Server server = {
+    .listen_fd = -1,
+    .epoll_fd = -1,
+    .wake_fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+volatile sig_atomic_t serverStop = 0;
+
+GroupCommit groupCommit = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .enabled = 1,
+    .window_us = GROUP_COMMIT_WINDOW_US,
+    .batch_size = GROUP_COMMIT_BATCH,
+    .fd = { -1, -1, -1, -1 }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench-group-commit") == 0) {
+        return benchGroupCommit(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-stock") == 0) {
+        return benchStock(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-checkout") == 0) {
+        return benchCheckout(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-substring") == 0) {
+        return benchSubstring(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-reports") == 0) {
+        return benchReports(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-scan") == 0) {
+        return benchScan(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--stress-locks") == 0) {
+        return stressLocks(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--crash-test") == 0) {
+        return crashTest(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+        return serveCatalog(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--client") == 0) {
+        return clientPanel(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-server") == 0) {
+        return benchServer(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--migrate-data") == 0) {
+        return migrateDataFile(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--convert-transactions") == 0) {
+        // Under the commit lock, and published, as at startup
+        ShadowHeader published;
+        if (!shadowOpen() || !shadowLock(1)) {
+            return 1;
+        }
+        int ok = shadowRecover(&published) && convertTransactionFile() && shadowCommit(NULL, 0, -1, NULL);
+        shadowUnlock();
+        return ok ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "--rebuild-rollups") == 0) {
+        recoverTransactionFiles();
+        rebuildSalesRollups();
+        if (!saveSalesRollups()) {
+            return 1;
+        }
+        printf("Rebuilt from %lld bytes of %s: %d hours, %d days, %d medicines.\n",
+               salesRollups.covered, TRANSACTION_BIN_FILE,
+               salesRollups.tables[ROLLUP_HOURLY].count,
+               salesRollups.tables[ROLLUP_DAILY].count,
+               salesRollups.tables[ROLLUP_MEDICINE].count);
+        return 0;
+    }
+    
+    if (argc > 2 && (strcmp(argv[1], "--import-csv") == 0 || strcmp(argv[1], "--export-csv") == 0)) {
+        loadMedicines();
+        recoverTransactionFiles();
+        if (!groupCommitOpen()) {
+            return 1;
+        }
+        int ok = strcmp(argv[1], "--import-csv") == 0 ? importCatalogCsv(argv[2]) : exportCatalogCsv(argv[2]);
+        groupCommitClose();
+        freeMedicines();
+        return ok ? 0 : 1;
+    }
+    
     printf("\n");
     printLine('=', 60);
     printf("    MEDICAL STORE MANAGEMENT SYSTEM\n");
@@ -94,6 +945,13 @@ int main() {
     
     int choice;
     
+    loadMedicines();
+    recoverTransactionFiles();
+    loadSalesRollups();
+    if (!groupCommitOpen()) {
+        return 1;
+    }
+    
     do {
         displayMainMenu();
         printf("Enter your choice: ");
@@ -115,6 +973,9 @@ int main() {
         }
     } while(choice != 3);
     
+    catalogCheckpoint(1);
+    groupCommitClose();
+    freeMedicines();
     return 0;
 }
 
@@ -150,6 +1011,16 @@ void adminPanel() {
         printf("7. View Transactions (Binary)\n");
         printf("8. View Transactions (Text File)\n");
         printf("9. Return to Main Menu\n");
+        printf("10. Inventory Summary Report\n");
+        printf("11. Expiring / Expired Medicines\n");
+        printf("12. View Transaction Details\n");
+        printf("13. End-of-Day Sales Report\n");
+        printf("14. Top Selling Medicines\n");
+        printf("15. Sales Velocity\n");
+        printf("16. Rebuild Sales Rollups\n");
+        printf("17. Sales Totals by Date Range\n");
+        printf("18. Import Medicines (CSV)\n");
+        printf("19. Export Medicines (CSV)\n");
         printf("Enter your choice: ");
         scanf("%d", &choice);
         clearInputBuffer();
@@ -182,6 +1053,41 @@ void adminPanel() {
             case 9:
                 printf("\nReturning to Main Menu...\n");
                 break;
+            case 10:
+                inventorySummary();
+                break;
+            case 11:
+                viewExpiringMedicines();
+                break;
+            case 12:
+                viewTransactionDetails();
+                break;
+            case 13:
+                viewDailySales();
+                break;
+            case 14:
+                viewTopSellers();
+                break;
+            case 15:
+                viewSalesVelocity();
+                break;
+            case 16:
+                rebuildSalesRollups();
+                if (saveSalesRollups()) {
+                    printf("Sales rollups rebuilt: %d days, %d medicines.\n",
+                           salesRollups.tables[ROLLUP_DAILY].count,
+                           salesRollups.tables[ROLLUP_MEDICINE].count);
+                }
+                break;
+            case 17:
+                viewSalesTotals();
+                break;
+            case 18:
+                importMedicines();
+                break;
+            case 19:
+                exportMedicines();
+                break;
             default:
                 printf("\nInvalid choice! Please try again.\n");
         }
@@ -200,17 +1106,6 @@ void addMedicine() {
     printHeader("ADD NEW MEDICINE");
     
     Medicine med;
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
-    
-    loadMedicines(medicines, &count);
-    
-    if (count >= MAX_MEDICINES) {
-        printf("Medicine database is full!\n");
-        return;
-    }
-    
-    med.id = generateMedicineId();
     
     printf("Enter medicine name: ");
     fgets(med.name, sizeof(med.name), stdin);
@@ -227,14 +1122,29 @@ void addMedicine() {
     scanf("%d", &med.quantity);
     clearInputBuffer();
     
-    printf("Enter expiry date (DD/MM/YYYY): ");
-    fgets(med.expiry_date, sizeof(med.expiry_date), stdin);
-    med.expiry_date[strcspn(med.expiry_date, "\n")] = 0;
-    
-    medicines[count] = med;
-    count++;
+    char input[100];
+    while (1) {
+        printf("Enter expiry date (DD/MM/YYYY): ");
+        if (fgets(input, sizeof(input), stdin) == NULL) {
+            return;
+        }
+        if (normalizeExpiryDate(input, med.expiry_date, sizeof(med.expiry_date))) {
+            break;
+        }
+        printf("Invalid date! Please use DD/MM/YYYY.\n");
+    }
     
-    saveMedicines(medicines, count);
+    // The ID is picked after reloading, so it is new to every terminal
+    if (!catalogBeginChange()) {
+        return;
+    }
+    med.id = generateMedicineId();
+    catalogAdd(&med);
+    int saved = saveMedicines();
+    catalogEndChange();
+    if (!saved) {
+        return;
+    }
     
     printf("\nMedicine added successfully!\n");
     printf("Medicine ID: %d\n", med.id);
@@ -243,10 +1153,7 @@ void addMedicine() {
 void viewMedicines() {
     printHeader("ALL MEDICINES INVENTORY");
     
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
-    
-    loadMedicines(medicines, &count);
+    int count = catalog.count;
     
     if (count == 0) {
         printf("No medicines found in inventory.\n");
@@ -257,54 +1164,57 @@ void viewMedicines() {
            "ID", "Name", "Category", "Price", "Qty", "Expiry");
     printLine('-', 100);
     
-    float total_value = 0;
     for (int i = 0; i < count; i++) {
+        Medicine* med = catalog.slots[i];
         printf("%-10d %-30s %-20s %-10.2f %-8d %-12s\n",
-               medicines[i].id,
-               medicines[i].name,
-               medicines[i].category,
-               medicines[i].price,
-               medicines[i].quantity,
-               medicines[i].expiry_date);
-        total_value += medicines[i].price * medicines[i].quantity;
+               med->id,
+               med->name,
+               med->category,
+               med->price,
+               med->quantity,
+               med->expiry_date);
     }
     
     printLine('-', 100);
     printf("Total Medicines: %d\n", count);
-    printf("Total Inventory Value: $%.2f\n", total_value);
+    printf("Total Inventory Value: $%.2f\n", columnsInventoryValue(NULL));
 }
 
 void searchMedicine() {
     printHeader("SEARCH MEDICINE");
     
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
     char search_term[100];
     int found = 0;
     
-    loadMedicines(medicines, &count);
-    
     printf("Enter medicine name or ID to search: ");
     fgets(search_term, sizeof(search_term), stdin);
     search_term[strcspn(search_term, "\n")] = 0;
     
+    // Names match case-insensitively; a numeric term also matches the ID
+    char needle[100];
+    lowercaseCopy(search_term, needle, sizeof(needle));
+    size_t needle_length = strlen(needle);
+    
+    char* end;
+    long search_id = strtol(search_term, &end, 10);
+    int is_id = search_term[0] != 0 && *end == 0;
+    
     printf("\n%-10s %-30s %-20s %-10s %-8s %-12s\n", 
            "ID", "Name", "Category", "Price", "Qty", "Expiry");
     printLine('-', 100);
     
-    for (int i = 0; i < count; i++) {
-        char id_str[20];
-        sprintf(id_str, "%d", medicines[i].id);
+    for (int i = 0; i < catalog.count; i++) {
+        Medicine* med = catalog.slots[i];
         
-        if (strstr(medicines[i].name, search_term) != NULL || 
-            strcmp(id_str, search_term) == 0) {
+        if (ciFindField(med->name, sizeof(med->name), needle, needle_length) ||
+            (is_id && med->id == search_id)) {
             printf("%-10d %-30s %-20s %-10.2f %-8d %-12s\n",
-                   medicines[i].id,
-                   medicines[i].name,
-                   medicines[i].category,
-                   medicines[i].price,
-                   medicines[i].quantity,
-                   medicines[i].expiry_date);
+                   med->id,
+                   med->name,
+                   med->category,
+                   med->price,
+                   med->quantity,
+                   med->expiry_date);
             found = 1;
         }
     }
@@ -317,715 +1227,7493 @@ void searchMedicine() {
 void updateMedicine() {
     printHeader("UPDATE MEDICINE");
     
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
-    int id, found = 0;
-    
-    loadMedicines(medicines, &count);
+    int id;
     
     printf("Enter Medicine ID to update: ");
     scanf("%d", &id);
     clearInputBuffer();
     
-    for (int i = 0; i < count; i++) {
-        if (medicines[i].id == id) {
-            found = 1;
-            
-            printf("\nCurrent Details:\n");
-            printf("Name: %s\n", medicines[i].name);
-            printf("Category: %s\n", medicines[i].category);
-            printf("Price: %.2f\n", medicines[i].price);
-            printf("Quantity: %d\n", medicines[i].quantity);
-            printf("Expiry: %s\n", medicines[i].expiry_date);
-            
-            printf("\nEnter new details (press Enter to keep current value):\n");
-            
-            char input[100];
-            
-            printf("Name [%s]: ", medicines[i].name);
-            fgets(input, sizeof(input), stdin);
-            if (strlen(input) > 1) {
-                input[strcspn(input, "\n")] = 0;
-                strcpy(medicines[i].name, input);
-            }
-            
-            printf("Category [%s]: ", medicines[i].category);
-            fgets(input, sizeof(input), stdin);
-            if (strlen(input) > 1) {
-                input[strcspn(input, "\n")] = 0;
-                strcpy(medicines[i].category, input);
-            }
-            
-            printf("Price [%.2f]: ", medicines[i].price);
-            fgets(input, sizeof(input), stdin);
-            if (strlen(input) > 1) {
-                medicines[i].price = atof(input);
-            }
-            
-            printf("Quantity [%d]: ", medicines[i].quantity);
-            fgets(input, sizeof(input), stdin);
-            if (strlen(input) > 1) {
-                medicines[i].quantity = atoi(input);
-            }
-            
-            printf("Expiry Date [%s]: ", medicines[i].expiry_date);
-            fgets(input, sizeof(input), stdin);
-            if (strlen(input) > 1) {
-                input[strcspn(input, "\n")] = 0;
-                strcpy(medicines[i].expiry_date, input);
-            }
-            
-            saveMedicines(medicines, count);
-            printf("\nMedicine updated successfully!\n");
-            break;
-        }
-    }
-    
-    if (!found) {
+    int slot = findMedicineSlot(id);
+    if (slot < 0) {
         printf("Medicine with ID %d not found!\n", id);
+        return;
     }
-}
-
-void deleteMedicine() {
-    printHeader("DELETE MEDICINE");
     
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
-    int id, found = 0;
+    // Edits are collected first and applied to a fresh copy at the end, so
+    // fields left alone keep what other terminals wrote meanwhile
+    Medicine edit = *catalog.slots[slot];
+    int reorder_level = catalog.reorder_level[slot];
+    int name_changed = 0, category_changed = 0, price_changed = 0;
+    int quantity_changed = 0, reorder_changed = 0, expiry_changed = 0;
     
-    loadMedicines(medicines, &count);
+    printf("\nCurrent Details:\n");
+    printf("Name: %s\n", edit.name);
+    printf("Category: %s\n", edit.category);
+    printf("Price: %.2f\n", edit.price);
+    printf("Quantity: %d\n", edit.quantity);
+    printf("Expiry: %s\n", edit.expiry_date);
     
-    printf("Enter Medicine ID to delete: ");
-    scanf("%d", &id);
-    clearInputBuffer();
+    printf("\nEnter new details (press Enter to keep current value):\n");
     
-    for (int i = 0; i < count; i++) {
-        if (medicines[i].id == id) {
-            found = 1;
-            
-            printf("\nMedicine to delete:\n");
-            printf("ID: %d\n", medicines[i].id);
-            printf("Name: %s\n", medicines[i].name);
-            printf("Price: %.2f\n", medicines[i].price);
-            printf("Quantity: %d\n", medicines[i].quantity);
-            
-            char confirm;
-            printf("\nAre you sure you want to delete this medicine? (y/n): ");
-            scanf("%c", &confirm);
-            clearInputBuffer();
-            
-            if (confirm == 'y' || confirm == 'Y') {
-                // Shift all elements after i one position left
-                for (int j = i; j < count - 1; j++) {
-                    medicines[j] = medicines[j + 1];
-                }
-                count--;
-                
-                saveMedicines(medicines, count);
-                printf("Medicine deleted successfully!\n");
-            } else {
-                printf("Deletion cancelled.\n");
-            }
-            break;
-        }
+    char input[100];
+    
+    printf("Name [%s]: ", edit.name);
+    fgets(input, sizeof(input), stdin);
+    if (strlen(input) > 1) {
+        input[strcspn(input, "\n")] = 0;
+        strcpy(edit.name, input);
+        name_changed = 1;
     }
     
-    if (!found) {
-        printf("Medicine with ID %d not found!\n", id);
+    printf("Category [%s]: ", edit.category);
+    fgets(input, sizeof(input), stdin);
+    if (strlen(input) > 1) {
+        input[strcspn(input, "\n")] = 0;
+        strncpy(edit.category, input, sizeof(edit.category) - 1);
+        edit.category[sizeof(edit.category) - 1] = 0;
+        category_changed = 1;
     }
-}
-
-void viewLowStock() {
-    printHeader("LOW STOCK MEDICINES (Quantity < 10)");
     
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
-    int found = 0;
+    printf("Price [%.2f]: ", edit.price);
+    fgets(input, sizeof(input), stdin);
+    if (strlen(input) > 1) {
+        edit.price = atof(input);
+        price_changed = 1;
+    }
     
-    loadMedicines(medicines, &count);
+    printf("Quantity [%d]: ", edit.quantity);
+    fgets(input, sizeof(input), stdin);
+    if (strlen(input) > 1) {
+        edit.quantity = atoi(input);
+        quantity_changed = 1;
+    }
     
-    printf("%-10s %-30s %-20s %-10s %-8s %-12s\n", 
-           "ID", "Name", "Category", "Price", "Qty", "Expiry");
-    printLine('-', 100);
+    printf("Reorder Level [%d]: ", reorder_level);
+    fgets(input, sizeof(input), stdin);
+    if (strlen(input) > 1 && atoi(input) >= 0 && atoi(input) != reorder_level) {
+        reorder_level = atoi(input);
+        reorder_changed = 1;
+    }
     
-    for (int i = 0; i < count; i++) {
-        if (medicines[i].quantity < 10) {
-            printf("%-10d %-30s %-20s %-10.2f %-8d %-12s\n",
-                   medicines[i].id,
-                   medicines[i].name,
-                   medicines[i].category,
-                   medicines[i].price,
-                   medicines[i].quantity,
-                   medicines[i].expiry_date);
-            found = 1;
+    printf("Expiry Date [%s]: ", edit.expiry_date);
+    fgets(input, sizeof(input), stdin);
+    if (strlen(input) > 1) {
+        if (normalizeExpiryDate(input, edit.expiry_date, sizeof(edit.expiry_date))) {
+            expiry_changed = 1;
+        } else {
+            printf("Invalid date! Keeping %s.\n", edit.expiry_date);
         }
     }
     
-    if (!found) {
-        printf("No low stock medicines found.\n");
+    if (!catalogBeginChange()) {
+        return;
     }
-}
-
-void customerPanel() {
-    Cart cart;
-    cart.items = NULL;
-    cart.item_count = 0;
-    cart.subtotal = 0;
-    cart.tax = 0;
-    cart.total = 0;
+    slot = findMedicineSlot(id);
+    if (slot < 0) {
+        catalogEndChange();
+        printf("Medicine with ID %d was deleted meanwhile!\n", id);
+        return;
+    }
+    Medicine* med = catalog.slots[slot];
     
-    int choice;
+    if (name_changed) {
+        nameIndexRemove(med);
+        strcpy(med->name, edit.name);
+        nameIndexInsert(med);
+    }
+    if (category_changed) {
+        categoryPostingRemove(catalog.column_category[slot], med->id);
+        strcpy(med->category, edit.category);
+        categoryAssign(slot);
+    }
+    if (price_changed) {
+        med->price = edit.price;
+    }
+    if (quantity_changed) {
+        med->quantity = edit.quantity;
+    }
+    if (reorder_changed) {
+        catalog.reorder_level[slot] = reorder_level;
+    }
+    if (expiry_changed) {
+        expiryIndexRemove(med);
+        strcpy(med->expiry_date, edit.expiry_date);
+        expiryIndexInsert(med);
+    }
     
-    do {
-        printf("\n");
-        printLine('-', 40);
-        printf("        CUSTOMER PANEL\n");
-        printLine('-', 40);
-        printf("1. Browse Medicines\n");
-        printf("2. Search Medicine\n");
-        printf("3. View Cart\n");
-        printf("4. Remove from Cart\n");
-        printf("5. Checkout\n");
-        printf("6. Return to Main Menu\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clearInputBuffer();
-        
-        switch(choice) {
-            case 1:
-                browseMedicines();
-                addToCart(&cart);
-                break;
-            case 2:
-                searchMedicine();
-                addToCart(&cart);
-                break;
-            case 3:
-                viewCart(&cart);
-                break;
-            case 4:
-                removeFromCart(&cart);
-                break;
-            case 5:
-                if (cart.item_count > 0) {
-                    checkout(&cart);
-                } else {
-                    printf("\nYour cart is empty!\n");
-                }
-                break;
-            case 6:
-                // Free cart memory
-                CartItem* current = cart.items;
-                while (current != NULL) {
-                    CartItem* temp = current;
-                    current = current->next;
-                    free(temp);
-                }
-                printf("\nReturning to Main Menu...\n");
-                break;
-            default:
-                printf("\nInvalid choice! Please try again.\n");
-        }
-    } while(choice != 6);
+    catalogMarkDirty(slot);
+    int saved = saveMedicines();
+    if (saved && reorder_changed) {
+        saveReorderLevels();
+    }
+    catalogEndChange();
+    if (saved) {
+        printf("\nMedicine updated successfully!\n");
+    }
 }
 
-void browseMedicines() {
-    printHeader("BROWSE MEDICINES");
+void deleteMedicine() {
+    printHeader("DELETE MEDICINE");
     
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
+    int id;
     
-    loadMedicines(medicines, &count);
+    printf("Enter Medicine ID to delete: ");
+    scanf("%d", &id);
+    clearInputBuffer();
     
-    if (count == 0) {
-        printf("No medicines available.\n");
+    Medicine* med = findMedicine(id);
+    if (med == NULL) {
+        printf("Medicine with ID %d not found!\n", id);
         return;
     }
     
-    // Group by category
-    char categories[MAX_MEDICINES][50];
-    int cat_count = 0;
+    printf("\nMedicine to delete:\n");
+    printf("ID: %d\n", med->id);
+    printf("Name: %s\n", med->name);
+    printf("Price: %.2f\n", med->price);
+    printf("Quantity: %d\n", med->quantity);
     
-    // Collect unique categories
-    for (int i = 0; i < count; i++) {
-        int found = 0;
-        for (int j = 0; j < cat_count; j++) {
-            if (strcmp(categories[j], medicines[i].category) == 0) {
-                found = 1;
-                break;
-            }
+    char confirm;
+    printf("\nAre you sure you want to delete this medicine? (y/n): ");
+    scanf("%c", &confirm);
+    clearInputBuffer();
+    
+    if (confirm == 'y' || confirm == 'Y') {
+        if (!catalogBeginChange()) {
+            return;
         }
-        if (!found) {
-            strcpy(categories[cat_count], medicines[i].category);
-            cat_count++;
+        int removed = catalogRemove(id);
+        int saved = saveMedicines();
+        catalogEndChange();
+        if (!saved) {
+            return;
         }
-    }
-    
-    // Display by category
-    for (int c = 0; c < cat_count; c++) {
-        printf("\n%s:\n", categories[c]);
-        printf("%-5s %-30s %-10s %-8s\n", "ID", "Name", "Price", "Stock");
-        printLine('-', 60);
-        
-        for (int i = 0; i < count; i++) {
-            if (strcmp(medicines[i].category, categories[c]) == 0 && medicines[i].quantity > 0) {
-                printf("%-5d %-30s %-10.2f %-8d\n",
-                       medicines[i].id,
-                       medicines[i].name,
-                       medicines[i].price,
-                       medicines[i].quantity);
-            }
+        if (removed) {
+            printf("Medicine deleted successfully!\n");
+        } else {
+            printf("Medicine with ID %d was deleted meanwhile!\n", id);
         }
+    } else {
+        printf("Deletion cancelled.\n");
     }
 }
 
-void addToCart(Cart* cart) {
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
-    int id, quantity;
-    
-    loadMedicines(medicines, &count);
-    
-    printf("\nEnter Medicine ID to add to cart (0 to skip): ");
-    scanf("%d", &id);
-    
-    if (id == 0) {
-        clearInputBuffer();
-        return;
+const char* csvColumnNames[CSV_COLUMNS] = {
+    "id", "name", "price", "quantity", "category", "expiry_date", "reorder_level"
+};
+
+// Read one RFC 4180 record: quoted fields may hold commas, line breaks and
+// "" for a quote. Returns 0 at the end of the file.
+int csvReadRecord(CsvReader* reader) {
+    FILE* file = reader->file;
+    int c = getc_unlocked(file);
+    if (c == EOF) {
+        return 0;
     }
     
-    printf("Enter quantity: ");
-    scanf("%d", &quantity);
-    clearInputBuffer();
+    reader->line = reader->lines + 1;
+    int fields = 0, length = 0, quoted = 0;
+    char* out = reader->field[0];
     
-    int found = 0;
-    for (int i = 0; i < count; i++) {
-        if (medicines[i].id == id) {
-            found = 1;
-            
-            if (quantity <= 0) {
-                printf("Invalid quantity!\n");
-                return;
+    while (1) {
+        if (quoted) {
+            if (c == '"') {
+                c = getc_unlocked(file);
+                if (c != '"') {
+                    // Closing quote; look at the next character unquoted
+                    quoted = 0;
+                    continue;
+                }
+            } else if (c == EOF) {
+                quoted = 0;
+                continue;
+            } else if (c == '\n') {
+                reader->lines++;
             }
-            
-            if (quantity > medicines[i].quantity) {
-                printf("Insufficient stock! Available: %d\n", medicines[i].quantity);
-                return;
+        } else if (c == '"' && length == 0) {
+            quoted = 1;
+            c = getc_unlocked(file);
+            continue;
+        } else if (c == ',' || c == '\n' || c == EOF) {
+            if (out != NULL) {
+                out[length] = '\0';
             }
-            
-            // Check if already in cart
-            CartItem* current = cart->items;
-            while (current != NULL) {
-                if (current->medicine_id == id) {
-                    current->quantity += quantity;
-                    printf("Quantity updated in cart!\n");
-                    return;
+            fields++;
+            length = 0;
+            out = fields < CSV_MAX_FIELDS ? reader->field[fields] : NULL;
+            if (c != ',') {
+                if (c == '\n') {
+                    reader->lines++;
                 }
-                current = current->next;
+                break;
             }
-            
-            // Add new item to cart
-            CartItem* new_item = (CartItem*)malloc(sizeof(CartItem));
-            new_item->medicine_id = id;
-            strcpy(new_item->medicine_name, medicines[i].name);
-            new_item->price = medicines[i].price;
-            new_item->quantity = quantity;
-            new_item->next = cart->items;
-            cart->items = new_item;
-            cart->item_count++;
-            
-            printf("Added to cart: %s x %d\n", medicines[i].name, quantity);
-            break;
+            c = getc_unlocked(file);
+            continue;
+        } else if (c == '\r') {
+            c = getc_unlocked(file);
+            continue;
+        }
+        
+        if (out != NULL && length < CSV_FIELD_SIZE - 1) {
+            out[length++] = (char)c;
         }
+        c = getc_unlocked(file);
     }
     
-    if (!found) {
-        printf("Medicine with ID %d not found!\n", id);
+    reader->count = fields < CSV_MAX_FIELDS ? fields : CSV_MAX_FIELDS;
+    return 1;
+}
+
+// A row's value for a column, or NULL when the column is absent or blank
+const char* csvValue(const CsvReader* reader, const int map[], int column) {
+    int field = map[column];
+    if (field < 0 || field >= reader->count || reader->field[field][0] == '\0') {
+        return NULL;
     }
+    return reader->field[field];
 }
 
-void removeFromCart(Cart* cart) {
-    if (cart->item_count == 0) {
-        printf("\nYour cart is empty!\n");
-        return;
+int csvParseInt(const char* text, int* value) {
+    char* end;
+    long result = strtol(text, &end, 10);
+    while (isspace((unsigned char)*end)) {
+        end++;
     }
+    if (end == text || *end != '\0' || result < 0 || result > 2147483647L) {
+        return 0;
+    }
+    *value = (int)result;
+    return 1;
+}
+
+int csvParsePrice(const char* text, float* value) {
+    char* end;
+    double result = strtod(text, &end);
+    while (isspace((unsigned char)*end)) {
+        end++;
+    }
+    if (end == text || *end != '\0' || !(result >= 0 && result < 1e9)) {
+        return 0;
+    }
+    *value = (float)result;
+    return 1;
+}
+
+void importNamesBuild(ImportNames* names, int needed) {
+    unsigned int capacity = 1024;
+    while (capacity < (unsigned int)needed * 2) {
+        capacity *= 2;
+    }
+    free(names->slots);
+    names->slots = (int*)malloc(sizeof(int) * capacity);
+    if (names->slots == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    memset(names->slots, -1, sizeof(int) * capacity);
+    names->capacity = capacity;
+    names->used = 0;
     
-    viewCart(cart);
+    for (int slot = 0; slot < catalog.count; slot++) {
+        unsigned int bucket = categoryHash(catalog.slots[slot]->name) & (capacity - 1);
+        while (names->slots[bucket] != -1) {
+            bucket = (bucket + 1) & (capacity - 1);
+        }
+        names->slots[bucket] = slot;
+        names->used++;
+    }
+}
+
+// Index a slot under its current name; growing rebuilds from the catalog,
+// which also drops the stale entries
+void importNamesInsert(ImportNames* names, int slot) {
+    if ((unsigned int)(names->used + 1) * 2 > names->capacity) {
+        importNamesBuild(names, catalog.count * 2);
+        return;
+    }
+    unsigned int mask = names->capacity - 1;
+    unsigned int bucket = categoryHash(catalog.slots[slot]->name) & mask;
+    while (names->slots[bucket] != -1) {
+        bucket = (bucket + 1) & mask;
+    }
+    names->slots[bucket] = slot;
+    names->used++;
+}
+
+int importNamesFind(const ImportNames* names, const char* name) {
+    unsigned int mask = names->capacity - 1;
+    unsigned int bucket = categoryHash(name) & mask;
+    while (names->slots[bucket] != -1) {
+        int slot = names->slots[bucket];
+        if (strcasecmp(catalog.slots[slot]->name, name) == 0) {
+            return slot;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return -1;
+}
+
+void importReject(ImportStats* stats, long line, const char* reason) {
+    if (stats->rejected < CSV_REPORTED_ERRORS) {
+        printf("Line %ld: %s, row skipped.\n", line, reason);
+    }
+    stats->rejected++;
+}
+
+// Upsert one row: by ID when the row has one, otherwise by name. Blank
+// fields keep the current value, as in Update Medicine.
+void importRow(const CsvReader* reader, const int map[], ImportNames* names, ImportStats* stats) {
+    const char* id_text = csvValue(reader, map, CSV_ID);
+    const char* name_text = csvValue(reader, map, CSV_NAME);
+    const char* price_text = csvValue(reader, map, CSV_PRICE);
+    const char* quantity_text = csvValue(reader, map, CSV_QUANTITY);
+    const char* category = csvValue(reader, map, CSV_CATEGORY);
+    const char* expiry_text = csvValue(reader, map, CSV_EXPIRY);
+    const char* reorder_text = csvValue(reader, map, CSV_REORDER);
     
-    int id;
-    printf("\nEnter Medicine ID to remove from cart (0 to cancel): ");
-    scanf("%d", &id);
-    clearInputBuffer();
+    int id = 0, quantity = 0, reorder_level = 0;
+    float price = 0;
+    char name[sizeof(((Medicine*)0)->name)];
+    char expiry_date[sizeof(((Medicine*)0)->expiry_date)];
     
-    if (id == 0) {
+    if (id_text != NULL && (!csvParseInt(id_text, &id) || id == 0)) {
+        importReject(stats, reader->line, "invalid ID");
+        return;
+    }
+    if (price_text != NULL && !csvParsePrice(price_text, &price)) {
+        importReject(stats, reader->line, "invalid price");
+        return;
+    }
+    if (quantity_text != NULL && !csvParseInt(quantity_text, &quantity)) {
+        importReject(stats, reader->line, "invalid quantity");
+        return;
+    }
+    if (reorder_text != NULL && !csvParseInt(reorder_text, &reorder_level)) {
+        importReject(stats, reader->line, "invalid reorder level");
+        return;
+    }
+    if (expiry_text != NULL && !normalizeExpiryDate(expiry_text, expiry_date, sizeof(expiry_date))) {
+        importReject(stats, reader->line, "invalid expiry date");
         return;
     }
+    if (name_text != NULL) {
+        strncpy(name, name_text, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+    }
     
-    CartItem* current = cart->items;
-    CartItem* prev = NULL;
-    int found = 0;
+    int slot = -1;
+    if (id != 0) {
+        slot = findMedicineSlot(id);
+    } else if (name_text != NULL) {
+        slot = importNamesFind(names, name);
+    }
     
-    while (current != NULL) {
-        if (current->medicine_id == id) {
-            found = 1;
-            
-            printf("Found: %s (Quantity: %d)\n", current->medicine_name, current->quantity);
-            printf("Enter quantity to remove (0 to remove all): ");
-            int remove_qty;
-            scanf("%d", &remove_qty);
-            clearInputBuffer();
-            
-            if (remove_qty <= 0 || remove_qty >= current->quantity) {
-                // Remove entire item
-                if (prev == NULL) {
-                    cart->items = current->next;
-                } else {
-                    prev->next = current->next;
+    if (slot < 0) {
+        if (name_text == NULL || price_text == NULL || quantity_text == NULL) {
+            importReject(stats, reader->line, "new medicine needs a name, price and quantity");
+            return;
+        }
+        Medicine med;
+        memset(&med, 0, sizeof(med));
+        med.id = id != 0 ? id : generateMedicineId();
+        strcpy(med.name, name);
+        if (category != NULL) {
+            strncpy(med.category, category, sizeof(med.category) - 1);
+        }
+        med.price = price;
+        med.quantity = quantity;
+        if (expiry_text != NULL) {
+            strcpy(med.expiry_date, expiry_date);
+        }
+        slot = catalogAppend(&med);
+        importNamesInsert(names, slot);
+        stats->inserted++;
+    } else {
+        Medicine* med = catalog.slots[slot];
+        if (name_text != NULL && strcmp(med->name, name) != 0) {
+            strcpy(med->name, name);
+            importNamesInsert(names, slot);
+        }
+        if (category != NULL && strcmp(med->category, category) != 0) {
+            categoryPostingRemove(catalog.column_category[slot], med->id);
+            strncpy(med->category, category, sizeof(med->category) - 1);
+            med->category[sizeof(med->category) - 1] = '\0';
+            categoryAssign(slot);
+        }
+        if (price_text != NULL) {
+            med->price = price;
+        }
+        if (quantity_text != NULL) {
+            med->quantity = quantity;
+        }
+        if (expiry_text != NULL) {
+            strcpy(med->expiry_date, expiry_date);
+        }
+        stats->updated++;
+    }
+    
+    if (reorder_text != NULL && reorder_level != catalog.reorder_level[slot]) {
+        catalog.reorder_level[slot] = reorder_level;
+        stats->reorder_changed = 1;
+    }
+    catalogMarkDirty(slot);
+}
+
+// Stream a CSV into the catalog in one pass. The header row names the
+// columns, so any subset in any order works. The name and expiry indexes
+// are rebuilt once at the end and medicines.dat is written once.
+int importCatalogCsv(const char* path) {
+    CsvReader* reader = (CsvReader*)malloc(sizeof(CsvReader));
+    if (reader == NULL) {
+        printf("Out of memory!\n");
+        return 0;
+    }
+    reader->file = fopen(path, "r");
+    reader->lines = 0;
+    if (reader->file == NULL) {
+        printf("Error opening %s!\n", path);
+        free(reader);
+        return 0;
+    }
+    
+    int map[CSV_COLUMNS];
+    for (int column = 0; column < CSV_COLUMNS; column++) {
+        map[column] = -1;
+    }
+    if (csvReadRecord(reader)) {
+        for (int field = 0; field < reader->count; field++) {
+            char* heading = reader->field[field];
+            if (field == 0 && strncmp(heading, "\xEF\xBB\xBF", 3) == 0) {
+                heading += 3;           // byte order mark written by spreadsheets
+            }
+            heading += strspn(heading, " \t");
+            heading[strcspn(heading, " \t")] = '\0';
+            for (int column = 0; column < CSV_COLUMNS; column++) {
+                if (strcasecmp(heading, csvColumnNames[column]) == 0) {
+                    map[column] = field;
                 }
-                
-                printf("Removed %s from cart.\n", current->medicine_name);
-                free(current);
-                cart->item_count--;
-            } else {
-                // Reduce quantity
-                current->quantity -= remove_qty;
-                printf("Reduced quantity of %s by %d. Remaining: %d\n", 
-                       current->medicine_name, remove_qty, current->quantity);
             }
-            break;
         }
-        prev = current;
-        current = current->next;
+    }
+    if (map[CSV_ID] < 0 && map[CSV_NAME] < 0) {
+        printf("Error: %s needs a header row with an id or name column!\n", path);
+        fclose(reader->file);
+        free(reader);
+        return 0;
     }
     
-    if (!found) {
-        printf("Medicine with ID %d not found in cart!\n", id);
+    ImportStats stats;
+    memset(&stats, 0, sizeof(stats));
+    ImportNames names;
+    memset(&names, 0, sizeof(names));
+    
+    double start = nowSeconds();
+    if (!catalogBeginChange()) {
+        fclose(reader->file);
+        free(reader);
+        return 0;
     }
+    importNamesBuild(&names, catalog.count);
+    while (csvReadRecord(reader)) {
+        if (reader->count == 1 && reader->field[0][0] == '\0') {
+            continue;
+        }
+        stats.rows++;
+        importRow(reader, map, &names, &stats);
+    }
+    int read_error = ferror(reader->file);
+    fclose(reader->file);
+    free(reader);
+    free(names.slots);
+    
+    nameIndexBuild();
+    expiryIndexBuild();
+    saveMedicines();
+    if (stats.reorder_changed) {
+        saveReorderLevels();
+    }
+    catalogEndChange();
+    double seconds = nowSeconds() - start;
+    
+    if (read_error) {
+        printf("Error reading %s; import stopped early!\n", path);
+    }
+    if (stats.rejected > CSV_REPORTED_ERRORS) {
+        printf("... %ld more rows skipped.\n", stats.rejected - CSV_REPORTED_ERRORS);
+    }
+    printf("Imported %ld rows in %.3f s (%.0f rows/sec): %ld added, %ld updated, %ld skipped.\n",
+           stats.rows, seconds, seconds > 0 ? stats.rows / seconds : 0.0,
+           stats.inserted, stats.updated, stats.rejected);
+    return !read_error;
 }
 
-void viewCart(Cart* cart) {
-    printHeader("YOUR SHOPPING CART");
-    
-    if (cart->item_count == 0) {
-        printf("Your cart is empty.\n");
+// Quote a field only when it holds a separator, a quote or a line break
+void csvWriteField(FILE* file, const char* text) {
+    if (strpbrk(text, ",\"\r\n") == NULL) {
+        fputs(text, file);
         return;
     }
+    putc('"', file);
+    for (; *text; text++) {
+        if (*text == '"') {
+            putc('"', file);
+        }
+        putc(*text, file);
+    }
+    putc('"', file);
+}
+
+// Write every medicine in the columns importCatalogCsv reads, through a
+// temporary file so a failed export never leaves half a file behind
+int exportCatalogCsv(const char* path) {
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
     
-    printf("%-5s %-30s %-10s %-8s %-10s\n", 
-           "ID", "Name", "Price", "Qty", "Total");
-    printLine('-', 73);
+    double start = nowSeconds();
+    FILE* file = fopen(temp_path, "w");
+    if (file == NULL) {
+        printf("Error creating %s!\n", temp_path);
+        return 0;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 16);
     
-    float subtotal = 0;
-    CartItem* current = cart->items;
-    while (current != NULL) {
-        float item_total = current->price * current->quantity;
-        printf("%-5d %-30s %-10.2f %-8d %-10.2f\n",
-               current->medicine_id,
-               current->medicine_name,
-               current->price,
-               current->quantity,
-               item_total);
-        subtotal += item_total;
-        current = current->next;
+    for (int column = 0; column < CSV_COLUMNS; column++) {
+        fprintf(file, column == 0 ? "%s" : ",%s", csvColumnNames[column]);
     }
+    putc('\n', file);
     
-    printLine('-', 73);
-    float tax = subtotal * 0.08; // 8% tax
-    float total = subtotal + tax;
+    for (int slot = 0; slot < catalog.count; slot++) {
+        Medicine* med = catalog.slots[slot];
+        fprintf(file, "%d,", med->id);
+        csvWriteField(file, med->name);
+        fprintf(file, ",%.2f,%d,", med->price, med->quantity);
+        csvWriteField(file, med->category);
+        putc(',', file);
+        csvWriteField(file, med->expiry_date);
+        fprintf(file, ",%d\n", catalog.reorder_level[slot]);
+    }
     
-    printf("Subtotal: $%.2f\n", subtotal);
-    printf("Tax (8%%): $%.2f\n", tax);
-    printf("Total: $%.2f\n", total);
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed || rename(temp_path, path) != 0) {
+        printf("Error writing %s!\n", path);
+        remove(temp_path);
+        return 0;
+    }
     
-    cart->subtotal = subtotal;
-    cart->tax = tax;
-    cart->total = total;
+    double seconds = nowSeconds() - start;
+    printf("Exported %d rows to %s in %.3f s (%.0f rows/sec).\n",
+           catalog.count, path, seconds, seconds > 0 ? catalog.count / seconds : 0.0);
+    return 1;
 }
 
-void checkout(Cart* cart) {
-    printHeader("CHECKOUT");
+void readCsvPath(char* path, size_t size) {
+    printf("CSV file: ");
+    if (fgets(path, (int)size, stdin) == NULL) {
+        path[0] = '\0';
+        return;
+    }
+    path[strcspn(path, "\n")] = '\0';
+}
+
+void importMedicines() {
+    printHeader("IMPORT MEDICINES FROM CSV");
+    printf("Columns: id,name,price,quantity,category,expiry_date,reorder_level\n");
+    printf("Rows match by ID, else by name; blank fields keep the current value.\n");
     
-    viewCart(cart);
+    char path[256];
+    readCsvPath(path, sizeof(path));
+    if (path[0] == '\0') {
+        printf("Import cancelled.\n");
+        return;
+    }
+    importCatalogCsv(path);
+}
+
+void exportMedicines() {
+    printHeader("EXPORT MEDICINES TO CSV");
     
-    if (cart->item_count == 0) {
+    char path[256];
+    readCsvPath(path, sizeof(path));
+    if (path[0] == '\0') {
+        printf("Export cancelled.\n");
         return;
     }
+    exportCatalogCsv(path);
+}
+
+int compareLowStock(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return lowStockBefore(x, y) ? -1 : lowStockBefore(y, x);
+}
+
+// The low-stock heap already holds exactly the medicines to list, so
+// this sorts those k slots and never looks at the rest of the catalog
+void viewLowStock() {
+    printHeader("LOW STOCK MEDICINES (Below Reorder Level)");
     
-    printf("\nProceed to payment? (y/n): ");
-    char confirm;
-    scanf("%c", &confirm);
-    clearInputBuffer();
+    int found = catalog.low_stock_count;
+    int* slots = (int*)malloc(sizeof(int) * (found + 1));
+    if (slots == NULL) {
+        printf("Out of memory!\n");
+        return;
+    }
+    memcpy(slots, catalog.low_stock_heap, sizeof(int) * found);
+    qsort(slots, found, sizeof(int), compareLowStock);
     
-    if (confirm == 'y' || confirm == 'Y') {
-        processPayment(cart);
-    } else {
-        printf("Checkout cancelled.\n");
+    printf("%-10s %-30s %-20s %-10s %-8s %-8s %-12s\n", 
+           "ID", "Name", "Category", "Price", "Qty", "Reorder", "Expiry");
+    printLine('-', 108);
+    
+    for (int i = 0; i < found; i++) {
+        Medicine* med = catalog.slots[slots[i]];
+        printf("%-10d %-30s %-20s %-10.2f %-8d %-8d %-12s\n",
+               med->id,
+               med->name,
+               med->category,
+               med->price,
+               med->quantity,
+               catalog.reorder_level[slots[i]],
+               med->expiry_date);
+    }
+    
+    if (found == 0) {
+        printf("No low stock medicines found.\n");
     }
+    free(slots);
 }
 
-void processPayment(Cart* cart) {
-    printHeader("PAYMENT PROCESSING");
-    
-    printf("Total Amount Due: $%.2f\n", cart->total);
+void inventorySummary() {
+    printHeader("INVENTORY SUMMARY REPORT");
     
-    float amount_paid;
-    printf("Enter amount paid: $");
-    scanf("%f", &amount_paid);
-    clearInputBuffer();
+    long long units;
+    double value = columnsInventoryValue(&units);
+    int low_stock = catalog.low_stock_count;
     
-    if (amount_paid < cart->total) {
-        printf("Insufficient payment! Transaction cancelled.\n");
+    int* slots = (int*)malloc(sizeof(int) * (catalog.count + 1));
+    if (slots == NULL) {
+        printf("Out of memory!\n");
         return;
     }
+    int out_of_stock = columnsSelectBelow(1, slots);
     
-    float change = amount_paid - cart->total;
-    printf("Payment successful!\n");
-    printf("Change: $%.2f\n", change);
-    
-    // Update inventory and prepare transaction data
-    Medicine medicines[MAX_MEDICINES];
-    int count = 0;
-    
-    loadMedicines(medicines, &count);
-    
-    // Create transaction record with details
-    Transaction trans;
-    trans.transaction_id = generateTransactionId();
-    trans.amount = cart->total;
-    trans.items_count = 0;
+    printf("Medicines (SKUs):       %d\n", catalog.count);
+    printf("Units in stock:         %lld\n", units);
+    printf("Total Inventory Value:  $%.2f\n", value);
+    printf("Below reorder level:    %d\n", low_stock);
+    printf("Out of stock:           %d\n", out_of_stock);
     
-    // Get current date and time
-    time_t t = time(NULL);
-    struct tm* tm_info = localtime(&t);
-    strftime(trans.date, sizeof(trans.date), "%d/%m/%Y", tm_info);
-    strftime(trans.time, sizeof(trans.time), "%H:%M:%S", tm_info);
-    
-    CartItem* current = cart->items;
-    int items_sold = 0;
-    
-    while (current != NULL) {
-        // Update inventory
-        for (int i = 0; i < count; i++) {
-            if (medicines[i].id == current->medicine_id) {
-                medicines[i].quantity -= current->quantity;
-                items_sold += current->quantity;
-                
-                // Add to transaction details
-                trans.items[trans.items_count].medicine_id = current->medicine_id;
-                strcpy(trans.items[trans.items_count].medicine_name, current->medicine_name);
-                trans.items[trans.items_count].price = current->price;
-                trans.items[trans.items_count].quantity = current->quantity;
-                trans.items_count++;
-                break;
+    // Per-category value straight from the code and stock columns
+    double* category_value = (double*)calloc(categories.count + 1, sizeof(double));
+    int* category_units = (int*)calloc(categories.count + 1, sizeof(int));
+    if (category_value != NULL && category_units != NULL) {
+        for (int i = 0; i < catalog.count; i++) {
+            int code = catalog.column_category[i];
+            category_value[code] += (double)catalog.column_price[i] * catalog.column_quantity[i];
+            category_units[code] += catalog.column_quantity[i];
+        }
+        
+        printf("\n%-20s %-8s %-10s %-14s\n", "Category", "SKUs", "Units", "Value");
+        printLine('-', 55);
+        for (int c = 0; c < categories.count; c++) {
+            if (categories.entries[c].count > 0) {
+                printf("%-20s %-8d %-10d $%-13.2f\n",
+                       categories.entries[c].name,
+                       categories.entries[c].count,
+                       category_units[c],
+                       category_value[c]);
             }
         }
-        current = current->next;
     }
+    free(category_value);
+    free(category_units);
     
-    saveMedicines(medicines, count);
-    saveTransactionToBinary(&trans);
-    saveTransactionToText(&trans);
-    
-    // Generate receipt
-    printf("\n");
-    printLine('=', 50);
-    printf("          SALES RECEIPT\n");
-    printLine('=', 50);
-    printf("Transaction ID: %d\n", trans.transaction_id);
-    printf("Date: %s\n", trans.date);
-    printf("Time: %s\n", trans.time);
-    printf("\nItems Purchased:\n");
-    printf("%-30s %-8s %-10s %-10s\n", "Medicine", "Qty", "Price", "Total");
-    printLine('-', 58);
+    if (out_of_stock > 0) {
+        printf("\n%-10s %-30s %-20s\n", "ID", "Name", "Category");
+        printLine('-', 60);
+        for (int i = 0; i < out_of_stock; i++) {
+            Medicine* med = catalog.slots[slots[i]];
+            printf("%-10d %-30s %-20s\n", med->id, med->name, med->category);
+        }
+    }
+    free(slots);
+}
+
+// Walks the expiry index from its start, so the cost is the binary
+// search plus the medicines listed
+void viewExpiringMedicines() {
+    printHeader("EXPIRING MEDICINES");
     
-    for (int i = 0; i < trans.items_count; i++) {
-        printf("%-30s %-8d $%-9.2f $%-9.2f\n",
-               trans.items[i].medicine_name,
-               trans.items[i].quantity,
-               trans.items[i].price,
-               trans.items[i].price * trans.items[i].quantity);
+    int days;
+    printf("Show medicines expiring within how many days (0 = already expired): ");
+    if (scanf("%d", &days) != 1 || days < 0) {
+        clearInputBuffer();
+        printf("Invalid number of days!\n");
+        return;
     }
+    clearInputBuffer();
     
-    printLine('-', 58);
-    printf("Subtotal: $%.2f\n", cart->subtotal);
-    printf("Tax (8%%): $%.2f\n", cart->tax);
-    printf("Total: $%.2f\n", cart->total);
-    printf("Paid: $%.2f\n", amount_paid);
-    printf("Change: $%.2f\n", change);
-    printLine('=', 50);
-    printf("Thank you for your purchase!\n");
-    printf("Transaction saved to: %s\n", TRANSACTION_TEXT_FILE);
+    int today = todayDayNumber();
+    int end = expiryLowerBound(days > 0 ? today + days + 1 : today, 0);
     
-    // Clear cart
-    current = cart->items;
-    while (current != NULL) {
-        CartItem* temp = current;
-        current = current->next;
-        free(temp);
+    printf("%-10s %-30s %-20s %-8s %-12s %-10s\n", 
+           "ID", "Name", "Category", "Qty", "Expiry", "Status");
+    printLine('-', 95);
+    
+    for (int i = 0; i < end; i++) {
+        ExpiryEntry* entry = &expiryIndex.entries[i];
+        Medicine* med = entry->medicine;
+        char status[20];
+        if (entry->day < today) {
+            strcpy(status, "EXPIRED");
+        } else {
+            snprintf(status, sizeof(status), "%d days", entry->day - today);
+        }
+        printf("%-10d %-30s %-20s %-8d %-12s %-10s\n",
+               med->id,
+               med->name,
+               med->category,
+               med->quantity,
+               med->expiry_date,
+               status);
     }
     
-    cart->items = NULL;
-    cart->item_count = 0;
-    cart->subtotal = 0;
-    cart->tax = 0;
-    cart->total = 0;
+    if (end == 0) {
+        printf("No medicines found.\n");
+    }
 }
 
-void saveTransactionToBinary(Transaction* trans) {
-    FILE* file = fopen(TRANSACTION_BIN_FILE, "ab");
-    if (file == NULL) {
-        printf("Error saving transaction to binary file!\n");
-        return;
-    }
+void customerPanel() {
+    Cart cart;
+    cartInit(&cart);
     
-    fwrite(trans, sizeof(Transaction), 1, file);
-    fclose(file);
+    int choice;
+    
+    do {
+        printf("\n");
+        printLine('-', 40);
+        printf("        CUSTOMER PANEL\n");
+        printLine('-', 40);
+        printf("1. Browse Medicines\n");
+        printf("2. Search Medicine\n");
+        printf("3. View Cart\n");
+        printf("4. Remove from Cart\n");
+        printf("5. Checkout\n");
+        printf("6. Return to Main Menu\n");
+        printf("7. Quick Find by Name Prefix\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+        clearInputBuffer();
+        
+        switch(choice) {
+            case 1:
+                browseMedicines();
+                addToCart(&cart);
+                break;
+            case 2:
+                searchMedicine();
+                addToCart(&cart);
+                break;
+            case 3:
+                viewCart(&cart);
+                break;
+            case 4:
+                removeFromCart(&cart);
+                break;
+            case 5:
+                if (cart.item_count > 0) {
+                    checkout(&cart);
+                } else {
+                    printf("\nYour cart is empty!\n");
+                }
+                break;
+            case 6:
+                cartFree(&cart);
+                printf("\nReturning to Main Menu...\n");
+                break;
+            case 7:
+                quickFind();
+                addToCart(&cart);
+                break;
+            default:
+                printf("\nInvalid choice! Please try again.\n");
+        }
+    } while(choice != 6);
 }
 
-void saveTransactionToText(Transaction* trans) {
-    FILE* file = fopen(TRANSACTION_TEXT_FILE, "a");
-    if (file == NULL) {
-        printf("Error saving transaction to text file!\n");
+void quickFind() {
+    printHeader("QUICK FIND");
+    
+    char prefix[100];
+    printf("Enter the start of the medicine name: ");
+    fgets(prefix, sizeof(prefix), stdin);
+    prefix[strcspn(prefix, "\n")] = 0;
+    
+    Medicine* top[QUICK_FIND_TOP];
+    int count = prefixTopMatches(prefix, QUICK_FIND_TOP, top);
+    
+    if (count == 0) {
+        printf("No medicines found starting with '%s'\n", prefix);
         return;
     }
     
-    fprintf(file, "\n========================================\n");
-    fprintf(file, "TRANSACTION ID: %d\n", trans->transaction_id);
-    fprintf(file, "Date: %s | Time: %s\n", trans->date, trans->time);
-    fprintf(file, "----------------------------------------\n");
-    fprintf(file, "ITEMS PURCHASED:\n");
-    fprintf(file, "%-30s %-8s %-10s %-10s\n", "Medicine", "Qty", "Price", "Total");
-    fprintf(file, "----------------------------------------\n");
-    
-    for (int i = 0; i < trans->items_count; i++) {
-        fprintf(file, "%-30s %-8d $%-9.2f $%-9.2f\n",
-                trans->items[i].medicine_name,
-                trans->items[i].quantity,
-                trans->items[i].price,
-                trans->items[i].price * trans->items[i].quantity);
+    printf("\n%-5s %-30s %-10s %-8s\n", "ID", "Name", "Price", "Stock");
+    printLine('-', 60);
+    for (int i = 0; i < count; i++) {
+        printf("%-5d %-30s %-10.2f %-8d\n",
+               top[i]->id,
+               top[i]->name,
+               top[i]->price,
+               top[i]->quantity);
     }
+}
+
+void printCategoryMedicines(int code) {
+    CategoryEntry* entry = &categories.entries[code];
     
-    fprintf(file, "----------------------------------------\n");
-    fprintf(file, "Total Items: %d\n", trans->items_count);
-    fprintf(file, "Total Amount: $%.2f\n", trans->amount);
-    fprintf(file, "========================================\n\n");
+    printf("\n%s:\n", entry->name);
+    printf("%-5s %-30s %-10s %-8s\n", "ID", "Name", "Price", "Stock");
+    printLine('-', 60);
     
-    fclose(file);
-    printf("Transaction details saved to %s\n", TRANSACTION_TEXT_FILE);
+    for (int i = 0; i < entry->count; i++) {
+        Medicine* med = findMedicine(entry->ids[i]);
+        if (med != NULL && med->quantity > 0) {
+            printf("%-5d %-30s %-10.2f %-8d\n",
+                   med->id,
+                   med->name,
+                   med->price,
+                   med->quantity);
+        }
+    }
 }
 
-void viewTransactions() {
-    printHeader("TRANSACTION HISTORY (Binary File)");
+// Each category's posting list names its members, so showing one
+// category never touches medicines outside it
+void browseMedicines() {
+    printHeader("BROWSE MEDICINES");
     
-    FILE* file = fopen(TRANSACTION_BIN_FILE, "rb");
-    if (file == NULL) {
-        printf("No transactions found.\n");
+    if (catalog.count == 0) {
+        printf("No medicines available.\n");
         return;
     }
     
-    printf("%-15s %-12s %-10s %-10s %-10s\n", 
-           "Transaction ID", "Date", "Time", "Items", "Amount");
-    printLine('-', 60);
-    
-    Transaction trans;
-    float total_sales = 0;
-    int total_transactions = 0;
-    
-    while (fread(&trans, sizeof(Transaction), 1, file)) {
-        printf("%-15d %-12s %-10s %-10d $%-9.2f\n",
-               trans.transaction_id,
-               trans.date,
-               trans.time,
-               trans.items_count,
-               trans.amount);
-        total_sales += trans.amount;
-        total_transactions++;
+    for (int c = 0; c < categories.count; c++) {
+        if (categories.entries[c].count > 0) {
+            printf("%d. %s (%d)\n", c + 1, categories.entries[c].name, categories.entries[c].count);
+        }
     }
     
-    fclose(file);
+    int choice;
+    printf("Enter category number to browse (0 for all): ");
+    if (scanf("%d", &choice) != 1) {
+        choice = 0;
+    }
+    clearInputBuffer();
     
-    printLine('-', 60);
-    printf("Total Transactions: %d\n", total_transactions);
-    printf("Total Sales: $%.2f\n", total_sales);
+    if (choice > 0 && choice <= categories.count) {
+        printCategoryMedicines(choice - 1);
+        return;
+    }
+    for (int c = 0; c < categories.count; c++) {
+        if (categories.entries[c].count > 0) {
+            printCategoryMedicines(c);
+        }
+    }
 }
 
-void viewTransactionsFromText() {
-    printHeader("TRANSACTION HISTORY (Text File)");
-    
-    FILE* file = fopen(TRANSACTION_TEXT_FILE, "r");
-    if (file == NULL) {
-        printf("No transaction text file found.\n");
-        return;
+void cartInit(Cart* cart) {
+    memset(cart, 0, sizeof(Cart));
+    cart->head = -1;
+    cart->tail = -1;
+    cart->free_item = -1;
+}
+
+void cartFree(Cart* cart) {
+    free(cart->items);
+    free(cart->index);
+    cartInit(cart);
+}
+
+// Empty the cart but keep its pool for the next customer
+void cartClear(Cart* cart) {
+    if (cart->head >= 0) {
+        cart->items[cart->tail].next = cart->free_item;
+        cart->free_item = cart->head;
+    }
+    for (int i = 0; i < cart->index_capacity; i++) {
+        cart->index[i] = -1;
+    }
+    cart->head = -1;
+    cart->tail = -1;
+    cart->item_count = 0;
+    cart->subtotal_cents = 0;
+    cartTotals(cart);
+}
+
+long long cartLineCents(const CartItem* item) {
+    return (long long)(item->price * 100.0 + 0.5) * item->quantity;
+}
+
+void cartIndexInsert(Cart* cart, int line) {
+    unsigned int mask = (unsigned int)cart->index_capacity - 1;
+    unsigned int bucket = hashMedicineId(cart->items[line].medicine_id) & mask;
+    while (cart->index[bucket] != -1) {
+        bucket = (bucket + 1) & mask;
+    }
+    cart->index[bucket] = line;
+}
+
+// Line holding a medicine, or -1
+int cartFind(const Cart* cart, int medicine_id) {
+    if (cart->item_count == 0) {
+        return -1;
     }
     
-    char line[200];
-    printf("\nContents of %s:\n", TRANSACTION_TEXT_FILE);
-    printLine('-', 60);
+    unsigned int mask = (unsigned int)cart->index_capacity - 1;
+    unsigned int bucket = hashMedicineId(medicine_id) & mask;
+    while (cart->index[bucket] != -1) {
+        if (cart->items[cart->index[bucket]].medicine_id == medicine_id) {
+            return cart->index[bucket];
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return -1;
+}
+
+// Double the line pool, chaining the new lines onto the free list, and
+// index the lines again at twice the new size
+void cartGrow(Cart* cart) {
+    int capacity = cart->capacity > 0 ? cart->capacity * 2 : 16;
+    CartItem* items = (CartItem*)realloc(cart->items, sizeof(CartItem) * capacity);
+    int* index = (int*)malloc(sizeof(int) * capacity * 2);
+    if (items == NULL || index == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
     
-    while (fgets(line, sizeof(line), file)) {
-        printf("%s", line);
+    for (int i = cart->capacity; i < capacity; i++) {
+        items[i].next = i + 1 < capacity ? i + 1 : cart->free_item;
     }
+    cart->free_item = cart->capacity;
+    cart->items = items;
+    cart->capacity = capacity;
     
-    fclose(file);
-    printLine('-', 60);
+    free(cart->index);
+    cart->index = index;
+    cart->index_capacity = capacity * 2;
+    for (int i = 0; i < cart->index_capacity; i++) {
+        cart->index[i] = -1;
+    }
+    for (int line = cart->head; line >= 0; line = items[line].next) {
+        cartIndexInsert(cart, line);
+    }
 }
 
-void loadMedicines(Medicine medicines[], int* count) {
-    FILE* file = fopen(MEDICINE_FILE, "rb");
-    *count = 0;
-    
-    if (file == NULL) {
-        return;
+// Line holding a medicine, added empty at the end of the cart if the
+// medicine is not in it yet
+int cartLine(Cart* cart, int medicine_id) {
+    int line = cartFind(cart, medicine_id);
+    if (line >= 0) {
+        return line;
     }
     
-    while (fread(&medicines[*count], sizeof(Medicine), 1, file)) {
-        (*count)++;
-        if (*count >= MAX_MEDICINES) {
-            break;
-        }
+    if (cart->free_item < 0) {
+        cartGrow(cart);
     }
+    line = cart->free_item;
+    cart->free_item = cart->items[line].next;
     
-    fclose(file);
+    CartItem* item = &cart->items[line];
+    memset(item, 0, sizeof(CartItem));
+    item->medicine_id = medicine_id;
+    item->prev = cart->tail;
+    item->next = -1;
+    if (cart->tail >= 0) {
+        cart->items[cart->tail].next = line;
+    } else {
+        cart->head = line;
+    }
+    cart->tail = line;
+    cart->item_count++;
+    cartIndexInsert(cart, line);
+    return line;
 }
 
-void saveMedicines(Medicine medicines[], int count) {
-    FILE* file = fopen(MEDICINE_FILE, "wb");
-    if (file == NULL) {
-        printf("Error saving medicines!\n");
-        return;
+// Take a line out of the cart. Entries further along its probe cluster
+// move back into the gap unless their home bucket lies past it.
+void cartRemove(Cart* cart, int line) {
+    unsigned int mask = (unsigned int)cart->index_capacity - 1;
+    unsigned int gap = hashMedicineId(cart->items[line].medicine_id) & mask;
+    while (cart->index[gap] != line) {
+        gap = (gap + 1) & mask;
+    }
+    for (unsigned int bucket = (gap + 1) & mask; cart->index[bucket] != -1; bucket = (bucket + 1) & mask) {
+        unsigned int home = hashMedicineId(cart->items[cart->index[bucket]].medicine_id) & mask;
+        if (((bucket - home) & mask) >= ((bucket - gap) & mask)) {
+            cart->index[gap] = cart->index[bucket];
+            gap = bucket;
+        }
     }
+    cart->index[gap] = -1;
     
-    fwrite(medicines, sizeof(Medicine), count, file);
-    fclose(file);
+    CartItem* item = &cart->items[line];
+    cart->subtotal_cents -= cartLineCents(item);
+    if (item->prev >= 0) {
+        cart->items[item->prev].next = item->next;
+    } else {
+        cart->head = item->next;
+    }
+    if (item->next >= 0) {
+        cart->items[item->next].prev = item->prev;
+    } else {
+        cart->tail = item->prev;
+    }
+    item->next = cart->free_item;
+    cart->free_item = line;
+    cart->item_count--;
+    cartTotals(cart);
 }
 
-int generateMedicineId() {
-    static int last_id = 1000;
-    last_id++;
-    return last_id;
+void cartSetQuantity(Cart* cart, int line, int quantity) {
+    cart->subtotal_cents -= cartLineCents(&cart->items[line]);
+    cart->items[line].quantity = quantity;
+    cart->subtotal_cents += cartLineCents(&cart->items[line]);
+    cartTotals(cart);
 }
 
-int generateTransactionId() {
-    static int last_trans_id = 5000;
-    last_trans_id++;
-    return last_trans_id;
+// Subtotal, tax and total from the running subtotal
+void cartTotals(Cart* cart) {
+    cart->subtotal = cart->subtotal_cents / 100.0f;
+    cart->tax = cart->subtotal * 0.08; // 8% tax
+    cart->total = cart->subtotal + cart->tax;
 }
 
-void clearInputBuffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
+// Make room for count lines in a transaction's items. Returns 0 if out of
+// memory, leaving the items it had.
+int transactionReserve(Transaction* trans, int count) {
+    TransactionItem* items = (TransactionItem*)realloc(trans->items, sizeof(TransactionItem) * (count > 0 ? count : 1));
+    if (items == NULL) {
+        return 0;
+    }
+    trans->items = items;
+    return 1;
 }
 
-void printHeader(const char* title) {
-    printf("\n");
-    printLine('=', 50);
-    printf("          %s\n", title);
-    printLine('=', 50);
+void transactionFree(Transaction* trans) {
+    free(trans->items);
+    trans->items = NULL;
+    trans->items_count = 0;
 }
 
-void printLine(char ch, int length) {
-    for (int i = 0; i < length; i++) {
-        printf("%c", ch);
+// Copy a cart's lines into a transaction, in cart order, with items
+// allocated to the cart's size. Returns 0 if a medicine in the cart is no
+// longer in the catalog, since the cart's total would charge for it, and
+// -1 if out of memory; either way the transaction has no items.
+int cartToTransaction(const Cart* cart, Transaction* trans) {
+    trans->items = NULL;
+    trans->items_count = 0;
+    if (!transactionReserve(trans, cart->item_count)) {
+        return -1;
     }
-    printf("\n");
+    for (int line = cart->head; line >= 0; line = cart->items[line].next) {
+        const CartItem* current = &cart->items[line];
+        if (findMedicine(current->medicine_id) == NULL) {
+            transactionFree(trans);
+            return 0;
+        }
+        TransactionItem* item = &trans->items[trans->items_count++];
+        item->medicine_id = current->medicine_id;
+        strcpy(item->medicine_name, current->medicine_name);
+        item->price = current->price;
+        item->quantity = current->quantity;
+    }
+    return 1;
+}
+
+void addToCart(Cart* cart) {
+    int id, quantity;
+    
+    printf("\nEnter Medicine ID to add to cart (0 to skip): ");
+    scanf("%d", &id);
+    
+    if (id == 0) {
+        clearInputBuffer();
+        return;
+    }
+    
+    printf("Enter quantity: ");
+    scanf("%d", &quantity);
+    clearInputBuffer();
+    
+    int slot = findMedicineSlot(id);
+    if (slot < 0) {
+        printf("Medicine with ID %d not found!\n", id);
+        return;
+    }
+    Medicine* med = catalog.slots[slot];
+    
+    if (slotExpired(slot, todayDayNumber())) {
+        printf("%s expired on %s and cannot be sold!\n", med->name, med->expiry_date);
+        return;
+    }
+    
+    if (quantity <= 0) {
+        printf("Invalid quantity!\n");
+        return;
+    }
+    
+    if (quantity > med->quantity) {
+        printf("Insufficient stock! Available: %d\n", med->quantity);
+        return;
+    }
+    
+    // Check if already in cart; the line is priced again from the record so
+    // its version vouches for the new quantity
+    int line = cartFind(cart, id);
+    if (line >= 0) {
+        CartItem* current = &cart->items[line];
+        if (current->quantity + quantity > med->quantity) {
+            printf("Insufficient stock! Available: %d, already in cart: %d\n", med->quantity, current->quantity);
+            return;
+        }
+        cartTake(cart, line, slot);
+        cartSetQuantity(cart, line, current->quantity + quantity);
+        printf("Quantity updated in cart!\n");
+        return;
+    }
+    
+    // Add new item to cart
+    line = cartLine(cart, id);
+    cartTake(cart, line, slot);
+    cartSetQuantity(cart, line, quantity);
+    
+    printf("Added to cart: %s x %d\n", med->name, quantity);
+}
+
+void removeFromCart(Cart* cart) {
+    if (cart->item_count == 0) {
+        printf("\nYour cart is empty!\n");
+        return;
+    }
+    
+    viewCart(cart);
+    
+    int id;
+    printf("\nEnter Medicine ID to remove from cart (0 to cancel): ");
+    scanf("%d", &id);
+    clearInputBuffer();
+    
+    if (id == 0) {
+        return;
+    }
+    
+    int line = cartFind(cart, id);
+    if (line < 0) {
+        printf("Medicine with ID %d not found in cart!\n", id);
+        return;
+    }
+    CartItem* current = &cart->items[line];
+    
+    printf("Found: %s (Quantity: %d)\n", current->medicine_name, current->quantity);
+    printf("Enter quantity to remove (0 to remove all): ");
+    int remove_qty;
+    scanf("%d", &remove_qty);
+    clearInputBuffer();
+    
+    if (remove_qty <= 0 || remove_qty >= current->quantity) {
+        // Remove entire item
+        printf("Removed %s from cart.\n", current->medicine_name);
+        cartRemove(cart, line);
+    } else {
+        // Reduce quantity
+        cartSetQuantity(cart, line, current->quantity - remove_qty);
+        printf("Reduced quantity of %s by %d. Remaining: %d\n", 
+               current->medicine_name, remove_qty, current->quantity);
+    }
+}
+
+void viewCart(Cart* cart) {
+    printHeader("YOUR SHOPPING CART");
+    
+    if (cart->item_count == 0) {
+        printf("Your cart is empty.\n");
+        return;
+    }
+    
+    printf("%-5s %-30s %-10s %-8s %-10s\n", 
+           "ID", "Name", "Price", "Qty", "Total");
+    printLine('-', 73);
+    
+    for (int line = cart->head; line >= 0; line = cart->items[line].next) {
+        CartItem* current = &cart->items[line];
+        printf("%-5d %-30s %-10.2f %-8d %-10.2f\n",
+               current->medicine_id,
+               current->medicine_name,
+               current->price,
+               current->quantity,
+               current->price * current->quantity);
+    }
+    
+    // The totals are kept up to date as the cart changes
+    printLine('-', 73);
+    printf("Subtotal: $%.2f\n", cart->subtotal);
+    printf("Tax (8%%): $%.2f\n", cart->tax);
+    printf("Total: $%.2f\n", cart->total);
+}
+
+// Price a cart line from the record in a slot
+void cartTake(Cart* cart, int line, int slot) {
+    Medicine* med = catalog.slots[slot];
+    CartItem* item = &cart->items[line];
+    cart->subtotal_cents -= cartLineCents(item);
+    item->medicine_id = med->id;
+    strcpy(item->medicine_name, med->name);
+    item->price = med->price;
+    item->version = catalog.version[slot];
+    cart->subtotal_cents += cartLineCents(item);
+    cartTotals(cart);
+}
+
+// Check a cart before checkout in one pass. A line whose record still has
+// the version it was priced from was in stock then and still is, so only
+// its expiry date (which passes without a change) is checked. A changed
+// record is looked at again: the line gets the current name and price and
+// its stock is checked.
+// Returns 0 if the cart can be sold, 1 with the reason in message if it
+// cannot, 2 with a note in message if a price changed (the cart has the
+// new prices, so its totals must be shown again).
+int cartValidate(Cart* cart, char* message, size_t message_size) {
+    int today = todayDayNumber();
+    int repriced = 0;
+    
+    for (int line = cart->head; line >= 0; line = cart->items[line].next) {
+        CartItem* current = &cart->items[line];
+        int slot = findMedicineSlot(current->medicine_id);
+        if (slot < 0) {
+            snprintf(message, message_size, "%s is no longer available!", current->medicine_name);
+            return 1;
+        }
+        Medicine* med = catalog.slots[slot];
+        if (slotExpired(slot, today)) {
+            snprintf(message, message_size, "%s expired on %s and cannot be sold!", med->name, med->expiry_date);
+            return 1;
+        }
+        if (current->version == catalog.version[slot]) {
+            continue;
+        }
+        
+        if (current->quantity > med->quantity) {
+            snprintf(message, message_size, "Insufficient stock for %s! Available: %d", med->name, med->quantity);
+            return 1;
+        }
+        if (current->price != med->price && !repriced++) {
+            snprintf(message, message_size, "Price of %s changed to $%.2f!", med->name, med->price);
+        }
+        cartTake(cart, line, slot);
+    }
+    return repriced ? 2 : 0;
+}
+
+void checkout(Cart* cart) {
+    printHeader("CHECKOUT");
+    
+    // Bring changed lines up to date so the totals shown are current
+    char message[200];
+    int check = cartValidate(cart, message, sizeof(message));
+    if (check == 1) {
+        printf("%s\n", message);
+        return;
+    }
+    if (check == 2) {
+        printf("%s\n", message);
+    }
+    
+    viewCart(cart);
+    
+    if (cart->item_count == 0) {
+        return;
+    }
+    
+    printf("\nProceed to payment? (y/n): ");
+    char confirm;
+    scanf("%c", &confirm);
+    clearInputBuffer();
+    
+    if (confirm == 'y' || confirm == 'Y') {
+        processPayment(cart);
+    } else {
+        printf("Checkout cancelled.\n");
+    }
+}
+
+void processPayment(Cart* cart) {
+    printHeader("PAYMENT PROCESSING");
+    
+    printf("Total Amount Due: $%.2f\n", cart->total);
+    
+    float amount_paid;
+    printf("Enter amount paid: $");
+    scanf("%f", &amount_paid);
+    clearInputBuffer();
+    
+    if (amount_paid < cart->total) {
+        printf("Insufficient payment! Transaction cancelled.\n");
+        return;
+    }
+    
+    float change = amount_paid - cart->total;
+    
+    // Create transaction record with details
+    Transaction trans;
+    int made = cartToTransaction(cart, &trans);
+    if (made <= 0) {
+        printf(made == 0 ? "A medicine in your cart is no longer available! Transaction cancelled.\n"
+                         : "Out of memory! Transaction cancelled.\n");
+        return;
+    }
+    trans.transaction_id = 0;   // numbered when the sale is committed
+    trans.amount = cart->total;
+    
+    // Get current date and time
+    time_t t = time(NULL);
+    struct tm* tm_info = localtime(&t);
+    strftime(trans.date, sizeof(trans.date), "%d/%m/%Y", tm_info);
+    strftime(trans.time, sizeof(trans.time), "%H:%M:%S", tm_info);
+    
+    // Update inventory and save the transaction in one durable commit
+    int result = commitSale(&trans);
+    if (result == 0) {
+        printf("Cart has expired medicine or not enough stock! Transaction cancelled.\n");
+        transactionFree(&trans);
+        return;
+    }
+    if (result < 0) {
+        printf("Error recording sale! Transaction cancelled.\n");
+        transactionFree(&trans);
+        return;
+    }
+    
+    printf("Payment successful!\n");
+    printf("Change: $%.2f\n", change);
+    printf("Transaction details saved to %s\n", TRANSACTION_TEXT_FILE);
+    
+    // Generate receipt
+    printf("\n");
+    printLine('=', 50);
+    printf("          SALES RECEIPT\n");
+    printLine('=', 50);
+    printf("Transaction ID: %d\n", trans.transaction_id);
+    printf("Date: %s\n", trans.date);
+    printf("Time: %s\n", trans.time);
+    printf("\nItems Purchased:\n");
+    printf("%-30s %-8s %-10s %-10s\n", "Medicine", "Qty", "Price", "Total");
+    printLine('-', 58);
+    
+    for (int i = 0; i < trans.items_count; i++) {
+        printf("%-30s %-8d $%-9.2f $%-9.2f\n",
+               trans.items[i].medicine_name,
+               trans.items[i].quantity,
+               trans.items[i].price,
+               trans.items[i].price * trans.items[i].quantity);
+    }
+    
+    printLine('-', 58);
+    printf("Subtotal: $%.2f\n", cart->subtotal);
+    printf("Tax (8%%): $%.2f\n", cart->tax);
+    printf("Total: $%.2f\n", cart->total);
+    printf("Paid: $%.2f\n", amount_paid);
+    printf("Change: $%.2f\n", change);
+    printLine('=', 50);
+    printf("Thank you for your purchase!\n");
+    printf("Transaction saved to: %s\n", TRANSACTION_TEXT_FILE);
+    transactionFree(&trans);
+    
+    // Clear cart
+    cartClear(cart);
+}
+
+// Write one transaction frame: the header, then only the items it has
+void saveTransactionToBinary(FILE* file, Transaction* trans) {
+    TransactionHeader header;
+    fillTransactionHeader(&header, trans);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(trans->items, sizeof(TransactionItem), trans->items_count, file);
+}
+
+void fillTransactionHeader(TransactionHeader* header, const Transaction* trans) {
+    memset(header, 0, sizeof(*header));
+    header->magic = TRANSACTION_MAGIC;
+    header->transaction_id = trans->transaction_id;
+    header->timestamp = transactionTimestamp(trans);
+    memcpy(header->date, trans->date, sizeof(header->date));
+    memcpy(header->time, trans->time, sizeof(header->time));
+    header->amount = trans->amount;
+    header->items_count = trans->items_count;
+}
+
+void saveTransactionToText(FILE* file, Transaction* trans) {
+    fprintf(file, "\n========================================\n");
+    fprintf(file, "TRANSACTION ID: %d\n", trans->transaction_id);
+    fprintf(file, "Date: %s | Time: %s\n", trans->date, trans->time);
+    fprintf(file, "----------------------------------------\n");
+    fprintf(file, "ITEMS PURCHASED:\n");
+    fprintf(file, "%-30s %-8s %-10s %-10s\n", "Medicine", "Qty", "Price", "Total");
+    fprintf(file, "----------------------------------------\n");
+    
+    for (int i = 0; i < trans->items_count; i++) {
+        fprintf(file, "%-30s %-8d $%-9.2f $%-9.2f\n",
+                trans->items[i].medicine_name,
+                trans->items[i].quantity,
+                trans->items[i].price,
+                trans->items[i].price * trans->items[i].quantity);
+    }
+    
+    fprintf(file, "----------------------------------------\n");
+    fprintf(file, "Total Items: %d\n", trans->items_count);
+    fprintf(file, "Total Amount: $%.2f\n", trans->amount);
+    fprintf(file, "========================================\n\n");
+}
+
+// Listing walks the index and reads one header per sale; item lists
+// are never read
+void viewTransactions() {
+    printHeader("TRANSACTION HISTORY (Binary File)");
+    
+    int count;
+    TransactionIndexEntry* entries = loadTransactionIndex(&count);
+    FILE* file = fopen(TRANSACTION_BIN_FILE, "rb");
+    if (file == NULL || count == 0) {
+        printf("No transactions found.\n");
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(entries);
+        return;
+    }
+    
+    printf("%-15s %-12s %-10s %-10s %-10s\n", 
+           "Transaction ID", "Date", "Time", "Items", "Amount");
+    printLine('-', 60);
+    
+    TransactionHeader header;
+    float total_sales = 0;
+    int total_transactions = 0;
+    
+    for (int i = 0; i < count; i++) {
+        if (fseek(file, (long)entries[i].offset, SEEK_SET) != 0 || !readTransactionHeader(file, &header)) {
+            printf("Error reading transaction %d!\n", entries[i].transaction_id);
+            break;
+        }
+        printf("%-15d %-12s %-10s %-10d $%-9.2f\n",
+               header.transaction_id,
+               header.date,
+               header.time,
+               header.items_count,
+               header.amount);
+        total_sales += header.amount;
+        total_transactions++;
+    }
+    
+    fclose(file);
+    free(entries);
+    
+    printLine('-', 60);
+    printf("Total Transactions: %d\n", total_transactions);
+    printf("Total Sales: $%.2f\n", total_sales);
+}
+
+// Find a sale through the index and read just its frame
+void viewTransactionDetails() {
+    printHeader("TRANSACTION DETAILS");
+    
+    int id;
+    printf("Enter Transaction ID: ");
+    if (scanf("%d", &id) != 1) {
+        clearInputBuffer();
+        printf("Invalid transaction ID!\n");
+        return;
+    }
+    clearInputBuffer();
+    
+    int count;
+    TransactionIndexEntry* entries = loadTransactionIndex(&count);
+    int found = -1;
+    for (int i = count - 1; i >= 0; i--) {
+        if (entries[i].transaction_id == id) {
+            found = i;
+            break;
+        }
+    }
+    
+    FILE* file = found >= 0 ? fopen(TRANSACTION_BIN_FILE, "rb") : NULL;
+    if (file == NULL) {
+        printf("Transaction %d not found!\n", id);
+        free(entries);
+        return;
+    }
+    
+    TransactionHeader header;
+    TransactionItem item;
+    if (fseek(file, (long)entries[found].offset, SEEK_SET) != 0 || !readTransactionHeader(file, &header)) {
+        printf("Error reading transaction %d!\n", id);
+        fclose(file);
+        free(entries);
+        return;
+    }
+    
+    printf("Transaction ID: %d\n", header.transaction_id);
+    printf("Date: %s\n", header.date);
+    printf("Time: %s\n", header.time);
+    printf("\n%-30s %-8s %-10s %-10s\n", "Medicine", "Qty", "Price", "Total");
+    printLine('-', 58);
+    for (int i = 0; i < header.items_count && fread(&item, sizeof(item), 1, file) == 1; i++) {
+        printf("%-30s %-8d $%-9.2f $%-9.2f\n",
+               item.medicine_name,
+               item.quantity,
+               item.price,
+               item.price * item.quantity);
+    }
+    printLine('-', 58);
+    printf("Total: $%.2f\n", header.amount);
+    
+    fclose(file);
+    free(entries);
+}
+
+// Seconds since the epoch for the local date and time stamped on a sale
+long long transactionTimestamp(const Transaction* trans) {
+    struct tm tm_info;
+    memset(&tm_info, 0, sizeof(tm_info));
+    if (sscanf(trans->date, "%d/%d/%d", &tm_info.tm_mday, &tm_info.tm_mon, &tm_info.tm_year) != 3) {
+        return 0;
+    }
+    sscanf(trans->time, "%d:%d:%d", &tm_info.tm_hour, &tm_info.tm_min, &tm_info.tm_sec);
+    tm_info.tm_mon -= 1;
+    tm_info.tm_year -= 1900;
+    tm_info.tm_isdst = -1;
+    return (long long)mktime(&tm_info);
+}
+
+long long transactionFrameSize(int items_count) {
+    return (long long)sizeof(TransactionHeader) + (long long)items_count * (long long)sizeof(TransactionItem);
+}
+
+// Read a frame header, rejecting anything that is not a whole valid header
+int readTransactionHeader(FILE* file, TransactionHeader* header) {
+    if (fread(header, sizeof(*header), 1, file) != 1) {
+        return 0;
+    }
+    return header->magic == TRANSACTION_MAGIC && header->items_count >= 0;
+}
+
+// The whole index file in memory (it is small: one entry per sale)
+TransactionIndexEntry* loadTransactionIndex(int* count) {
+    *count = 0;
+    FILE* file = fopen(TRANSACTION_INDEX_FILE, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long entries_on_file = ftell(file) / (long)sizeof(TransactionIndexEntry);
+    rewind(file);
+    
+    TransactionIndexEntry* entries = (TransactionIndexEntry*)malloc(sizeof(TransactionIndexEntry) * (entries_on_file + 1));
+    if (entries == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    *count = (int)fread(entries, sizeof(TransactionIndexEntry), entries_on_file, file);
+    fclose(file);
+    return entries;
+}
+
+// One-shot conversion of a transaction file in the old layout (fixed-size
+// Transaction records with room for 100 items each) into frames plus an
+// index. The original is kept as TRANSACTION_BIN_FILE ".old".
+int convertTransactionFile() {
+    FILE* old_file = fopen(TRANSACTION_BIN_FILE, "rb");
+    if (old_file == NULL) {
+        printf("No %s to convert.\n", TRANSACTION_BIN_FILE);
+        return 1;
+    }
+    
+    unsigned int magic;
+    if (fread(&magic, sizeof(magic), 1, old_file) == 1 && magic == TRANSACTION_MAGIC) {
+        printf("%s is already in the framed format.\n", TRANSACTION_BIN_FILE);
+        fclose(old_file);
+        return 1;
+    }
+    fseek(old_file, 0, SEEK_END);
+    long old_size = ftell(old_file);
+    rewind(old_file);
+    if (old_size % (long)sizeof(LegacyTransaction) != 0) {
+        printf("Error: %s is not a whole number of old transaction records!\n", TRANSACTION_BIN_FILE);
+        fclose(old_file);
+        return 0;
+    }
+    
+    FILE* data = fopen(TRANSACTION_BIN_FILE ".new", "wb");
+    FILE* index = fopen(TRANSACTION_INDEX_FILE ".new", "wb");
+    LegacyTransaction* old = (LegacyTransaction*)malloc(sizeof(LegacyTransaction));
+    int ok = data != NULL && index != NULL && old != NULL;
+    long long offset = 0;
+    int converted = 0;
+    
+    while (ok && fread(old, sizeof(LegacyTransaction), 1, old_file) == 1) {
+        if (old->items_count < 0 || old->items_count > LEGACY_TRANSACTION_ITEMS) {
+            printf("Error: transaction %d has %d items!\n", old->transaction_id, old->items_count);
+            ok = 0;
+            break;
+        }
+        Transaction trans;
+        trans.transaction_id = old->transaction_id;
+        memcpy(trans.date, old->date, sizeof(trans.date));
+        memcpy(trans.time, old->time, sizeof(trans.time));
+        trans.amount = old->amount;
+        trans.items_count = old->items_count;
+        trans.items = old->items;
+        TransactionIndexEntry entry;
+        entry.transaction_id = trans.transaction_id;
+        entry.items_count = trans.items_count;
+        entry.timestamp = transactionTimestamp(&trans);
+        entry.offset = offset;
+        saveTransactionToBinary(data, &trans);
+        fwrite(&entry, sizeof(entry), 1, index);
+        offset += transactionFrameSize(trans.items_count);
+        converted++;
+    }
+    fclose(old_file);
+    free(old);
+    
+    if (data != NULL && (fflush(data) != 0 || fsync(fileno(data)) != 0)) {
+        ok = 0;
+    }
+    if (index != NULL && (fflush(index) != 0 || fsync(fileno(index)) != 0)) {
+        ok = 0;
+    }
+    if (data != NULL && fclose(data) != 0) {
+        ok = 0;
+    }
+    if (index != NULL && fclose(index) != 0) {
+        ok = 0;
+    }
+    
+    // Keep the original under a second name, then swap the new file in with
+    // one rename; a crash in between leaves the old layout to convert again
+    unlink(TRANSACTION_BIN_FILE ".old");
+    if (!ok || link(TRANSACTION_BIN_FILE, TRANSACTION_BIN_FILE ".old") != 0 ||
+        rename(TRANSACTION_INDEX_FILE ".new", TRANSACTION_INDEX_FILE) != 0 ||
+        rename(TRANSACTION_BIN_FILE ".new", TRANSACTION_BIN_FILE) != 0) {
+        printf("Error converting %s!\n", TRANSACTION_BIN_FILE);
+        unlink(TRANSACTION_BIN_FILE ".new");
+        unlink(TRANSACTION_INDEX_FILE ".new");
+        return 0;
+    }
+    
+    printf("Converted %d transactions: %ld bytes -> %lld bytes (original kept as %s.old)\n",
+           converted, old_size, offset, TRANSACTION_BIN_FILE);
+    return 1;
+}
+
+// Startup check of the transaction files. Converts the old layout, then
+// lines the index up with the data file after a crash: index entries whose
+// frame never made it are dropped, frames written without their entry are
+// indexed, and a torn last frame is cut off.
+void recoverTransactionFiles() {
+    // Batches of other terminals wait meanwhile, so a tail being written
+    // right now is not mistaken for a torn one. A batch that never got its
+    // shadow commit header is cut off first, from all three files.
+    ShadowHeader published;
+    int locked = shadowOpen() && shadowLock(1);
+    if (locked) {
+        shadowRecover(&published);
+    }
+    
+    FILE* file = fopen(TRANSACTION_BIN_FILE, "rb");
+    unsigned int magic;
+    int changed = 0;
+    if (file != NULL && fread(&magic, sizeof(magic), 1, file) == 1 && magic != TRANSACTION_MAGIC) {
+        fclose(file);
+        printf("Converting %s to the framed format...\n", TRANSACTION_BIN_FILE);
+        if (!convertTransactionFile()) {
+            exit(1);
+        }
+        file = fopen(TRANSACTION_BIN_FILE, "rb");
+        changed = 1;
+    }
+    
+    long long data_size = 0;
+    if (file != NULL) {
+        fseek(file, 0, SEEK_END);
+        data_size = ftell(file);
+    }
+    
+    int count;
+    TransactionIndexEntry* entries = loadTransactionIndex(&count);
+    int valid = 0;
+    long long end = 0;
+    while (valid < count && entries[valid].offset == end &&
+           end + transactionFrameSize(entries[valid].items_count) <= data_size) {
+        end += transactionFrameSize(entries[valid].items_count);
+        if (entries[valid].transaction_id > maxTransactionId) {
+            maxTransactionId = entries[valid].transaction_id;
+        }
+        valid++;
+    }
+    
+    // Frames past the last indexed one
+    TransactionHeader header;
+    int added = 0;
+    TransactionIndexEntry* missing = NULL;
+    while (file != NULL && fseek(file, (long)end, SEEK_SET) == 0 && readTransactionHeader(file, &header) &&
+           end + transactionFrameSize(header.items_count) <= data_size) {
+        TransactionIndexEntry* grown = (TransactionIndexEntry*)realloc(missing, sizeof(TransactionIndexEntry) * (added + 1));
+        if (grown == NULL) {
+            break;
+        }
+        missing = grown;
+        missing[added].transaction_id = header.transaction_id;
+        missing[added].items_count = header.items_count;
+        missing[added].timestamp = header.timestamp;
+        missing[added].offset = end;
+        added++;
+        end += transactionFrameSize(header.items_count);
+        if (header.transaction_id > maxTransactionId) {
+            maxTransactionId = header.transaction_id;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    
+    if (valid < count || added > 0) {
+        changed = 1;
+        FILE* index = fopen(TRANSACTION_INDEX_FILE, "ab");
+        if (index == NULL || ftruncate(fileno(index), (off_t)valid * (off_t)sizeof(TransactionIndexEntry)) != 0 ||
+            fwrite(missing, sizeof(TransactionIndexEntry), added, index) != (size_t)added) {
+            printf("Error repairing %s!\n", TRANSACTION_INDEX_FILE);
+        }
+        if (index != NULL) {
+            fclose(index);
+        }
+    }
+    if (end < data_size) {
+        changed = 1;
+        if (truncate(TRANSACTION_BIN_FILE, (off_t)end) != 0) {
+            printf("Error trimming %s!\n", TRANSACTION_BIN_FILE);
+        }
+    }
+    
+    free(missing);
+    free(entries);
+    if (locked) {
+        // Publish the repaired lengths, or the next recovery would cut the
+        // files back to the old ones
+        if (changed) {
+            shadowCommit(NULL, 0, -1, NULL);
+        }
+        shadowUnlock();
+    }
+}
+
+void viewTransactionsFromText() {
+    printHeader("TRANSACTION HISTORY (Text File)");
+    
+    FILE* file = fopen(TRANSACTION_TEXT_FILE, "r");
+    if (file == NULL) {
+        printf("No transaction text file found.\n");
+        return;
+    }
+    
+    char line[200];
+    printf("\nContents of %s:\n", TRANSACTION_TEXT_FILE);
+    printLine('-', 60);
+    
+    while (fgets(line, sizeof(line), file)) {
+        printf("%s", line);
+    }
+    
+    fclose(file);
+    printLine('-', 60);
+}
+
+// Bucket for key, inserted empty if missing; NULL when out of memory
+RollupBucket* rollupBucket(RollupTable* table, long long key) {
+    int position = table->count;
+    if (position == 0 || table->buckets[position - 1].key >= key) {
+        position = rollupLowerBound(table, key);
+    }
+    if (position < table->count && table->buckets[position].key == key) {
+        return &table->buckets[position];
+    }
+    
+    if (table->count == table->capacity) {
+        int capacity = table->capacity ? table->capacity * 2 : 64;
+        RollupBucket* buckets = (RollupBucket*)realloc(table->buckets, sizeof(RollupBucket) * capacity);
+        if (buckets == NULL) {
+            return NULL;
+        }
+        table->buckets = buckets;
+        table->capacity = capacity;
+    }
+    memmove(&table->buckets[position + 1], &table->buckets[position],
+            sizeof(RollupBucket) * (table->count - position));
+    table->count++;
+    memset(&table->buckets[position], 0, sizeof(RollupBucket));
+    table->buckets[position].key = key;
+    return &table->buckets[position];
+}
+
+// First bucket with a key not below the given one
+int rollupLowerBound(const RollupTable* table, long long key) {
+    int low = 0, high = table->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (table->buckets[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void rollupAdd(RollupTable* table, long long key, long long units, long long cents, int sign) {
+    RollupBucket* bucket = rollupBucket(table, key);
+    if (bucket == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    bucket->units += sign * units;
+    bucket->cents += sign * cents;
+    bucket->sales += sign;
+}
+
+// Add (sign 1) or take back (sign -1) one sale in every table
+void rollupApply(const TransactionHeader* header, const TransactionItem* items, int sign) {
+    int day_of_month = 0, month = 0, year = 0, hour = 0;
+    sscanf(header->date, "%d/%d/%d", &day_of_month, &month, &year);
+    sscanf(header->time, "%d", &hour);
+    int day = dayNumber(day_of_month, month, year);
+    
+    long long units = 0, cents = 0;
+    for (int i = 0; i < header->items_count; i++) {
+        long long line_cents = (long long)((double)items[i].price * items[i].quantity * 100.0 + 0.5);
+        units += items[i].quantity;
+        cents += line_cents;
+        rollupAdd(&salesRollups.tables[ROLLUP_MEDICINE], items[i].medicine_id,
+                  items[i].quantity, line_cents, sign);
+        rollupAdd(&salesRollups.tables[ROLLUP_MEDICINE_DAILY],
+                  (long long)day << 32 | (unsigned int)items[i].medicine_id,
+                  items[i].quantity, line_cents, sign);
+    }
+    rollupAdd(&salesRollups.tables[ROLLUP_HOURLY], (long long)day * 24 + hour, units, cents, sign);
+    rollupAdd(&salesRollups.tables[ROLLUP_DAILY], day, units, cents, sign);
+}
+
+// Apply every whole frame from the current position of the transaction
+// file and move the covered mark past the last one. Returns 0 if a frame
+// could not be read before the end of the file.
+int rollupReplay(FILE* file) {
+    TransactionHeader header;
+    Transaction frame = { 0 };      // item buffer, grown to the largest frame
+    int capacity = 0;
+    int ok = 1;
+    
+    while (ok && readTransactionHeader(file, &header)) {
+        if (header.items_count > capacity) {
+            ok = transactionReserve(&frame, header.items_count);
+            capacity = ok ? header.items_count : capacity;
+        }
+        ok = ok && fread(frame.items, sizeof(TransactionItem), header.items_count, file) == (size_t)header.items_count;
+        if (ok) {
+            rollupApply(&header, frame.items, 1);
+            salesRollups.covered += transactionFrameSize(header.items_count);
+        }
+    }
+    transactionFree(&frame);
+    return ok && feof(file);
+}
+
+void resetSalesRollups() {
+    for (int i = 0; i < ROLLUP_TABLES; i++) {
+        salesRollups.tables[i].count = 0;
+    }
+    salesRollups.covered = 0;
+}
+
+// Bring the tables up to the end of the transaction file the last commit
+// published and move the covered mark there. Checkouts do not add their
+// own sales; every terminal's sales get in through here, in file order.
+// Holds the commit lock so no batch is half written meanwhile. Returns 0
+// if a frame could not be read.
+int rollupCatchUp() {
+    ShadowHeader published;
+    int locked = shadowOpen() && shadowLock(1);
+    if (locked) {
+        shadowRecover(&published);
+    }
+    
+    int ok = 1;
+    FILE* file = fopen(TRANSACTION_BIN_FILE, "rb");
+    if (file != NULL) {
+        ok = fseek(file, (long)salesRollups.covered, SEEK_SET) == 0 && rollupReplay(file);
+        fclose(file);
+    }
+    if (locked) {
+        shadowUnlock();
+    }
+    return ok;
+}
+
+// Recompute every table from the whole transaction file
+void rebuildSalesRollups() {
+    resetSalesRollups();
+    if (!rollupCatchUp()) {
+        printf("Error reading %s at byte %lld!\n", TRANSACTION_BIN_FILE, salesRollups.covered);
+    }
+}
+
+// Catch the tables up, then write the rollup file and swap it in, so a
+// save never drops sales other terminals made since this one last looked.
+// Callers hold the layout lock exclusively, which keeps saves apart.
+int saveSalesRollups() {
+    if (!rollupCatchUp()) {
+        printf("Error reading %s at byte %lld!\n", TRANSACTION_BIN_FILE, salesRollups.covered);
+        return 0;
+    }
+    
+    FILE* file = fopen(SALES_ROLLUP_FILE ".tmp", "wb");
+    if (file == NULL) {
+        printf("Error saving sales rollups!\n");
+        return 0;
+    }
+    
+    RollupHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ROLLUP_MAGIC;
+    header.covered = salesRollups.covered;
+    for (int i = 0; i < ROLLUP_TABLES; i++) {
+        header.count[i] = salesRollups.tables[i].count;
+    }
+    
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; ok && i < ROLLUP_TABLES; i++) {
+        ok = fwrite(salesRollups.tables[i].buckets, sizeof(RollupBucket), header.count[i], file) == (size_t)header.count[i];
+    }
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(SALES_ROLLUP_FILE ".tmp", SALES_ROLLUP_FILE) != 0) {
+        printf("Error saving sales rollups!\n");
+        unlink(SALES_ROLLUP_FILE ".tmp");
+        return 0;
+    }
+    return 1;
+}
+
+// Load the saved tables and apply only the sales written after the save.
+// A missing or damaged rollup file, or a mark that does not land on a
+// frame boundary, means a full rebuild.
+void loadSalesRollups() {
+    RollupHeader header;
+    FILE* file = fopen(SALES_ROLLUP_FILE, "rb");
+    int ok = file != NULL && fread(&header, sizeof(header), 1, file) == 1 && header.magic == ROLLUP_MAGIC;
+    
+    resetSalesRollups();
+    for (int i = 0; ok && i < ROLLUP_TABLES; i++) {
+        RollupTable* table = &salesRollups.tables[i];
+        if (header.count[i] < 0) {
+            ok = 0;
+            break;
+        }
+        if (header.count[i] > table->capacity) {
+            RollupBucket* buckets = (RollupBucket*)realloc(table->buckets, sizeof(RollupBucket) * header.count[i]);
+            if (buckets == NULL) {
+                ok = 0;
+                break;
+            }
+            table->buckets = buckets;
+            table->capacity = header.count[i];
+        }
+        table->count = (int)fread(table->buckets, sizeof(RollupBucket), header.count[i], file);
+        if (table->count != header.count[i]) {
+            ok = 0;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    
+    struct stat info;
+    if (stat(TRANSACTION_BIN_FILE, &info) != 0) {
+        resetSalesRollups();
+        return;
+    }
+    if (ok && header.covered <= (long long)info.st_size) {
+        salesRollups.covered = header.covered;
+        ok = rollupCatchUp();
+    } else {
+        ok = 0;
+    }
+    if (!ok) {
+        rebuildSalesRollups();
+    }
+}
+
+// End-of-day report: one daily bucket plus that day's hourly buckets,
+// however long the history is
+void viewDailySales() {
+    printHeader("END-OF-DAY SALES REPORT");
+    
+    int days_ago;
+    printf("Days ago (0 = today): ");
+    if (scanf("%d", &days_ago) != 1 || days_ago < 0) {
+        clearInputBuffer();
+        printf("Invalid number of days!\n");
+        return;
+    }
+    clearInputBuffer();
+    
+    time_t when = time(NULL) - (time_t)days_ago * 86400;
+    struct tm* tm_info = localtime(&when);
+    char date[20];
+    strftime(date, sizeof(date), "%d/%m/%Y", tm_info);
+    int day = dayNumber(tm_info->tm_mday, tm_info->tm_mon + 1, tm_info->tm_year + 1900);
+    
+    printf("\nDate: %s\n", date);
+    rollupCatchUp();
+    const RollupTable* daily = &salesRollups.tables[ROLLUP_DAILY];
+    int position = rollupLowerBound(daily, day);
+    if (position == daily->count || daily->buckets[position].key != day || daily->buckets[position].sales == 0) {
+        printf("No sales on this day.\n");
+        return;
+    }
+    const RollupBucket* total = &daily->buckets[position];
+    printf("Transactions: %d\n", total->sales);
+    printf("Units Sold: %lld\n", total->units);
+    printf("Revenue (before tax): $%.2f\n", total->cents / 100.0);
+    
+    printf("\n%-8s %-14s %-10s %-10s\n", "Hour", "Transactions", "Units", "Revenue");
+    printLine('-', 46);
+    const RollupTable* hourly = &salesRollups.tables[ROLLUP_HOURLY];
+    for (int i = rollupLowerBound(hourly, (long long)day * 24);
+         i < hourly->count && hourly->buckets[i].key < (long long)(day + 1) * 24; i++) {
+        const RollupBucket* bucket = &hourly->buckets[i];
+        if (bucket->sales == 0) {
+            continue;
+        }
+        printf("%02lld:00    %-14d %-10lld $%-9.2f\n",
+               bucket->key % 24, bucket->sales, bucket->units, bucket->cents / 100.0);
+    }
+    printLine('-', 46);
+}
+
+int compareBucketKeys(const void* a, const void* b) {
+    const RollupBucket* x = (const RollupBucket*)a;
+    const RollupBucket* y = (const RollupBucket*)b;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// Most units first, ties by key
+int compareBucketUnits(const void* a, const void* b) {
+    const RollupBucket* x = (const RollupBucket*)a;
+    const RollupBucket* y = (const RollupBucket*)b;
+    if (x->units != y->units) {
+        return x->units > y->units ? -1 : 1;
+    }
+    return compareBucketKeys(a, b);
+}
+
+const char* rollupMedicineName(int id) {
+    Medicine* med = findMedicine(id);
+    return med != NULL ? med->name : "(deleted)";
+}
+
+// All-time best sellers, read from the per-medicine table
+void viewTopSellers() {
+    printHeader("TOP SELLING MEDICINES");
+    
+    rollupCatchUp();
+    const RollupTable* table = &salesRollups.tables[ROLLUP_MEDICINE];
+    RollupBucket* order = (RollupBucket*)malloc(sizeof(RollupBucket) * (table->count + 1));
+    if (order == NULL) {
+        printf("Out of memory!\n");
+        return;
+    }
+    memcpy(order, table->buckets, sizeof(RollupBucket) * table->count);
+    qsort(order, table->count, sizeof(RollupBucket), compareBucketUnits);
+    
+    printf("%-5s %-8s %-30s %-8s %-14s %-10s\n", "Rank", "ID", "Name", "Units", "Transactions", "Revenue");
+    printLine('-', 80);
+    int shown = 0;
+    for (int i = 0; i < table->count && shown < TOP_SELLERS; i++) {
+        if (order[i].units <= 0) {
+            break;
+        }
+        shown++;
+        printf("%-5d %-8lld %-30s %-8lld %-14d $%-9.2f\n",
+               shown, order[i].key, rollupMedicineName((int)order[i].key),
+               order[i].units, order[i].sales, order[i].cents / 100.0);
+    }
+    if (shown == 0) {
+        printf("No sales recorded.\n");
+    }
+    printLine('-', 80);
+    free(order);
+}
+
+// Units per day over the last N days for each medicine sold, with the days
+// of cover its stock gives at that rate. Reads only the per-medicine-per-day
+// buckets inside the window.
+void viewSalesVelocity() {
+    printHeader("SALES VELOCITY");
+    
+    int days;
+    printf("Window in days (e.g. 30): ");
+    if (scanf("%d", &days) != 1 || days <= 0) {
+        clearInputBuffer();
+        printf("Invalid number of days!\n");
+        return;
+    }
+    clearInputBuffer();
+    
+    rollupCatchUp();
+    const RollupTable* table = &salesRollups.tables[ROLLUP_MEDICINE_DAILY];
+    int first = rollupLowerBound(table, (long long)(todayDayNumber() - days + 1) << 32);
+    int count = table->count - first;
+    RollupBucket* sold = (RollupBucket*)malloc(sizeof(RollupBucket) * (count + 1));
+    if (sold == NULL) {
+        printf("Out of memory!\n");
+        return;
+    }
+    
+    // Re-key the window by medicine ID, then fold each medicine's days
+    for (int i = 0; i < count; i++) {
+        sold[i] = table->buckets[first + i];
+        sold[i].key = (unsigned int)sold[i].key;
+    }
+    qsort(sold, count, sizeof(RollupBucket), compareBucketKeys);
+    int merged = 0;
+    for (int i = 0; i < count; i++) {
+        if (merged > 0 && sold[merged - 1].key == sold[i].key) {
+            sold[merged - 1].units += sold[i].units;
+            sold[merged - 1].cents += sold[i].cents;
+            sold[merged - 1].sales += sold[i].sales;
+        } else {
+            sold[merged++] = sold[i];
+        }
+    }
+    qsort(sold, merged, sizeof(RollupBucket), compareBucketUnits);
+    
+    printf("%-8s %-30s %-8s %-10s %-8s %-10s\n", "ID", "Name", "Units", "Per Day", "Stock", "Cover");
+    printLine('-', 80);
+    int shown = 0;
+    for (int i = 0; i < merged; i++) {
+        if (sold[i].units <= 0) {
+            continue;
+        }
+        double per_day = (double)sold[i].units / days;
+        Medicine* med = findMedicine((int)sold[i].key);
+        printf("%-8lld %-30s %-8lld %-10.2f ", sold[i].key, rollupMedicineName((int)sold[i].key),
+               sold[i].units, per_day);
+        if (med != NULL) {
+            printf("%-8d %.1f days\n", med->quantity, med->quantity / per_day);
+        } else {
+            printf("%-8s -\n", "-");
+        }
+        shown++;
+    }
+    if (shown == 0) {
+        printf("No sales in the last %d days.\n", days);
+    }
+    printLine('-', 80);
+    free(sold);
+}
+
+// Seconds since the epoch at the local midnight that starts a day number
+long long dayStartTimestamp(int day) {
+    struct tm tm_info;
+    memset(&tm_info, 0, sizeof(tm_info));
+    tm_info.tm_year = 70;
+    tm_info.tm_mday = 1 + day;
+    tm_info.tm_isdst = -1;
+    return (long long)mktime(&tm_info);
+}
+
+// Next chunk for a worker: its own front first, then the back of another
+// worker's run. Returns -1 when every run is empty.
+int scanTakeChunk(ScanWorker* worker) {
+    ScanJob* job = worker->job;
+    for (int k = 0; k < job->threads; k++) {
+        ScanDeque* deque = &job->deques[(worker->self + k) % job->threads];
+        int chunk = -1;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail) {
+            chunk = k == 0 ? deque->head++ : --deque->tail;
+        }
+        pthread_mutex_unlock(&deque->lock);
+        if (chunk >= 0) {
+            if (k > 0) {
+                worker->totals.steals++;
+            }
+            return chunk;
+        }
+    }
+    return -1;
+}
+
+// Read a chunk in one go and add up the frames that pass the filter
+void* scanWorkerRun(void* arg) {
+    ScanWorker* worker = (ScanWorker*)arg;
+    ScanJob* job = worker->job;
+    char* buffer = NULL;
+    long long capacity = 0;
+    int chunk;
+    
+    while ((chunk = scanTakeChunk(worker)) >= 0) {
+        const ScanChunk* range = &job->chunks[chunk];
+        if (range->length > capacity) {
+            char* grown = (char*)realloc(buffer, (size_t)range->length);
+            if (grown == NULL) {
+                worker->totals.errors++;
+                continue;
+            }
+            buffer = grown;
+            capacity = range->length;
+        }
+        
+        long long done = 0;
+        while (done < range->length) {
+            ssize_t n = pread(job->fd, buffer + done, (size_t)(range->length - done), (off_t)(range->offset + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        if (done < range->length) {
+            worker->totals.errors++;
+            continue;
+        }
+        worker->totals.bytes += done;
+        
+        TransactionHeader header;
+        for (long long at = 0; at + (long long)sizeof(header) <= done; ) {
+            memcpy(&header, buffer + at, sizeof(header));
+            if (header.magic != TRANSACTION_MAGIC || header.items_count < 0) {
+                worker->totals.errors++;
+                break;
+            }
+            at += transactionFrameSize(header.items_count);
+            if (header.timestamp < job->from || header.timestamp >= job->to) {
+                continue;
+            }
+            worker->totals.transactions++;
+            worker->totals.items += header.items_count;
+            worker->totals.cents += (long long)(header.amount * 100.0 + (header.amount < 0 ? -0.5 : 0.5));
+        }
+    }
+    
+    free(buffer);
+    return NULL;
+}
+
+// Add up the transactions in a date range using `threads` workers. Chunks
+// whose index entries all fall outside the range are never read.
+int scanTransactions(const ScanFilter* filter, int threads, ScanTotals* totals) {
+    memset(totals, 0, sizeof(*totals));
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > SCAN_MAX_THREADS) {
+        threads = SCAN_MAX_THREADS;
+    }
+    
+    ScanJob job;
+    job.from = filter->first_day > 0 ? dayStartTimestamp(filter->first_day) : -(1LL << 62);
+    job.to = filter->last_day > 0 ? dayStartTimestamp(filter->last_day + 1) : 1LL << 62;
+    job.threads = threads;
+    
+    int count;
+    TransactionIndexEntry* entries = loadTransactionIndex(&count);
+    job.chunks = (ScanChunk*)malloc(sizeof(ScanChunk) * (count + 1));
+    if (job.chunks == NULL) {
+        free(entries);
+        return count == 0;
+    }
+    
+    int chunk_count = 0;
+    for (int i = 0; i < count; ) {
+        long long offset = entries[i].offset, end = offset;
+        int in_range = 0;
+        while (i < count && end - offset < SCAN_CHUNK_BYTES) {
+            end = entries[i].offset + transactionFrameSize(entries[i].items_count);
+            if (entries[i].timestamp >= job.from && entries[i].timestamp < job.to) {
+                in_range = 1;
+            }
+            i++;
+        }
+        if (in_range) {
+            job.chunks[chunk_count].offset = offset;
+            job.chunks[chunk_count].length = end - offset;
+            chunk_count++;
+        }
+    }
+    free(entries);
+    
+    job.fd = open(TRANSACTION_BIN_FILE, O_RDONLY);
+    if (job.fd < 0) {
+        free(job.chunks);
+        return count == 0;
+    }
+    
+    job.deques = (ScanDeque*)malloc(sizeof(ScanDeque) * threads);
+    ScanWorker* workers = (ScanWorker*)calloc(threads, sizeof(ScanWorker));
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    if (job.deques == NULL || workers == NULL || tids == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    
+    // Neighbouring chunks go to the same worker so each reads a contiguous run
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_init(&job.deques[t].lock, NULL);
+        job.deques[t].head = (int)((long long)chunk_count * t / threads);
+        job.deques[t].tail = (int)((long long)chunk_count * (t + 1) / threads);
+        workers[t].job = &job;
+        workers[t].self = t;
+    }
+    int started = 1;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, scanWorkerRun, &workers[t]) != 0) {
+            break;
+        }
+        started++;
+    }
+    scanWorkerRun(&workers[0]);
+    
+    for (int t = 0; t < threads; t++) {
+        if (t > 0 && t < started) {
+            pthread_join(tids[t], NULL);
+        }
+        totals->transactions += workers[t].totals.transactions;
+        totals->items += workers[t].totals.items;
+        totals->cents += workers[t].totals.cents;
+        totals->bytes += workers[t].totals.bytes;
+        totals->steals += workers[t].totals.steals;
+        totals->errors += workers[t].totals.errors;
+        pthread_mutex_destroy(&job.deques[t].lock);
+    }
+    
+    close(job.fd);
+    free(tids);
+    free(workers);
+    free(job.deques);
+    free(job.chunks);
+    return totals->errors == 0;
+}
+
+int scanThreadCount() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        return 1;
+    }
+    return cores > SCAN_MAX_THREADS ? SCAN_MAX_THREADS : (int)cores;
+}
+
+// Read one optional date; returns 1 with day = 0 when left blank
+int readOptionalDate(const char* prompt, int* day) {
+    char input[30];
+    printf("%s", prompt);
+    if (fgets(input, sizeof(input), stdin) == NULL) {
+        return 0;
+    }
+    input[strcspn(input, "\n")] = '\0';
+    if (input[0] == '\0') {
+        *day = 0;
+        return 1;
+    }
+    *day = expiryDayNumber(input);
+    return *day != 0;
+}
+
+// The totals of viewTransactions for any date range, from a parallel scan
+void viewSalesTotals() {
+    printHeader("SALES TOTALS BY DATE RANGE");
+    
+    ScanFilter filter;
+    if (!readOptionalDate("From date (DD/MM/YYYY, Enter for the beginning): ", &filter.first_day) ||
+        !readOptionalDate("To date (DD/MM/YYYY, Enter for today): ", &filter.last_day)) {
+        printf("Invalid date!\n");
+        return;
+    }
+    
+    ScanTotals totals;
+    int threads = scanThreadCount();
+    double start = nowSeconds();
+    int ok = scanTransactions(&filter, threads, &totals);
+    double seconds = nowSeconds() - start;
+    if (!ok) {
+        printf("Error reading %s; totals may be incomplete!\n", TRANSACTION_BIN_FILE);
+    }
+    
+    printLine('-', 50);
+    printf("Total Transactions: %lld\n", totals.transactions);
+    printf("Line Items: %lld\n", totals.items);
+    printf("Total Sales: $%.2f\n", totals.cents / 100.0);
+    printLine('-', 50);
+    printf("Scanned %.1f MB with %d threads in %.3f s\n", totals.bytes / 1048576.0, threads, seconds);
+}
+
+// Hash a medicine ID into the catalog index (Fibonacci hashing)
+unsigned int hashMedicineId(int id) {
+    return (unsigned int)id * 2654435769u;
+}
+
+void indexInsert(int id, int slot) {
+    unsigned int mask = (unsigned int)catalog.index_capacity - 1;
+    unsigned int bucket = hashMedicineId(id) & mask;
+    
+    while (catalog.index[bucket] != -1 && catalog.slots[catalog.index[bucket]]->id != id) {
+        bucket = (bucket + 1) & mask;
+    }
+    catalog.index[bucket] = slot;
+}
+
+void indexRebuild(int needed) {
+    int capacity = 64;
+    while (capacity < needed * 2) {
+        capacity <<= 1;
+    }
+    
+    free(catalog.index);
+    catalog.index = (int*)malloc(sizeof(int) * capacity);
+    if (catalog.index == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    catalog.index_capacity = capacity;
+    
+    for (int i = 0; i < capacity; i++) {
+        catalog.index[i] = -1;
+    }
+    for (int i = 0; i < catalog.count; i++) {
+        indexInsert(catalog.slots[i]->id, i);
+    }
+}
+
+// Make room in the index for needed records, keeping the entries it holds
+// rather than indexing every slot again
+void indexReserve(int needed) {
+    if (needed * 2 <= catalog.index_capacity) {
+        return;
+    }
+    
+    int* old = catalog.index;
+    int old_capacity = catalog.index_capacity;
+    int capacity = 64;
+    while (capacity < needed * 2) {
+        capacity <<= 1;
+    }
+    catalog.index = (int*)malloc(sizeof(int) * capacity);
+    if (catalog.index == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    catalog.index_capacity = capacity;
+    
+    for (int i = 0; i < capacity; i++) {
+        catalog.index[i] = -1;
+    }
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i] != -1) {
+            indexInsert(catalog.slots[old[i]]->id, old[i]);
+        }
+    }
+    free(old);
+}
+
+// Take a slot out of the index the way cartRemove does: entries further
+// along the probe cluster move back into the gap unless their home bucket
+// lies past it, so no tombstones are left behind
+void indexRemove(int slot) {
+    unsigned int mask = (unsigned int)catalog.index_capacity - 1;
+    unsigned int gap = hashMedicineId(catalog.slots[slot]->id) & mask;
+    while (catalog.index[gap] != slot) {
+        gap = (gap + 1) & mask;
+    }
+    for (unsigned int bucket = (gap + 1) & mask; catalog.index[bucket] != -1; bucket = (bucket + 1) & mask) {
+        unsigned int home = hashMedicineId(catalog.slots[catalog.index[bucket]]->id) & mask;
+        if (((bucket - home) & mask) >= ((bucket - gap) & mask)) {
+            catalog.index[gap] = catalog.index[bucket];
+            gap = bucket;
+        }
+    }
+    catalog.index[gap] = -1;
+}
+
+// Point the index entry of a record at the slot it was moved to
+void indexMove(int from, int to) {
+    unsigned int mask = (unsigned int)catalog.index_capacity - 1;
+    unsigned int bucket = hashMedicineId(catalog.slots[from]->id) & mask;
+    while (catalog.index[bucket] != from) {
+        bucket = (bucket + 1) & mask;
+    }
+    catalog.index[bucket] = to;
+}
+
+int findMedicineSlot(int id) {
+    if (catalog.index_capacity == 0) {
+        return -1;
+    }
+    
+    unsigned int mask = (unsigned int)catalog.index_capacity - 1;
+    unsigned int bucket = hashMedicineId(id) & mask;
+    
+    while (catalog.index[bucket] != -1) {
+        if (catalog.slots[catalog.index[bucket]]->id == id) {
+            return catalog.index[bucket];
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return -1;
+}
+
+Medicine* findMedicine(int id) {
+    int slot = findMedicineSlot(id);
+    return slot < 0 ? NULL : catalog.slots[slot];
+}
+
+Medicine* poolAllocMedicine() {
+    if (catalog.free_list != NULL) {
+        Medicine* med = catalog.free_list;
+        memcpy(&catalog.free_list, med, sizeof(Medicine*));
+        return med;
+    }
+    
+    if (catalog.blocks == NULL || catalog.block_used == MEDICINE_POOL_BLOCK) {
+        MedicineBlock* block = (MedicineBlock*)malloc(sizeof(MedicineBlock));
+        if (block == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        block->next = catalog.blocks;
+        catalog.blocks = block;
+        catalog.block_used = 0;
+    }
+    return &catalog.blocks->records[catalog.block_used++];
+}
+
+void poolFreeMedicine(Medicine* med) {
+    memcpy(med, &catalog.free_list, sizeof(Medicine*));
+    catalog.free_list = med;
+}
+
+void catalogReserve(int needed) {
+    if (needed <= catalog.capacity) {
+        return;
+    }
+    
+    int capacity = catalog.capacity ? catalog.capacity : MEDICINE_POOL_BLOCK;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    
+    Medicine** slots = (Medicine**)realloc(catalog.slots, sizeof(Medicine*) * capacity);
+    unsigned char* dirty = (unsigned char*)realloc(catalog.dirty, capacity);
+    int* dirty_slots = (int*)realloc(catalog.dirty_slots, sizeof(int) * capacity);
+    int* column_id = (int*)realloc(catalog.column_id, sizeof(int) * capacity);
+    float* column_price = (float*)realloc(catalog.column_price, sizeof(float) * capacity);
+    int* column_quantity = (int*)realloc(catalog.column_quantity, sizeof(int) * capacity);
+    int* column_expiry = (int*)realloc(catalog.column_expiry, sizeof(int) * capacity);
+    int* column_category = (int*)realloc(catalog.column_category, sizeof(int) * capacity);
+    int* reorder_level = (int*)realloc(catalog.reorder_level, sizeof(int) * capacity);
+    int* low_stock_heap = (int*)realloc(catalog.low_stock_heap, sizeof(int) * capacity);
+    int* low_stock_position = (int*)realloc(catalog.low_stock_position, sizeof(int) * capacity);
+    unsigned int* version = (unsigned int*)realloc(catalog.version, sizeof(unsigned int) * capacity);
+    if (slots == NULL || dirty == NULL || dirty_slots == NULL || column_id == NULL ||
+        column_price == NULL || column_quantity == NULL || column_expiry == NULL || column_category == NULL ||
+        reorder_level == NULL || low_stock_heap == NULL || low_stock_position == NULL || version == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    memset(dirty + catalog.capacity, 0, capacity - catalog.capacity);
+    
+    catalog.slots = slots;
+    catalog.dirty = dirty;
+    catalog.dirty_slots = dirty_slots;
+    catalog.column_id = column_id;
+    catalog.column_price = column_price;
+    catalog.column_quantity = column_quantity;
+    catalog.column_expiry = column_expiry;
+    catalog.column_category = column_category;
+    catalog.reorder_level = reorder_level;
+    catalog.low_stock_heap = low_stock_heap;
+    catalog.low_stock_position = low_stock_position;
+    catalog.version = version;
+    catalog.capacity = capacity;
+}
+
+// Every change to a record goes through here, which keeps the columns current
+void catalogMarkDirty(int slot) {
+    catalogSyncColumns(slot);
+    if (!catalog.dirty[slot]) {
+        catalog.dirty[slot] = 1;
+        catalog.dirty_slots[catalog.dirty_count++] = slot;
+    }
+}
+
+// Add a record to the slots, ID index, category and columns but not to the
+// sorted name and expiry indexes; bulk imports rebuild those once at the end
+int catalogAppend(const Medicine* med) {
+    catalogReserve(catalog.count + 1);
+    
+    Medicine* record = poolAllocMedicine();
+    *record = *med;
+    
+    int slot = catalog.count++;
+    catalog.slots[slot] = record;
+    catalog.reorder_level[slot] = LOW_STOCK_THRESHOLD;
+    catalog.low_stock_position[slot] = -1;
+    if (catalog.count * 2 > catalog.index_capacity) {
+        indexRebuild(catalog.count);
+    } else {
+        indexInsert(record->id, slot);
+    }
+    if (record->id > catalog.max_id) {
+        catalog.max_id = record->id;
+    }
+    categoryAssign(slot);
+    
+    catalogMarkDirty(slot);
+    return slot;
+}
+
+Medicine* catalogAdd(const Medicine* med) {
+    int slot = catalogAppend(med);
+    Medicine* record = catalog.slots[slot];
+    nameIndexInsert(record);
+    expiryIndexInsert(record);
+    return record;
+}
+
+// Index a slot just filled from the medicine file, as catalogAdd would
+void catalogIndexSlot(int slot) {
+    Medicine* med = catalog.slots[slot];
+    catalog.reorder_level[slot] = LOW_STOCK_THRESHOLD;
+    catalog.low_stock_position[slot] = -1;
+    indexInsert(med->id, slot);
+    if (med->id > catalog.max_id) {
+        catalog.max_id = med->id;
+    }
+    categoryAssign(slot);
+    nameIndexInsert(med);
+    expiryIndexInsert(med);
+    catalogSyncColumns(slot);
+}
+
+// Take a slot's record out of every index; the record stays in the slot
+void catalogUnindex(int slot) {
+    Medicine* med = catalog.slots[slot];
+    lowStockRemove(slot);
+    stockForget(med->id);
+    categoryPostingRemove(catalog.column_category[slot], med->id);
+    nameIndexRemove(med);
+    expiryIndexRemove(med);
+    indexRemove(slot);
+}
+
+// Move the last record into a slot whose record is out of the indexes and
+// drop the last slot, so only that slot has to be rewritten and the file
+// shrinks by one record; the ID index is patched in place rather than rebuilt
+void catalogCloseSlot(int slot) {
+    int last = catalog.count - 1;
+    if (slot != last) {
+        indexMove(last, slot);
+    }
+    poolFreeMedicine(catalog.slots[slot]);
+    catalog.slots[slot] = catalog.slots[last];
+    catalog.count--;
+    
+    if (slot != last) {
+        // The moved record keeps its category, reorder level and heap entry
+        catalog.column_category[slot] = catalog.column_category[last];
+        catalog.reorder_level[slot] = catalog.reorder_level[last];
+        catalog.low_stock_position[slot] = catalog.low_stock_position[last];
+        if (catalog.low_stock_position[slot] >= 0) {
+            catalog.low_stock_heap[catalog.low_stock_position[slot]] = slot;
+        }
+        catalogMarkDirty(slot);
+    }
+}
+
+int catalogRemove(int id) {
+    int slot = findMedicineSlot(id);
+    if (slot < 0) {
+        return 0;
+    }
+    
+    int had_level = catalog.reorder_level[slot] != LOW_STOCK_THRESHOLD;
+    catalogUnindex(slot);
+    catalogCloseSlot(slot);
+    
+    // IDs can be handed out again, so a deleted medicine's level must not linger
+    if (had_level) {
+        saveReorderLevels();
+    }
+    return 1;
+}
+
+void catalogSyncColumns(int slot) {
+    Medicine* med = catalog.slots[slot];
+    catalog.column_id[slot] = med->id;
+    catalog.column_price[slot] = med->price;
+    catalog.column_quantity[slot] = med->quantity;
+    catalog.column_expiry[slot] = expiryDayNumber(med->expiry_date);
+    lowStockUpdate(slot);
+    stockSync(slot);
+    
+    // Carts priced from the old record see the new stamp and look again
+    catalog.version[slot] = ++catalog.version_clock;
+}
+
+// Counter of a medicine ID, or NULL when the ID is out of range or its
+// page was never needed. With create set (catalog lock held) the page is
+// allocated and published.
+StockCounter* stockCounter(int id, int create) {
+    if (id < 0 || id >= STOCK_PAGE * STOCK_PAGES) {
+        return NULL;
+    }
+    
+    StockCounter* page = atomic_load_explicit(&stockCounters.pages[id / STOCK_PAGE], memory_order_acquire);
+    if (page == NULL && create) {
+        page = (StockCounter*)aligned_alloc(64, sizeof(StockCounter) * STOCK_PAGE);
+        if (page == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        memset(page, 0, sizeof(StockCounter) * STOCK_PAGE);
+        atomic_store_explicit(&stockCounters.pages[id / STOCK_PAGE], page, memory_order_release);
+    }
+    return page == NULL ? NULL : &page[id % STOCK_PAGE];
+}
+
+// Fold a change of a record's quantity into its counter
+void stockSync(int slot) {
+    Medicine* med = catalog.slots[slot];
+    StockCounter* counter = stockCounter(med->id, 1);
+    if (counter == NULL) {
+        return;
+    }
+    
+    counter->generation = stockCounters.generation;
+    if (med->quantity != counter->synced) {
+        atomic_fetch_add(&counter->available, med->quantity - counter->synced);
+        counter->synced = med->quantity;
+    }
+}
+
+// After a full build: IDs the build did not see are gone from the file
+void stockSweep() {
+    for (int p = 0; p < STOCK_PAGES; p++) {
+        StockCounter* page = atomic_load_explicit(&stockCounters.pages[p], memory_order_acquire);
+        for (int i = 0; page != NULL && i < STOCK_PAGE; i++) {
+            if (page[i].generation != stockCounters.generation && page[i].synced != 0) {
+                atomic_fetch_sub(&page[i].available, page[i].synced);
+                page[i].synced = 0;
+            }
+        }
+    }
+    stockCounters.generation++;
+}
+
+void stockForget(int id) {
+    StockCounter* counter = stockCounter(id, 0);
+    if (counter != NULL) {
+        atomic_fetch_sub(&counter->available, counter->synced);
+        counter->synced = 0;
+    }
+}
+
+// Reserve quantity units if that many are available. IDs too large for a
+// counter are left to the check under the lock.
+int stockReserve(int id, int quantity) {
+    StockCounter* counter = stockCounter(id, 0);
+    if (counter == NULL) {
+        return id < 0 || id >= STOCK_PAGE * STOCK_PAGES;
+    }
+    
+    int have = atomic_load_explicit(&counter->available, memory_order_relaxed);
+    do {
+        if (have < quantity) {
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak(&counter->available, &have, have - quantity));
+    return 1;
+}
+
+void stockRelease(int id, int quantity) {
+    StockCounter* counter = stockCounter(id, 0);
+    if (counter != NULL) {
+        atomic_fetch_add(&counter->available, quantity);
+    }
+}
+
+// Reserve every line of a transaction or none of them
+int stockReserveTransaction(const Transaction* trans) {
+    for (int i = 0; i < trans->items_count; i++) {
+        if (!stockReserve(trans->items[i].medicine_id, trans->items[i].quantity)) {
+            while (i-- > 0) {
+                stockRelease(trans->items[i].medicine_id, trans->items[i].quantity);
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void stockReleaseTransaction(const Transaction* trans) {
+    for (int i = 0; i < trans->items_count; i++) {
+        stockRelease(trans->items[i].medicine_id, trans->items[i].quantity);
+    }
+}
+
+// A checkout took its reserved units off the record: the counter already
+// reflects them, so only its view of the record moves
+void stockConsume(int slot, int quantity) {
+    StockCounter* counter = stockCounter(catalog.slots[slot]->id, 1);
+    if (counter != NULL) {
+        counter->synced -= quantity;
+    }
+}
+
+unsigned int categoryHash(const char* name) {
+    unsigned int hash = 2166136261u;
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned int)tolower((unsigned char)*name)) * 16777619u;
+    }
+    return hash;
+}
+
+void categoryIndexInsert(int code) {
+    unsigned int mask = (unsigned int)categories.index_capacity - 1;
+    unsigned int bucket = categoryHash(categories.entries[code].name) & mask;
+    while (categories.index[bucket] != -1) {
+        bucket = (bucket + 1) & mask;
+    }
+    categories.index[bucket] = code;
+}
+
+int categoryFind(const char* name) {
+    if (categories.index_capacity == 0) {
+        return -1;
+    }
+    
+    unsigned int mask = (unsigned int)categories.index_capacity - 1;
+    unsigned int bucket = categoryHash(name) & mask;
+    while (categories.index[bucket] != -1) {
+        int code = categories.index[bucket];
+        if (strcasecmp(categories.entries[code].name, name) == 0) {
+            return code;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return -1;
+}
+
+// Add a category to the in-memory dictionary and return its code
+int categoryAdd(const char* name) {
+    if (categories.count == categories.capacity) {
+        int capacity = categories.capacity ? categories.capacity * 2 : 16;
+        CategoryEntry* entries = (CategoryEntry*)realloc(categories.entries, sizeof(CategoryEntry) * capacity);
+        if (entries == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        categories.entries = entries;
+        categories.capacity = capacity;
+    }
+    
+    int code = categories.count++;
+    CategoryEntry* entry = &categories.entries[code];
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->name, name, sizeof(entry->name) - 1);
+    
+    if (categories.count * 2 > categories.index_capacity) {
+        int capacity = categories.index_capacity ? categories.index_capacity * 2 : 32;
+        free(categories.index);
+        categories.index = (int*)malloc(sizeof(int) * capacity);
+        if (categories.index == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        categories.index_capacity = capacity;
+        for (int i = 0; i < capacity; i++) {
+            categories.index[i] = -1;
+        }
+        for (int i = 0; i < categories.count; i++) {
+            categoryIndexInsert(i);
+        }
+    } else {
+        categoryIndexInsert(code);
+    }
+    return code;
+}
+
+// Code of a category, creating it (and appending it to the category file)
+// the first time it is seen
+int categoryIntern(const char* name) {
+    int code = categoryFind(name);
+    if (code >= 0) {
+        return code;
+    }
+    
+    code = categoryAdd(name);
+    FILE* file = fopen(CATEGORY_FILE, "ab");
+    if (file == NULL || fwrite(categories.entries[code].name, sizeof(categories.entries[code].name), 1, file) != 1) {
+        printf("Error saving categories!\n");
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    return code;
+}
+
+// Read the category file so existing names keep their codes
+void loadCategories() {
+    FILE* file = fopen(CATEGORY_FILE, "rb");
+    if (file == NULL) {
+        return;
+    }
+    char name[50];
+    while (fread(name, sizeof(name), 1, file) == 1) {
+        name[sizeof(name) - 1] = 0;
+        if (categoryFind(name) < 0) {
+            categoryAdd(name);
+        }
+    }
+    fclose(file);
+}
+
+// Position of the first ID in the posting list not below id
+int categoryPostingLowerBound(const CategoryEntry* entry, int id) {
+    int low = 0, high = entry->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (entry->ids[mid] < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int compareIds(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+void categoryPostingAppend(int code, int id) {
+    CategoryEntry* entry = &categories.entries[code];
+    if (entry->count == entry->capacity) {
+        int capacity = entry->capacity ? entry->capacity * 2 : 16;
+        int* ids = (int*)realloc(entry->ids, sizeof(int) * capacity);
+        if (ids == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        entry->ids = ids;
+        entry->capacity = capacity;
+    }
+    entry->ids[entry->count++] = id;
+}
+
+void categoryPostingInsert(int code, int id) {
+    CategoryEntry* entry = &categories.entries[code];
+    int position = categoryPostingLowerBound(entry, id);
+    categoryPostingAppend(code, id);
+    
+    // New medicines get the highest ID, so this rarely moves anything
+    memmove(&entry->ids[position + 1], &entry->ids[position], sizeof(int) * (entry->count - 1 - position));
+    entry->ids[position] = id;
+}
+
+void categoryPostingRemove(int code, int id) {
+    CategoryEntry* entry = &categories.entries[code];
+    int position = categoryPostingLowerBound(entry, id);
+    if (position == entry->count || entry->ids[position] != id) {
+        return;
+    }
+    memmove(&entry->ids[position], &entry->ids[position + 1], sizeof(int) * (entry->count - position - 1));
+    entry->count--;
+}
+
+// Give a slot its category code and posting list entry. The record takes
+// the dictionary spelling, so "tablet" and "Tablet" are one category.
+void categoryAssign(int slot) {
+    Medicine* med = catalog.slots[slot];
+    int code = categoryIntern(med->category);
+    strcpy(med->category, categories.entries[code].name);
+    catalog.column_category[slot] = code;
+    categoryPostingInsert(code, med->id);
+}
+
+// The low-stock heap orders by the quantity column, then ID
+int lowStockBefore(int a, int b) {
+    if (catalog.column_quantity[a] != catalog.column_quantity[b]) {
+        return catalog.column_quantity[a] < catalog.column_quantity[b];
+    }
+    return catalog.column_id[a] < catalog.column_id[b];
+}
+
+void lowStockPlace(int position, int slot) {
+    catalog.low_stock_heap[position] = slot;
+    catalog.low_stock_position[slot] = position;
+}
+
+void lowStockSiftUp(int position) {
+    int slot = catalog.low_stock_heap[position];
+    while (position > 0) {
+        int parent = (position - 1) / 2;
+        if (!lowStockBefore(slot, catalog.low_stock_heap[parent])) {
+            break;
+        }
+        lowStockPlace(position, catalog.low_stock_heap[parent]);
+        position = parent;
+    }
+    lowStockPlace(position, slot);
+}
+
+void lowStockSiftDown(int position) {
+    int slot = catalog.low_stock_heap[position];
+    while (1) {
+        int child = 2 * position + 1;
+        if (child >= catalog.low_stock_count) {
+            break;
+        }
+        if (child + 1 < catalog.low_stock_count &&
+            lowStockBefore(catalog.low_stock_heap[child + 1], catalog.low_stock_heap[child])) {
+            child++;
+        }
+        if (!lowStockBefore(catalog.low_stock_heap[child], slot)) {
+            break;
+        }
+        lowStockPlace(position, catalog.low_stock_heap[child]);
+        position = child;
+    }
+    lowStockPlace(position, slot);
+}
+
+// Add, move or drop a slot in the low-stock heap after its quantity or
+// reorder level changed. O(log n), so checkouts can afford it.
+void lowStockUpdate(int slot) {
+    int low = catalog.column_quantity[slot] < catalog.reorder_level[slot];
+    int position = catalog.low_stock_position[slot];
+    
+    if (low && position < 0) {
+        position = catalog.low_stock_count++;
+        lowStockPlace(position, slot);
+        lowStockSiftUp(position);
+    } else if (!low && position >= 0) {
+        lowStockRemove(slot);
+    } else if (low) {
+        lowStockSiftUp(position);
+        lowStockSiftDown(catalog.low_stock_position[slot]);
+    }
+}
+
+void lowStockRemove(int slot) {
+    int position = catalog.low_stock_position[slot];
+    if (position < 0) {
+        return;
+    }
+    
+    catalog.low_stock_position[slot] = -1;
+    int last = catalog.low_stock_heap[--catalog.low_stock_count];
+    if (position < catalog.low_stock_count) {
+        lowStockPlace(position, last);
+        lowStockSiftUp(position);
+        lowStockSiftDown(catalog.low_stock_position[last]);
+    }
+}
+
+// Has the reorder file been swapped or rewritten since it was last read or
+// written here? With note set it is remembered as it is now, which readers
+// do before reading so a save in between is not missed.
+int reorderFileChanged(int note) {
+    struct stat info;
+    if (stat(REORDER_LEVEL_FILE, &info) != 0) {
+        memset(&info, 0, sizeof(info));
+    }
+    int changed = info.st_ino != catalog.reorder_file.st_ino || info.st_size != catalog.reorder_file.st_size ||
+                  info.st_mtim.tv_sec != catalog.reorder_file.st_mtim.tv_sec ||
+                  info.st_mtim.tv_nsec != catalog.reorder_file.st_mtim.tv_nsec;
+    if (note) {
+        catalog.reorder_file = info;
+    }
+    return changed;
+}
+
+// Medicines not listed in the reorder file use LOW_STOCK_THRESHOLD.
+// Needs the ID index.
+void loadReorderLevels() {
+    for (int i = 0; i < catalog.count; i++) {
+        catalog.reorder_level[i] = LOW_STOCK_THRESHOLD;
+        catalog.low_stock_position[i] = -1;
+    }
+    catalog.low_stock_count = 0;
+    
+    reorderFileChanged(1);
+    FILE* file = fopen(REORDER_LEVEL_FILE, "rb");
+    if (file == NULL) {
+        return;
+    }
+    ReorderLevel entry;
+    while (fread(&entry, sizeof(entry), 1, file) == 1) {
+        int slot = findMedicineSlot(entry.medicine_id);
+        if (slot >= 0) {
+            catalog.reorder_level[slot] = entry.level;
+        }
+    }
+    fclose(file);
+}
+
+// Bring the reorder levels up to the reorder file: slots indexed since it
+// was read take their levels from it, and if another terminal rewrote it,
+// every slot does, levels it no longer lists going back to the default.
+// Only slots whose level changed move in the low-stock heap.
+void refreshReorderLevels() {
+    int* levels = NULL;
+    if (reorderFileChanged(1)) {
+        levels = (int*)malloc(sizeof(int) * (catalog.count + 1));
+        if (levels == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        for (int i = 0; i < catalog.count; i++) {
+            levels[i] = LOW_STOCK_THRESHOLD;
+        }
+    }
+    
+    FILE* file = fopen(REORDER_LEVEL_FILE, "rb");
+    ReorderLevel entry;
+    while (file != NULL && fread(&entry, sizeof(entry), 1, file) == 1) {
+        int slot = findMedicineSlot(entry.medicine_id);
+        if (slot >= 0 && levels != NULL) {
+            levels[slot] = entry.level;
+        } else if (slot >= 0 && catalog.reorder_level[slot] != entry.level) {
+            catalog.reorder_level[slot] = entry.level;
+            lowStockUpdate(slot);
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    
+    for (int i = 0; levels != NULL && i < catalog.count; i++) {
+        if (levels[i] != catalog.reorder_level[i]) {
+            catalog.reorder_level[i] = levels[i];
+            lowStockUpdate(i);
+        }
+    }
+    free(levels);
+}
+
+// Rewrite the reorder file with every level that differs from the default
+// and swap it in. The store program keeps its levels there too, so callers
+// hold the layout lock exclusively and have just caught up with the file.
+int saveReorderLevels() {
+    FILE* file = fopen(REORDER_LEVEL_FILE ".tmp", "wb");
+    if (file == NULL) {
+        printf("Error saving reorder levels!\n");
+        return 0;
+    }
+    
+    for (int i = 0; i < catalog.count; i++) {
+        if (catalog.reorder_level[i] != LOW_STOCK_THRESHOLD) {
+            ReorderLevel entry = { catalog.slots[i]->id, catalog.reorder_level[i] };
+            fwrite(&entry, sizeof(entry), 1, file);
+        }
+    }
+    
+    if (fclose(file) != 0 || rename(REORDER_LEVEL_FILE ".tmp", REORDER_LEVEL_FILE) != 0) {
+        printf("Error saving reorder levels!\n");
+        unlink(REORDER_LEVEL_FILE ".tmp");
+        return 0;
+    }
+    reorderFileChanged(1);
+    return 1;
+}
+
+// Days since 1970-01-01 for a calendar date, 0 if the date does not exist
+int dayNumber(int day, int month, int year) {
+    static const int month_days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (year < 1970 || year > 9999 || month < 1 || month > 12 || day < 1) {
+        return 0;
+    }
+    int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (day > month_days[month - 1] + (month == 2 && leap)) {
+        return 0;
+    }
+    
+    // Count from March so the leap day falls at the end of the year
+    year -= month <= 2;
+    int era = year / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Day number of a DD/MM/YYYY (or DD-MM-YYYY) date, 0 if it does not parse
+int expiryDayNumber(const char* text) {
+    int day, month, year;
+    char rest;
+    if (sscanf(text, "%d/%d/%d %c", &day, &month, &year, &rest) != 3 &&
+        sscanf(text, "%d-%d-%d %c", &day, &month, &year, &rest) != 3) {
+        return 0;
+    }
+    return dayNumber(day, month, year);
+}
+
+int todayDayNumber() {
+    time_t now = time(NULL);
+    struct tm* tm_info = localtime(&now);
+    return dayNumber(tm_info->tm_mday, tm_info->tm_mon + 1, tm_info->tm_year + 1900);
+}
+
+// Rewrite a date typed by the user in the stored DD/MM/YYYY form.
+// Returns 0 if it is not a real date.
+int normalizeExpiryDate(const char* input, char* output, size_t output_size) {
+    int day, month, year;
+    char rest;
+    if (sscanf(input, "%d/%d/%d %c", &day, &month, &year, &rest) != 3 &&
+        sscanf(input, "%d-%d-%d %c", &day, &month, &year, &rest) != 3) {
+        return 0;
+    }
+    if (dayNumber(day, month, year) == 0) {
+        return 0;
+    }
+    snprintf(output, output_size, "%02d/%02d/%04d", day, month, year);
+    return 1;
+}
+
+// Expired means the expiry day is already past; records without a valid
+// date are never treated as expired
+int slotExpired(int slot, int today) {
+    int day = catalog.column_expiry[slot];
+    return day != 0 && day < today;
+}
+
+// Position of the first expiry index entry not ordered before (day, id)
+int expiryLowerBound(int day, int id) {
+    int low = 0, high = expiryIndex.count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        ExpiryEntry* entry = &expiryIndex.entries[mid];
+        if (entry->day < day || (entry->day == day && entry->medicine->id < id)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void expiryIndexInsert(Medicine* med) {
+    int day = expiryDayNumber(med->expiry_date);
+    if (day == 0) {
+        return;
+    }
+    
+    if (expiryIndex.count == expiryIndex.capacity) {
+        int capacity = expiryIndex.capacity ? expiryIndex.capacity * 2 : MEDICINE_POOL_BLOCK;
+        ExpiryEntry* entries = (ExpiryEntry*)realloc(expiryIndex.entries, sizeof(ExpiryEntry) * capacity);
+        if (entries == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        expiryIndex.entries = entries;
+        expiryIndex.capacity = capacity;
+    }
+    
+    int position = expiryLowerBound(day, med->id);
+    memmove(&expiryIndex.entries[position + 1], &expiryIndex.entries[position],
+            sizeof(ExpiryEntry) * (expiryIndex.count - position));
+    expiryIndex.entries[position].day = day;
+    expiryIndex.entries[position].medicine = med;
+    expiryIndex.count++;
+}
+
+// The medicine must still hold the expiry date it was indexed under
+void expiryIndexRemove(Medicine* med) {
+    int day = expiryDayNumber(med->expiry_date);
+    int position = expiryLowerBound(day, med->id);
+    if (day == 0 || position == expiryIndex.count || expiryIndex.entries[position].medicine != med) {
+        return;
+    }
+    memmove(&expiryIndex.entries[position], &expiryIndex.entries[position + 1],
+            sizeof(ExpiryEntry) * (expiryIndex.count - position - 1));
+    expiryIndex.count--;
+}
+
+int compareExpiryEntries(const void* a, const void* b) {
+    const ExpiryEntry* x = (const ExpiryEntry*)a;
+    const ExpiryEntry* y = (const ExpiryEntry*)b;
+    if (x->day != y->day) {
+        return (x->day > y->day) - (x->day < y->day);
+    }
+    return (x->medicine->id > y->medicine->id) - (x->medicine->id < y->medicine->id);
+}
+
+// Built from the expiry column filled in by loadMedicines
+void expiryIndexBuild() {
+    free(expiryIndex.entries);
+    expiryIndex.capacity = catalog.count > MEDICINE_POOL_BLOCK ? catalog.count : MEDICINE_POOL_BLOCK;
+    expiryIndex.entries = (ExpiryEntry*)malloc(sizeof(ExpiryEntry) * expiryIndex.capacity);
+    if (expiryIndex.entries == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    
+    expiryIndex.count = 0;
+    for (int i = 0; i < catalog.count; i++) {
+        if (catalog.column_expiry[i] != 0) {
+            expiryIndex.entries[expiryIndex.count].day = catalog.column_expiry[i];
+            expiryIndex.entries[expiryIndex.count].medicine = catalog.slots[i];
+            expiryIndex.count++;
+        }
+    }
+    qsort(expiryIndex.entries, expiryIndex.count, sizeof(ExpiryEntry), compareExpiryEntries);
+}
+
+// The column reports below use independent accumulators and branch-free
+// bodies so the compiler can vectorize them
+
+// Sum of price * quantity over the catalog; units gets the total quantity
+double columnsInventoryValue(long long* units) {
+    double value[COLUMN_LANES] = { 0 };
+    long long quantity[COLUMN_LANES] = { 0 };
+    const float* price = catalog.column_price;
+    const int* stock = catalog.column_quantity;
+    int count = catalog.count;
+    int i = 0;
+    
+    for (; i + COLUMN_LANES <= count; i += COLUMN_LANES) {
+        for (int lane = 0; lane < COLUMN_LANES; lane++) {
+            value[lane] += (double)price[i + lane] * stock[i + lane];
+            quantity[lane] += stock[i + lane];
+        }
+    }
+    for (; i < count; i++) {
+        value[0] += (double)price[i] * stock[i];
+        quantity[0] += stock[i];
+    }
+    
+    double total = 0;
+    long long total_units = 0;
+    for (int lane = 0; lane < COLUMN_LANES; lane++) {
+        total += value[lane];
+        total_units += quantity[lane];
+    }
+    if (units != NULL) {
+        *units = total_units;
+    }
+    return total;
+}
+
+// Slots with quantity below threshold, in slot order. out needs room for
+// catalog.count entries.
+int columnsSelectBelow(int threshold, int out[]) {
+    const int* stock = catalog.column_quantity;
+    int count = catalog.count;
+    int found = 0;
+    
+    for (int i = 0; i < count; i++) {
+        out[found] = i;
+        found += stock[i] < threshold;
+    }
+    return found;
+}
+
+int nameOrder(const Medicine* a, const Medicine* b) {
+    int result = strncasecmp(a->name, b->name, sizeof(a->name));
+    if (result != 0) {
+        return result;
+    }
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+int compareMedicineNames(const void* a, const void* b) {
+    return nameOrder(*(Medicine* const*)a, *(Medicine* const*)b);
+}
+
+// Position of the first name index entry not ordered before med
+int nameLowerBound(const Medicine* med) {
+    int low = 0, high = nameIndex.count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (nameOrder(nameIndex.entries[mid], med) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void nameIndexInsert(Medicine* med) {
+    if (nameIndex.count == nameIndex.capacity) {
+        int capacity = nameIndex.capacity ? nameIndex.capacity * 2 : MEDICINE_POOL_BLOCK;
+        Medicine** entries = (Medicine**)realloc(nameIndex.entries, sizeof(Medicine*) * capacity);
+        if (entries == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        nameIndex.entries = entries;
+        nameIndex.capacity = capacity;
+    }
+    
+    int position = nameLowerBound(med);
+    memmove(&nameIndex.entries[position + 1], &nameIndex.entries[position],
+            sizeof(Medicine*) * (nameIndex.count - position));
+    nameIndex.entries[position] = med;
+    nameIndex.count++;
+}
+
+// The medicine must still hold the name it was indexed under
+void nameIndexRemove(Medicine* med) {
+    int position = nameLowerBound(med);
+    if (position == nameIndex.count || nameIndex.entries[position] != med) {
+        return;
+    }
+    memmove(&nameIndex.entries[position], &nameIndex.entries[position + 1],
+            sizeof(Medicine*) * (nameIndex.count - position - 1));
+    nameIndex.count--;
+}
+
+void nameIndexBuild() {
+    free(nameIndex.entries);
+    nameIndex.capacity = catalog.count > MEDICINE_POOL_BLOCK ? catalog.count : MEDICINE_POOL_BLOCK;
+    nameIndex.entries = (Medicine**)malloc(sizeof(Medicine*) * nameIndex.capacity);
+    if (nameIndex.entries == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    
+    nameIndex.count = catalog.count;
+    if (catalog.count) {
+        memcpy(nameIndex.entries, catalog.slots, sizeof(Medicine*) * catalog.count);
+    }
+    qsort(nameIndex.entries, nameIndex.count, sizeof(Medicine*), compareMedicineNames);
+}
+
+// Top k medicines whose name starts with the prefix (case-insensitive),
+// most stock first. Returns how many were found.
+int prefixTopMatches(const char* prefix, int k, Medicine* out[]) {
+    size_t prefix_length = strlen(prefix);
+    int low = 0, high = nameIndex.count;
+    int found = 0;
+    
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (strncasecmp(nameIndex.entries[mid]->name, prefix, prefix_length) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    
+    for (int i = low; i < nameIndex.count; i++) {
+        Medicine* med = nameIndex.entries[i];
+        if (strncasecmp(med->name, prefix, prefix_length) != 0) {
+            break;
+        }
+        
+        // Insertion into the short ranked list
+        int position = found < k ? found++ : k;
+        while (position > 0 && out[position - 1]->quantity < med->quantity) {
+            if (position < k) {
+                out[position] = out[position - 1];
+            }
+            position--;
+        }
+        if (position < k) {
+            out[position] = med;
+        }
+    }
+    return found;
+}
+
+// Byte offset of a slot's record in the medicine file; dataOffset(count)
+// is the file's length
+long long dataOffset(int slot) {
+    return DATA_HEADER + (long long)slot * DATA_RECORD;
+}
+
+// Pack a medicine into its file record, every unused byte zero. The expiry
+// is kept as numbers; text that is not a date becomes no date.
+void medicineToRecord(MedicineRecord* record, const Medicine* med) {
+    int day, month, year;
+    memset(record, 0, sizeof(*record));
+    record->id = med->id;
+    record->quantity = med->quantity;
+    record->price = med->price;
+    if (sscanf(med->expiry_date, "%d/%d/%d", &day, &month, &year) == 3 ||
+        sscanf(med->expiry_date, "%d-%d-%d", &day, &month, &year) == 3) {
+        record->expiry_day = day;
+        record->expiry_month = month;
+        record->expiry_year = year;
+    }
+    memcpy(record->name, med->name, strnlen(med->name, sizeof(med->name)));
+    memcpy(record->category, med->category, strnlen(med->category, sizeof(med->category)));
+}
+
+void medicineFromRecord(Medicine* med, const MedicineRecord* record) {
+    memset(med, 0, sizeof(*med));
+    med->id = record->id;
+    med->quantity = record->quantity;
+    med->price = (float)record->price;
+    if (record->expiry_day != 0 || record->expiry_month != 0 || record->expiry_year != 0) {
+        snprintf(med->expiry_date, sizeof(med->expiry_date), "%02d/%02d/%04d",
+                 record->expiry_day, record->expiry_month, record->expiry_year);
+    }
+    memcpy(med->name, record->name, strnlen(record->name, sizeof(med->name) - 1));
+    memcpy(med->category, record->category, strnlen(record->category, sizeof(med->category) - 1));
+}
+
+// Check the medicine file's header, writing one into a new file (or over
+// one a crash tore while it was written). Returns 0 for a file in a legacy
+// layout or of another format version, which must be left alone.
+int dataFileCheck(int fd) {
+    DataHeader fresh, header;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.magic = DATA_MAGIC;
+    fresh.version = DATA_VERSION;
+    fresh.header_size = DATA_HEADER;
+    fresh.record_size = DATA_RECORD;
+    if (!layoutLock(fd, F_WRLCK, 1)) {
+        printf("Error locking %s!\n", MEDICINE_FILE);
+        return 0;
+    }
+    
+    struct stat info;
+    ssize_t got = fstat(fd, &info) == 0 ? pread(fd, &header, sizeof(header), 0) : -1;
+    int ok = 1;
+    if (got < 0) {
+        printf("Error reading %s!\n", MEDICINE_FILE);
+        ok = 0;
+    } else if (got < (ssize_t)sizeof(header) && got == info.st_size && memcmp(&header, &fresh, (size_t)got) == 0) {
+        ok = pwriteAll(fd, (const char*)&fresh, sizeof(fresh), 0) && fdatasync(fd) == 0;
+        if (!ok) {
+            printf("Error writing the header of %s!\n", MEDICINE_FILE);
+        }
+    } else if (got < (ssize_t)sizeof(header) || header.magic != DATA_MAGIC) {
+        printf("%s is in an older layout; convert it with --migrate-data\n", MEDICINE_FILE);
+        ok = 0;
+    } else if (header.version != DATA_VERSION || header.header_size != DATA_HEADER ||
+               header.record_size != DATA_RECORD) {
+        printf("%s is format version %u; this program reads version %d\n",
+               MEDICINE_FILE, header.version, DATA_VERSION);
+        ok = 0;
+    }
+    layoutLock(fd, F_UNLCK, 1);
+    return ok;
+}
+
+void loadMedicines() {
+    memset(&catalog, 0, sizeof(catalog));
+    pthread_mutex_init(&catalog.lock, NULL);
+    
+    // Created up front: the lock bytes of other terminals live on this file
+    int fd = open(MEDICINE_FILE, O_RDWR | O_CREAT, 0644);
+    catalog.file = fd >= 0 ? fdopen(fd, "rb+") : NULL;
+    if (catalog.file == NULL) {
+        printf("Error opening %s!\n", MEDICINE_FILE);
+    } else if (!dataFileCheck(fd)) {
+        exit(1);
+    } else {
+        // Finish a commit a terminal died in the middle of before reading,
+        // and read with none under way, so the records are those of the
+        // generation read with them
+        layoutLock(fd, F_RDLCK, 1);
+        int locked = shadowOpen() && shadowLock(1);
+        if (locked) {
+            ShadowHeader header;
+            shadowRecover(&header);
+        }
+        catalogReadRecords();
+        if (locked) {
+            shadowUnlock();
+        }
+        layoutLock(fd, F_UNLCK, 1);
+        catalogCloseFreeSlots(fd);
+    }
+    
+    catalogBuildIndexes();
+}
+
+// Close up the slots the store program (first.c) leaves free when it
+// deletes (ID 0): the last records move into them and the file is saved
+// once, read again under the layout lock held exclusively. Only at load,
+// before the indexes are built.
+void catalogCloseFreeSlots(int fd) {
+    int free_slots = 0;
+    for (int i = 0; i < catalog.count; i++) {
+        free_slots += catalog.slots[i]->id == 0;
+    }
+    if (free_slots == 0 || !layoutLock(fd, F_WRLCK, 1)) {
+        return;
+    }
+    
+    for (int i = 0; i < catalog.count; i++) {
+        poolFreeMedicine(catalog.slots[i]);
+    }
+    catalog.count = 0;
+    catalog.max_id = 0;
+    catalogReadRecords();
+    catalogCompactFreeSlots();
+    layoutLock(fd, F_UNLCK, 1);
+}
+
+// Move the last records into the free slots (ID 0) just read and save the
+// moves, so no free slot ever reaches the indexes or a listing. Callers
+// hold the layout lock exclusively.
+void catalogCompactFreeSlots() {
+    int moved = 0;
+    for (int slot = 0; slot < catalog.count; slot++) {
+        while (slot < catalog.count && catalog.slots[slot]->id == 0) {
+            poolFreeMedicine(catalog.slots[slot]);
+            catalog.slots[slot] = catalog.slots[--catalog.count];
+            moved = 1;
+            if (slot < catalog.count && !catalog.dirty[slot]) {
+                catalog.dirty[slot] = 1;
+                catalog.dirty_slots[catalog.dirty_count++] = slot;
+            }
+        }
+    }
+    
+    // The moved records are only right on file once saved
+    if (moved && !saveMedicines()) {
+        exit(1);
+    }
+}
+
+// Read every record of the medicine file into empty slots: one mapping of
+// the whole file, records unpacked from it in place into the pool. The
+// file's generation is taken with them.
+void catalogReadRecords() {
+    struct stat info;
+    DataHeader header;
+    if (pread(fileno(catalog.file), &header, sizeof(header), 0) == (ssize_t)sizeof(header)) {
+        catalog.generation = header.generation;
+    }
+    if (fstat(fileno(catalog.file), &info) != 0 || info.st_size <= DATA_HEADER) {
+        catalog.file_count = catalog.count;
+        return;
+    }
+    const unsigned char* map = (const unsigned char*)mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED,
+                                                           fileno(catalog.file), 0);
+    if (map == MAP_FAILED) {
+        printf("Error reading %s!\n", MEDICINE_FILE);
+        catalog.file_count = catalog.count;
+        return;
+    }
+    int records = (int)((info.st_size - DATA_HEADER) / DATA_RECORD);
+    const MedicineRecord* on_file = (const MedicineRecord*)(map + DATA_HEADER);
+    
+    catalogReserve(records);
+    for (int i = 0; i < records; i++) {
+        Medicine* med = poolAllocMedicine();
+        medicineFromRecord(med, &on_file[i]);
+        catalog.slots[catalog.count++] = med;
+        if (med->id > catalog.max_id) {
+            catalog.max_id = med->id;
+        }
+    }
+    munmap((void*)map, (size_t)info.st_size);
+    catalog.file_count = catalog.count;
+}
+
+// Start over from the medicine file, when other terminals changed too much
+// of it to catch up record by record. Category codes are kept. Callers hold
+// the layout lock exclusively, since slots the store program freed are
+// closed up.
+void catalogReload() {
+    for (int i = 0; i < catalog.count; i++) {
+        poolFreeMedicine(catalog.slots[i]);
+    }
+    for (int i = 0; i < catalog.dirty_count; i++) {
+        catalog.dirty[catalog.dirty_slots[i]] = 0;
+    }
+    catalog.dirty_count = 0;
+    catalog.count = 0;
+    catalog.max_id = 0;
+    for (int c = 0; c < categories.count; c++) {
+        categories.entries[c].count = 0;
+    }
+    
+    catalogReadRecords();
+    catalogCompactFreeSlots();
+    catalogBuildIndexes();
+}
+
+// Does a slot need reading again: committed since the generation the
+// catalog was brought up to, or not saved from here
+int catalogSlotStale(int slot, const MedicineRecord* record) {
+    return slot >= catalog.file_count || catalog.dirty[slot] ||
+           (int32_t)(record->generation - catalog.generation) > 0;
+}
+
+// Catch up with the medicine file after other terminals committed to it.
+// Nothing is read if the header's generation is the one the catalog was
+// brought up to; otherwise only the records committed since, those not
+// saved from here and those past either end are, and each goes into the
+// indexes on its own. Slots the store program freed are closed up and
+// saved. Callers hold the layout lock exclusively. Returns 0 if the file
+// could not be read or the closed slots saved.
+int catalogRefresh() {
+    int fd = fileno(catalog.file);
+    DataHeader header;
+    struct stat info;
+    int ok = shadowLock(1);
+    if (ok) {
+        ShadowHeader published;
+        ok = shadowRecover(&published) && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+             fstat(fd, &info) == 0;
+        shadowUnlock();
+    }
+    if (!ok) {
+        printf("Error reading %s!\n", MEDICINE_FILE);
+        return 0;
+    }
+    
+    int records = info.st_size > DATA_HEADER ? (int)((info.st_size - DATA_HEADER) / DATA_RECORD) : 0;
+    if (header.generation == catalog.generation && catalog.dirty_count == 0 &&
+        records == catalog.count && catalog.file_count == catalog.count) {
+        if (reorderFileChanged(0)) {
+            refreshReorderLevels();
+        }
+        return 1;
+    }
+    
+    const unsigned char* map = NULL;
+    if (records > 0) {
+        map = (const unsigned char*)mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            printf("Error reading %s!\n", MEDICINE_FILE);
+            return 0;
+        }
+    }
+    const MedicineRecord* on_file = map != NULL ? (const MedicineRecord*)(map + DATA_HEADER) : NULL;
+    int kept = records < catalog.count ? records : catalog.count;
+    int changed = records > catalog.count ? records - catalog.count : catalog.count - records;
+    int stale[REFRESH_MAX_RECORDS];
+    int stale_count = 0;
+    for (int i = 0; i < kept && changed + stale_count <= REFRESH_MAX_RECORDS; i++) {
+        if (catalogSlotStale(i, &on_file[i])) {
+            if (stale_count < REFRESH_MAX_RECORDS) {
+                stale[stale_count] = i;
+            }
+            stale_count++;
+        }
+    }
+    if (changed + stale_count > REFRESH_MAX_RECORDS) {
+        if (map != NULL) {
+            munmap((void*)map, (size_t)info.st_size);
+        }
+        catalogReload();
+        return 1;
+    }
+    
+    // Out of the indexes first: records that now hold another medicine and
+    // those past the file's end, so an ID that moved is never in them twice
+    for (int k = 0; k < stale_count; k++) {
+        int i = stale[k];
+        if (on_file[i].id != catalog.slots[i]->id) {
+            catalogUnindex(i);
+        }
+    }
+    for (int i = kept; i < catalog.count; i++) {
+        catalogUnindex(i);
+        poolFreeMedicine(catalog.slots[i]);
+    }
+    catalog.count = kept;
+    catalogReserve(records);
+    indexReserve(records);
+    loadCategories();
+    
+    for (int k = 0; k < stale_count; k++) {
+        int i = stale[k];
+        if (on_file[i].id != catalog.slots[i]->id) {
+            medicineFromRecord(catalog.slots[i], &on_file[i]);
+            if (catalog.slots[i]->id != 0) {
+                catalogIndexSlot(i);
+            }
+        } else {
+            Medicine fresh;
+            medicineFromRecord(&fresh, &on_file[i]);
+            catalogAdopt(i, &fresh);
+        }
+    }
+    for (int i = kept; i < records; i++) {
+        Medicine* med = poolAllocMedicine();
+        medicineFromRecord(med, &on_file[i]);
+        catalog.slots[i] = med;
+        catalog.low_stock_position[i] = -1;
+        catalog.count = i + 1;
+        if (med->id != 0) {
+            catalogIndexSlot(i);
+        }
+    }
+    if (map != NULL) {
+        munmap((void*)map, (size_t)info.st_size);
+    }
+    
+    for (int i = 0; i < catalog.dirty_count; i++) {
+        catalog.dirty[catalog.dirty_slots[i]] = 0;
+    }
+    catalog.dirty_count = 0;
+    catalog.file_count = records;
+    catalog.generation = header.generation;
+    
+    // The last live record moves into each free slot (ID 0)
+    int moved = 0;
+    for (int slot = 0; slot < catalog.count; slot++) {
+        if (catalog.slots[slot]->id != 0) {
+            continue;
+        }
+        while (catalog.count - 1 > slot && catalog.slots[catalog.count - 1]->id == 0) {
+            poolFreeMedicine(catalog.slots[--catalog.count]);
+        }
+        catalogCloseSlot(slot);
+        moved = 1;
+    }
+    refreshReorderLevels();
+    return !moved || saveMedicines();
+}
+
+// Could this be a record of a legacy layout? All-zero records are deleted
+// slots of the other program. Used to tell the two layouts apart.
+int legacyStorePlausible(const LegacyStoreMedicine* med) {
+    static const LegacyStoreMedicine zero;
+    if (med->id == 0) {
+        return memcmp(med, &zero, sizeof(zero)) == 0;
+    }
+    return med->id > 0 && med->quantity >= 0 && med->price >= 0 && med->price < 1e9 &&
+           med->expiry_month >= 0 && med->expiry_month <= 12 &&
+           memchr(med->name, '\0', sizeof(med->name)) != NULL;
+}
+
+int legacyCatalogPlausible(const LegacyCatalogMedicine* med) {
+    return med->id > 0 && med->quantity >= 0 && med->price >= 0 && med->price < 1e9f &&
+           memchr(med->name, '\0', sizeof(med->name)) != NULL &&
+           memchr(med->category, '\0', sizeof(med->category)) != NULL &&
+           memchr(med->expiry_date, '\0', sizeof(med->expiry_date)) != NULL;
+}
+
+// The legacy layout size bytes of the medicine file are in: 1 the store
+// program's, 2 this program's, 0 when neither or both fit
+int legacyLayout(const unsigned char* data, size_t size) {
+    int store = size % sizeof(LegacyStoreMedicine) == 0;
+    int catalog_layout = size % sizeof(LegacyCatalogMedicine) == 0;
+    for (size_t i = 0; store && i < size / sizeof(LegacyStoreMedicine); i++) {
+        store = legacyStorePlausible((const LegacyStoreMedicine*)data + i);
+    }
+    for (size_t i = 0; catalog_layout && i < size / sizeof(LegacyCatalogMedicine); i++) {
+        catalog_layout = legacyCatalogPlausible((const LegacyCatalogMedicine*)data + i);
+    }
+    if (store == catalog_layout) {
+        return 0;
+    }
+    return store ? 1 : 2;
+}
+
+void legacyStoreToRecord(MedicineRecord* record, const LegacyStoreMedicine* med) {
+    memset(record, 0, sizeof(*record));
+    record->id = med->id;
+    record->quantity = med->quantity;
+    record->price = med->price;
+    record->expiry_day = med->expiry_day;
+    record->expiry_month = med->expiry_month;
+    record->expiry_year = med->expiry_year;
+    memcpy(record->name, med->name, strnlen(med->name, sizeof(med->name)));
+}
+
+void legacyCatalogToRecord(MedicineRecord* record, const LegacyCatalogMedicine* med) {
+    // Copied whole so medicineToRecord sees terminated strings
+    Medicine copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.id = med->id;
+    copy.price = med->price;
+    copy.quantity = med->quantity;
+    memcpy(copy.name, med->name, strnlen(med->name, sizeof(copy.name) - 1));
+    memcpy(copy.category, med->category, strnlen(med->category, sizeof(copy.category) - 1));
+    memcpy(copy.expiry_date, med->expiry_date, strnlen(med->expiry_date, sizeof(copy.expiry_date) - 1));
+    medicineToRecord(record, &copy);
+}
+
+// --migrate-data [store|catalog]: convert the medicine file from a layout
+// it had before the header, this program's or the store program's, to the
+// current format. The layout is worked out from the records unless given.
+// A commit left unfinished is finished first; the converted file replaces
+// the old one in a single rename. Run it with the store closed.
+int migrateDataFile(int argc, char* argv[]) {
+    int layout = 0;
+    if (argc > 0) {
+        layout = strcmp(argv[0], "store") == 0 ? 1 : strcmp(argv[0], "catalog") == 0 ? 2 : -1;
+    }
+    if (layout < 0) {
+        printf("Usage: --migrate-data [store|catalog]\n");
+        return 1;
+    }
+    
+    int fd = open(MEDICINE_FILE, O_RDWR);
+    catalog.file = fd >= 0 ? fdopen(fd, "rb+") : NULL;
+    if (catalog.file == NULL) {
+        printf("Error opening %s!\n", MEDICINE_FILE);
+        return 1;
+    }
+    if (!shadowOpen() || !layoutLock(fd, F_WRLCK, 1) || !shadowLock(1)) {
+        printf("Error locking %s!\n", MEDICINE_FILE);
+        fclose(catalog.file);
+        catalog.file = NULL;
+        return 1;
+    }
+    ShadowHeader published;
+    int ok = shadowRecover(&published);
+    
+    struct stat info;
+    unsigned char* data = NULL;
+    size_t size = 0;
+    ok = ok && fstat(fd, &info) == 0;
+    if (ok && (size = (size_t)info.st_size) > 0) {
+        data = (unsigned char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            printf("Error reading %s!\n", MEDICINE_FILE);
+            data = NULL;
+            ok = 0;
+        }
+    }
+    
+    int done = 0;
+    if (ok && size == 0) {
+        printf("%s is empty; it gets a header when the store is opened.\n", MEDICINE_FILE);
+        done = 1;
+    } else if (ok && size >= sizeof(uint32_t) && *(const uint32_t*)data == DATA_MAGIC) {
+        printf("%s is already in format version %u.\n", MEDICINE_FILE, ((const DataHeader*)data)->version);
+        done = 1;
+    } else if (ok && layout == 0 && (layout = legacyLayout(data, size)) == 0) {
+        printf("Cannot tell the layout of %s; name it: --migrate-data store|catalog\n", MEDICINE_FILE);
+        ok = 0;
+    }
+    
+    int count = 0;
+    if (ok && !done) {
+        size_t record_size = layout == 1 ? sizeof(LegacyStoreMedicine) : sizeof(LegacyCatalogMedicine);
+        count = (int)(size / record_size);
+        MedicineRecord* converted = (MedicineRecord*)calloc((size_t)count + 1, DATA_RECORD);
+        if (converted == NULL) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        DataHeader* header = (DataHeader*)converted;
+        header->magic = DATA_MAGIC;
+        header->version = DATA_VERSION;
+        header->header_size = DATA_HEADER;
+        header->record_size = DATA_RECORD;
+        for (int i = 0; i < count; i++) {
+            const unsigned char* old = data + (size_t)i * record_size;
+            if (layout == 1) {
+                legacyStoreToRecord(&converted[i + 1], (const LegacyStoreMedicine*)old);
+            } else {
+                legacyCatalogToRecord(&converted[i + 1], (const LegacyCatalogMedicine*)old);
+            }
+        }
+        
+        int out = open(MEDICINE_FILE ".migrating", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok = out >= 0 && writeAll(out, (const char*)converted, (size_t)dataOffset(count)) && fsync(out) == 0;
+        if (out >= 0 && close(out) != 0) {
+            ok = 0;
+        }
+        ok = ok && rename(MEDICINE_FILE ".migrating", MEDICINE_FILE) == 0;
+        if (!ok) {
+            printf("Error writing the converted %s!\n", MEDICINE_FILE);
+            unlink(MEDICINE_FILE ".migrating");
+        }
+        free(converted);
+    }
+    
+    if (data != NULL) {
+        munmap(data, size);
+    }
+    shadowUnlock();
+    fclose(catalog.file);
+    catalog.file = NULL;
+    if (ok && !done) {
+        printf("Converted %d records of %s from the %s layout to format version %d.\n",
+               count, MEDICINE_FILE, layout == 1 ? "store" : "catalog", DATA_VERSION);
+    }
+    return ok ? 0 : 1;
+}
+
+// Build the ID, category, name and expiry indexes and the columns over
+// every slot in one pass each, rather than one insert at a time
+void catalogBuildIndexes() {
+    indexRebuild(catalog.count);
+    loadReorderLevels();
+    loadCategories();
+    for (int i = 0; i < catalog.count; i++) {
+        catalogSyncColumns(i);
+        catalog.column_category[i] = categoryIntern(catalog.slots[i]->category);
+        categoryPostingAppend(catalog.column_category[i], catalog.slots[i]->id);
+    }
+    for (int c = 0; c < categories.count; c++) {
+        qsort(categories.entries[c].ids, categories.entries[c].count, sizeof(int), compareIds);
+    }
+    
+    nameIndexBuild();
+    expiryIndexBuild();
+    stockSweep();
+}
+
+int fileLock(int fd, int type, off_t start, off_t length, int wait) {
+    if (!recordLocking) {
+        return 1;
+    }
+    
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = (short)type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = start;
+    lock.l_len = length;
+    while (fcntl(fd, wait ? LOCK_WAIT : LOCK_TRY, &lock) != 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int layoutLock(int fd, int type, int wait) {
+    return fileLock(fd, type, CATALOG_LAYOUT_LOCK, 1, wait);
+}
+
+// The files a commit publishes the length of; transaction stream i is
+// shadowFiles[SHADOW_SALES + i]
+const char* shadowFiles[SHADOW_FILES] = {
+    MEDICINE_FILE, "sales_history.txt", TRANSACTION_BIN_FILE, TRANSACTION_TEXT_FILE, TRANSACTION_INDEX_FILE
+};
+
+// Open the shadow file (once per process); the commit lock lives on it
+int shadowOpen() {
+    if (shadow.fd < 0) {
+        shadow.fd = open(SHADOW_FILE, O_RDWR | O_CREAT, 0644);
+        if (shadow.fd < 0) {
+            printf("Error opening %s!\n", SHADOW_FILE);
+        }
+    }
+    return shadow.fd >= 0;
+}
+
+// One write of a commit (at -1 = append). Under --crash-test the process
+// dies at its fault point with half the bytes written, as a kill can
+// leave them.
+int faultWrite(int point, int fd, const void* data, size_t length, off_t at) {
+    if (faultPoint == point) {
+        if (at < 0) {
+            writeAll(fd, (const char*)data, length / 2);
+        } else {
+            pwriteAll(fd, (const char*)data, length / 2, at);
+        }
+        _exit(FAULT_EXIT);
+    }
+    return at < 0 ? writeAll(fd, (const char*)data, length) : pwriteAll(fd, (const char*)data, length, at);
+}
+
+void faultCheck(int point) {
+    if (faultPoint == point) {
+        _exit(FAULT_EXIT);
+    }
+}
+
+unsigned int shadowChecksum(const ShadowHeader* header) {
+    ShadowHeader copy = *header;
+    copy.checksum = 0;
+    
+    // FNV-1a
+    const unsigned char* bytes = (const unsigned char*)&copy;
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(copy); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// The last commit published in the shadow file (seq 0 if there is none)
+// and the seq of the last one written back to the medicine file
+void shadowNewest(ShadowHeader* header, long long* applied) {
+    char buffer[SHADOW_APPLIED + sizeof(long long)];
+    ssize_t got = shadow.fd >= 0 ? pread(shadow.fd, buffer, sizeof(buffer), 0) : -1;
+    
+    // With no commit yet there is nothing to cut the files back to
+    memset(header, 0, sizeof(*header));
+    for (int i = 0; i < SHADOW_FILES; i++) {
+        header->size[i] = -1;
+    }
+    *applied = 0;
+    for (int i = 0; i < 2 && got >= (ssize_t)(i * SHADOW_SLOT + sizeof(ShadowHeader)); i++) {
+        ShadowHeader slot;
+        memcpy(&slot, buffer + i * SHADOW_SLOT, sizeof(slot));
+        if (slot.magic == SHADOW_MAGIC && slot.checksum == shadowChecksum(&slot) && slot.seq > header->seq) {
+            *header = slot;
+        }
+    }
+    if (got == (ssize_t)sizeof(buffer)) {
+        memcpy(applied, buffer + SHADOW_APPLIED, sizeof(*applied));
+    }
+}
+
+// Take the commit lock: this terminal's threads first, then the other
+// terminals; with wait 0 give up if anyone holds it. Taken even when
+// record locking is off, since interleaved commits would leave the shadow
+// file unreadable.
+int shadowLock(int wait) {
+    if (!wait) {
+        if (pthread_mutex_trylock(&shadow.lock) != 0) {
+            return 0;
+        }
+    } else {
+        pthread_mutex_lock(&shadow.lock);
+    }
+    
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    int result = -1;
+    if (shadow.fd >= 0) {
+        while ((result = fcntl(shadow.fd, wait ? LOCK_WAIT : LOCK_TRY, &lock)) != 0 && errno == EINTR) {
+        }
+    }
+    if (result != 0) {
+        pthread_mutex_unlock(&shadow.lock);
+        return 0;
+    }
+    return 1;
+}
+
+void shadowUnlock() {
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_UNLCK;
+    lock.l_whence = SEEK_SET;
+    fcntl(shadow.fd, LOCK_WAIT, &lock);
+    pthread_mutex_unlock(&shadow.lock);
+}
+
+// Write a commit's pages back to the medicine file, sync it and note the
+// commit as written back. Doing this twice is harmless, so a commit whose
+// terminal died on the way is simply done again.
+int shadowApply(const ShadowHeader* header, const ShadowImage images[], int fd) {
+    for (int i = 0; i < header->pages; i++) {
+        if (!faultWrite(FAULT_APPLY, fd, images[i].data, SHADOW_PAGE, (off_t)images[i].page * SHADOW_PAGE)) {
+            return 0;
+        }
+    }
+    if (ftruncate(fd, (off_t)header->size[SHADOW_DATA]) != 0 || fdatasync(fd) != 0) {
+        return 0;
+    }
+    faultCheck(FAULT_APPLIED);
+    return pwriteAll(shadow.fd, (const char*)&header->seq, sizeof(header->seq), SHADOW_APPLIED);
+}
+
+// Finish the last commit if its terminal died before writing it back, and
+// cut each transaction file and the store program's sales history back to
+// the length that commit published, which drops a batch torn by a crash
+// before its header. Callers hold the
+// commit lock. Returns 0 if the last commit could not be finished.
+int shadowRecover(ShadowHeader* header) {
+    long long applied;
+    shadowNewest(header, &applied);
+    
+    if (header->seq > 0 && applied != header->seq) {
+        // Without a catalog (--rebuild-rollups) the file is opened for this
+        int fd = catalog.file != NULL ? fileno(catalog.file) : open(MEDICINE_FILE, O_RDWR | O_CREAT, 0644);
+        size_t length = sizeof(ShadowImage) * header->pages;
+        ShadowImage* images = (ShadowImage*)malloc(length ? length : 1);
+        int ok = fd >= 0 && images != NULL &&
+                 pread(shadow.fd, images, length, (off_t)header->images) == (ssize_t)length &&
+                 shadowApply(header, images, fd);
+        free(images);
+        if (catalog.file == NULL && fd >= 0) {
+            close(fd);
+        }
+        if (!ok) {
+            printf("Error finishing the last commit to %s!\n", MEDICINE_FILE);
+            return 0;
+        }
+    }
+    
+    struct stat info;
+    for (int i = SHADOW_SALES; i < SHADOW_FILES; i++) {
+        if (header->size[i] >= 0 && stat(shadowFiles[i], &info) == 0 &&
+            info.st_size > (off_t)header->size[i] &&
+            truncate(shadowFiles[i], (off_t)header->size[i]) != 0) {
+            printf("Error trimming %s!\n", shadowFiles[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Finish a commit a dead terminal published but never wrote back, before
+// records are re-read from the medicine file. Costs one read when there is
+// none; a commit under way holds the lock and finishes it anyway.
+void shadowCatchUp() {
+    ShadowHeader header;
+    long long applied;
+    shadowNewest(&header, &applied);
+    if (header.seq == applied || !shadowLock(0)) {
+        return;
+    }
+    shadowRecover(&header);
+    shadowUnlock();
+}
+
+int compareRecordImages(const void* a, const void* b) {
+    int x = ((const RecordImage*)a)->slot;
+    int y = ((const RecordImage*)b)->slot;
+    return (x > y) - (x < y);
+}
+
+// The ID of the last sale on file, from the last transaction index entry.
+// Only meaningful under the commit lock, after shadowRecover has cut off
+// anything unpublished. Files from before IDs were handed out here may
+// hold a higher ID further back, which maxTransactionId still covers.
+int lastTransactionId() {
+    int last = maxTransactionId > 5000 ? maxTransactionId : 5000;
+    int fd = groupCommit.fd[GC_TRANSACTION_INDEX];
+    struct stat info;
+    TransactionIndexEntry entry;
+    if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(entry) &&
+        pread(fd, &entry, sizeof(entry), info.st_size - info.st_size % (off_t)sizeof(entry) - (off_t)sizeof(entry)) ==
+            (ssize_t)sizeof(entry) &&
+        entry.transaction_id > last) {
+        last = entry.transaction_id;
+    }
+    return last;
+}
+
+// Number a batch's sales after the last one on file, every terminal's
+// included, and write their frames, index entries and text to match. The
+// caller holds the commit lock. Returns 0 if out of memory.
+int batchNumber(CommitBatch* batch) {
+    int id = lastTransactionId();
+    int k = 0;
+    TransactionIndexEntry entry;
+    batch->length[GC_TRANSACTION_TEXT] = 0;
+    for (size_t at = 0; at + sizeof(entry) <= batch->length[GC_TRANSACTION_INDEX]; at += sizeof(entry)) {
+        Transaction* trans = batch->sales[k++];
+        trans->transaction_id = ++id;
+        
+        memcpy(&entry, batch->buffer[GC_TRANSACTION_INDEX] + at, sizeof(entry));
+        entry.transaction_id = id;
+        memcpy(batch->buffer[GC_TRANSACTION_INDEX] + at, &entry, sizeof(entry));
+        memcpy(batch->buffer[GC_TRANSACTION_BIN] + entry.offset + offsetof(TransactionHeader, transaction_id), &id,
+               sizeof(id));
+        
+        char* text = NULL;
+        size_t text_length = 0;
+        FILE* stream = open_memstream(&text, &text_length);
+        if (stream == NULL) {
+            return 0;
+        }
+        saveTransactionToText(stream, trans);
+        fclose(stream);
+        int ok = batchAppend(batch, GC_TRANSACTION_TEXT, text, text_length);
+        free(text);
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Commit changed records and a batch of checkouts (NULL for none) as one
+// shadow commit. The medicine file pages the records fall on, and the
+// header's with the generation bumped, are read,
+// patched and written to the shadow file clear of the last commit's, the
+// batch is appended to the transaction files, and once all of it is synced
+// one header write publishes it; then the pages are written back in place.
+// size is the medicine file's new length, -1 to keep it. Sorts records.
+// The caller holds the commit lock. Returns 1 once the header is on disk;
+// a failure before that cuts the transaction files back and leaves the
+// medicine file as it was.
+int shadowCommit(RecordImage records[], int count, long long size, CommitBatch* batch) {
+    int fd = catalog.file != NULL ? fileno(catalog.file) : open(MEDICINE_FILE, O_RDWR | O_CREAT, 0644);
+    ShadowHeader last, header;
+    ShadowImage* images = NULL;
+    off_t start[GC_STREAMS] = { -1, -1, -1, -1 };
+    struct stat info;
+    uint32_t generation = 0;
+    int pages = 0;
+    int ok = fd >= 0 && shadowRecover(&last) && fstat(fd, &info) == 0;
+    if (ok && size < 0) {
+        size = info.st_size;
+    }
+    
+    // The header's page, then the pages the records fall on, in file
+    // order, each read once
+    if (count > 0) {
+        qsort(records, count, sizeof(RecordImage), compareRecordImages);
+    }
+    long long capacity = (size + SHADOW_PAGE - 1) / SHADOW_PAGE;
+    if (capacity > 2LL * count + 1) {
+        capacity = 2LL * count + 1;
+    }
+    if (ok) {
+        images = (ShadowImage*)malloc(sizeof(ShadowImage) * (size_t)(capacity ? capacity : 1));
+        ok = images != NULL;
+    }
+    if (ok) {
+        // A new medicine file gets its header when the store is opened;
+        // until then there is no generation to bump
+        ssize_t got = pread(fd, images[0].data, SHADOW_PAGE, 0);
+        ok = got >= 0;
+        if (got >= (ssize_t)sizeof(DataHeader)) {
+            memset(images[0].data + got, 0, SHADOW_PAGE - (size_t)got);
+            images[pages++].page = 0;
+            memcpy(&generation, images[0].data + offsetof(DataHeader, generation), sizeof(generation));
+            generation++;
+            memcpy(images[0].data + offsetof(DataHeader, generation), &generation, sizeof(generation));
+        }
+    }
+    for (int i = 0; ok && i < count; i++) {
+        long long from = dataOffset(records[i].slot);
+        long long to = from + DATA_RECORD;
+        if (to > size) {
+            continue;
+        }
+        for (long long page = from / SHADOW_PAGE; ok && page <= (to - 1) / SHADOW_PAGE; page++) {
+            if (pages > 0 && images[pages - 1].page == page) {
+                continue;
+            }
+            ssize_t got = pread(fd, images[pages].data, SHADOW_PAGE, (off_t)page * SHADOW_PAGE);
+            if (got < 0) {
+                ok = 0;
+                break;
+            }
+            memset(images[pages].data + got, 0, SHADOW_PAGE - (size_t)got);
+            images[pages++].page = page;
+        }
+        MedicineRecord packed;
+        medicineToRecord(&packed, &records[i].record);
+        packed.generation = generation;
+        const unsigned char* source = (const unsigned char*)&packed;
+        for (int k = pages - 1; ok && k >= 0 && images[k].page >= from / SHADOW_PAGE; k--) {
+            long long base = images[k].page * SHADOW_PAGE;
+            long long a = from > base ? from : base;
+            long long b = to < base + SHADOW_PAGE ? to : base + SHADOW_PAGE;
+            memcpy(images[k].data + (a - base), source + (a - from), (size_t)(b - a));
+        }
+    }
+    
+    memset(&header, 0, sizeof(header));
+    header.magic = SHADOW_MAGIC;
+    header.seq = last.seq + 1;
+    header.size[SHADOW_DATA] = size;
+    header.pages = pages;
+    for (int i = SHADOW_SALES; i < SHADOW_FILES; i++) {
+        header.size[i] = stat(shadowFiles[i], &info) == 0 ? (long long)info.st_size : 0;
+    }
+    ok = ok && (batch == NULL || batchNumber(batch));
+    for (int i = GC_RECORDS + 1; ok && i < GC_STREAMS; i++) {
+        if (batch == NULL || batch->length[i] == 0) {
+            continue;
+        }
+        start[i] = lseek(groupCommit.fd[i], 0, SEEK_END);
+        if (i == GC_TRANSACTION_INDEX) {
+            // Index entries were queued with offsets relative to the batch;
+            // the frames start where the transaction file ended
+            TransactionIndexEntry entry;
+            for (size_t at = 0; at + sizeof(entry) <= batch->length[i]; at += sizeof(entry)) {
+                memcpy(&entry, batch->buffer[i] + at, sizeof(entry));
+                entry.offset += (long long)start[GC_TRANSACTION_BIN];
+                memcpy(batch->buffer[i] + at, &entry, sizeof(entry));
+            }
+        }
+        ok = start[i] >= 0 && faultWrite(FAULT_SALES, groupCommit.fd[i], batch->buffer[i], batch->length[i], -1);
+        header.size[SHADOW_SALES + i] = (long long)start[i] + (long long)batch->length[i];
+    }
+    
+    // Images go where the last commit's are not: a torn header falls back
+    // to that commit, which must still be there to finish
+    long long length = (long long)sizeof(ShadowImage) * pages;
+    header.images = SHADOW_IMAGES;
+    if (last.seq > 0 && last.images - SHADOW_IMAGES < length) {
+        header.images = last.images + (long long)sizeof(ShadowImage) * last.pages;
+    }
+    ok = ok && faultWrite(FAULT_IMAGES, shadow.fd, images, (size_t)length, (off_t)header.images);
+    for (int i = GC_RECORDS + 1; ok && i < GC_STREAMS; i++) {
+        if (start[i] >= 0 && fdatasync(groupCommit.fd[i]) != 0) {
+            ok = 0;
+        }
+    }
+    ok = ok && fdatasync(shadow.fd) == 0;
+    if (ok) {
+        faultCheck(FAULT_SYNCED);
+    }
+    
+    header.checksum = shadowChecksum(&header);
+    ok = ok && faultWrite(FAULT_HEADER, shadow.fd, &header, sizeof(header), (off_t)(header.seq & 1) * SHADOW_SLOT) &&
+         fdatasync(shadow.fd) == 0;
+    
+    if (ok) {
+        // This terminal's slots already hold what it wrote; it is only up
+        // to date if no other terminal committed since it last looked
+        if (catalog.generation == generation - 1) {
+            catalog.generation = generation;
+        }
+        faultCheck(FAULT_COMMITTED);
+        if (!shadowApply(&header, images, fd)) {
+            printf("Error writing %s; the next commit finishes this one.\n", MEDICINE_FILE);
+        }
+    } else {
+        for (int i = GC_RECORDS + 1; i < GC_STREAMS; i++) {
+            if (start[i] >= 0 && ftruncate(groupCommit.fd[i], start[i]) != 0) {
+                printf("Error rolling back %s!\n", shadowFiles[SHADOW_SALES + i]);
+            }
+        }
+    }
+    free(images);
+    if (catalog.file == NULL && fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+// Take the layout lock exclusively and catch up with the file, so a change
+// made now is made to what is on file. Returns 0 if the lock could not be
+// taken or the file read.
+int catalogBeginChange() {
+    if (catalog.file == NULL || !layoutLock(fileno(catalog.file), F_WRLCK, 1)) {
+        printf("Error locking %s!\n", MEDICINE_FILE);
+        return 0;
+    }
+    if (!catalogRefresh()) {
+        layoutLock(fileno(catalog.file), F_UNLCK, 1);
+        return 0;
+    }
+    return 1;
+}
+
+void catalogEndChange() {
+    fflush(catalog.file);
+    layoutLock(fileno(catalog.file), F_UNLCK, 1);
+}
+
+// Save the sales rollups, and any records still waiting for a save. The
+// layout lock is taken exclusively, which this terminal's own checkouts
+// would hold up, so this only runs when none of them is in flight. With
+// wait 0 this gives up rather than block a checkout.
+void catalogCheckpoint(int wait) {
+    if (catalog.file == NULL || catalog.commits_in_flight > 0 ||
+        !layoutLock(fileno(catalog.file), F_WRLCK, wait)) {
+        return;
+    }
+    saveMedicines();
+    if (saveSalesRollups()) {
+        catalog.sales_since_save = 0;
+    }
+    layoutLock(fileno(catalog.file), F_UNLCK, 1);
+}
+
+// Take the file's copy of a record that another terminal may have changed
+void catalogAdopt(int slot, const Medicine* fresh) {
+    Medicine* med = catalog.slots[slot];
+    if (memcmp(med, fresh, sizeof(Medicine)) == 0) {
+        return;
+    }
+    
+    if (strcmp(med->name, fresh->name) != 0) {
+        nameIndexRemove(med);
+        strcpy(med->name, fresh->name);
+        nameIndexInsert(med);
+    }
+    if (strcmp(med->category, fresh->category) != 0) {
+        categoryPostingRemove(catalog.column_category[slot], med->id);
+        strcpy(med->category, fresh->category);
+        categoryAssign(slot);
+    }
+    if (strcmp(med->expiry_date, fresh->expiry_date) != 0) {
+        expiryIndexRemove(med);
+        strcpy(med->expiry_date, fresh->expiry_date);
+        expiryIndexInsert(med);
+    }
+    med->price = fresh->price;
+    med->quantity = fresh->quantity;
+    catalogSyncColumns(slot);
+}
+
+// Re-read locked records from the file. Returns 0 when the file no longer
+// lines up with the catalog (records added, removed or moved elsewhere),
+// which calls for a reload. Records not saved yet keep the memory copy.
+int catalogRefreshSlots(int fd, const int slots[], int count) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size != (off_t)dataOffset(catalog.file_count)) {
+        return 0;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        int slot = slots[i];
+        if (slot >= catalog.file_count || catalog.dirty[slot]) {
+            continue;
+        }
+        MedicineRecord fresh, held;
+        if (pread(fd, &fresh, sizeof(fresh), (off_t)dataOffset(slot)) != (ssize_t)sizeof(fresh) ||
+            fresh.id != catalog.slots[slot]->id) {
+            return 0;
+        }
+        medicineToRecord(&held, catalog.slots[slot]);
+        held.generation = fresh.generation;
+        if (memcmp(&fresh, &held, sizeof(fresh)) != 0) {
+            Medicine med;
+            medicineFromRecord(&med, &fresh);
+            catalogAdopt(slot, &med);
+        }
+    }
+    return 1;
+}
+
+// Commit the records that changed since the last save, and the medicine
+// file's new length, as one shadow commit. Callers hold the layout lock
+// exclusively, or own the files outright (benchmarks). Returns 1 on
+// success; on failure the file is as it was and the slots stay dirty.
+int saveMedicines() {
+    if (catalog.dirty_count == 0 && catalog.file_count == catalog.count) {
+        return 1;
+    }
+    
+    RecordImage* records = (RecordImage*)malloc(sizeof(RecordImage) * (catalog.dirty_count + 1));
+    if (records == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    int n = 0;
+    for (int i = 0; i < catalog.dirty_count; i++) {
+        int slot = catalog.dirty_slots[i];
+        if (slot < catalog.count) {
+            records[n].slot = slot;
+            records[n].record = *catalog.slots[slot];
+            n++;
+        }
+    }
+    
+    int ok = shadowLock(1);
+    if (ok) {
+        ok = shadowCommit(records, n, dataOffset(catalog.count), NULL);
+        shadowUnlock();
+    }
+    free(records);
+    if (!ok) {
+        printf("Error saving medicines!\n");
+        return 0;
+    }
+    
+    for (int i = 0; i < catalog.dirty_count; i++) {
+        catalog.dirty[catalog.dirty_slots[i]] = 0;
+    }
+    catalog.dirty_count = 0;
+    catalog.file_count = catalog.count;
+    return 1;
+}
+
+int groupCommitOpen() {
+    groupCommit.fd[GC_TRANSACTION_BIN] = open(TRANSACTION_BIN_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    groupCommit.fd[GC_TRANSACTION_TEXT] = open(TRANSACTION_TEXT_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    groupCommit.fd[GC_TRANSACTION_INDEX] = open(TRANSACTION_INDEX_FILE, O_RDWR | O_APPEND | O_CREAT, 0644);
+    
+    for (int i = GC_RECORDS + 1; i < GC_STREAMS; i++) {
+        if (groupCommit.fd[i] < 0) {
+            printf("Error opening transaction files!\n");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void groupCommitClose() {
+    for (int i = 0; i < GC_STREAMS; i++) {
+        if (groupCommit.fd[i] >= 0) {
+            close(groupCommit.fd[i]);
+            groupCommit.fd[i] = -1;
+        }
+    }
+}
+
+int batchAppend(CommitBatch* batch, int stream, const void* data, size_t length) {
+    if (length == 0) {
+        return 1;
+    }
+    if (batch->length[stream] + length > batch->capacity[stream]) {
+        size_t capacity = batch->capacity[stream] ? batch->capacity[stream] * 2 : 4096;
+        while (capacity < batch->length[stream] + length) {
+            capacity *= 2;
+        }
+        char* buffer = (char*)realloc(batch->buffer[stream], capacity);
+        if (buffer == NULL) {
+            return 0;
+        }
+        batch->buffer[stream] = buffer;
+        batch->capacity[stream] = capacity;
+    }
+    
+    memcpy(batch->buffer[stream] + batch->length[stream], data, length);
+    batch->length[stream] += length;
+    return 1;
+}
+
+int writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 1;
+}
+
+// Write a whole buffer at an offset
+int pwriteAll(int fd, const char* data, size_t length, off_t at) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, at);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        data += written;
+        length -= (size_t)written;
+        at += written;
+    }
+    return 1;
+}
+
+// Write a batch as one shadow commit: its checkouts' records and
+// transactions become durable together or not at all
+int batchWrite(CommitBatch* batch) {
+    if (!shadowLock(1)) {
+        return 0;
+    }
+    int ok = shadowCommit((RecordImage*)batch->buffer[GC_RECORDS],
+                          (int)(batch->length[GC_RECORDS] / sizeof(RecordImage)), -1, batch);
+    shadowUnlock();
+    return ok;
+}
+
+// Queue one checkout's bytes (one buffer per stream) into the open batch.
+// The transaction is kept to number it and write its text when the batch
+// is written; it must stay put until groupCommitWait returns. Called with
+// the catalog lock held so log order follows stock order.
+CommitBatch* groupCommitSubmit(const void* data[], const size_t length[], Transaction* trans) {
+    pthread_mutex_lock(&groupCommit.lock);
+    
+    if (groupCommit.failed) {
+        pthread_mutex_unlock(&groupCommit.lock);
+        return NULL;
+    }
+    
+    int limit = groupCommit.enabled ? groupCommit.batch_size : 1;
+    CommitBatch* batch = groupCommit.tail;
+    if (batch == NULL || batch->closed || batch->count >= limit) {
+        batch = (CommitBatch*)calloc(1, sizeof(CommitBatch));
+        if (batch == NULL) {
+            pthread_mutex_unlock(&groupCommit.lock);
+            return NULL;
+        }
+        if (groupCommit.tail != NULL) {
+            groupCommit.tail->next = batch;
+        } else {
+            groupCommit.head = batch;
+        }
+        groupCommit.tail = batch;
+    }
+    
+    // A transaction index entry gets its frame's offset within the batch
+    TransactionIndexEntry entry;
+    memcpy(&entry, data[GC_TRANSACTION_INDEX], sizeof(entry));
+    entry.offset = (long long)batch->length[GC_TRANSACTION_BIN];
+    data[GC_TRANSACTION_INDEX] = &entry;
+    
+    Transaction** sales = (Transaction**)realloc(batch->sales, sizeof(Transaction*) * (batch->count + 1));
+    if (sales == NULL) {
+        pthread_mutex_unlock(&groupCommit.lock);
+        return NULL;
+    }
+    batch->sales = sales;
+    for (int i = 0; i < GC_STREAMS; i++) {
+        if (!batchAppend(batch, i, data[i], length[i])) {
+            pthread_mutex_unlock(&groupCommit.lock);
+            return NULL;
+        }
+    }
+    batch->sales[batch->count] = trans;
+    batch->count++;
+    batch->waiting++;
+    groupCommit.commits++;
+    
+    if (batch->count >= limit) {
+        pthread_cond_broadcast(&groupCommit.cond);
+    }
+    pthread_mutex_unlock(&groupCommit.lock);
+    return batch;
+}
+
+// Block until a batch is durable; returns 1 on success. The first waiter
+// of the oldest batch writes it, optionally waiting up to window_us for
+// more checkouts to join first.
+int groupCommitWait(CommitBatch* batch) {
+    pthread_mutex_lock(&groupCommit.lock);
+    
+    while (!batch->done) {
+        if (batch != groupCommit.head || groupCommit.writing) {
+            pthread_cond_wait(&groupCommit.cond, &groupCommit.lock);
+            continue;
+        }
+        
+        groupCommit.writing = 1;
+        if (groupCommit.enabled && groupCommit.window_us > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += groupCommit.window_us * 1000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            while (batch->count < groupCommit.batch_size &&
+                   pthread_cond_timedwait(&groupCommit.cond, &groupCommit.lock, &deadline) != ETIMEDOUT) {
+            }
+        }
+        batch->closed = 1;
+        
+        pthread_mutex_unlock(&groupCommit.lock);
+        int ok = batchWrite(batch);
+        pthread_mutex_lock(&groupCommit.lock);
+        
+        batch->done = ok ? 1 : -1;
+        if (!ok) {
+            groupCommit.failed = 1;
+        }
+        groupCommit.head = batch->next;
+        if (groupCommit.head == NULL) {
+            groupCommit.tail = NULL;
+        }
+        groupCommit.writing = 0;
+        groupCommit.batches++;
+        pthread_cond_broadcast(&groupCommit.cond);
+    }
+    
+    int ok = batch->done > 0;
+    if (--batch->waiting == 0) {
+        for (int i = 0; i < GC_STREAMS; i++) {
+            free(batch->buffer[i]);
+        }
+        free(batch->sales);
+        free(batch);
+    }
+    
+    pthread_mutex_unlock(&groupCommit.lock);
+    return ok;
+}
+
+// Join a transaction to the catalog. Lines of the same medicine are merged
+// through a small hash table on the id, then each distinct medicine is
+// looked up in the id index once. Fills lines and returns how many there
+// are. The caller holds the catalog lock.
+int joinSaleLines(const Transaction* trans, SaleLine lines[]) {
+    int small[32];
+    unsigned int capacity = 16;
+    while (capacity < (unsigned int)trans->items_count * 2) {
+        capacity <<= 1;
+    }
+    // Carts of up to 16 lines probe a table on the stack
+    int* table = capacity <= 32 ? small : (int*)malloc(sizeof(int) * capacity);
+    if (table == NULL) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    for (unsigned int i = 0; i < capacity; i++) {
+        table[i] = -1;
+    }
+    
+    int count = 0;
+    for (int i = 0; i < trans->items_count; i++) {
+        int id = trans->items[i].medicine_id;
+        unsigned int bucket = hashMedicineId(id) & (capacity - 1);
+        while (table[bucket] != -1 && lines[table[bucket]].medicine_id != id) {
+            bucket = (bucket + 1) & (capacity - 1);
+        }
+        if (table[bucket] == -1) {
+            table[bucket] = count;
+            lines[count].medicine_id = id;
+            lines[count].slot = findMedicineSlot(id);
+            lines[count].quantity = 0;
+            count++;
+        }
+        lines[table[bucket]].quantity += trans->items[i].quantity;
+    }
+    if (table != small) {
+        free(table);
+    }
+    return count;
+}
+
+// Join a transaction to the catalog and lock the medicine file records it
+// touches, in file order so two checkouts never wait on each other, and
+// bring them up to date. Returns the number of sale lines with the catalog
+// lock held, or -1 if the records could not be locked. The slots stay put
+// while the layout lock is held. Any lock this took is dropped by closing fd.
+int lockSaleRecords(int fd, const Transaction* trans, SaleLine lines[]) {
+    int* slots = (int*)malloc(sizeof(int) * (trans->items_count + 1));
+    int result = -1;
+    for (int attempt = 0; slots != NULL && result < 0 && attempt < 3; attempt++) {
+        if (!layoutLock(fd, F_RDLCK, 1)) {
+            break;
+        }
+        
+        pthread_mutex_lock(&catalog.lock);
+        int n = joinSaleLines(trans, lines);
+        pthread_mutex_unlock(&catalog.lock);
+        int count = 0;
+        for (int i = 0; i < n; i++) {
+            if (lines[i].slot >= 0) {
+                slots[count++] = lines[i].slot;
+            }
+        }
+        qsort(slots, count, sizeof(int), compareIds);
+        
+        int locked = 1;
+        for (int i = 0; locked && i < count; i++) {
+            locked = fileLock(fd, F_WRLCK, (off_t)dataOffset(slots[i]), DATA_RECORD, 1);
+        }
+        if (locked) {
+            shadowCatchUp();
+        }
+        
+        pthread_mutex_lock(&catalog.lock);
+        if (locked && catalogRefreshSlots(fd, slots, count)) {
+            result = n;
+            break;
+        }
+        
+        // Another terminal changed the layout: catch up with the file,
+        // under the layout lock held exclusively (taken before the catalog
+        // lock, as everywhere else)
+        pthread_mutex_unlock(&catalog.lock);
+        fileLock(fd, F_UNLCK, 0, 0, 1);
+        if (!layoutLock(fd, F_WRLCK, 1)) {
+            break;
+        }
+        pthread_mutex_lock(&catalog.lock);
+        catalogRefresh();
+        pthread_mutex_unlock(&catalog.lock);
+        layoutLock(fd, F_UNLCK, 1);
+    }
+    free(slots);
+    return result;
+}
+
+// Commit a sale. The transaction is joined to the catalog, its records are
+// locked and re-read from the medicine file, stock is reduced in memory, and
+// the changed records and the transaction records go into one shadow commit
+// through group commit, which writes the records back before the locks are
+// let go.
+// Memory is restored if the batch cannot be written. The stock itself is
+// reserved on the stock counters first, without a lock.
+// Returns 1 on success, 0 if stock ran short or a line is expired stock or
+// a medicine no longer on file (nothing changed), -1 if the sale could not
+// be written.
+int commitSale(Transaction* trans) {
+    RecordImage* records = (RecordImage*)malloc(sizeof(RecordImage) * (trans->items_count + 1));
+    SaleLine* lines = (SaleLine*)malloc(sizeof(SaleLine) * (trans->items_count + 1));
+    char* frame = NULL;
+    size_t frame_length = 0;
+    FILE* frame_stream = open_memstream(&frame, &frame_length);
+    
+    if (records == NULL || lines == NULL || frame_stream == NULL) {
+        free(records);
+        free(lines);
+        if (frame_stream != NULL) {
+            fclose(frame_stream);
+        }
+        free(frame);
+        return -1;
+    }
+    saveTransactionToBinary(frame_stream, trans);
+    fclose(frame_stream);
+    
+    TransactionIndexEntry entry;
+    entry.transaction_id = trans->transaction_id;
+    entry.items_count = trans->items_count;
+    entry.timestamp = transactionTimestamp(trans);
+    entry.offset = 0;
+    
+    // A descriptor of its own per checkout, so its locks are its own
+    int fd = open(MEDICINE_FILE, O_RDWR);
+    
+    // Claim the stock without a lock. When it looks short another terminal
+    // may have restocked, so re-read the records once and try again.
+    int reserved = fd >= 0 && stockReserveTransaction(trans);
+    if (fd >= 0 && !reserved && lockSaleRecords(fd, trans, lines) >= 0) {
+        pthread_mutex_unlock(&catalog.lock);
+        fileLock(fd, F_UNLCK, 0, 0, 1);
+        reserved = stockReserveTransaction(trans);
+    }
+    int count = fd >= 0 && reserved ? lockSaleRecords(fd, trans, lines) : -1;
+    if (count < 0) {
+        if (reserved) {
+            stockReleaseTransaction(trans);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(records);
+        free(lines);
+        free(frame);
+        return fd >= 0 && !reserved ? 0 : -1;
+    }
+    
+    // The records can still be short of a reservation when another
+    // terminal sold them since this one last looked, or deleted them
+    int today = todayDayNumber();
+    for (int i = 0; i < count; i++) {
+        int slot = lines[i].slot;
+        if (slot < 0 || slotExpired(slot, today) || lines[i].quantity > catalog.slots[slot]->quantity) {
+            pthread_mutex_unlock(&catalog.lock);
+            stockReleaseTransaction(trans);
+            close(fd);
+            free(records);
+            free(lines);
+            free(frame);
+            return 0;
+        }
+    }
+    
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        int slot = lines[i].slot;
+        catalog.slots[slot]->quantity -= lines[i].quantity;
+        stockConsume(slot, lines[i].quantity);
+        
+        // Records already on file are committed with the sale; new ones wait for a save
+        if (slot < catalog.file_count && !catalog.dirty[slot]) {
+            catalogSyncColumns(slot);
+            records[n].slot = slot;
+            records[n].record = *catalog.slots[slot];
+            n++;
+        } else {
+            catalogMarkDirty(slot);
+        }
+    }
+    catalog.commits_in_flight++;
+    
+    const void* data[GC_STREAMS] = { records, frame, NULL, &entry };
+    size_t length[GC_STREAMS] = { sizeof(RecordImage) * n, frame_length, 0, sizeof(entry) };
+    CommitBatch* batch = groupCommitSubmit(data, length, trans);
+    
+    pthread_mutex_unlock(&catalog.lock);
+    free(frame);
+    
+    int ok = batch != NULL && groupCommitWait(batch);
+    close(fd);
+    
+    pthread_mutex_lock(&catalog.lock);
+    catalog.commits_in_flight--;
+    if (!ok) {
+        // Give the stock back; the files were cut back to before the batch
+        for (int i = 0; i < count; i++) {
+            int slot = lines[i].slot >= 0 ? findMedicineSlot(lines[i].medicine_id) : -1;
+            if (slot >= 0) {
+                catalog.slots[slot]->quantity += lines[i].quantity;
+                catalogSyncColumns(slot);
+            }
+        }
+    } else if (++catalog.sales_since_save >= ROLLUP_SAVE_SALES) {
+        // Save the rollups now and then, once no batch is in flight
+        pthread_mutex_lock(&groupCommit.lock);
+        if (groupCommit.head == NULL) {
+            catalogCheckpoint(0);
+        }
+        pthread_mutex_unlock(&groupCommit.lock);
+    }
+    pthread_mutex_unlock(&catalog.lock);
+    
+    free(records);
+    free(lines);
+    return ok ? 1 : -1;
+}
+
+void freeMedicines() {
+    if (catalog.file != NULL) {
+        fclose(catalog.file);
+    }
+    if (shadow.fd >= 0) {
+        close(shadow.fd);
+        shadow.fd = -1;
+    }
+    
+    MedicineBlock* block = catalog.blocks;
+    while (block != NULL) {
+        MedicineBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    
+    free(catalog.slots);
+    free(catalog.dirty);
+    free(catalog.dirty_slots);
+    free(catalog.column_id);
+    free(catalog.column_price);
+    free(catalog.column_quantity);
+    free(catalog.column_expiry);
+    free(catalog.column_category);
+    free(catalog.reorder_level);
+    free(catalog.low_stock_heap);
+    free(catalog.low_stock_position);
+    free(catalog.version);
+    free(catalog.index);
+    memset(&catalog, 0, sizeof(catalog));
+    
+    free(nameIndex.entries);
+    memset(&nameIndex, 0, sizeof(nameIndex));
+    
+    free(expiryIndex.entries);
+    memset(&expiryIndex, 0, sizeof(expiryIndex));
+    
+    for (int i = 0; i < categories.count; i++) {
+        free(categories.entries[i].ids);
+    }
+    free(categories.entries);
+    free(categories.index);
+    memset(&categories, 0, sizeof(categories));
+}
+
+int generateMedicineId() {
+    static int last_id = 1000;
+    if (last_id < catalog.max_id) {
+        last_id = catalog.max_id;
+    }
+    last_id++;
+    return last_id;
+}
+
+void clearInputBuffer() {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF);
+}
+
+void printHeader(const char* title) {
+    printf("\n");
+    printLine('=', 50);
+    printf("          %s\n", title);
+    printLine('=', 50);
+}
+
+void printLine(char ch, int length) {
+    for (int i = 0; i < length; i++) {
+        printf("%c", ch);
+    }
+    printf("\n");
+}
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    int checkouts;
+    unsigned int seed;
+} BenchWorker;
+
+// Benchmark worker: random 1-5 line transactions against the whole catalog
+void* benchCheckoutWorker(void* arg) {
+    BenchWorker* worker = (BenchWorker*)arg;
+    Transaction* trans = (Transaction*)calloc(1, sizeof(Transaction));
+    if (trans == NULL || !transactionReserve(trans, 5)) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    
+    for (int n = 0; n < worker->checkouts; n++) {
+        trans->transaction_id = n;
+        trans->items_count = 1 + rand_r(&worker->seed) % 5;
+        for (int i = 0; i < trans->items_count; i++) {
+            Medicine* med = catalog.slots[rand_r(&worker->seed) % catalog.count];
+            trans->items[i].medicine_id = med->id;
+            strcpy(trans->items[i].medicine_name, med->name);
+            trans->items[i].price = med->price;
+            trans->items[i].quantity = 1;
+        }
+        if (commitSale(trans) != 1) {
+            printf("Checkout failed!\n");
+            break;
+        }
+    }
+    
+    transactionFree(trans);
+    free(trans);
+    return NULL;
+}
+
+// Checkouts/sec from concurrent counters with group commit off and on.
+// Runs in a scratch directory so real data files are never touched.
+int benchGroupCommit(int argc, char* argv[]) {
+    int threads = argc > 0 ? atoi(argv[0]) : 8;
+    int checkouts = argc > 1 ? atoi(argv[1]) : 200;
+    long window_us = argc > 2 ? atol(argv[2]) : GROUP_COMMIT_WINDOW_US;
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (checkouts < 1) {
+        checkouts = 1;
+    }
+    
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        printf("Error creating scratch directory!\n");
+        return 1;
+    }
+    
+    loadMedicines();
+    if (!groupCommitOpen()) {
+        return 1;
+    }
+    for (int i = 0; i < 1000; i++) {
+        Medicine med;
+        memset(&med, 0, sizeof(med));
+        med.id = generateMedicineId();
+        sprintf(med.name, "Medicine %d", i + 1);
+        strcpy(med.category, "Tablet");
+        med.price = 1.0f;
+        med.quantity = 1 << 30;
+        catalogAdd(&med);
+    }
+    saveMedicines();
+    
+    printf("%d threads x %d checkouts, window %ld us, batch %d\n",
+           threads, checkouts, window_us, GROUP_COMMIT_BATCH);
+    
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    BenchWorker* workers = (BenchWorker*)malloc(sizeof(BenchWorker) * threads);
+    
+    for (int mode = 0; mode < 2; mode++) {
+        groupCommit.enabled = mode;
+        groupCommit.window_us = window_us;
+        groupCommit.batches = 0;
+        groupCommit.commits = 0;
+        
+        double start = nowSeconds();
+        for (int i = 0; i < threads; i++) {
+            workers[i].checkouts = checkouts;
+            workers[i].seed = 12345u + (unsigned int)i;
+            pthread_create(&tids[i], NULL, benchCheckoutWorker, &workers[i]);
+        }
+        for (int i = 0; i < threads; i++) {
+            pthread_join(tids[i], NULL);
+        }
+        double seconds = nowSeconds() - start;
+        
+        printf("group commit %-3s: %8.0f checkouts/sec, %ld fsync batches (%.1f checkouts/batch)\n",
+               mode ? "on" : "off",
+               groupCommit.commits / seconds,
+               groupCommit.batches,
+               groupCommit.batches ? (double)groupCommit.commits / groupCommit.batches : 0.0);
+    }
+    
+    free(tids);
+    free(workers);
+    groupCommitClose();
+    freeMedicines();
+    
+    unlink(MEDICINE_FILE);
+    unlink(SHADOW_FILE);
+    unlink(TRANSACTION_BIN_FILE);
+    unlink(TRANSACTION_TEXT_FILE);
+    unlink(TRANSACTION_INDEX_FILE);
+    unlink(CATEGORY_FILE);
+    unlink(SALES_ROLLUP_FILE);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
+
+typedef struct {
+    int checkouts;
+    int hot;                        // medicines that take most of the lines
+    int locked;                     // 1 = read-check-subtract under the catalog lock
+    unsigned int seed;
+    long units;
+} StockWorker;
+
+// Benchmark worker: 1-3 line transactions skewed to a few hot medicines,
+// claimed either under the catalog lock or on the stock counters
+void* benchStockWorker(void* arg) {
+    StockWorker* worker = (StockWorker*)arg;
+    Transaction* trans = (Transaction*)calloc(1, sizeof(Transaction));
+    if (trans == NULL || !transactionReserve(trans, 3)) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    
+    for (int n = 0; n < worker->checkouts; n++) {
+        trans->items_count = 1 + rand_r(&worker->seed) % 3;
+        for (int i = 0; i < trans->items_count; i++) {
+            int r = rand_r(&worker->seed);
+            int slot = r % 100 < STOCK_BENCH_HOT_PERCENT ? r / 100 % worker->hot : r / 100 % catalog.count;
+            trans->items[i].medicine_id = catalog.slots[slot]->id;
+            trans->items[i].quantity = 1;
+        }
+        
+        int ok = 1;
+        if (worker->locked) {
+            pthread_mutex_lock(&catalog.lock);
+            for (int i = 0; ok && i < trans->items_count; i++) {
+                Medicine* med = findMedicine(trans->items[i].medicine_id);
+                ok = med != NULL && trans->items[i].quantity <= med->quantity;
+            }
+            for (int i = 0; ok && i < trans->items_count; i++) {
+                findMedicine(trans->items[i].medicine_id)->quantity -= trans->items[i].quantity;
+            }
+            pthread_mutex_unlock(&catalog.lock);
+        } else {
+            ok = stockReserveTransaction(trans);
+        }
+        
+        for (int i = 0; ok && i < trans->items_count; i++) {
+            worker->units += trans->items[i].quantity;
+        }
+    }
+    
+    transactionFree(trans);
+    free(trans);
+    return NULL;
+}
+
+// Units left across the catalog, on the records or on the counters
+long stockTotal(int locked) {
+    long total = 0;
+    for (int i = 0; i < catalog.count; i++) {
+        if (locked) {
+            total += catalog.slots[i]->quantity;
+        } else {
+            StockCounter* counter = stockCounter(catalog.slots[i]->id, 0);
+            total += counter == NULL ? 0 : atomic_load(&counter->available);
+        }
+    }
+    return total;
+}
+
+// Stock claims/sec by thread count on a hot-SKU workload: the catalog lock
+// against the CAS counters. Only the claim is timed; the durable part of a
+// checkout is what --bench-group-commit measures. Runs in a scratch
+// directory so real data files are never touched.
+int benchStock(int argc, char* argv[]) {
+    int max_threads = argc > 0 ? atoi(argv[0]) : 16;
+    int checkouts = argc > 1 ? atoi(argv[1]) : 200000;
+    int medicines = argc > 2 ? atoi(argv[2]) : 10000;
+    int hot = 8;
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+    if (checkouts < 1) {
+        checkouts = 1;
+    }
+    if (medicines < hot) {
+        medicines = hot;
+    }
+    
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        printf("Error creating scratch directory!\n");
+        return 1;
+    }
+    
+    loadMedicines();
+    for (int i = 0; i < medicines; i++) {
+        Medicine med;
+        memset(&med, 0, sizeof(med));
+        med.id = generateMedicineId();
+        sprintf(med.name, "Medicine %d", i + 1);
+        strcpy(med.category, "Tablet");
+        med.price = 1.0f;
+        med.quantity = 1 << 30;
+        catalogAdd(&med);
+    }
+    
+    printf("%d checkouts per thread, %d medicines, %d%% of lines on %d of them\n",
+           checkouts, medicines, STOCK_BENCH_HOT_PERCENT, hot);
+    printf("%-8s %18s %18s\n", "threads", "lock checkouts/s", "CAS checkouts/s");
+    
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * max_threads);
+    StockWorker* workers = (StockWorker*)malloc(sizeof(StockWorker) * max_threads);
+    int conserved = 1;
+    
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double rate[2];
+        for (int locked = 1; locked >= 0; locked--) {
+            long before = stockTotal(locked);
+            long units = 0;
+            
+            double start = nowSeconds();
+            for (int i = 0; i < threads; i++) {
+                memset(&workers[i], 0, sizeof(StockWorker));
+                workers[i].checkouts = checkouts;
+                workers[i].hot = hot;
+                workers[i].locked = locked;
+                workers[i].seed = 777u + (unsigned int)i;
+                pthread_create(&tids[i], NULL, benchStockWorker, &workers[i]);
+            }
+            for (int i = 0; i < threads; i++) {
+                pthread_join(tids[i], NULL);
+            }
+            rate[locked] = (double)threads * checkouts / (nowSeconds() - start);
+            
+            for (int i = 0; i < threads; i++) {
+                units += workers[i].units;
+            }
+            if (before - stockTotal(locked) != units) {
+                conserved = 0;
+            }
+        }
+        printf("%-8d %18.0f %18.0f\n", threads, rate[1], rate[0]);
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+    printf("Stock conserved: %s\n", conserved ? "yes" : "NO");
+    
+    free(tids);
+    free(workers);
+    freeMedicines();
+    unlink(MEDICINE_FILE);
+    unlink(CATEGORY_FILE);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return conserved ? 0 : 1;
+}
+
+// The in-memory part of a checkout with nested loops, the way it once was:
+// every line walks the catalog to check its stock, then again to take it
+int checkoutNested(const Transaction* trans) {
+    for (int i = 0; i < trans->items_count; i++) {
+        int found = 0;
+        for (int j = 0; !found && j < catalog.count; j++) {
+            found = catalog.slots[j]->id == trans->items[i].medicine_id &&
+                    catalog.slots[j]->quantity >= trans->items[i].quantity;
+        }
+        if (!found) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < trans->items_count; i++) {
+        for (int j = 0; j < catalog.count; j++) {
+            if (catalog.slots[j]->id == trans->items[i].medicine_id) {
+                catalog.slots[j]->quantity -= trans->items[i].quantity;
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+// The same through joinSaleLines: one index probe per distinct medicine,
+// with lines sized for the transaction by the caller
+int checkoutJoined(const Transaction* trans, SaleLine lines[]) {
+    int count = joinSaleLines(trans, lines);
+    for (int i = 0; i < count; i++) {
+        if (lines[i].slot < 0 || catalog.slots[lines[i].slot]->quantity < lines[i].quantity) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        catalog.slots[lines[i].slot]->quantity -= lines[i].quantity;
+    }
+    return 1;
+}
+
+// Checkout cost by transaction size on a large catalog: nested line x
+// catalog loops against the hash join. Only the check and the stock update
+// under the catalog lock are timed; the durable part of a checkout is what
+// --bench-group-commit measures. Runs in a scratch directory so real data
+// files are never touched.
+int benchCheckout(int argc, char* argv[]) {
+    int medicines = argc > 0 ? atoi(argv[0]) : 100000;
+    int rounds = argc > 1 ? atoi(argv[1]) : 100;
+    int sizes[] = { 1, 20, 100 };
+    if (medicines < 100) {
+        medicines = 100;
+    }
+    if (rounds < 1) {
+        rounds = 1;
+    }
+    
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        printf("Error creating scratch directory!\n");
+        return 1;
+    }
+    
+    loadMedicines();
+    for (int i = 0; i < medicines; i++) {
+        Medicine med;
+        memset(&med, 0, sizeof(med));
+        med.id = generateMedicineId();
+        sprintf(med.name, "Medicine %d", i + 1);
+        strcpy(med.category, "Tablet");
+        med.price = 1.0f;
+        med.quantity = 1 << 30;
+        catalogAdd(&med);
+    }
+    
+    printf("%d medicines, %d checkouts per transaction size\n", medicines, rounds);
+    printf("%-8s %16s %16s %10s\n", "lines", "nested us/sale", "joined us/sale", "speedup");
+    
+    int most = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    Transaction* trans = (Transaction*)calloc(1, sizeof(Transaction));
+    SaleLine* lines = (SaleLine*)malloc(sizeof(SaleLine) * most);
+    if (trans == NULL || lines == NULL || !transactionReserve(trans, most)) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    unsigned int seed = 4242u;
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        double seconds[2];
+        for (int joined = 0; joined < 2; joined++) {
+            seconds[joined] = 0.0;
+            for (int r = 0; r < rounds; r++) {
+                trans->items_count = sizes[s];
+                for (int i = 0; i < sizes[s]; i++) {
+                    trans->items[i].medicine_id = catalog.slots[rand_r(&seed) % catalog.count]->id;
+                    trans->items[i].quantity = 1;
+                }
+                
+                pthread_mutex_lock(&catalog.lock);
+                double start = nowSeconds();
+                int ok = joined ? checkoutJoined(trans, lines) : checkoutNested(trans);
+                seconds[joined] += nowSeconds() - start;
+                pthread_mutex_unlock(&catalog.lock);
+                if (!ok) {
+                    printf("Error: checkout failed!\n");
+                    break;
+                }
+            }
+        }
+        printf("%-8d %16.2f %16.2f %9.0fx\n", sizes[s], seconds[0] * 1e6 / rounds, seconds[1] * 1e6 / rounds,
+               seconds[1] > 0.0 ? seconds[0] / seconds[1] : 0.0);
+    }
+    
+    transactionFree(trans);
+    free(trans);
+    free(lines);
+    freeMedicines();
+    unlink(MEDICINE_FILE);
+    unlink(CATEGORY_FILE);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
+
+// One terminal of the lock stress test: random 1-3 line checkouts against
+// the shared catalog. Returns how many checkouts failed.
+int stressTerminal(int checkouts, unsigned int seed) {
+    loadMedicines();
+    recoverTransactionFiles();
+    if (!groupCommitOpen()) {
+        return checkouts;
+    }
+    
+    Transaction* trans = (Transaction*)calloc(1, sizeof(Transaction));
+    if (trans != NULL && !transactionReserve(trans, 3)) {
+        free(trans);
+        trans = NULL;
+    }
+    int failures = trans == NULL ? checkouts : 0;
+    for (int n = 0; trans != NULL && n < checkouts; n++) {
+        time_t now = time(NULL);
+        struct tm* tm_info = localtime(&now);
+        strftime(trans->date, sizeof(trans->date), "%d/%m/%Y", tm_info);
+        strftime(trans->time, sizeof(trans->time), "%H:%M:%S", tm_info);
+        trans->items_count = 1 + rand_r(&seed) % 3;
+        trans->amount = 0;
+        for (int i = 0; i < trans->items_count; i++) {
+            Medicine* med = catalog.slots[rand_r(&seed) % catalog.count];
+            trans->items[i].medicine_id = med->id;
+            strcpy(trans->items[i].medicine_name, med->name);
+            trans->items[i].price = med->price;
+            trans->items[i].quantity = 1 + rand_r(&seed) % 3;
+            trans->amount += trans->items[i].price * trans->items[i].quantity;
+        }
+        if (commitSale(trans) != 1) {
+            failures++;
+        }
+    }
+    
+    if (trans != NULL) {
+        transactionFree(trans);
+    }
+    free(trans);
+    catalogCheckpoint(1);
+    groupCommitClose();
+    freeMedicines();
+    return failures;
+}
+
+// Several terminals (processes) check out the same few medicines at once,
+// first without record locks and then with them. Afterwards every unit in
+// the transaction file must be missing from stock; anything else is a lost
+// update. Runs in a scratch directory so real data files are never touched.
+int stressLocks(int argc, char* argv[]) {
+    int processes = argc > 0 ? atoi(argv[0]) : 4;
+    int checkouts = argc > 1 ? atoi(argv[1]) : 200;
+    int medicines = argc > 2 ? atoi(argv[2]) : 8;
+    if (processes < 1) {
+        processes = 1;
+    }
+    if (checkouts < 1) {
+        checkouts = 1;
+    }
+    if (medicines < 1) {
+        medicines = 1;
+    }
+    
+    char dir[] = "/tmp/medstore-stress-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        printf("Error creating scratch directory!\n");
+        return 1;
+    }
+    
+    printf("%d terminals x %d checkouts on %d medicines\n", processes, checkouts, medicines);
+    int passed = 0;
+    
+    for (int mode = 0; mode < 2; mode++) {
+        recordLocking = mode;
+        unlink(MEDICINE_FILE);
+        unlink(SHADOW_FILE);
+        unlink(TRANSACTION_BIN_FILE);
+        unlink(TRANSACTION_TEXT_FILE);
+        unlink(TRANSACTION_INDEX_FILE);
+        unlink(CATEGORY_FILE);
+        unlink(SALES_ROLLUP_FILE);
+        
+        loadMedicines();
+        for (int i = 0; i < medicines; i++) {
+            Medicine med;
+            memset(&med, 0, sizeof(med));
+            med.id = 1001 + i;
+            sprintf(med.name, "Medicine %d", i + 1);
+            strcpy(med.category, "Tablet");
+            strcpy(med.expiry_date, "31/12/2099");
+            med.price = 1.0f;
+            med.quantity = 1 << 24;
+            catalogAdd(&med);
+        }
+        saveMedicines();
+        freeMedicines();
+        
+        fflush(stdout);
+        double start = nowSeconds();
+        int failures = 0;
+        for (int p = 0; p < processes; p++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                _exit(stressTerminal(checkouts, 777u + (unsigned int)p) != 0);
+            }
+            if (pid < 0) {
+                printf("Error starting terminal %d!\n", p + 1);
+                failures++;
+            }
+        }
+        int status;
+        while (wait(&status) > 0) {
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failures++;
+            }
+        }
+        double seconds = nowSeconds() - start;
+        
+        // Read back as a new terminal would, and rebuild sales from scratch
+        recordLocking = 1;
+        loadMedicines();
+        rebuildSalesRollups();
+        long long units_lost = 0;
+        for (int i = 0; i < catalog.count; i++) {
+            RollupTable* table = &salesRollups.tables[ROLLUP_MEDICINE];
+            int position = rollupLowerBound(table, catalog.slots[i]->id);
+            long long sold = position < table->count && table->buckets[position].key == catalog.slots[i]->id ?
+                             table->buckets[position].units : 0;
+            units_lost += llabs((1LL << 24) - sold - catalog.slots[i]->quantity);
+        }
+        long long transactions = 0;
+        for (int i = 0; i < salesRollups.tables[ROLLUP_DAILY].count; i++) {
+            transactions += salesRollups.tables[ROLLUP_DAILY].buckets[i].sales;
+        }
+        freeMedicines();
+        
+        // Every sale must have an ID of its own, whichever terminal made it
+        int count;
+        TransactionIndexEntry* entries = loadTransactionIndex(&count);
+        int* ids = (int*)malloc(sizeof(int) * (count + 1));
+        int duplicates = 0;
+        for (int i = 0; ids != NULL && i < count; i++) {
+            ids[i] = entries[i].transaction_id;
+        }
+        if (ids != NULL && count > 0) {
+            qsort(ids, count, sizeof(int), compareIds);
+            for (int i = 1; i < count; i++) {
+                duplicates += ids[i] == ids[i - 1];
+            }
+        }
+        free(ids);
+        free(entries);
+        
+        printf("record locks %-3s: %8.0f checkouts/sec, %lld of %lld transactions on file, %lld units of stock lost, "
+               "%d duplicate IDs%s\n",
+               mode ? "on" : "off", processes * (double)checkouts / seconds,
+               transactions, (long long)processes * checkouts, units_lost, duplicates,
+               failures ? " (some terminals failed)" : "");
+        if (mode == 1) {
+            passed = units_lost == 0 && duplicates == 0 && failures == 0 &&
+                     transactions == (long long)processes * checkouts;
+        }
+    }
+    
+    unlink(MEDICINE_FILE);
+    unlink(SHADOW_FILE);
+    unlink(TRANSACTION_BIN_FILE);
+    unlink(TRANSACTION_TEXT_FILE);
+    unlink(TRANSACTION_INDEX_FILE);
+    unlink(CATEGORY_FILE);
+    unlink(SALES_ROLLUP_FILE);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return passed ? 0 : 1;
+}
+
+#define CRASH_MEDICINES 200         // several SHADOW_PAGEs of records
+#define CRASH_STOCK 50
+#define CRASH_SCENARIOS 3
+#define CRASH_SALE_LINES 5
+#define CRASH_DELETED 7
+
+const char* faultNames[FAULT_POINTS + 1] = {
+    "none", "sales", "images", "synced", "header", "committed", "apply", "applied"
+};
+const char* crashScenarios[CRASH_SCENARIOS] = { "checkout", "add", "delete" };
+const int crashSale[CRASH_SALE_LINES] = { 1, 15, 16, 120, CRASH_MEDICINES };   // 15 and 16 end and start a page
+
+// Run one scenario of the crash test; in the child, faultPoint kills it
+void crashScenario(int scenario) {
+    loadMedicines();
+    recoverTransactionFiles();
+    if (scenario == 0) {
+        Transaction* trans = (Transaction*)calloc(1, sizeof(Transaction));
+        if (trans == NULL || !transactionReserve(trans, CRASH_SALE_LINES) || !groupCommitOpen()) {
+            return;
+        }
+        trans->transaction_id = 1;
+        time_t now = time(NULL);
+        struct tm* tm_info = localtime(&now);
+        strftime(trans->date, sizeof(trans->date), "%d/%m/%Y", tm_info);
+        strftime(trans->time, sizeof(trans->time), "%H:%M:%S", tm_info);
+        trans->items_count = CRASH_SALE_LINES;
+        for (int i = 0; i < CRASH_SALE_LINES; i++) {
+            Medicine* med = findMedicine(crashSale[i]);
+            trans->items[i].medicine_id = med->id;
+            strcpy(trans->items[i].medicine_name, med->name);
+            trans->items[i].price = med->price;
+            trans->items[i].quantity = 3;
+            trans->amount += trans->items[i].price * trans->items[i].quantity;
+        }
+        commitSale(trans);
+        transactionFree(trans);
+        free(trans);
+    } else if (catalogBeginChange()) {
+        if (scenario == 1) {
+            Medicine med;
+            memset(&med, 0, sizeof(med));
+            med.id = CRASH_MEDICINES + 1;
+            sprintf(med.name, "Medicine %d", med.id);
+            strcpy(med.category, "Tablet");
+            strcpy(med.expiry_date, "31/12/2099");
+            med.price = 1.0f;
+            med.quantity = CRASH_STOCK;
+            catalogAdd(&med);
+        } else {
+            catalogRemove(CRASH_DELETED);
+        }
+        saveMedicines();
+        catalogEndChange();
+    }
+}
+
+// Does the store, after recovery, hold the scenario's change (1), not hold
+// it (0) or hold something else (-1)? Every record, its stock and all
+// three transaction files are checked.
+int crashOutcome(int scenario) {
+    loadMedicines();
+    recoverTransactionFiles();
+    rebuildSalesRollups();
+    
+    struct stat info;
+    long long data_size = stat(TRANSACTION_BIN_FILE, &info) == 0 ? (long long)info.st_size : 0;
+    long long text_size = stat(TRANSACTION_TEXT_FILE, &info) == 0 ? (long long)info.st_size : 0;
+    int indexed;
+    free(loadTransactionIndex(&indexed));
+    long long sales = 0;
+    for (int i = 0; i < salesRollups.tables[ROLLUP_DAILY].count; i++) {
+        sales += salesRollups.tables[ROLLUP_DAILY].buckets[i].sales;
+    }
+    
+    int outcome = -1;
+    for (int changed = 0; outcome < 0 && changed <= 1; changed++) {
+        int expect = CRASH_MEDICINES + (changed && scenario == 1) - (changed && scenario == 2);
+        int ok = catalog.count == expect;
+        for (int slot = 0; ok && slot < catalog.count; slot++) {
+            // A removal moves the last record into the freed slot
+            int id = changed && scenario == 2 && slot == CRASH_DELETED - 1 ? CRASH_MEDICINES : slot + 1;
+            int quantity = CRASH_STOCK;
+            for (int i = 0; changed && scenario == 0 && i < CRASH_SALE_LINES; i++) {
+                if (crashSale[i] == id) {
+                    quantity -= 3;
+                }
+            }
+            char name[100];
+            sprintf(name, "Medicine %d", id);
+            ok = catalog.slots[slot]->id == id && catalog.slots[slot]->quantity == quantity &&
+                 strcmp(catalog.slots[slot]->name, name) == 0;
+        }
+        int sold = changed && scenario == 0;
+        if (ok && sales == sold && indexed == sold && (text_size > 0) == sold &&
+            salesRollups.covered == data_size) {
+            outcome = changed;
+        }
+    }
+    freeMedicines();
+    return outcome;
+}
+
+// Kill a checkout, an add and a delete at each write point of a commit
+// (halfway through the write where there is one), then load the store as
+// the next terminal would. A kill before the header is written must leave
+// no trace of the change and after it the whole change. Runs in a scratch
+// directory so real data files are never touched.
+int crashTest(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+    char dir[] = "/tmp/medstore-crash-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        printf("Error creating scratch directory!\n");
+        return 1;
+    }
+    
+    printf("%d medicines; each change killed at every write point, then recovered\n", CRASH_MEDICINES);
+    printf("%-9s %-10s %-5s %s\n", "change", "killed at", "died", "after reload");
+    int failures = 0;
+    
+    for (int scenario = 0; scenario < CRASH_SCENARIOS; scenario++) {
+        for (int point = 1; point <= FAULT_POINTS; point++) {
+            unlink(MEDICINE_FILE);
+            unlink(SHADOW_FILE);
+            unlink(TRANSACTION_BIN_FILE);
+            unlink(TRANSACTION_TEXT_FILE);
+            unlink(TRANSACTION_INDEX_FILE);
+            unlink(CATEGORY_FILE);
+            unlink(SALES_ROLLUP_FILE);
+            
+            loadMedicines();
+            for (int i = 0; i < CRASH_MEDICINES; i++) {
+                Medicine med;
+                memset(&med, 0, sizeof(med));
+                med.id = i + 1;
+                sprintf(med.name, "Medicine %d", i + 1);
+                strcpy(med.category, "Tablet");
+                strcpy(med.expiry_date, "31/12/2099");
+                med.price = 1.0f;
+                med.quantity = CRASH_STOCK;
+                catalogAdd(&med);
+            }
+            saveMedicines();
+            freeMedicines();
+            
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                faultPoint = point;
+                crashScenario(scenario);
+                _exit(0);
+            }
+            int status = 0;
+            if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+                printf("Error running the crash test!\n");
+                return 1;
+            }
+            int died = WIFEXITED(status) && WEXITSTATUS(status) == FAULT_EXIT;
+            
+            // A change that got as far as its header must be all there
+            int expect = !died || point >= FAULT_COMMITTED;
+            int outcome = crashOutcome(scenario);
+            if (outcome != expect) {
+                failures++;
+            }
+            printf("%-9s %-10s %-5s %-12s %s\n", crashScenarios[scenario], faultNames[point],
+                   died ? "yes" : "no", outcome < 0 ? "damaged" : outcome ? "committed" : "rolled back",
+                   outcome == expect ? "ok" : "WRONG");
+        }
+    }
+    printf("%s\n", failures ? "crash test FAILED" : "crash test passed");
+    
+    unlink(MEDICINE_FILE);
+    unlink(SHADOW_FILE);
+    unlink(TRANSACTION_BIN_FILE);
+    unlink(TRANSACTION_TEXT_FILE);
+    unlink(TRANSACTION_INDEX_FILE);
+    unlink(CATEGORY_FILE);
+    unlink(SALES_ROLLUP_FILE);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return failures ? 1 : 0;
+}
+
+void serverSignal(int sig) {
+    (void)sig;
+    serverStop = 1;
+}
+
+// Append formatted text to a connection's output
+void connPrintf(Connection* c, const char* format, ...) {
+    va_list args;
+    while (1) {
+        va_start(args, format);
+        int n = vsnprintf(c->output + c->output_length, c->output_capacity - c->output_length, format, args);
+        va_end(args);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n < c->output_capacity - c->output_length) {
+            c->output_length += (size_t)n;
+            return;
+        }
+        size_t capacity = c->output_capacity ? c->output_capacity * 2 : 4096;
+        while (capacity < c->output_length + (size_t)n + 1) {
+            capacity *= 2;
+        }
+        char* output = (char*)realloc(c->output, capacity);
+        if (output == NULL) {
+            c->closing = 1;
+            return;
+        }
+        c->output = output;
+        c->output_capacity = capacity;
+    }
+}
+
+void connLine(Connection* c, char ch, int length) {
+    char line[128];
+    if (length > (int)sizeof(line) - 1) {
+        length = (int)sizeof(line) - 1;
+    }
+    memset(line, ch, length);
+    line[length] = 0;
+    connPrintf(c, "%s\n", line);
+}
+
+// Start a reply: display lines printed from here on belong to it
+void connBegin(Connection* c) {
+    c->reply_start = c->output_length;
+}
+
+// Finish a reply by putting the status line in front of its display
+// lines. An ERR reply drops them.
+void connReply(Connection* c, int ok, const char* message) {
+    if (!ok) {
+        c->output_length = c->reply_start;
+        connPrintf(c, "ERR %s\n", message);
+        return;
+    }
+    
+    int lines = 0;
+    for (size_t i = c->reply_start; i < c->output_length; i++) {
+        if (c->output[i] == '\n') {
+            lines++;
+        }
+    }
+    char status[SERVER_LINE_MAX];
+    int length = snprintf(status, sizeof(status), message[0] ? "OK %d %s\n" : "OK %d\n", lines, message);
+    if (length >= (int)sizeof(status)) {
+        length = (int)sizeof(status) - 1;
+        status[length - 1] = '\n';
+    }
+    
+    // Append it to make room, then move it in front of the lines
+    size_t body = c->output_length - c->reply_start;
+    connPrintf(c, "%s", status);
+    if (c->closing) {
+        return;
+    }
+    memmove(c->output + c->reply_start + length, c->output + c->reply_start, body);
+    memcpy(c->output + c->reply_start, status, length);
+}
+
+void connCategory(Connection* c, int code) {
+    CategoryEntry* entry = &categories.entries[code];
+    
+    connPrintf(c, "\n%s:\n", entry->name);
+    connPrintf(c, "%-5s %-30s %-10s %-8s\n", "ID", "Name", "Price", "Stock");
+    connLine(c, '-', 60);
+    
+    for (int i = 0; i < entry->count; i++) {
+        Medicine* med = findMedicine(entry->ids[i]);
+        if (med != NULL && med->quantity > 0) {
+            connPrintf(c, "%-5d %-30s %-10.2f %-8d\n", med->id, med->name, med->price, med->quantity);
+        }
+    }
+}
+
+void connBrowse(Connection* c, const char* argument) {
+    if (catalog.count == 0) {
+        connReply(c, 0, "No medicines available.");
+        return;
+    }
+    
+    int choice = atoi(argument);
+    if (choice > 0 && choice <= categories.count) {
+        connCategory(c, choice - 1);
+    } else {
+        for (int code = 0; code < categories.count; code++) {
+            if (categories.entries[code].count > 0) {
+                connCategory(c, code);
+            }
+        }
+    }
+    connReply(c, 1, "");
+}
+
+void connCategories(Connection* c) {
+    if (catalog.count == 0) {
+        connReply(c, 0, "No medicines available.");
+        return;
+    }
+    
+    for (int code = 0; code < categories.count; code++) {
+        if (categories.entries[code].count > 0) {
+            connPrintf(c, "%d. %s (%d)\n", code + 1, categories.entries[code].name, categories.entries[code].count);
+        }
+    }
+    connReply(c, 1, "");
+}
+
+// Same matching as searchMedicine: names case-insensitively, and a
+// numeric term also matches the ID
+void connSearch(Connection* c, const char* term) {
+    char needle[100];
+    lowercaseCopy(term, needle, sizeof(needle));
+    size_t needle_length = strlen(needle);
+    
+    char* end;
+    long search_id = strtol(term, &end, 10);
+    int is_id = term[0] != 0 && *end == 0;
+    int found = 0;
+    
+    connPrintf(c, "%-10s %-30s %-20s %-10s %-8s %-12s\n", "ID", "Name", "Category", "Price", "Qty", "Expiry");
+    connLine(c, '-', 100);
+    for (int i = 0; i < catalog.count; i++) {
+        Medicine* med = catalog.slots[i];
+        if (ciFindField(med->name, sizeof(med->name), needle, needle_length) ||
+            (is_id && med->id == search_id)) {
+            connPrintf(c, "%-10d %-30s %-20s %-10.2f %-8d %-12s\n",
+                       med->id, med->name, med->category, med->price, med->quantity, med->expiry_date);
+            found = 1;
+        }
+    }
+    
+    char message[200];
+    snprintf(message, sizeof(message), found ? "" : "No medicines found matching '%.100s'", term);
+    connReply(c, 1, message);
+}
+
+void connPrefix(Connection* c, const char* prefix) {
+    Medicine* top[QUICK_FIND_TOP];
+    int count = prefixTopMatches(prefix, QUICK_FIND_TOP, top);
+    if (count == 0) {
+        char message[200];
+        snprintf(message, sizeof(message), "No medicines found starting with '%.100s'", prefix);
+        connReply(c, 1, message);
+        return;
+    }
+    
+    connPrintf(c, "%-5s %-30s %-10s %-8s\n", "ID", "Name", "Price", "Stock");
+    connLine(c, '-', 60);
+    for (int i = 0; i < count; i++) {
+        connPrintf(c, "%-5d %-30s %-10.2f %-8d\n", top[i]->id, top[i]->name, top[i]->price, top[i]->quantity);
+    }
+    connReply(c, 1, "");
+}
+
+// Same checks and messages as addToCart
+void connAdd(Connection* c, int id, int quantity) {
+    char message[200];
+    int slot = findMedicineSlot(id);
+    if (slot < 0) {
+        snprintf(message, sizeof(message), "Medicine with ID %d not found!", id);
+        connReply(c, 0, message);
+        return;
+    }
+    Medicine* med = catalog.slots[slot];
+    
+    if (slotExpired(slot, todayDayNumber())) {
+        snprintf(message, sizeof(message), "%s expired on %s and cannot be sold!", med->name, med->expiry_date);
+        connReply(c, 0, message);
+        return;
+    }
+    if (quantity <= 0) {
+        connReply(c, 0, "Invalid quantity!");
+        return;
+    }
+    if (quantity > med->quantity) {
+        snprintf(message, sizeof(message), "Insufficient stock! Available: %d", med->quantity);
+        connReply(c, 0, message);
+        return;
+    }
+    
+    int line = cartFind(&c->cart, id);
+    if (line >= 0) {
+        CartItem* current = &c->cart.items[line];
+        if (current->quantity + quantity > med->quantity) {
+            snprintf(message, sizeof(message), "Insufficient stock! Available: %d, already in cart: %d",
+                     med->quantity, current->quantity);
+            connReply(c, 0, message);
+            return;
+        }
+        cartTake(&c->cart, line, slot);
+        cartSetQuantity(&c->cart, line, current->quantity + quantity);
+        connReply(c, 1, "Quantity updated in cart!");
+        return;
+    }
+    
+    line = cartLine(&c->cart, id);
+    cartTake(&c->cart, line, slot);
+    cartSetQuantity(&c->cart, line, quantity);
+    
+    snprintf(message, sizeof(message), "Added to cart: %s x %d", med->name, quantity);
+    connReply(c, 1, message);
+}
+
+// Same as removeFromCart: a quantity of 0 or more than is in the cart
+// removes the whole line
+void connRemove(Connection* c, int id, int remove_qty) {
+    char message[200];
+    if (c->cart.item_count == 0) {
+        connReply(c, 0, "Your cart is empty!");
+        return;
+    }
+    
+    int line = cartFind(&c->cart, id);
+    if (line < 0) {
+        snprintf(message, sizeof(message), "Medicine with ID %d not found in cart!", id);
+        connReply(c, 0, message);
+        return;
+    }
+    CartItem* current = &c->cart.items[line];
+    
+    if (remove_qty <= 0 || remove_qty >= current->quantity) {
+        snprintf(message, sizeof(message), "Removed %s from cart.", current->medicine_name);
+        cartRemove(&c->cart, line);
+    } else {
+        cartSetQuantity(&c->cart, line, current->quantity - remove_qty);
+        snprintf(message, sizeof(message), "Reduced quantity of %s by %d. Remaining: %d",
+                 current->medicine_name, remove_qty, current->quantity);
+    }
+    connReply(c, 1, message);
+}
+
+// The cart table of viewCart. Changed lines are brought up to date first,
+// as checkout does.
+void connCart(Connection* c) {
+    if (c->cart.item_count == 0) {
+        connReply(c, 0, "Your cart is empty.");
+        return;
+    }
+    
+    char message[200] = "";
+    int check = cartValidate(&c->cart, message, sizeof(message));
+    if (check == 1) {
+        connReply(c, 0, message);
+        return;
+    }
+    if (check == 0) {
+        message[0] = 0;
+    }
+    
+    connPrintf(c, "%-5s %-30s %-10s %-8s %-10s\n", "ID", "Name", "Price", "Qty", "Total");
+    connLine(c, '-', 73);
+    for (int line = c->cart.head; line >= 0; line = c->cart.items[line].next) {
+        CartItem* current = &c->cart.items[line];
+        connPrintf(c, "%-5d %-30s %-10.2f %-8d %-10.2f\n", current->medicine_id, current->medicine_name,
+                   current->price, current->quantity, current->price * current->quantity);
+    }
+    connLine(c, '-', 73);
+    connPrintf(c, "Subtotal: $%.2f\n", c->cart.subtotal);
+    connPrintf(c, "Tax (8%%): $%.2f\n", c->cart.tax);
+    connPrintf(c, "Total: $%.2f\n", c->cart.total);
+    connReply(c, 1, message);
+}
+
+// Build the transaction as processPayment does and hand it to the
+// workers; the loop stops reading from c until it is committed
+void connCheckout(Connection* c, float paid) {
+    if (c->cart.item_count == 0) {
+        connReply(c, 0, "Your cart is empty!");
+        return;
+    }
+    
+    // A price that changed since the cart was last shown cancels the
+    // checkout; the cart now has the new price
+    char message[200];
+    int check = cartValidate(&c->cart, message, sizeof(message));
+    if (check != 0) {
+        if (check == 2) {
+            strcat(message, " Transaction cancelled.");
+        }
+        connReply(c, 0, message);
+        return;
+    }
+    
+    if (paid < c->cart.total) {
+        connReply(c, 0, "Insufficient payment! Transaction cancelled.");
+        return;
+    }
+    
+    Transaction* trans = (Transaction*)calloc(1, sizeof(Transaction));
+    if (trans == NULL) {
+        connReply(c, 0, "Out of memory!");
+        return;
+    }
+    int made = cartToTransaction(&c->cart, trans);
+    if (made <= 0) {
+        free(trans);
+        connReply(c, 0, made == 0 ? "A medicine in your cart is no longer available! Transaction cancelled."
+                                   : "Out of memory! Transaction cancelled.");
+        return;
+    }
+    trans->transaction_id = 0;  // numbered when the sale is committed
+    trans->amount = c->cart.total;
+    time_t t = time(NULL);
+    struct tm* tm_info = localtime(&t);
+    strftime(trans->date, sizeof(trans->date), "%d/%m/%Y", tm_info);
+    strftime(trans->time, sizeof(trans->time), "%H:%M:%S", tm_info);
+    
+    c->trans = trans;
+    c->paid = paid;
+    c->busy = 1;
+    c->next = NULL;
+    pthread_mutex_lock(&server.lock);
+    if (server.queue_tail != NULL) {
+        server.queue_tail->next = c;
+    } else {
+        server.queue_head = c;
+    }
+    server.queue_tail = c;
+    pthread_cond_signal(&server.cond);
+    pthread_mutex_unlock(&server.lock);
+}
+
+// The receipt of processPayment for a committed checkout
+void connReceipt(Connection* c) {
+    Transaction* trans = c->trans;
+    float change = c->paid - c->cart.total;
+    
+    connPrintf(c, "Payment successful!\n");
+    connPrintf(c, "Change: $%.2f\n", change);
+    connPrintf(c, "Transaction details saved to %s\n", TRANSACTION_TEXT_FILE);
+    connPrintf(c, "\n");
+    connLine(c, '=', 50);
+    connPrintf(c, "          SALES RECEIPT\n");
+    connLine(c, '=', 50);
+    connPrintf(c, "Transaction ID: %d\n", trans->transaction_id);
+    connPrintf(c, "Date: %s\n", trans->date);
+    connPrintf(c, "Time: %s\n", trans->time);
+    connPrintf(c, "\nItems Purchased:\n");
+    connPrintf(c, "%-30s %-8s %-10s %-10s\n", "Medicine", "Qty", "Price", "Total");
+    connLine(c, '-', 58);
+    for (int i = 0; i < trans->items_count; i++) {
+        connPrintf(c, "%-30s %-8d $%-9.2f $%-9.2f\n",
+                   trans->items[i].medicine_name,
+                   trans->items[i].quantity,
+                   trans->items[i].price,
+                   trans->items[i].price * trans->items[i].quantity);
+    }
+    connLine(c, '-', 58);
+    connPrintf(c, "Subtotal: $%.2f\n", c->cart.subtotal);
+    connPrintf(c, "Tax (8%%): $%.2f\n", c->cart.tax);
+    connPrintf(c, "Total: $%.2f\n", c->cart.total);
+    connPrintf(c, "Paid: $%.2f\n", c->paid);
+    connPrintf(c, "Change: $%.2f\n", change);
+    connLine(c, '=', 50);
+    connPrintf(c, "Thank you for your purchase!\n");
+    connPrintf(c, "Transaction saved to: %s\n", TRANSACTION_TEXT_FILE);
+}
+
+// Answer one request line
+void connRequest(Connection* c, char* line) {
+    char* argument = line + strcspn(line, " ");
+    if (*argument != 0) {
+        *argument++ = 0;
+    }
+    
+    connBegin(c);
+    if (strcmp(line, "CHECKOUT") == 0) {
+        pthread_mutex_lock(&catalog.lock);
+        connCheckout(c, (float)atof(argument));
+        pthread_mutex_unlock(&catalog.lock);
+        return;
+    }
+    
+    int id = 0, quantity = 0;
+    pthread_mutex_lock(&catalog.lock);
+    if (strcmp(line, "PING") == 0) {
+        connReply(c, 1, "");
+    } else if (strcmp(line, "CATEGORIES") == 0) {
+        connCategories(c);
+    } else if (strcmp(line, "BROWSE") == 0) {
+        connBrowse(c, argument);
+    } else if (strcmp(line, "SEARCH") == 0) {
+        connSearch(c, argument);
+    } else if (strcmp(line, "PREFIX") == 0) {
+        connPrefix(c, argument);
+    } else if (strcmp(line, "ADD") == 0 && sscanf(argument, "%d %d", &id, &quantity) == 2) {
+        connAdd(c, id, quantity);
+    } else if (strcmp(line, "REMOVE") == 0 && sscanf(argument, "%d %d", &id, &quantity) >= 1) {
+        connRemove(c, id, quantity);
+    } else if (strcmp(line, "CART") == 0) {
+        connCart(c);
+    } else {
+        connReply(c, 0, "Invalid request!");
+    }
+    pthread_mutex_unlock(&catalog.lock);
+}
+
+// Answer every complete line buffered for c, stopping at a checkout
+void connProcess(Connection* c) {
+    size_t start = 0;
+    while (!c->busy && !c->closing) {
+        char* newline = (char*)memchr(c->input + start, '\n', c->input_length - start);
+        if (newline == NULL) {
+            break;
+        }
+        *newline = 0;
+        if (newline > c->input + start && newline[-1] == '\r') {
+            newline[-1] = 0;
+        }
+        connRequest(c, c->input + start);
+        start = (size_t)(newline - c->input) + 1;
+    }
+    
+    memmove(c->input, c->input + start, c->input_length - start);
+    c->input_length -= start;
+    if (!c->busy && c->input_length >= SERVER_LINE_MAX) {
+        c->closing = 1;         // no newline in sight
+    }
+}
+
+// Read what the peer sent; marks c closing on end of file or an error
+void connRead(Connection* c) {
+    while (1) {
+        if (c->input_capacity - c->input_length < 1024) {
+            size_t capacity = c->input_capacity ? c->input_capacity * 2 : 4096;
+            char* input = (char*)realloc(c->input, capacity);
+            if (input == NULL) {
+                c->closing = 1;
+                return;
+            }
+            c->input = input;
+            c->input_capacity = capacity;
+        }
+        
+        ssize_t n = read(c->fd, c->input + c->input_length, c->input_capacity - c->input_length);
+        if (n > 0) {
+            c->input_length += (size_t)n;
+            if (c->input_length >= SERVER_LINE_MAX) {
+                return;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            c->closing = 1;
+        }
+        return;
+    }
+}
+
+// Send as much pending output as the socket takes
+void connWrite(Connection* c) {
+    while (c->output_sent < c->output_length) {
+        ssize_t n = write(c->fd, c->output + c->output_sent, c->output_length - c->output_sent);
+        if (n > 0) {
+            c->output_sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        c->closing = 1;
+        c->output_sent = c->output_length;
+    }
+    c->output_length = 0;
+    c->output_sent = 0;
+}
+
+// Set what the loop waits for on c, or free it once it is finished.
+// Reading pauses during a checkout and while output is backed up.
+void connUpdate(Connection* c) {
+    if (c->closing) {
+        // A hung-up socket keeps reporting; the worker's reply finishes it
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+        if (c->busy) {
+            return;
+        }
+        close(c->fd);
+        cartFree(&c->cart);
+        free(c->input);
+        free(c->output);
+        free(c);
+        return;
+    }
+    
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.data.ptr = c;
+    if (!c->busy && c->output_length - c->output_sent < SERVER_OUTPUT_HIGH) {
+        event.events |= EPOLLIN;
+    }
+    if (c->output_sent < c->output_length) {
+        event.events |= EPOLLOUT;
+    }
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, c->fd, &event);
+}
+
+// Checkout worker: commit queued transactions and hand them back
+void* serverCheckoutWorker(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&server.lock);
+    while (1) {
+        while (server.queue_head == NULL && !server.stopping) {
+            pthread_cond_wait(&server.cond, &server.lock);
+        }
+        Connection* c = server.queue_head;
+        if (c == NULL) {
+            break;
+        }
+        server.queue_head = c->next;
+        if (server.queue_head == NULL) {
+            server.queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&server.lock);
+        
+        c->result = commitSale(c->trans);
+        
+        pthread_mutex_lock(&server.lock);
+        c->next = server.done;
+        server.done = c;
+        uint64_t one = 1;
+        if (write(server.wake_fd, &one, sizeof(one)) < 0) {
+            printf("Error waking the server!\n");
+        }
+    }
+    pthread_mutex_unlock(&server.lock);
+    return NULL;
+}
+
+// Reply to checkouts the workers finished and resume their connections
+void serverFinishCheckouts() {
+    uint64_t count;
+    if (read(server.wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        printf("Error reading server wakeup!\n");
+    }
+    
+    pthread_mutex_lock(&server.lock);
+    Connection* c = server.done;
+    server.done = NULL;
+    pthread_mutex_unlock(&server.lock);
+    
+    while (c != NULL) {
+        Connection* next = c->next;
+        c->busy = 0;
+        // Replies sent since the CHECKOUT was read may have been flushed
+        connBegin(c);
+        if (c->result > 0) {
+            connReceipt(c);
+            connReply(c, 1, "");
+            cartClear(&c->cart);
+        } else if (c->result == 0) {
+            connReply(c, 0, "Cart has expired medicine or not enough stock! Transaction cancelled.");
+        } else {
+            connReply(c, 0, "Error recording sale! Transaction cancelled.");
+        }
+        transactionFree(c->trans);
+        free(c->trans);
+        c->trans = NULL;
+        connProcess(c);
+        connWrite(c);
+        connUpdate(c);
+        c = next;
+    }
+}
+
+// Take every waiting connection
+void serverAccept() {
+    while (1) {
+        int fd = accept4(server.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                printf("Error accepting a client!\n");
+            }
+            return;
+        }
+        
+        Connection* c = (Connection*)calloc(1, sizeof(Connection));
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = c;
+        if (c == NULL || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            printf("Error registering a client!\n");
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        cartInit(&c->cart);
+    }
+}
+
+// Run the catalog server on a Unix domain socket until SIGINT or SIGTERM
+int serveCatalog(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : SERVER_SOCKET;
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Error: socket path too long!\n");
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+    
+    loadMedicines();
+    recoverTransactionFiles();
+    loadSalesRollups();
+    if (!groupCommitOpen()) {
+        return 1;
+    }
+    
+    // No SA_RESTART, so epoll_wait returns when a signal arrives
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serverSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    unlink(path);
+    
+    struct epoll_event listen_event, wake_event;
+    memset(&listen_event, 0, sizeof(listen_event));
+    memset(&wake_event, 0, sizeof(wake_event));
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = &server.listen_fd;
+    wake_event.events = EPOLLIN;
+    wake_event.data.ptr = &server.wake_fd;
+    if (server.listen_fd < 0 || server.epoll_fd < 0 || server.wake_fd < 0 ||
+        bind(server.listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server.listen_fd, SOMAXCONN) != 0 ||
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_event) != 0 ||
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.wake_fd, &wake_event) != 0) {
+        printf("Error starting the server on %s!\n", path);
+        groupCommitClose();
+        freeMedicines();
+        return 1;
+    }
+    
+    pthread_t workers[SERVER_CHECKOUT_THREADS];
+    for (int i = 0; i < SERVER_CHECKOUT_THREADS; i++) {
+        pthread_create(&workers[i], NULL, serverCheckoutWorker, NULL);
+    }
+    printf("Serving %d medicines on %s\n", catalog.count, path);
+    fflush(stdout);
+    
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!serverStop) {
+        int n = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Error waiting for clients!\n");
+            break;
+        }
+        
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &server.listen_fd) {
+                serverAccept();
+                continue;
+            }
+            if (events[i].data.ptr == &server.wake_fd) {
+                serverFinishCheckouts();
+                continue;
+            }
+            Connection* c = (Connection*)events[i].data.ptr;
+            if (events[i].events & EPOLLOUT) {
+                connWrite(c);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                connRead(c);
+                connProcess(c);
+                connWrite(c);
+            }
+            connUpdate(c);
+        }
+    }
+    
+    // Let queued checkouts finish; their connections go with the process
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.cond);
+    pthread_mutex_unlock(&server.lock);
+    for (int i = 0; i < SERVER_CHECKOUT_THREADS; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    close(server.listen_fd);
+    unlink(path);
+    
+    catalogCheckpoint(1);
+    groupCommitClose();
+    freeMedicines();
+    return 0;
+}
+
+int serverConnect(ServerLink* link, const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    
+    link->in = NULL;
+    link->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (link->fd < 0) {
+        return 0;
+    }
+    if (connect(link->fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        (link->in = fdopen(dup(link->fd), "r")) == NULL) {
+        close(link->fd);
+        return 0;
+    }
+    return 1;
+}
+
+void serverDisconnect(ServerLink* link) {
+    fclose(link->in);
+    close(link->fd);
+}
+
+// Send one request line (several when it holds newlines, which the server
+// reads as pipelined requests). Returns 0 if the connection failed.
+int serverSend(ServerLink* link, const char* request) {
+    char line[SERVER_LINE_MAX];
+    size_t length = strlen(request);
+    if (length + 1 >= sizeof(line)) {
+        return 0;
+    }
+    memcpy(line, request, length);
+    line[length] = '\n';
+    return writeAll(link->fd, line, length + 1);
+}
+
+// Read one reply. Display lines are printed when show is set and skipped
+// otherwise; the status message goes to message. The status line must be
+// exactly "OK <lines>[ message]" or "ERR <message>" and every line whole,
+// so a reply spliced into another is caught rather than read past.
+// Returns 1 for OK, 0 for ERR, -1 if the connection failed or the reply
+// is not framed right.
+int serverReadReply(ServerLink* link, int show, char* message, size_t message_size) {
+    char line[SERVER_LINE_MAX];
+    if (fgets(line, sizeof(line), link->in) == NULL || strchr(line, '\n') == NULL) {
+        return -1;
+    }
+    line[strcspn(line, "\n")] = 0;
+    
+    int lines = -1, end = 0;
+    int ok = strncmp(line, "OK ", 3) == 0;
+    if (ok) {
+        if (sscanf(line, "OK %d%n", &lines, &end) != 1 || lines < 0 || !isdigit((unsigned char)line[3]) ||
+            (line[end] != 0 && line[end] != ' ')) {
+            return -1;
+        }
+    } else if (strncmp(line, "ERR ", 4) != 0) {
+        return -1;
+    }
+    if (message != NULL) {
+        snprintf(message, message_size, "%s", ok ? (line[end] ? line + end + 1 : "") : line + 4);
+    }
+    for (int i = 0; i < lines; i++) {
+        if (fgets(line, sizeof(line), link->in) == NULL || strchr(line, '\n') == NULL) {
+            return -1;
+        }
+        if (show) {
+            fputs(line, stdout);
+        }
+    }
+    return ok;
+}
+
+// Send one request line and read the reply, as serverReadReply
+int serverRequest(ServerLink* link, const char* request, int show, char* message, size_t message_size) {
+    return serverSend(link, request) ? serverReadReply(link, show, message, message_size) : -1;
+}
+
+// Send a request and print its reply, the status message last
+int clientShow(ServerLink* link, const char* request) {
+    char message[SERVER_LINE_MAX];
+    int ok = serverRequest(link, request, 1, message, sizeof(message));
+    if (ok < 0) {
+        printf("\nLost connection to the server!\n");
+    } else if (message[0] != 0) {
+        printf("%s\n", message);
+    }
+    return ok;
+}
+
+// Offer to add a medicine after a listing, like addToCart
+int clientAddToCart(ServerLink* link) {
+    int id = 0, quantity = 0;
+    
+    printf("\nEnter Medicine ID to add to cart (0 to skip): ");
+    if (scanf("%d", &id) != 1 || id == 0) {
+        clearInputBuffer();
+        return 1;
+    }
+    printf("Enter quantity: ");
+    if (scanf("%d", &quantity) != 1) {
+        quantity = 0;
+    }
+    clearInputBuffer();
+    
+    char request[64];
+    snprintf(request, sizeof(request), "ADD %d %d", id, quantity);
+    return clientShow(link, request);
+}
+
+// Read a line for a request, without its newline
+void clientReadLine(const char* prompt, char* text, size_t size) {
+    printf("%s", prompt);
+    if (fgets(text, (int)size, stdin) == NULL) {
+        text[0] = 0;
+    }
+    text[strcspn(text, "\n")] = 0;
+}
+
+// The customer panel as a thin client of a running server
+int clientPanel(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : SERVER_SOCKET;
+    ServerLink link;
+    if (!serverConnect(&link, path)) {
+        printf("Error connecting to the server at %s!\n", path);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    
+    char request[SERVER_LINE_MAX];
+    char text[100];
+    int choice;
+    int ok = 1;
+    
+    do {
+        printf("\n");
+        printLine('-', 40);
+        printf("        CUSTOMER PANEL (%s)\n", path);
+        printLine('-', 40);
+        printf("1. Browse Medicines\n");
+        printf("2. Search Medicine\n");
+        printf("3. View Cart\n");
+        printf("4. Remove from Cart\n");
+        printf("5. Checkout\n");
+        printf("6. Exit\n");
+        printf("7. Quick Find by Name Prefix\n");
+        printf("Enter your choice: ");
+        if (scanf("%d", &choice) != 1) {
+            if (feof(stdin)) {
+                break;
+            }
+            choice = 0;
+        }
+        clearInputBuffer();
+        
+        switch(choice) {
+            case 1:
+                printHeader("BROWSE MEDICINES");
+                ok = clientShow(&link, "CATEGORIES");
+                if (ok <= 0) {
+                    break;
+                }
+                clientReadLine("Enter category number to browse (0 for all): ", text, sizeof(text));
+                snprintf(request, sizeof(request), "BROWSE %d", atoi(text));
+                ok = clientShow(&link, request);
+                if (ok > 0) {
+                    ok = clientAddToCart(&link);
+                }
+                break;
+            case 2:
+                printHeader("SEARCH MEDICINE");
+                clientReadLine("Enter medicine name or ID to search: ", text, sizeof(text));
+                printf("\n");
+                snprintf(request, sizeof(request), "SEARCH %s", text);
+                ok = clientShow(&link, request);
+                if (ok > 0) {
+                    ok = clientAddToCart(&link);
+                }
+                break;
+            case 3:
+                printHeader("YOUR SHOPPING CART");
+                ok = clientShow(&link, "CART");
+                break;
+            case 4:
+                printHeader("YOUR SHOPPING CART");
+                ok = clientShow(&link, "CART");
+                if (ok <= 0) {
+                    break;
+                }
+                clientReadLine("\nEnter Medicine ID to remove from cart (0 to cancel): ", text, sizeof(text));
+                if (atoi(text) == 0) {
+                    break;
+                }
+                int id = atoi(text);
+                clientReadLine("Enter quantity to remove (0 to remove all): ", text, sizeof(text));
+                snprintf(request, sizeof(request), "REMOVE %d %d", id, atoi(text));
+                ok = clientShow(&link, request);
+                break;
+            case 5:
+                printHeader("CHECKOUT");
+                ok = clientShow(&link, "CART");
+                if (ok <= 0) {
+                    break;
+                }
+                clientReadLine("\nProceed to payment? (y/n): ", text, sizeof(text));
+                if (text[0] != 'y' && text[0] != 'Y') {
+                    printf("Checkout cancelled.\n");
+                    break;
+                }
+                printHeader("PAYMENT PROCESSING");
+                clientReadLine("Enter amount paid: $", text, sizeof(text));
+                snprintf(request, sizeof(request), "CHECKOUT %.2f", atof(text));
+                ok = clientShow(&link, request);
+                break;
+            case 6:
+                printf("\nGoodbye!\n");
+                break;
+            case 7:
+                printHeader("QUICK FIND");
+                clientReadLine("Enter the start of the medicine name: ", text, sizeof(text));
+                printf("\n");
+                snprintf(request, sizeof(request), "PREFIX %s", text);
+                ok = clientShow(&link, request);
+                if (ok > 0) {
+                    ok = clientAddToCart(&link);
+                }
+                break;
+            default:
+                printf("\nInvalid choice! Please try again.\n");
+        }
+    } while(choice != 6 && ok >= 0);
+    
+    serverDisconnect(&link);
+    return ok < 0 ? 1 : 0;
+}
+
+// Load generator client: lookups, searches, prefix finds and carts on its
+// own connection, one request at a time except that each ADD is pipelined
+// with the CHECKOUT after it, so a checkout reply follows a reply the
+// server may already have flushed
+void* loadClientRun(void* arg) {
+    LoadClient* client = (LoadClient*)arg;
+    ServerLink link;
+    if (!serverConnect(&link, client->path)) {
+        client->failed = client->requests;
+        return NULL;
+    }
+    
+    char request[128];
+    int pipelined = 0;
+    for (int n = 0; n < client->requests; n++) {
+        int id = 1001 + rand_r(&client->seed) % client->medicines;
+        int kind = n % 10;
+        if (kind == 8 && n + 1 < client->requests) {
+            snprintf(request, sizeof(request), "ADD %d 1\nCHECKOUT 1000000", id);
+            pipelined = 1;
+        } else if (kind < 4) {
+            snprintf(request, sizeof(request), "SEARCH %d", id);
+        } else if (kind < 6) {
+            snprintf(request, sizeof(request), "SEARCH icine %d", id - 1000);
+        } else if (kind < 8) {
+            snprintf(request, sizeof(request), "PREFIX medicine %d", id - 1000);
+        } else if (kind == 8) {
+            snprintf(request, sizeof(request), "ADD %d 1", id);
+        } else {
+            snprintf(request, sizeof(request), "CHECKOUT 1000000");
+        }
+        
+        // The CHECKOUT of a pipelined pair went out with the ADD
+        double start = nowSeconds();
+        int ok;
+        if (kind == 9 && pipelined) {
+            ok = serverReadReply(&link, 0, NULL, 0);
+            pipelined = 0;
+        } else {
+            ok = serverRequest(&link, request, 0, NULL, 0);
+        }
+        double seconds = nowSeconds() - start;
+        client->latency[client->answered++] = seconds;
+        if (kind == 9) {
+            client->checkout[client->checkouts++] = seconds;
+        }
+        if (ok != 1) {
+            client->failed++;
+        }
+        if (ok < 0) {
+            // A reply that arrived but could not be read is misframed
+            client->misframed += !feof(link.in) && !ferror(link.in);
+            break;
+        }
+    }
+    
+    serverDisconnect(&link);
+    return NULL;
+}
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Latency at a percentile of a sorted sample, in microseconds
+double percentileMicros(const double* sorted, long count, double percent) {
+    if (count == 0) {
+        return 0.0;
+    }
+    long i = (long)(percent / 100.0 * (double)(count - 1) + 0.5);
+    return sorted[i] * 1e6;
+}
+
+// Start a server on a scratch catalog and drive it with concurrent
+// clients; reports requests/sec and p50 / p99 latency. Runs in a scratch
+// directory so real data files are never touched.
+int benchServer(int argc, char* argv[]) {
+    int clients = argc > 0 ? atoi(argv[0]) : 16;
+    int requests = argc > 1 ? atoi(argv[1]) : 2000;
+    int medicines = argc > 2 ? atoi(argv[2]) : 10000;
+    if (clients < 1) {
+        clients = 1;
+    }
+    if (requests < 1) {
+        requests = 1;
+    }
+    if (medicines < 1) {
+        medicines = 1;
+    }
+    
+    char dir[] = "/tmp/medstore-server-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        printf("Error creating scratch directory!\n");
+        return 1;
+    }
+    
+    loadMedicines();
+    for (int i = 0; i < medicines; i++) {
+        Medicine med;
+        memset(&med, 0, sizeof(med));
+        med.id = 1001 + i;
+        sprintf(med.name, "Medicine %d", i + 1);
+        strcpy(med.category, i % 2 ? "Tablet" : "Syrup");
+        strcpy(med.expiry_date, "31/12/2099");
+        med.price = 1.0f;
+        med.quantity = 1 << 30;
+        catalogAdd(&med);
+    }
+    saveMedicines();
+    freeMedicines();
+    
+    char path[sizeof(dir) + 16];
+    snprintf(path, sizeof(path), "%s/%s", dir, SERVER_SOCKET);
+    char* server_argv[] = { path };
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(1);
+        }
+        _exit(serveCatalog(1, server_argv));
+    }
+    if (pid < 0) {
+        printf("Error starting the server!\n");
+        return 1;
+    }
+    
+    ServerLink probe;
+    int up = 0;
+    for (int i = 0; i < 500 && !up; i++) {
+        up = serverConnect(&probe, path);
+        if (!up) {
+            usleep(10000);
+        }
+    }
+    if (up) {
+        serverDisconnect(&probe);
+    }
+    
+    printf("%d clients x %d requests, %d medicines, %d checkout threads\n",
+           clients, requests, medicines, SERVER_CHECKOUT_THREADS);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * clients);
+    LoadClient* load = (LoadClient*)calloc(clients, sizeof(LoadClient));
+    double* latency = (double*)malloc(sizeof(double) * clients * (size_t)requests);
+    double* checkout = (double*)malloc(sizeof(double) * clients * (size_t)requests);
+    int ok = up && threads != NULL && load != NULL && latency != NULL && checkout != NULL;
+    
+    if (ok) {
+        double start = nowSeconds();
+        for (int i = 0; i < clients; i++) {
+            load[i].path = path;
+            load[i].requests = requests;
+            load[i].medicines = medicines;
+            load[i].seed = 4242u + (unsigned int)i;
+            load[i].latency = latency + (size_t)i * requests;
+            load[i].checkout = checkout + (size_t)i * requests;
+            pthread_create(&threads[i], NULL, loadClientRun, &load[i]);
+        }
+        for (int i = 0; i < clients; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        double seconds = nowSeconds() - start;
+        
+        long count = 0;
+        long checkouts = 0;
+        long failed = 0;
+        long misframed = 0;
+        for (int i = 0; i < clients; i++) {
+            for (int k = 0; k < load[i].checkouts; k++) {
+                checkout[checkouts++] = load[i].checkout[k];
+            }
+            for (int k = 0; k < load[i].answered; k++) {
+                latency[count++] = load[i].latency[k];
+            }
+            failed += load[i].failed;
+            misframed += load[i].misframed;
+        }
+        qsort(latency, count, sizeof(double), compareDoubles);
+        qsort(checkout, checkouts, sizeof(double), compareDoubles);
+        printf("%.0f requests/sec, p50 %.0f us, p99 %.0f us, max %.0f us\n",
+               count / seconds, percentileMicros(latency, count, 50),
+               percentileMicros(latency, count, 99), percentileMicros(latency, count, 100));
+        printf("checkouts: %ld, p50 %.0f us, p99 %.0f us; %ld requests refused\n",
+               checkouts, percentileMicros(checkout, checkouts, 50),
+               percentileMicros(checkout, checkouts, 99), failed);
+        if (misframed > 0) {
+            printf("Error: %ld replies were not framed right!\n", misframed);
+            ok = 0;
+        }
+    } else {
+        printf("Error: the server did not come up!\n");
+    }
+    free(threads);
+    free(load);
+    free(latency);
+    free(checkout);
+    
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(MEDICINE_FILE);
+    unlink(SHADOW_FILE);
+    unlink(TRANSACTION_BIN_FILE);
+    unlink(TRANSACTION_TEXT_FILE);
+    unlink(TRANSACTION_INDEX_FILE);
+    unlink(CATEGORY_FILE);
+    unlink(SALES_ROLLUP_FILE);
+    unlink(path);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return ok ? 0 : 1;
+}
+
+void lowercaseCopy(const char* src, char* dst, size_t dst_size) {
+    size_t i;
+    for (i = 0; i + 1 < dst_size && src[i]; i++) {
+        dst[i] = (char)tolower((unsigned char)src[i]);
+    }
+    dst[i] = 0;
+}
+
+// ASCII lowercase of one byte, same folding as tolower() in the C locale
+#define ASCII_LOWER(c) ((unsigned char)((c) - 'A') < 26 ? (char)((c) | 0x20) : (char)(c))
+
+int ciMatch(const char* text, const char* needle, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (ASCII_LOWER(text[i]) != needle[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Case-insensitive substring search inside a fixed-size name field,
+// without copying. The needle must already be lowercased. The vector
+// kernels may read the whole field, including bytes after the NUL.
+int ciFindScalar(const char* field, size_t field_size, const char* needle, size_t needle_length) {
+    size_t length = strnlen(field, field_size);
+    if (needle_length > length) {
+        return 0;
+    }
+    
+    for (size_t i = 0; i + needle_length <= length; i++) {
+        if (ASCII_LOWER(field[i]) == needle[0] && ciMatch(field + i + 1, needle + 1, needle_length - 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#ifdef HAVE_X86_SIMD
+__m128i foldCaseSSE2(__m128i v) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+// Tests 16 start positions at once by matching the needle's first and last
+// byte, then verifies the middle of each candidate
+int ciFindSSE2(const char* field, size_t field_size, const char* needle, size_t needle_length) {
+    size_t length = strnlen(field, field_size);
+    if (needle_length == 0) {
+        return 1;
+    }
+    if (needle_length > length) {
+        return 0;
+    }
+    if (needle_length - 1 + 16 > field_size) {
+        return ciFindScalar(field, field_size, needle, needle_length);
+    }
+    
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+    size_t last_start = length - needle_length;
+    
+    for (size_t i = 0; i <= last_start; i += 16) {
+        // Keep both loads inside the field; the final window may overlap
+        size_t at = i + needle_length - 1 + 16 > field_size ? field_size - 16 - (needle_length - 1) : i;
+        __m128i a = foldCaseSSE2(_mm_loadu_si128((const __m128i*)(field + at)));
+        __m128i b = foldCaseSSE2(_mm_loadu_si128((const __m128i*)(field + at + needle_length - 1)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        if (last_start - at < 15) {
+            mask &= (1u << (last_start - at + 1)) - 1;
+        }
+        
+        while (mask) {
+            size_t position = at + (size_t)__builtin_ctz(mask);
+            if (needle_length <= 2 || ciMatch(field + position + 1, needle + 1, needle_length - 2)) {
+                return 1;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return 0;
+}
+
+__attribute__((target("avx2")))
+__m256i foldCaseAVX2(__m256i v) {
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+// Same scheme as the SSE2 kernel over 32 start positions
+__attribute__((target("avx2")))
+int ciFindAVX2(const char* field, size_t field_size, const char* needle, size_t needle_length) {
+    size_t length = strnlen(field, field_size);
+    if (needle_length == 0) {
+        return 1;
+    }
+    if (needle_length > length) {
+        return 0;
+    }
+    if (needle_length - 1 + 32 > field_size) {
+        return ciFindSSE2(field, field_size, needle, needle_length);
+    }
+    
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+    size_t last_start = length - needle_length;
+    
+    for (size_t i = 0; i <= last_start; i += 32) {
+        size_t at = i + needle_length - 1 + 32 > field_size ? field_size - 32 - (needle_length - 1) : i;
+        __m256i a = foldCaseAVX2(_mm256_loadu_si256((const __m256i*)(field + at)));
+        __m256i b = foldCaseAVX2(_mm256_loadu_si256((const __m256i*)(field + at + needle_length - 1)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        if (last_start - at < 31) {
+            mask &= (1u << (last_start - at + 1)) - 1;
+        }
+        
+        while (mask) {
+            size_t position = at + (size_t)__builtin_ctz(mask);
+            if (needle_length <= 2 || ciMatch(field + position + 1, needle + 1, needle_length - 2)) {
+                return 1;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+// Kernel picked for this CPU on first use
+int (*ciFindImpl)(const char*, size_t, const char*, size_t) = NULL;
+
+int ciFindField(const char* field, size_t field_size, const char* needle, size_t needle_length) {
+    if (ciFindImpl == NULL) {
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        ciFindImpl = __builtin_cpu_supports("avx2") ? ciFindAVX2 : ciFindSSE2;
+#else
+        ciFindImpl = ciFindScalar;
+#endif
+    }
+    return ciFindImpl(field, field_size, needle, needle_length);
+}
+
+// Time full scans of a synthetic catalog: the original case-sensitive
+// strstr + sprintf/strcmp ID loop against each case-folding kernel
+int benchSubstring(int argc, char* argv[]) {
+    int count = argc > 0 ? atoi(argv[0]) : 1000000;
+    if (count < 1) {
+        count = 1;
+    }
+    
+    static const char* syllables[] = {
+        "para", "ceta", "mol", "amoxi", "cillin", "ibu", "pro", "fen", "ceti",
+        "ri", "zine", "met", "for", "min", "lora", "ta", "dine", "vita", "cal",
+        "cium", "ome", "pra", "zole", "azi", "thro", "my"
+    };
+    static const char* queries[] = { "para", "cillin", "zole", "min 500", "xyzzy", "1000123" };
+    int syllable_count = sizeof(syllables) / sizeof(syllables[0]);
+    int query_count = sizeof(queries) / sizeof(queries[0]);
+    
+    Medicine* medicines = (Medicine*)calloc((size_t)count, sizeof(Medicine));
+    if (medicines == NULL) {
+        printf("Out of memory!\n");
+        return 1;
+    }
+    
+    unsigned int seed = 42;
+    for (int i = 0; i < count; i++) {
+        int length = 0;
+        int parts = 2 + rand_r(&seed) % 4;
+        medicines[i].id = 1001 + i;
+        for (int p = 0; p < parts; p++) {
+            length += sprintf(medicines[i].name + length, "%s", syllables[rand_r(&seed) % syllable_count]);
+        }
+        if (rand_r(&seed) % 3 == 0) {
+            sprintf(medicines[i].name + length, " %d mg", 100 * (1 + rand_r(&seed) % 9));
+        }
+    }
+    
+    const char* labels[] = { "strstr+id", "scalar", "sse2", "avx2" };
+    int (*kernels[4])(const char*, size_t, const char*, size_t) = { NULL, ciFindScalar, NULL, NULL };
+    int kernel_count = 2;
+#ifdef HAVE_X86_SIMD
+    kernels[kernel_count++] = ciFindSSE2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[kernel_count++] = ciFindAVX2;
+    }
+#endif
+    
+    printf("%d medicines, ms per full scan (kernels fold case, strstr does not)\n", count);
+    printf("%-10s", "query");
+    for (int k = 0; k < kernel_count; k++) {
+        printf(" %10s", labels[k]);
+    }
+    printf(" %8s\n", "matches");
+    
+    for (int q = 0; q < query_count; q++) {
+        char needle[100];
+        lowercaseCopy(queries[q], needle, sizeof(needle));
+        size_t needle_length = strlen(needle);
+        char* end;
+        long search_id = strtol(queries[q], &end, 10);
+        int is_id = *end == 0;
+        int matches = 0;
+        
+        printf("%-10s", queries[q]);
+        for (int k = 0; k < kernel_count; k++) {
+            double start = nowSeconds();
+            matches = 0;
+            for (int i = 0; i < count; i++) {
+                if (k == 0) {
+                    char id_str[20];
+                    sprintf(id_str, "%d", medicines[i].id);
+                    matches += strstr(medicines[i].name, queries[q]) != NULL || strcmp(id_str, queries[q]) == 0;
+                } else {
+                    matches += kernels[k](medicines[i].name, sizeof(medicines[i].name), needle, needle_length) ||
+                               (is_id && medicines[i].id == search_id);
+                }
+            }
+            printf(" %10.2f", (nowSeconds() - start) * 1000.0);
+        }
+        printf(" %8d\n", matches);
+    }
+    
+    free(medicines);
+    return 0;
+}
+
+// Time the inventory reports over a synthetic catalog: walking the
+// Medicine records against scanning the columns. Runs in a scratch
+// directory because adding medicines records their categories.
+int benchReports(int argc, char* argv[]) {
+    int count = argc > 0 ? atoi(argv[0]) : 1000000;
+    int rounds = argc > 1 ? atoi(argv[1]) : 10;
+    if (count < 1) {
+        count = 1;
+    }
+    if (rounds < 1) {
+        rounds = 1;
+    }
+    
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        printf("Error creating scratch directory!\n");
+        return 1;
+    }
+    
+    // Filled the way loadMedicines fills the catalog, then indexed in bulk
+    memset(&catalog, 0, sizeof(catalog));
+    catalogReserve(count);
+    unsigned int seed = 42;
+    for (int i = 0; i < count; i++) {
+        Medicine* med = poolAllocMedicine();
+        memset(med, 0, sizeof(*med));
+        med->id = 1001 + i;
+        sprintf(med->name, "Medicine %08d", i);
+        strcpy(med->category, i % 3 == 0 ? "Tablet" : (i % 3 == 1 ? "Syrup" : "Injection"));
+        med->price = (float)(1 + rand_r(&seed) % 50000) / 100.0f;
+        med->quantity = rand_r(&seed) % 200;
+        sprintf(med->expiry_date, "%02d/%02d/%04d", 1 + rand_r(&seed) % 28, 1 + rand_r(&seed) % 12,
+                2024 + rand_r(&seed) % 5);
+        catalog.slots[catalog.count++] = med;
+    }
+    catalogBuildIndexes();
+    
+    int* slots = (int*)malloc(sizeof(int) * (count + 1));
+    if (slots == NULL) {
+        printf("Out of memory!\n");
+        return 1;
+    }
+    
+    printf("%d medicines, %d rounds, ms per report\n", count, rounds);
+    printf("%-14s %10s %10s %14s\n", "report", "records", "columns", "result");
+    
+    double start = nowSeconds();
+    float row_value = 0;
+    for (int r = 0; r < rounds; r++) {
+        row_value = 0;
+        for (int i = 0; i < catalog.count; i++) {
+            row_value += catalog.slots[i]->price * catalog.slots[i]->quantity;
+        }
+    }
+    double rows = (nowSeconds() - start) * 1000.0 / rounds;
+    start = nowSeconds();
+    double value = 0;
+    for (int r = 0; r < rounds; r++) {
+        value = columnsInventoryValue(NULL);
+    }
+    printf("%-14s %10.3f %10.3f %14.2f\n", "valuation", rows, (nowSeconds() - start) * 1000.0 / rounds, value);
+    printf("%-14s %10s %10s %14.2f\n", "  float total", "", "", row_value);
+    
+    int thresholds[2] = { LOW_STOCK_THRESHOLD, 1 };
+    const char* labels[2] = { "low stock", "out of stock" };
+    for (int t = 0; t < 2; t++) {
+        int row_found = 0;
+        start = nowSeconds();
+        for (int r = 0; r < rounds; r++) {
+            row_found = 0;
+            for (int i = 0; i < catalog.count; i++) {
+                if (catalog.slots[i]->quantity < thresholds[t]) {
+                    slots[row_found++] = i;
+                }
+            }
+        }
+        rows = (nowSeconds() - start) * 1000.0 / rounds;
+        
+        int found = 0;
+        start = nowSeconds();
+        for (int r = 0; r < rounds; r++) {
+            found = columnsSelectBelow(thresholds[t], slots);
+        }
+        printf("%-14s %10.3f %10.3f %14d\n", labels[t], rows, (nowSeconds() - start) * 1000.0 / rounds, found);
+        if (found != row_found) {
+            printf("Error: column and record scans disagree (%d vs %d)!\n", found, row_found);
+        }
+    }
+    
+    free(slots);
+    freeMedicines();
+    
+    unlink(CATEGORY_FILE);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
+
+// Scan a synthetic transaction history with 1, 2, 4 ... threads and report
+// throughput; every run has to produce the same totals
+int benchScan(int argc, char* argv[]) {
+    int count = argc > 0 ? atoi(argv[0]) : 1000000;
+    int max_threads = argc > 1 ? atoi(argv[1]) : scanThreadCount();
+    if (count < 1) {
+        count = 1;
+    }
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+    if (max_threads > SCAN_MAX_THREADS) {
+        max_threads = SCAN_MAX_THREADS;
+    }
+    
+    char dir[] = "/tmp/medstore-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        printf("Error creating scratch directory!\n");
+        return 1;
+    }
+    
+    // Three years of sales, written frame by frame with their index entries
+    FILE* data = fopen(TRANSACTION_BIN_FILE, "wb");
+    FILE* index = fopen(TRANSACTION_INDEX_FILE, "wb");
+    TransactionItem* items = (TransactionItem*)calloc(5, sizeof(TransactionItem));
+    if (data == NULL || index == NULL || items == NULL) {
+        printf("Error creating transaction files!\n");
+        return 1;
+    }
+    int days = 3 * 365;
+    int first_day = todayDayNumber() - days + 1;
+    unsigned int seed = 42;
+    long long offset = 0;
+    for (int i = 0; i < count; i++) {
+        int day = first_day + (int)((long long)i * days / count);
+        long long midnight = dayStartTimestamp(day);
+        time_t when = (time_t)(midnight + 8 * 3600 + rand_r(&seed) % (12 * 3600));
+        struct tm tm_info;
+        localtime_r(&when, &tm_info);
+        
+        TransactionHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = TRANSACTION_MAGIC;
+        header.transaction_id = 5001 + i;
+        header.timestamp = (long long)when;
+        strftime(header.date, sizeof(header.date), "%d/%m/%Y", &tm_info);
+        strftime(header.time, sizeof(header.time), "%H:%M:%S", &tm_info);
+        header.items_count = 1 + rand_r(&seed) % 5;
+        for (int j = 0; j < header.items_count; j++) {
+            items[j].medicine_id = 1001 + rand_r(&seed) % 1000;
+            sprintf(items[j].medicine_name, "Medicine %d", items[j].medicine_id);
+            items[j].price = (float)(1 + rand_r(&seed) % 5000) / 100.0f;
+            items[j].quantity = 1 + rand_r(&seed) % 4;
+            header.amount += items[j].price * items[j].quantity;
+        }
+        
+        TransactionIndexEntry entry = { header.transaction_id, header.items_count, header.timestamp, offset };
+        fwrite(&header, sizeof(header), 1, data);
+        fwrite(items, sizeof(TransactionItem), header.items_count, data);
+        fwrite(&entry, sizeof(entry), 1, index);
+        offset += transactionFrameSize(header.items_count);
+    }
+    fclose(data);
+    fclose(index);
+    free(items);
+    
+    ScanFilter all = { 0, 0 };
+    ScanFilter recent = { todayDayNumber() - 89, 0 };
+    ScanTotals baseline, totals;
+    scanTransactions(&all, 1, &baseline);   // warm the page cache
+    
+    printf("%d transactions, %.1f MB, %d cores online\n", count, offset / 1048576.0, scanThreadCount());
+    printf("%-8s %10s %10s %10s %8s %14s\n", "threads", "ms", "MB/s", "speedup", "steals", "total");
+    double single = 0;
+    for (int threads = 1; ; threads = threads * 2 > max_threads && threads < max_threads ? max_threads : threads * 2) {
+        double start = nowSeconds();
+        int ok = scanTransactions(&all, threads, &totals);
+        double seconds = nowSeconds() - start;
+        if (threads == 1) {
+            single = seconds;
+        }
+        printf("%-8d %10.2f %10.1f %9.2fx %8lld %14.2f\n", threads, seconds * 1000.0,
+               totals.bytes / 1048576.0 / seconds, single / seconds, totals.steals, totals.cents / 100.0);
+        if (!ok || totals.transactions != baseline.transactions || totals.cents != baseline.cents) {
+            printf("Error: %d-thread scan disagrees with the baseline!\n", threads);
+        }
+        if (threads >= max_threads) {
+            break;
+        }
+    }
+    
+    double start = nowSeconds();
+    scanTransactions(&recent, max_threads, &totals);
+    printf("last 90 days, %d threads: %lld transactions, $%.2f, %.1f MB read, %.2f ms\n", max_threads,
+           totals.transactions, totals.cents / 100.0, totals.bytes / 1048576.0, (nowSeconds() - start) * 1000.0);
+    
+    unlink(TRANSACTION_BIN_FILE);
+    unlink(TRANSACTION_INDEX_FILE);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return 0;
 }